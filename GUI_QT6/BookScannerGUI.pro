@@ -6,22 +6,32 @@ CONFIG += c++17
 
 SOURCES += \
     archivehandler.cpp \
+    bookdictionaries.cpp \
     bookparser.cpp \
     fb2reader.cpp \
     inpxparser.cpp \
     main.cpp \
     mainwindow.cpp \
     settingsdialog.cpp \
-    scannerdialog.cpp
+    scannerdialog.cpp \
+    searchkeys.cpp \
+    ../fb2_cover.c \
+    ../base64.c \
+    ../text_fold.c
 
 HEADERS += \
     archivehandler.h \
+    bookdictionaries.h \
     bookparser.h \
     fb2reader.h \
     inpxparser.h \
     mainwindow.h \
     settingsdialog.h \
-    scannerdialog.h
+    scannerdialog.h \
+    searchkeys.h \
+    ../fb2_cover.h \
+    ../base64.h \
+    ../text_fold.h
 
 FORMS += \
     mainwindow.ui \
@@ -50,3 +60,7 @@ unix {
 
 # Убедимся что компилятор видит заголовочные файлы
 INCLUDEPATH += /usr/include
+
+# Общий с консольным сканером код (поиск обложки FB2, base64, ключи поиска)
+INCLUDEPATH += ..
+QMAKE_CFLAGS += -std=c99
@@ -0,0 +1,103 @@
+#include "bookdictionaries.h"
+#include "searchkeys.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QRegularExpression>
+#include <QDebug>
+
+// Максимальная длина имени в словаре (DICT_NAME_MAX_CHARS в ../utils.h)
+static const int DictNameMaxChars = 255;
+
+bool hasDictionaryTables(const QSqlDatabase &db)
+{
+    const QStringList tables = db.tables();
+    return tables.contains("authors") && tables.contains("series") &&
+           tables.contains("genres") && tables.contains("book_authors");
+}
+
+QStringList splitAuthorList(const QString &authors)
+{
+    QStringList names;
+    for (const QString &part : authors.split(QRegularExpression("[,;]"), Qt::SkipEmptyParts)) {
+        QString name = part.trimmed().left(DictNameMaxChars);
+        if (!name.isEmpty() && !names.contains(name)) {
+            names << name;
+        }
+    }
+    return names;
+}
+
+QString primaryGenre(const QString &genres)
+{
+    for (const QString &part : genres.split(QRegularExpression("[:,;]"), Qt::SkipEmptyParts)) {
+        const QString genre = part.trimmed().left(DictNameMaxChars);
+        if (!genre.isEmpty()) {
+            return genre;
+        }
+    }
+    return QString();
+}
+
+// id имени в словаре; новое имя добавляется вместе с ключом сортировки
+static QVariant internName(QSqlDatabase &db, const QString &table, const QString &name)
+{
+    if (name.isEmpty()) {
+        return QVariant();
+    }
+
+    const QString shortName = name.left(DictNameMaxChars);
+
+    QSqlQuery query(db);
+    query.prepare(QString("SELECT id FROM %1 WHERE name = ?").arg(table));
+    query.addBindValue(shortName);
+    if (query.exec() && query.next()) {
+        return query.value(0);
+    }
+
+    query.prepare(QString("INSERT INTO %1 (name, name_key) VALUES (?, ?)").arg(table));
+    query.addBindValue(shortName);
+    query.addBindValue(foldSearchKey(shortName));
+    if (!query.exec()) {
+        qDebug() << "Failed to add" << shortName << "to" << table << ":" << query.lastError().text();
+        return QVariant();
+    }
+    return query.lastInsertId();
+}
+
+void linkBookDictionaries(QSqlDatabase &db, const QVariant &bookId, const QString &author,
+                          const QString &series, const QString &genre)
+{
+    if (!bookId.isValid() || !hasDictionaryTables(db)) {
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE books SET series_id = ?, genre_id = ? WHERE id = ?");
+    query.addBindValue(internName(db, "series", series.trimmed()));
+    query.addBindValue(internName(db, "genres", primaryGenre(genre)));
+    query.addBindValue(bookId);
+    if (!query.exec()) {
+        qDebug() << "Failed to link series/genre:" << query.lastError().text();
+    }
+
+    // При обновлении книги автор мог измениться - связи пересоздаются
+    query.prepare("DELETE FROM book_authors WHERE book_id = ?");
+    query.addBindValue(bookId);
+    query.exec();
+
+    const QStringList names = splitAuthorList(author);
+    for (int i = 0; i < names.size(); i++) {
+        QVariant authorId = internName(db, "authors", names[i]);
+        if (!authorId.isValid()) {
+            continue;
+        }
+
+        query.prepare("INSERT INTO book_authors (book_id, author_id, position) VALUES (?, ?, ?)");
+        query.addBindValue(bookId);
+        query.addBindValue(authorId);
+        query.addBindValue(i);
+        if (!query.exec()) {
+            qDebug() << "Failed to link author" << names[i] << ":" << query.lastError().text();
+        }
+    }
+}
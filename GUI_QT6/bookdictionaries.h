@@ -0,0 +1,24 @@
+#ifndef BOOKDICTIONARIES_H
+#define BOOKDICTIONARIES_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QSqlDatabase>
+
+// Словари authors/series/genres и связи book_authors создает консольный сканер
+// (см. ../database.c); GUI читает их для навигации и поддерживает при своих вставках.
+bool hasDictionaryTables(const QSqlDatabase &db);
+
+// Имена авторов через ',' или ';' - то же разбиение, что split_author_list() в сканере
+QStringList splitAuthorList(const QString &authors);
+
+// Первый жанр списка через ':', ',' или ';' ("sf_fantasy:adv_history:" -> "sf_fantasy") -
+// на него ссылается books.genre_id, как у primary_genre() в сканере
+QString primaryGenre(const QString &genres);
+
+// Привязывает книгу к словарям: заменяет связи с авторами и выставляет series_id/genre_id
+void linkBookDictionaries(QSqlDatabase &db, const QVariant &bookId, const QString &author,
+                          const QString &series, const QString &genre);
+
+#endif // BOOKDICTIONARIES_H
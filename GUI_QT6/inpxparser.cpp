@@ -1,4 +1,6 @@
 #include "inpxparser.h"
+#include "searchkeys.h"
+#include "bookdictionaries.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
@@ -475,6 +477,8 @@ bool InpxParser::insertBookToDatabase(const InpxBookMeta &meta, const QString &b
     insertQuery.addBindValue(internalPath);
 
     if (insertQuery.exec()) {
+        updateBookSearchKeys(m_database, insertQuery.lastInsertId(), meta.title, meta.author, meta.series);
+        linkBookDictionaries(m_database, insertQuery.lastInsertId(), meta.author, meta.series, meta.genre);
         qDebug() << "Book added from INPX:" << meta.title << "-" << meta.author;
         return true;
     } else {
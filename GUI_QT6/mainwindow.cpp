@@ -13,8 +13,13 @@
 #include <QFile>
 #include <QDir>
 #include <QXmlStreamReader>
+#include <QRegularExpression>
 #include <archive.h>
 #include <archive_entry.h>
+#include "fb2_cover.h"
+#include "base64.h"
+#include "searchkeys.h"
+#include "bookdictionaries.h"
 #include <QSettings>
 #include <QShowEvent>
 #include <QResizeEvent>
@@ -470,9 +475,26 @@ void MainWindow::loadSeriesByLetter(const QString &letter)
     treeModel->clear();
     treeModel->setHorizontalHeaderLabels(QStringList() << QString("Серии на '%1'").arg(letter));
 
+    // По ключу буква ищется диапазоном по индексу и без учета регистра;
+    // словарь series (если его создал сканер) вместо DISTINCT по всей таблице books
     QSqlQuery query;
-    query.prepare("SELECT DISTINCT series FROM books WHERE series IS NOT NULL AND series != '' AND series LIKE ? ORDER BY series");
-    query.addBindValue(letter + "%");
+    const QString letterKey = foldSearchKey(letter);
+    const bool useDictionary = !letterKey.isEmpty() && hasDictionaryTables(db);
+    const bool useKeys = useDictionary || (!letterKey.isEmpty() && hasSearchKeyColumns(db));
+    if (useDictionary) {
+        query.prepare("SELECT name_key, name, id FROM series WHERE name_key >= ? AND name_key < ? "
+                      "ORDER BY name_key, name");
+        query.addBindValue(letterKey);
+        query.addBindValue(letterKey + searchKeyRangeEnd());
+    } else if (useKeys) {
+        query.prepare("SELECT DISTINCT series_key, series FROM books WHERE series_key >= ? AND series_key < ? "
+                      "ORDER BY series_key, series");
+        query.addBindValue(letterKey);
+        query.addBindValue(letterKey + searchKeyRangeEnd());
+    } else {
+        query.prepare("SELECT DISTINCT series FROM books WHERE series IS NOT NULL AND series != '' AND series LIKE ? ORDER BY series");
+        query.addBindValue(letter + "%");
+    }
 
     if (!query.exec()) {
         showError("Ошибка загрузки серий: " + query.lastError().text());
@@ -482,13 +504,18 @@ void MainWindow::loadSeriesByLetter(const QString &letter)
 
     int seriesCount = 0;
     while (query.next()) {
-        QString series = query.value(0).toString();
+        QString series = query.value(useKeys ? 1 : 0).toString();
         QStandardItem *seriesItem = new QStandardItem(seriesIcon, series);
 
         // ЗАГРУЖАЕМ КНИГИ СРАЗУ
         QSqlQuery bookQuery;
-        bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series = ? ORDER BY series_number, title LIMIT 100");
-        bookQuery.addBindValue(series);
+        if (useDictionary) {
+            bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series_id = ? ORDER BY series_number, title LIMIT 100");
+            bookQuery.addBindValue(query.value(2));
+        } else {
+            bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series = ? ORDER BY series_number, title LIMIT 100");
+            bookQuery.addBindValue(series);
+        }
 
         if (bookQuery.exec()) {
             while (bookQuery.next()) {
@@ -533,7 +560,12 @@ void MainWindow::loadAllSeries()
     treeModel->setHorizontalHeaderLabels(QStringList() << "Все серии");
 
     QSqlQuery query;
-    query.exec("SELECT DISTINCT series FROM books WHERE series IS NOT NULL AND series != '' ORDER BY series");
+    const bool useDictionary = hasDictionaryTables(db);
+    if (useDictionary) {
+        query.exec("SELECT name, id FROM series ORDER BY name_key, name");
+    } else {
+        query.exec("SELECT DISTINCT series FROM books WHERE series IS NOT NULL AND series != '' ORDER BY series");
+    }
 
     int seriesCount = 0;
     while (query.next()) {
@@ -542,8 +574,13 @@ void MainWindow::loadAllSeries()
 
         // ЗАГРУЖАЕМ КНИГИ СРАЗУ
         QSqlQuery bookQuery;
-        bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series = ? ORDER BY series_number, title LIMIT 50");
-        bookQuery.addBindValue(series);
+        if (useDictionary) {
+            bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series_id = ? ORDER BY series_number, title LIMIT 50");
+            bookQuery.addBindValue(query.value(1));
+        } else {
+            bookQuery.prepare("SELECT id, title, author, series_number FROM books WHERE series = ? ORDER BY series_number, title LIMIT 50");
+            bookQuery.addBindValue(series);
+        }
 
         if (bookQuery.exec()) {
             while (bookQuery.next()) {
@@ -588,7 +625,11 @@ void MainWindow::loadGenresByLetter(const QString &letter)
 
     // Получаем ВСЕ жанры из базы и фильтруем их на клиентской стороне
     QSqlQuery query;
-    query.prepare("SELECT DISTINCT genre FROM books WHERE genre IS NOT NULL AND genre != '' ORDER BY genre");
+    if (hasDictionaryTables(db)) {
+        query.prepare("SELECT name FROM genres ORDER BY name");
+    } else {
+        query.prepare("SELECT DISTINCT genre FROM books WHERE genre IS NOT NULL AND genre != '' ORDER BY genre");
+    }
 
     if (!query.exec()) {
         showError("Ошибка загрузки жанров: " + query.lastError().text());
@@ -660,7 +701,11 @@ void MainWindow::loadAllGenres()
     treeModel->setHorizontalHeaderLabels(QStringList() << "Все жанры");
 
     QSqlQuery query;
-    query.exec("SELECT DISTINCT genre FROM books WHERE genre IS NOT NULL AND genre != '' ORDER BY genre");
+    if (hasDictionaryTables(db)) {
+        query.exec("SELECT name FROM genres ORDER BY name");
+    } else {
+        query.exec("SELECT DISTINCT genre FROM books WHERE genre IS NOT NULL AND genre != '' ORDER BY genre");
+    }
 
     int genreCount = 0;
     QMap<QString, QString> sortedGenres; // Для сортировки по читаемым названиям
@@ -957,9 +1002,26 @@ void MainWindow::loadAuthorsByLetter(const QString &letter)
     treeModel->setHorizontalHeaderLabels(QStringList() << QString("Авторы на '%1'").arg(letter));
 
     // Загружаем авторов на указанную букву
+    // По ключу буква ищется диапазоном по индексу и без учета регистра;
+    // словарь authors (если его создал сканер) вместо DISTINCT по всей таблице books
     QSqlQuery query;
-    query.prepare("SELECT DISTINCT author FROM books WHERE author IS NOT NULL AND author != '' AND author LIKE ? ORDER BY author");
-    query.addBindValue(letter + "%");
+    const QString letterKey = foldSearchKey(letter);
+    const bool useDictionary = !letterKey.isEmpty() && hasDictionaryTables(db);
+    const bool useKeys = useDictionary || (!letterKey.isEmpty() && hasSearchKeyColumns(db));
+    if (useDictionary) {
+        query.prepare("SELECT name_key, name, id FROM authors WHERE name_key >= ? AND name_key < ? "
+                      "ORDER BY name_key, name");
+        query.addBindValue(letterKey);
+        query.addBindValue(letterKey + searchKeyRangeEnd());
+    } else if (useKeys) {
+        query.prepare("SELECT DISTINCT author_key, author FROM books WHERE author_key >= ? AND author_key < ? "
+                      "ORDER BY author_key, author");
+        query.addBindValue(letterKey);
+        query.addBindValue(letterKey + searchKeyRangeEnd());
+    } else {
+        query.prepare("SELECT DISTINCT author FROM books WHERE author IS NOT NULL AND author != '' AND author LIKE ? ORDER BY author");
+        query.addBindValue(letter + "%");
+    }
 
     if (!query.exec()) {
         showError("Ошибка загрузки авторов: " + query.lastError().text());
@@ -969,13 +1031,20 @@ void MainWindow::loadAuthorsByLetter(const QString &letter)
 
     int authorCount = 0;
     while (query.next()) {
-        QString author = query.value(0).toString();
+        QString author = query.value(useKeys ? 1 : 0).toString();
         QStandardItem *authorItem = new QStandardItem(authorIcon, author);
 
-        // ЗАГРУЖАЕМ КНИГИ СРАЗУ (как было раньше)
+        // ЗАГРУЖАЕМ КНИГИ СРАЗУ (как было раньше); через book_authors находятся и книги в соавторстве
         QSqlQuery bookQuery;
-        bookQuery.prepare("SELECT id, title, series, series_number FROM books WHERE author = ? ORDER BY series, series_number, title LIMIT 100"); // Ограничиваем для скорости
-        bookQuery.addBindValue(author);
+        if (useDictionary) {
+            bookQuery.prepare("SELECT b.id, b.title, b.series, b.series_number FROM book_authors ba "
+                              "JOIN books b ON b.id = ba.book_id WHERE ba.author_id = ? "
+                              "ORDER BY b.series, b.series_number, b.title LIMIT 100");
+            bookQuery.addBindValue(query.value(2));
+        } else {
+            bookQuery.prepare("SELECT id, title, series, series_number FROM books WHERE author = ? ORDER BY series, series_number, title LIMIT 100"); // Ограничиваем для скорости
+            bookQuery.addBindValue(author);
+        }
 
         if (bookQuery.exec()) {
             while (bookQuery.next()) {
@@ -1023,7 +1092,12 @@ void MainWindow::loadAllAuthors()
 
     // Загружаем всех авторов
     QSqlQuery query;
-    query.exec("SELECT DISTINCT author FROM books WHERE author IS NOT NULL AND author != '' ORDER BY author");
+    const bool useDictionary = hasDictionaryTables(db);
+    if (useDictionary) {
+        query.exec("SELECT name, id FROM authors ORDER BY name_key, name");
+    } else {
+        query.exec("SELECT DISTINCT author FROM books WHERE author IS NOT NULL AND author != '' ORDER BY author");
+    }
 
     int authorCount = 0;
     while (query.next()) {
@@ -1032,8 +1106,15 @@ void MainWindow::loadAllAuthors()
 
         // ЗАГРУЖАЕМ КНИГИ СРАЗУ (как было раньше)
         QSqlQuery bookQuery;
-        bookQuery.prepare("SELECT id, title, series, series_number FROM books WHERE author = ? ORDER BY series, series_number, title LIMIT 50"); // Ограничиваем для скорости
-        bookQuery.addBindValue(author);
+        if (useDictionary) {
+            bookQuery.prepare("SELECT b.id, b.title, b.series, b.series_number FROM book_authors ba "
+                              "JOIN books b ON b.id = ba.book_id WHERE ba.author_id = ? "
+                              "ORDER BY b.series, b.series_number, b.title LIMIT 50");
+            bookQuery.addBindValue(query.value(1));
+        } else {
+            bookQuery.prepare("SELECT id, title, series, series_number FROM books WHERE author = ? ORDER BY series, series_number, title LIMIT 50"); // Ограничиваем для скорости
+            bookQuery.addBindValue(author);
+        }
 
         if (bookQuery.exec()) {
             while (bookQuery.next()) {
@@ -1428,9 +1509,15 @@ bool MainWindow::createDatabaseTables()
             "    last_modified TIMESTAMP NULL,"
             "    last_scanned TIMESTAMP NULL,"
             "    file_mtime BIGINT,"
+            "    title_key VARCHAR(255) COLLATE utf8mb4_bin,"
+            "    author_key VARCHAR(255) COLLATE utf8mb4_bin,"
+            "    series_key VARCHAR(255) COLLATE utf8mb4_bin,"
             "    INDEX idx_author (author(50)),"
             "    INDEX idx_series (series(50)),"
-            "    INDEX idx_genre (genre(50))"
+            "    INDEX idx_genre (genre(50)),"
+            "    INDEX idx_books_author_key (author_key, title_key),"
+            "    INDEX idx_books_title_key (title_key),"
+            "    INDEX idx_books_series_key (series_key)"
             ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci";
 
         if (!query.exec(createBooksTable)) {
@@ -1481,6 +1568,9 @@ bool MainWindow::createDatabaseTables()
             "    last_modified DATETIME,"
             "    last_scanned DATETIME,"
             "    file_mtime INTEGER,"
+            "    title_key TEXT,"
+            "    author_key TEXT,"
+            "    series_key TEXT,"
             "    UNIQUE(file_path, archive_path, archive_internal_path)"
             ")";
 
@@ -1489,6 +1579,15 @@ bool MainWindow::createDatabaseTables()
             return false;
         }
 
+        // Базы, созданные до появления ключей поиска: добавляем колонки
+        if (!hasSearchKeyColumns(db)) {
+            for (const QString &column : {QString("title_key"), QString("author_key"), QString("series_key")}) {
+                if (!query.exec(QString("ALTER TABLE books ADD COLUMN %1 TEXT").arg(column))) {
+                    qDebug() << "Failed to add column" << column << ":" << query.lastError().text();
+                }
+            }
+        }
+
         QString createBooksTableArch =
                 "CREATE TABLE IF NOT EXISTS archives ("
                 "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
@@ -1523,7 +1622,10 @@ bool MainWindow::createDatabaseTables()
             << "CREATE INDEX IF NOT EXISTS idx_books_series_number ON books(series_number)"
             << "CREATE INDEX IF NOT EXISTS idx_books_added_date ON books(added_date)"
             << "CREATE INDEX IF NOT EXISTS idx_books_last_scanned ON books(last_scanned)"
-            << "CREATE INDEX IF NOT EXISTS idx_books_title_author ON books(title, author)";
+            << "CREATE INDEX IF NOT EXISTS idx_books_title_author ON books(title, author)"
+            << "CREATE INDEX IF NOT EXISTS idx_books_author_key ON books(author_key, title_key)"
+            << "CREATE INDEX IF NOT EXISTS idx_books_title_key ON books(title_key)"
+            << "CREATE INDEX IF NOT EXISTS idx_books_series_key ON books(series_key)";
 
         for (const QString &indexQuery : indexQueries) {
             if (!query.exec(indexQuery)) {
@@ -1568,14 +1670,17 @@ void MainWindow::loadStatistics()
         ui->statsLabel_book->setText(query.value(0).toString());
     }
 
-    // Количество авторов
-    query.exec("SELECT COUNT(DISTINCT author) FROM books WHERE author IS NOT NULL AND author != ''");
+    // Количество авторов и серий: по словарям, если они есть, иначе группировкой по books
+    const bool useDictionary = hasDictionaryTables(db);
+    query.exec(useDictionary ? "SELECT COUNT(*) FROM authors"
+                             : "SELECT COUNT(DISTINCT author) FROM books WHERE author IS NOT NULL AND author != ''");
     if (query.next()) {
         ui->statsLabel_autor->setText(query.value(0).toString());
     }
 
     // Количество серий
-    query.exec("SELECT COUNT(DISTINCT series) FROM books WHERE series IS NOT NULL AND series != ''");
+    query.exec(useDictionary ? "SELECT COUNT(*) FROM series"
+                             : "SELECT COUNT(DISTINCT series) FROM books WHERE series IS NOT NULL AND series != ''");
     if (query.next()) {
         ui->statsLabel_series->setText(query.value(0).toString());
     }
@@ -1952,81 +2057,39 @@ QPixmap MainWindow::parseCoverFromFB2(const QByteArray& content)
 
 QPixmap MainWindow::parseCoverFromFB2Content(const QByteArray& content)
 {
-    QXmlStreamReader xml(content);
-    QString coverId;
-
-    // Ищем ID обложки в FB2
-    while (!xml.atEnd() && !xml.hasError()) {
-        xml.readNext();
-
-        if (xml.isStartElement() && xml.name().toString() == "coverpage") {
-            while (!xml.atEnd() && !xml.hasError()) {
-                xml.readNext();
-
-                if (xml.isStartElement() && xml.name().toString() == "image") {
-                    QXmlStreamAttributes attrs = xml.attributes();
-                    for (const auto& attr : attrs) {
-                        if (attr.name().toString().contains("href", Qt::CaseInsensitive)) {
-                            QString href = attr.value().toString();
-                            if (href.startsWith('#')) {
-                                coverId = href.mid(1);
-                            }
-                            break;
-                        }
-                    }
-                    break;
-                }
-
-                if (xml.isEndElement() && xml.name().toString() == "coverpage") {
-                    break;
-                }
-            }
-            break;
-        }
+    // Общий с консольным сканером поиск <coverpage>/<binary> без XML-разбора и QString-копий
+    Fb2CoverSpan span;
+    if (!fb2_locate_cover(content.constData(), static_cast<size_t>(content.size()), &span)) {
+        return QPixmap();
     }
 
-    if (coverId.isEmpty()) {
+    QString contentType = QString::fromLatin1(span.content_type);
+    if (!contentType.startsWith("image/")) {
         return QPixmap();
     }
 
-    // Ищем binary с найденным ID
-    xml.clear();
-    xml.addData(content);
-
-    while (!xml.atEnd() && !xml.hasError()) {
-        xml.readNext();
-
-        if (xml.isStartElement() && xml.name().toString() == "binary") {
-            if (xml.attributes().value("id").toString() == coverId) {
-                QString contentType = xml.attributes().value("content-type").toString();
+    QByteArray imageData(static_cast<qsizetype>(BASE64_DECODED_MAX(span.base64_len)), Qt::Uninitialized);
+    size_t decoded = base64_decode(span.base64, span.base64_len,
+                                   reinterpret_cast<unsigned char*>(imageData.data()));
+    imageData.truncate(static_cast<qsizetype>(decoded));
 
-                if (contentType.startsWith("image/")) {
-                    QString base64Data = xml.readElementText();
-                    QByteArray imageData = QByteArray::fromBase64(base64Data.toUtf8());
-
-                    QPixmap cover;
-                    if (cover.loadFromData(imageData)) {
-                        return cover;
-                    }
-
-                    // Пробуем разные форматы
-                    if (contentType.contains("jpeg") || contentType.contains("jpg")) {
-                        cover.loadFromData(imageData, "JPEG");
-                    } else if (contentType.contains("png")) {
-                        cover.loadFromData(imageData, "PNG");
-                    } else if (contentType.contains("gif")) {
-                        cover.loadFromData(imageData, "GIF");
-                    } else {
-                        cover.loadFromData(imageData);
-                    }
+    QPixmap cover;
+    if (cover.loadFromData(imageData)) {
+        return cover;
+    }
 
-                    return cover;
-                }
-            }
-        }
+    // Пробуем разные форматы
+    if (contentType.contains("jpeg") || contentType.contains("jpg")) {
+        cover.loadFromData(imageData, "JPEG");
+    } else if (contentType.contains("png")) {
+        cover.loadFromData(imageData, "PNG");
+    } else if (contentType.contains("gif")) {
+        cover.loadFromData(imageData, "GIF");
+    } else {
+        cover.loadFromData(imageData);
     }
 
-    return QPixmap();
+    return cover;
 }
 
 QPixmap MainWindow::parseCoverFromEpubContent(const QByteArray& epubData)
@@ -2464,6 +2527,59 @@ void MainWindow::on_btn_search_clicked()
     performSearch(ui->searchLineEdit->text().trimmed());
 }
 
+QString MainWindow::buildSearchCondition(const QString &queryText, QVariantList &bindValues)
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QStringList terms = queryText.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+
+    // Индексы создает консольный сканер: books_trigram/books_fts в SQLite, ft_books_search в MySQL.
+    // Триграммы сохраняют прежнюю семантику LIKE '%...%', но без полного просмотра таблицы.
+    if (db.driverName() == "QSQLITE" && queryText.length() >= 3 && db.tables().contains("books_trigram")) {
+        QString phrase = queryText;
+        bindValues << "\"" + phrase.replace("\"", "\"\"") + "\"";
+        return "id IN (SELECT rowid FROM books_trigram WHERE books_trigram MATCH ?)";
+    }
+
+    if (db.driverName() == "QSQLITE" && db.tables().contains("books_fts")) {
+        QStringList parts;
+        for (QString term : terms) {
+            parts << "\"" + term.replace("\"", "\"\"") + "\"*";
+        }
+        bindValues << QString("{title author series} : (%1)").arg(parts.join(' '));
+        return "id IN (SELECT rowid FROM books_fts WHERE books_fts MATCH ?)";
+    }
+
+    if (db.driverName().contains("MYSQL", Qt::CaseInsensitive) ||
+        db.driverName().contains("MARIADB", Qt::CaseInsensitive)) {
+        QSqlQuery check;
+        if (check.exec("SHOW INDEX FROM books WHERE Key_name = 'ft_books_search'") && check.next()) {
+            QStringList parts;
+            for (QString term : terms) {
+                term.remove(QRegularExpression("[+\\-<>()~*\"@]"));
+                if (!term.isEmpty()) {
+                    parts << "+" + term + "*";
+                }
+            }
+            if (!parts.isEmpty()) {
+                bindValues << parts.join(' ');
+                return "MATCH(title, author, series, genre) AGAINST (? IN BOOLEAN MODE)";
+            }
+        }
+    }
+
+    // Без индексов поиска сравниваем нормализованные ключи: регистр и ё/е не важны
+    const QString queryKey = foldSearchKey(queryText);
+    if (!queryKey.isEmpty() && hasSearchKeyColumns(db)) {
+        QString keyPattern = "%" + queryKey + "%";
+        bindValues << keyPattern << keyPattern << keyPattern;
+        return "(author_key LIKE ? OR title_key LIKE ? OR series_key LIKE ?)";
+    }
+
+    QString searchPattern = "%" + queryText + "%";
+    bindValues << searchPattern << searchPattern << searchPattern;
+    return "(author LIKE ? OR title LIKE ? OR series LIKE ?)";
+}
+
 void MainWindow::performSearch(const QString &queryText)
 {
     if (!isDatabaseOpen()) return;
@@ -2498,18 +2614,20 @@ void MainWindow::performSearch(const QString &queryText)
     treeModel->setHorizontalHeaderLabels(QStringList() << "Результаты поиска");
 
 
+    QVariantList bindValues;
+    QString condition = buildSearchCondition(queryText, bindValues);
+
     QSqlQuery query;
     query.prepare(
         "SELECT id, author, title, series, series_number, file_path "
         "FROM books "
-        "WHERE author LIKE ? OR title LIKE ? OR series LIKE ? "
+        "WHERE " + condition + " "
         "ORDER BY author, title"
     );
 
-    QString searchPattern = "%" + queryText + "%";
-    query.addBindValue(searchPattern);
-    query.addBindValue(searchPattern);
-    query.addBindValue(searchPattern);
+    for (const QVariant &value : bindValues) {
+        query.addBindValue(value);
+    }
 
     if (!query.exec()) {
         showError("Ошибка поиска: " + query.lastError().text());
@@ -2567,10 +2685,10 @@ void MainWindow::performSearch(const QString &queryText)
 
     // Для поиска показываем только количество найденных книг и авторов
     QSqlQuery countQuery;
-    countQuery.prepare("SELECT COUNT(DISTINCT series) FROM books WHERE author LIKE ? OR title LIKE ? OR series LIKE ?");
-    countQuery.addBindValue(searchPattern);
-    countQuery.addBindValue(searchPattern);
-    countQuery.addBindValue(searchPattern);
+    countQuery.prepare("SELECT COUNT(DISTINCT series) FROM books WHERE " + condition);
+    for (const QVariant &value : bindValues) {
+        countQuery.addBindValue(value);
+    }
     if (countQuery.exec() && countQuery.next()) {
         ui->statsLabel_series->setText(countQuery.value(0).toString());
     } else {
@@ -154,6 +154,7 @@ private:
 
     // Поиск
     void performSearch(const QString &queryText);
+    QString buildSearchCondition(const QString &queryText, QVariantList &bindValues);
 
     // Статический метод для извлечения файлов из архивов
     static QByteArray extractFileFromArchive(const QString& archivePath, const QString& internalPath);
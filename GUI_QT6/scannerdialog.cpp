@@ -1,5 +1,7 @@
 #include "scannerdialog.h"
 #include "ui_scannerdialog.h"
+#include "searchkeys.h"
+#include "bookdictionaries.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QDir>
@@ -373,6 +375,8 @@ void BookScanner::processFile(const QString &filePath)
             updateQuery.addBindValue(existingId);
 
             if (updateQuery.exec()) {
+                updateBookSearchKeys(m_database, existingId, meta.title, meta.author, meta.series);
+                linkBookDictionaries(m_database, existingId, meta.author, meta.series, meta.genre);
                 qDebug() << "Book updated (larger file):" << meta.title << "-" << meta.author
                          << "New size:" << fileInfo.size() << "Old size:" << existingSize;
                 emit bookFound(meta.title + " [ОБНОВЛЕНО]", meta.author, fileName);
@@ -407,6 +411,8 @@ void BookScanner::processFile(const QString &filePath)
     insertQuery.addBindValue(fileInfo.lastModified().toSecsSinceEpoch());
 
     if (insertQuery.exec()) {
+        updateBookSearchKeys(m_database, insertQuery.lastInsertId(), meta.title, meta.author, meta.series);
+        linkBookDictionaries(m_database, insertQuery.lastInsertId(), meta.author, meta.series, meta.genre);
         qDebug() << "Book added to database:" << meta.title << "-" << meta.author;
         emit bookFound(meta.title, meta.author, fileName);
     } else {
@@ -656,6 +662,8 @@ bool BookScanner::addBookToDatabase(const BookMeta &meta, const ArchiveFile &fil
     insertQuery.addBindValue(archiveInfo.lastModified().toSecsSinceEpoch());
 
     if (insertQuery.exec()) {
+        updateBookSearchKeys(m_database, insertQuery.lastInsertId(), meta.title, meta.author, meta.series);
+        linkBookDictionaries(m_database, insertQuery.lastInsertId(), meta.author, meta.series, meta.genre);
         qDebug() << "Book from archive added to database:" << meta.title << "-" << meta.author;
         emit bookFound(meta.title, meta.author, file.name + " [архив]");
         return true;
@@ -696,6 +704,8 @@ bool BookScanner::updateBookInDatabase(const BookMeta &meta, const ArchiveFile &
     updateQuery.addBindValue(existingId);
 
     if (updateQuery.exec()) {
+        updateBookSearchKeys(m_database, existingId, meta.title, meta.author, meta.series);
+        linkBookDictionaries(m_database, existingId, meta.author, meta.series, meta.genre);
         qDebug() << "Book from archive updated (larger file):" << meta.title << "-" << meta.author;
         emit bookFound(meta.title + " [ОБНОВЛЕНО]", meta.author, file.name + " [архив]");
         return true;
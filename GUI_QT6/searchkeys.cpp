@@ -0,0 +1,50 @@
+#include "searchkeys.h"
+#include "text_fold.h"
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QDebug>
+#include <cstdlib>
+
+QString foldSearchKey(const QString &text)
+{
+    QByteArray utf8 = text.toUtf8();
+    char *key = fold_search_key(utf8.constData());
+    if (!key) {
+        return QString();
+    }
+
+    QString result = QString::fromUtf8(key);
+    free(key);
+    return result;
+}
+
+QString searchKeyRangeEnd()
+{
+    return QString::fromUtf8(FOLD_KEY_RANGE_END);
+}
+
+bool hasSearchKeyColumns(const QSqlDatabase &db)
+{
+    QSqlRecord record = db.record("books");
+    return record.contains("title_key") && record.contains("author_key") && record.contains("series_key");
+}
+
+void updateBookSearchKeys(QSqlDatabase &db, const QVariant &bookId,
+                          const QString &title, const QString &author, const QString &series)
+{
+    if (!bookId.isValid() || !hasSearchKeyColumns(db)) {
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE books SET title_key = ?, author_key = ?, series_key = ? WHERE id = ?");
+    query.addBindValue(title.isNull() ? QVariant() : QVariant(foldSearchKey(title)));
+    query.addBindValue(author.isNull() ? QVariant() : QVariant(foldSearchKey(author)));
+    query.addBindValue(series.isNull() ? QVariant() : QVariant(foldSearchKey(series)));
+    query.addBindValue(bookId);
+
+    if (!query.exec()) {
+        qDebug() << "Failed to update search keys:" << query.lastError().text();
+    }
+}
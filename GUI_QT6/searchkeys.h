@@ -0,0 +1,22 @@
+#ifndef SEARCHKEYS_H
+#define SEARCHKEYS_H
+
+#include <QString>
+#include <QVariant>
+#include <QSqlDatabase>
+
+// Нормализованные ключи title_key/author_key/series_key - те же, что пишет консольный сканер
+// (нижний регистр, ё -> е, без знаков препинания; см. ../text_fold.c)
+QString foldSearchKey(const QString &text);
+
+// Верхняя граница диапазона для поиска по префиксу ключа: key >= prefix AND key < prefix + searchKeyRangeEnd()
+QString searchKeyRangeEnd();
+
+// Есть ли в таблице books колонки ключей (их добавляет сканер или createTables)
+bool hasSearchKeyColumns(const QSqlDatabase &db);
+
+// Записывает ключи для книги, добавленной или обновленной из GUI
+void updateBookSearchKeys(QSqlDatabase &db, const QVariant &bookId,
+                          const QString &title, const QString &author, const QString &series);
+
+#endif // SEARCHKEYS_H
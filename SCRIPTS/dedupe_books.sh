@@ -1,7 +1,9 @@
 #!/bin/bash
 
-# Скрипт для поиска и удаления дубликатов книг
-# Оставляет книгу с наибольшим размером
+# Скрипт для удаления дубликатов книг
+# Группы изданий одного текста и каноническое издание в каждой находит сканер:
+#   book_scanner config.ini --dedupe
+# Скрипт удаляет записи, отмеченные в duplicate_of, и оставляет канонические
 
 DB_FILE="${1:-./library.db}"
 
@@ -37,54 +39,27 @@ show_stats() {
 echo "📈 НАЧАЛЬНАЯ СТАТИСТИКА:"
 show_stats
 
-echo "🔎 Ищем дубликаты по названию и автору..."
+echo "🔎 Издания одного текста (book_scanner --dedupe)..."
 sqlite3 -header -column "$DB_FILE" "
 SELECT 
-    title as 'Название',
-    author as 'Автор', 
+    c.title as 'Название',
+    c.author as 'Автор', 
     COUNT(*) as 'Дубликатов',
-    MIN(file_size) as 'Мин. размер',
-    MAX(file_size) as 'Макс. размер',
-    GROUP_CONCAT(id, ', ') as 'ID книг'
-FROM books 
-GROUP BY title, author 
-HAVING COUNT(*) > 1 
-ORDER BY COUNT(*) DESC, title
+    c.file_size as 'Размер канонического',
+    GROUP_CONCAT(d.id, ', ') as 'ID дубликатов'
+FROM books d
+JOIN books c ON c.id = d.duplicate_of
+GROUP BY c.id
+ORDER BY COUNT(*) DESC, c.title
 LIMIT 20;
 " | head -20
 
 echo
 echo "🗑️  Начинаем удаление дубликатов..."
 
-# Создаем временную таблицу для хранения ID книг, которые нужно сохранить
 sqlite3 "$DB_FILE" "
--- Создаем временную таблицу с книгами для сохранения (самые большие по размеру)
-CREATE TEMPORARY TABLE books_to_keep AS
-SELECT 
-    b1.id,
-    b1.title,
-    b1.author,
-    b1.file_size,
-    ROW_NUMBER() OVER (PARTITION BY b1.title, b1.author ORDER BY b1.file_size DESC, b1.id DESC) as rn
-FROM books b1
-WHERE b1.title IS NOT NULL AND b1.author IS NOT NULL;
-
--- Подсчитываем сколько будет удалено
-CREATE TEMPORARY TABLE deletion_stats AS
-SELECT COUNT(*) as to_delete FROM books_to_keep WHERE rn > 1;
-
--- Удаляем дубликаты (оставляем только первую запись для каждой группы)
-DELETE FROM books 
-WHERE id IN (
-    SELECT id FROM books_to_keep WHERE rn > 1
-);
-
--- Выводим статистику удаления
-SELECT 'Удалено дубликатов: ' || (SELECT to_delete FROM deletion_stats) as result;
-
--- Удаляем временные таблицы
-DROP TABLE books_to_keep;
-DROP TABLE deletion_stats;
+SELECT 'Удалено дубликатов: ' || COUNT(*) FROM books WHERE duplicate_of IS NOT NULL;
+DELETE FROM books WHERE duplicate_of IS NOT NULL;
 "
 
 echo
@@ -108,7 +83,7 @@ ORDER BY file_size DESC
 LIMIT 10;
 "
 
-# Проверяем остались ли дубликаты
+# Проверяем остались ли дубликаты по названию и автору (их сканер не вставляет вовсе)
 echo
 echo "🔍 ПРОВЕРКА НА ДУБЛИКАТЫ:"
 DUPLICATES=$(sqlite3 "$DB_FILE" "
@@ -124,18 +99,7 @@ FROM (
 if [ "$DUPLICATES" -eq 0 ]; then
     echo "✅ Дубликатов не найдено!"
 else
-    echo "⚠️  Найдено групп дубликатов: $DUPLICATES"
-    sqlite3 -header -column "$DB_FILE" "
-    SELECT 
-        title as 'Название',
-        author as 'Автор', 
-        COUNT(*) as 'Дубликатов'
-    FROM books 
-    GROUP BY title, author 
-    HAVING COUNT(*) > 1 
-    ORDER BY COUNT(*) DESC
-    LIMIT 10;
-    "
+    echo "⚠️  Найдено групп с одинаковыми названием и автором: $DUPLICATES"
 fi
 
 echo
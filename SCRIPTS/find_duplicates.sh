@@ -55,6 +55,23 @@ HAVING COUNT(*) > 1
 ORDER BY COUNT(*) DESC
 LIMIT 20;"
 
+# 2a. Другие издания того же текста: duplicate_of заполняет book_scanner --dedupe
+echo ""
+echo "2a. ИЗДАНИЯ ОДНОГО ТЕКСТА (book_scanner --dedupe):"
+echo "--------------------------------------------------"
+run_sql "
+SELECT 
+    c.id as 'ID',
+    c.title as 'Каноническое издание',
+    c.author as 'Автор',
+    COUNT(*) as 'Других изданий',
+    GROUP_CONCAT(d.id, ', ') as 'ID изданий'
+FROM books d
+JOIN books c ON c.id = d.duplicate_of
+GROUP BY c.id
+ORDER BY COUNT(*) DESC
+LIMIT 20;"
+
 # 3. Дубликаты по пути файла (разные версии)
 echo ""
 echo "3. ДУБЛИКАТЫ ПО ПУТИ ФАЙЛА:"
@@ -0,0 +1,108 @@
+// arena.c - арена для метаданных книги и временных строк разбора
+#include "common.h"
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+// Блок больше этого после сброса не сохраняется - одна огромная книга не держит память до конца сканирования
+#define ARENA_KEEP_MAX (16 * 1024 * 1024)
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char* block_data(ArenaBlock *block) {
+    return (char*)block + align_up(sizeof(ArenaBlock));
+}
+
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = align_up(size ? size : 1);
+
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = arena->block_size ? arena->block_size : ARENA_DEFAULT_BLOCK;
+        if (block_size < size) block_size = size;
+
+        ArenaBlock *fresh = malloc(align_up(sizeof(ArenaBlock)) + block_size);
+        if (!fresh) return NULL;
+        fresh->next = block;
+        fresh->size = block_size;
+        fresh->used = 0;
+        arena->head = block = fresh;
+    }
+
+    void *ptr = block_data(block) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void* arena_calloc(Arena *arena, size_t size) {
+    void *ptr = arena_alloc(arena, size);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+char* arena_strndup(Arena *arena, const char *str, size_t max_len) {
+    if (!str) return NULL;
+    size_t len = strnlen(str, max_len);
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(Arena *arena, const char *str) {
+    return str ? arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+char* arena_adopt(Arena *arena, char *heap_str) {
+    char *copy = arena_strdup(arena, heap_str);
+    free(heap_str);
+    return copy;
+}
+
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    if (!block) return;
+
+    if (!block->next) {
+        // Единственный блок под одну огромную строку тоже не держим: следующая книга
+        // начнет с обычного блока
+        if (block->size > ARENA_KEEP_MAX) {
+            free(block);
+            arena->head = NULL;
+            return;
+        }
+        block->used = 0;
+        return;
+    }
+
+    // Книга не уместилась в один блок: освобождаем цепочку и в следующий раз
+    // берем один блок на весь объем, чтобы дальше обходиться без malloc
+    size_t total = 0;
+    while (block) {
+        ArenaBlock *next = block->next;
+        total += block->size;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    if (total <= ARENA_KEEP_MAX) {
+        arena->block_size = total;
+    }
+}
+
+void arena_destroy(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Блок арены: данные идут сразу за заголовком
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+// Арена с выделением "сдвигом указателя": память отдельных строк не освобождается,
+// вся арена сбрасывается разом (на каждую книгу или запись INP).
+// После сброса арена держит один блок размером с пик прошлой книги (огромные блоки
+// освобождаются, см. ARENA_KEEP_MAX), поэтому в установившемся режиме разбор книги
+// не обращается к malloc вовсе.
+// Обнуленная структура - готовая пустая арена
+typedef struct {
+    ArenaBlock *head;       // текущий блок, NULL - еще ничего не выделено
+    size_t block_size;      // размер следующего блока, 0 - ARENA_DEFAULT_BLOCK
+} Arena;
+
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+
+void arena_init(Arena *arena, size_t block_size);
+void* arena_alloc(Arena *arena, size_t size);
+void* arena_calloc(Arena *arena, size_t size);
+char* arena_strdup(Arena *arena, const char *str);
+char* arena_strndup(Arena *arena, const char *str, size_t max_len);
+// Копирует строку из кучи в арену и освобождает оригинал (для calculate_file_hash и т.п.)
+char* arena_adopt(Arena *arena, char *heap_str);
+// Делает всю выделенную память недействительной, оставляя блок для следующей книги
+void arena_reset(Arena *arena);
+void arena_destroy(Arena *arena);
+
+#endif
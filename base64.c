@@ -0,0 +1,138 @@
+// base64.c - декодер base64 для <binary> FB2 с векторным ядром SSSE3
+#include "base64.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_HAVE_SSSE3 1
+#include <immintrin.h>
+#endif
+
+#define B64_SKIP 0x40   // пробелы, переводы строк и прочий мусор
+#define B64_STOP 0x80   // '=' или начало следующего тега
+
+static const unsigned char decode_table[256] = {
+    ['A'] = 0,  ['B'] = 1,  ['C'] = 2,  ['D'] = 3,  ['E'] = 4,  ['F'] = 5,  ['G'] = 6,  ['H'] = 7,
+    ['I'] = 8,  ['J'] = 9,  ['K'] = 10, ['L'] = 11, ['M'] = 12, ['N'] = 13, ['O'] = 14, ['P'] = 15,
+    ['Q'] = 16, ['R'] = 17, ['S'] = 18, ['T'] = 19, ['U'] = 20, ['V'] = 21, ['W'] = 22, ['X'] = 23,
+    ['Y'] = 24, ['Z'] = 25, ['a'] = 26, ['b'] = 27, ['c'] = 28, ['d'] = 29, ['e'] = 30, ['f'] = 31,
+    ['g'] = 32, ['h'] = 33, ['i'] = 34, ['j'] = 35, ['k'] = 36, ['l'] = 37, ['m'] = 38, ['n'] = 39,
+    ['o'] = 40, ['p'] = 41, ['q'] = 42, ['r'] = 43, ['s'] = 44, ['t'] = 45, ['u'] = 46, ['v'] = 47,
+    ['w'] = 48, ['x'] = 49, ['y'] = 50, ['z'] = 51, ['0'] = 52, ['1'] = 53, ['2'] = 54, ['3'] = 55,
+    ['4'] = 56, ['5'] = 57, ['6'] = 58, ['7'] = 59, ['8'] = 60, ['9'] = 61, ['+'] = 62, ['/'] = 63,
+    ['='] = B64_STOP, ['<'] = B64_STOP
+};
+
+// Для всех символов вне алфавита, кроме '=' и '<', таблица содержит B64_SKIP
+static unsigned char lookup(unsigned char c) {
+    unsigned char v = decode_table[c];
+    if (v == 0 && c != 'A') return B64_SKIP;
+    return v;
+}
+
+#ifdef BASE64_HAVE_SSSE3
+
+// Декодирует подряд идущие блоки по 16 символов, пока в блоке нет пробелов и переводов строк.
+// Алгоритм проверки и сдвига по таблицам старших/младших полубайтов (W. Muła, D. Lemire).
+__attribute__((target("ssse3")))
+static size_t decode_blocks_ssse3(const unsigned char **in_ptr, const unsigned char *end, unsigned char **out_ptr) {
+    const unsigned char *in = *in_ptr;
+    unsigned char *out = *out_ptr;
+
+    const __m128i shift_lut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_lut = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                           (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+    const __m128i bitpos_lut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack_shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i slash = _mm_set1_epi8(0x2f);
+    const __m128i slash_shift = _mm_set1_epi8(16);
+
+    // Запас в 24 символа гарантирует, что 16-байтная запись не выйдет за BASE64_DECODED_MAX
+    while (end - in >= 24) {
+        __m128i input = _mm_loadu_si128((const __m128i*)in);
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(input, 4), nibble_mask);
+        __m128i lo_nibbles = _mm_and_si128(input, nibble_mask);
+
+        __m128i allowed = _mm_shuffle_epi8(mask_lut, lo_nibbles);
+        __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi_nibbles);
+        __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(allowed, bit), _mm_setzero_si128());
+        if (_mm_movemask_epi8(invalid)) break;
+
+        __m128i is_slash = _mm_cmpeq_epi8(input, slash);
+        __m128i shift = _mm_or_si128(_mm_and_si128(is_slash, slash_shift),
+                                     _mm_andnot_si128(is_slash, _mm_shuffle_epi8(shift_lut, hi_nibbles)));
+        __m128i values = _mm_add_epi8(input, shift);
+
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(packed, pack_shuffle));
+
+        in += 16;
+        out += 12;
+    }
+
+    size_t consumed = (size_t)(in - *in_ptr);
+    *in_ptr = in;
+    *out_ptr = out;
+    return consumed;
+}
+
+static int ssse3_available(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return cached;
+}
+
+#endif
+
+size_t base64_decode(const char *src, size_t src_len, unsigned char *dst) {
+    const unsigned char *in = (const unsigned char*)src;
+    const unsigned char *end = in + src_len;
+    unsigned char *out = dst;
+
+    uint32_t accum = 0;
+    int quad = 0;
+
+#ifdef BASE64_HAVE_SSSE3
+    int use_simd = ssse3_available();
+#endif
+
+    while (in < end) {
+#ifdef BASE64_HAVE_SSSE3
+        // Векторный путь возможен только на границе четверки символов
+        if (use_simd && quad == 0) {
+            decode_blocks_ssse3(&in, end, &out);
+            if (in >= end) break;
+        }
+#endif
+        unsigned char v = lookup(*in++);
+        if (v == B64_STOP) break;
+        if (v == B64_SKIP) continue;
+
+        accum = (accum << 6) | v;
+        if (++quad == 4) {
+            out[0] = (unsigned char)(accum >> 16);
+            out[1] = (unsigned char)(accum >> 8);
+            out[2] = (unsigned char)accum;
+            out += 3;
+            accum = 0;
+            quad = 0;
+        }
+    }
+
+    // Неполная последняя четверка (после нее обычно идет '=')
+    if (quad == 2) {
+        *out++ = (unsigned char)(accum >> 4);
+    } else if (quad == 3) {
+        *out++ = (unsigned char)(accum >> 10);
+        *out++ = (unsigned char)(accum >> 2);
+    }
+
+    return (size_t)(out - dst);
+}
@@ -0,0 +1,22 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Максимальный размер результата для src_len символов base64
+#define BASE64_DECODED_MAX(src_len) ((src_len) / 4 * 3 + 3)
+
+// Декодирует base64, пропуская пробелы и переводы строк; останавливается на '=' или '<'.
+// dst должен вмещать BASE64_DECODED_MAX(src_len) байт или совпадать с src (декодирование на месте).
+// Возвращает число записанных байт.
+size_t base64_decode(const char *src, size_t src_len, unsigned char *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,639 @@
+// bench_scanner.c - поэтапные замеры конвейера сканера на синтетической библиотеке (make bench)
+//
+// Использование:
+//   bench_scanner --corpus DIR [--output FILE] [--baseline FILE] [--threshold PCT]
+//                 [--db PATH] [--mysql-config FILE]
+//
+// Этапы замеряются по отдельности, на каждый элемент (файл, архив, запись архива, строку INP, книгу):
+//   walk, hash, archive_enum, decompress, encoding, fb2_parse, format_parse, inp_parse,
+//   db_insert_sqlite/db_finish_sqlite и, если указан --mysql-config, db_insert_mysql/db_finish_mysql.
+// Каждый этап - те же функции, что зовет сканер: zip_index_load и заголовки libarchive,
+// zip_entry_read или archive_read_data, detect_encoding/convert_encoding, parse_fb2_from_memory
+// и parse_memory обработчиков остальных форматов.
+// Результат - JSON с пропускной способностью и p50/p99 на элемент. С --baseline
+// результат сравнивается с сохраненным: падение items_per_sec больше порога - регрессия.
+//
+// ВНИМАНИЕ: база MySQL из --mysql-config перед замером очищается.
+//
+// Коды возврата: 0 - успех, 1 - ошибка аргументов, 2 - ошибка замера, 3 - регрессия.
+#include "common.h"
+#include "config.h"
+#include "database.h"
+#include "format.h"
+#include "inpx_parser.h"
+#include "metadata.h"
+#include "scanner.h"
+#include "scanner_integration.h"
+#include "utils.h"
+#include "zip_index.h"
+#include <errno.h>
+#include <archive.h>
+#include <archive_entry.h>
+
+#define BENCH_OK 0
+#define BENCH_USAGE 1
+#define BENCH_FAILED 2
+#define BENCH_REGRESSION 3
+
+#define BENCH_MAX_ENTRY_SIZE 10485760   // тот же предел, что у scan_archive
+
+typedef enum {
+    STAGE_WALK,
+    STAGE_HASH,
+    STAGE_ARCHIVE_ENUM,
+    STAGE_DECOMPRESS,
+    STAGE_ENCODING,
+    STAGE_FB2_PARSE,
+    STAGE_FORMAT_PARSE,
+    STAGE_INP_PARSE,
+    STAGE_DB_INSERT_SQLITE,
+    STAGE_DB_FINISH_SQLITE,
+    STAGE_DB_INSERT_MYSQL,
+    STAGE_DB_FINISH_MYSQL,
+    STAGE_COUNT
+} BenchStageId;
+
+static const char *stage_names[STAGE_COUNT] = {
+    "walk", "hash", "archive_enum", "decompress", "encoding", "fb2_parse", "format_parse", "inp_parse",
+    "db_insert_sqlite", "db_finish_sqlite", "db_insert_mysql", "db_finish_mysql"
+};
+
+typedef struct {
+    double *samples;            // секунды на элемент
+    size_t count;
+    size_t cap;
+    unsigned long long bytes;
+    double total;
+} BenchStage;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t cap;
+} PathList;
+
+typedef struct {
+    const char *corpus;
+    const char *output;
+    const char *baseline;
+    const char *db_path;
+    const char *mysql_config;
+    double threshold;
+} BenchOptions;
+
+// Файлы корпуса, собранные на этапе walk
+typedef struct {
+    PathList files;             // все обычные файлы - для hash
+    PathList archives;          // архивы - для archive_enum и decompress
+    PathList books;             // отдельные книги - сразу на разбор
+    char *inpx;
+} Corpus;
+
+typedef void (*InpRecordFn)(BookMeta *meta, const char *file_path, const char *internal_path, void *arg);
+
+static BenchStage stages[STAGE_COUNT];
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void stage_add(BenchStageId id, double seconds, unsigned long long bytes) {
+    BenchStage *stage = &stages[id];
+    if (stage->count == stage->cap) {
+        size_t cap = stage->cap ? stage->cap * 2 : 1024;
+        double *samples = realloc(stage->samples, cap * sizeof(double));
+        if (!samples) return;
+        stage->samples = samples;
+        stage->cap = cap;
+    }
+    stage->samples[stage->count++] = seconds;
+    stage->bytes += bytes;
+    stage->total += seconds;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double stage_percentile(const BenchStage *stage, double q) {
+    if (stage->count == 0) return 0.0;
+    // Выборка уже отсортирована в write_results
+    size_t index = (size_t)(q * (double)(stage->count - 1) + 0.5);
+    return stage->samples[index];
+}
+
+static int path_list_add(PathList *list, const char *path) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        char **items = realloc(list->items, cap * sizeof(char*));
+        if (!items) return 0;
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count] = strdup(path);
+    return list->items[list->count++] != NULL;
+}
+
+static void path_list_free(PathList *list) {
+    for (size_t i = 0; i < list->count; i++) free(list->items[i]);
+    free(list->items);
+    memset(list, 0, sizeof(PathList));
+}
+
+static int has_ext(const char *name, const char *ext) {
+    const char *dot = strrchr(name, '.');
+    return dot && strcasecmp(dot, ext) == 0;
+}
+
+// Тот же обход, что у scan_directory: opendir/readdir и stat на каждую запись
+static int bench_walk(const char *path, Corpus *corpus) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Cannot open directory %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    struct dirent *entry;
+    int ok = 1;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        double start = now_seconds();
+        char full_path[MAX_PATH];
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+
+        struct stat st;
+        if (stat(full_path, &st) != 0) continue;
+        stage_add(STAGE_WALK, now_seconds() - start, 0);
+
+        if (S_ISDIR(st.st_mode)) {
+            ok = bench_walk(full_path, corpus);
+        } else if (S_ISREG(st.st_mode)) {
+            ok = path_list_add(&corpus->files, full_path);
+            if (has_ext(entry->d_name, ".inpx")) {
+                if (!corpus->inpx) corpus->inpx = strdup(full_path);
+            } else if (is_archive_format(entry->d_name)) {
+                ok = ok && path_list_add(&corpus->archives, full_path);
+            } else if (is_supported_format(entry->d_name)) {
+                ok = ok && path_list_add(&corpus->books, full_path);
+            }
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+static int bench_hash(const Corpus *corpus) {
+    for (size_t i = 0; i < corpus->files.count; i++) {
+        struct stat st;
+        if (stat(corpus->files.items[i], &st) != 0) continue;
+
+        double start = now_seconds();
+        char *hash = calculate_file_hash(corpus->files.items[i], "md5");
+        double elapsed = now_seconds() - start;
+        if (!hash) return 0;
+        free(hash);
+        stage_add(STAGE_HASH, elapsed, (unsigned long long)st.st_size);
+    }
+    return 1;
+}
+
+static struct archive* open_archive(const char *path) {
+    struct archive *a = archive_read_new();
+    archive_read_support_format_all(a);
+    archive_read_support_filter_all(a);
+    if (archive_read_open_filename(a, path, 10240) != ARCHIVE_OK) {
+        fprintf(stderr, "Cannot open archive %s: %s\n", path, archive_error_string(a));
+        archive_read_free(a);
+        return NULL;
+    }
+    return a;
+}
+
+// Обходит записи всех .inp в INPX; разбор строки попадает в этап inp_parse,
+// а каждая книга передается в fn (путь к архиву строится, как в import_inpx_collection)
+static int for_each_inp_record(const char *inpx_path, const char *books_dir, InpRecordFn fn, void *arg) {
+    struct archive *a = open_archive(inpx_path);
+    if (!a) return 0;
+
+    TImportContext ctx = {0};
+    get_inpx_fields("AUTHOR;GENRE;TITLE;SERIES;SERNO;FILE;SIZE;LIBID;DEL;EXT;DATE;LANG;KEYWORDS", &ctx);
+
+    struct archive_entry *entry;
+    int ok = 1;
+    while (ok && archive_read_next_header(a, &entry) == ARCHIVE_OK) {
+        const char *name = archive_entry_pathname(entry);
+        la_int64_t size = archive_entry_size(entry);
+        if (!has_ext(name, ".inp") || size <= 0) {
+            archive_read_data_skip(a);
+            continue;
+        }
+
+        char *content = malloc((size_t)size + 1);
+        if (!content || archive_read_data(a, content, (size_t)size) != size) {
+            free(content);
+            ok = 0;
+            break;
+        }
+        content[size] = '\0';
+
+        char file_path[MAX_PATH];
+        snprintf(file_path, sizeof(file_path), "%s/%.*s.zip", books_dir,
+                 (int)(strrchr(name, '.') - name), name);
+
+        Arena record_arena;
+        arena_init(&record_arena, 0);
+
+        char *line = content;
+        while (*line) {
+            char *line_end = line + strcspn(line, "\r\n");
+            if (*line_end == '\0') break;
+            char *next = line_end;
+            if (*next == '\r') next++;
+            if (*next == '\n') next++;
+            *line_end = '\0';
+
+            size_t line_len = (size_t)(line_end - line);
+            if (line_len > 10) {
+                BookMeta meta = {0};
+                meta.arena = &record_arena;
+                char *file_name = NULL;
+                char *file_ext = NULL;
+
+                double start = now_seconds();
+                parse_inpx_data(line, &ctx, 0, &meta, &file_name, &file_ext);
+                if (!fn) stage_add(STAGE_INP_PARSE, now_seconds() - start, line_len);
+
+                if (fn && meta.title && meta.author && file_name) {
+                    char internal_path[256];
+                    snprintf(internal_path, sizeof(internal_path), "%s.%s", file_name,
+                             file_ext && file_ext[0] ? file_ext : "fb2");
+                    fn(&meta, file_path, internal_path, arg);
+                }
+
+                free_book_meta(&meta);
+            }
+            line = next;
+        }
+        arena_destroy(&record_arena);
+        free(content);
+    }
+
+    free_import_context(&ctx);
+    archive_read_free(a);
+    return ok;
+}
+
+typedef struct {
+    DatabaseHandle *db_handle;
+    Config *config;
+    BenchStageId stage;
+} InsertContext;
+
+static void insert_record(BookMeta *meta, const char *file_path, const char *internal_path, void *arg) {
+    InsertContext *ic = arg;
+    double start = now_seconds();
+    insert_book_to_db(ic->db_handle, file_path, meta, file_path, internal_path, ic->config);
+    stage_add(ic->stage, now_seconds() - start, 0);
+}
+
+// Разбор одной книги (content завершен нулем). FB2 делится на два этапа: encoding - определение
+// и перекодирование windows-1251, как в parse_fb2_text, и fb2_parse - parse_fb2_from_memory по
+// уже UTF-8 тексту (повторно он не перекодируется). Остальные форматы - parse_memory обработчика
+static void bench_book(const char *name, const char *content, size_t content_size, Arena *arena) {
+    BookFormat format = detect_format_memory(content, content_size, name);
+    const FormatHandler *handler = format_handler(format);
+    if (!handler->parse_memory) return;
+
+    if (format != BOOK_FORMAT_FB2) {
+        double start = now_seconds();
+        handler->parse_memory(content, content_size, arena);
+        stage_add(STAGE_FORMAT_PARSE, now_seconds() - start, content_size);
+        arena_reset(arena);
+        return;
+    }
+
+    double start = now_seconds();
+    char *converted = detect_encoding(content) == 2 ? convert_encoding(content, "WINDOWS-1251", "UTF-8") : NULL;
+    stage_add(STAGE_ENCODING, now_seconds() - start, content_size);
+
+    const char *text = converted ? converted : content;
+    size_t text_size = converted ? strlen(converted) : content_size;
+    start = now_seconds();
+    parse_fb2_from_memory(text, text_size, arena);
+    stage_add(STAGE_FB2_PARSE, now_seconds() - start, text_size);
+
+    free(converted);
+    arena_reset(arena);
+}
+
+// Архив разбирается тем же путем, что в scan_archive. archive_enum - центральный каталог ZIP
+// и заголовки записей libarchive (один замер на архив), decompress - распаковка каждой записи:
+// zip_entry_read для ZIP из одной книги, иначе archive_read_data
+static int bench_archive(const char *path, Arena *arena) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 1;
+
+    double start = now_seconds();
+    ZipIndex *zip_index = detect_format(path) == BOOK_FORMAT_ZIP ? zip_index_load(path) : NULL;
+    double enum_seconds = now_seconds() - start;
+
+    const ZipEntryInfo *single = zip_index && zip_index->count == 1 ? &zip_index->entries[0] : NULL;
+    if (single) {
+        BookFormat format = format_from_extension(single->name);
+        if (format == BOOK_FORMAT_UNKNOWN || format_handler(format)->is_archive ||
+            single->uncompressed_size > BENCH_MAX_ENTRY_SIZE) {
+            single = NULL;
+        }
+    }
+
+    if (single) {
+        stage_add(STAGE_ARCHIVE_ENUM, enum_seconds, (unsigned long long)st.st_size);
+        int fd = open(path, O_RDONLY);
+        size_t content_size = 0;
+        start = now_seconds();
+        char *content = fd >= 0 ? zip_entry_read(fd, single, BENCH_MAX_ENTRY_SIZE, &content_size) : NULL;
+        double elapsed = now_seconds() - start;
+        if (fd >= 0) close(fd);
+        if (content) {
+            stage_add(STAGE_DECOMPRESS, elapsed, content_size);
+            bench_book(single->name, content, content_size, arena);
+            free(content);
+        }
+        zip_index_free(zip_index);
+        return content != NULL;
+    }
+    zip_index_free(zip_index);
+
+    start = now_seconds();
+    struct archive *a = open_archive(path);
+    enum_seconds += now_seconds() - start;
+    if (!a) return 0;
+
+    int ok = 1;
+    while (ok) {
+        struct archive_entry *entry;
+        start = now_seconds();
+        int r = archive_read_next_header(a, &entry);
+        enum_seconds += now_seconds() - start;
+        if (r != ARCHIVE_OK) break;
+
+        const char *name = archive_entry_pathname(entry);
+        la_int64_t size = archive_entry_size(entry);
+        if (archive_entry_filetype(entry) != AE_IFREG || size <= 0 || size > BENCH_MAX_ENTRY_SIZE ||
+            !is_supported_format(name)) {
+            archive_read_data_skip(a);
+            continue;
+        }
+
+        char *content = malloc((size_t)size + 1);
+        if (!content) {
+            ok = 0;
+            break;
+        }
+        start = now_seconds();
+        la_ssize_t bytes_read = archive_read_data(a, content, (size_t)size);
+        double elapsed = now_seconds() - start;
+        if (bytes_read == size) {
+            content[size] = '\0';
+            stage_add(STAGE_DECOMPRESS, elapsed, (unsigned long long)size);
+            bench_book(name, content, (size_t)size, arena);
+        } else {
+            fprintf(stderr, "Cannot read %s from %s: %s\n", name, path, archive_error_string(a));
+            ok = 0;
+        }
+        free(content);
+    }
+    stage_add(STAGE_ARCHIVE_ENUM, enum_seconds, (unsigned long long)st.st_size);
+
+    archive_read_free(a);
+    return ok;
+}
+
+static int bench_scan(const Corpus *corpus) {
+    Arena arena;
+    arena_init(&arena, 0);
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < corpus->archives.count; i++) {
+        ok = bench_archive(corpus->archives.items[i], &arena);
+    }
+
+    // Отдельные книги сканер отображает целиком (open_book_view) - разбор идет из того же view
+    for (size_t i = 0; ok && i < corpus->books.count; i++) {
+        FileView view;
+        if (!file_view_open(corpus->books.items[i], NULL, &view)) continue;
+        bench_book(corpus->books.items[i], view.data, view.size, &arena);
+        file_view_close(&view);
+    }
+
+    arena_destroy(&arena);
+    return ok;
+}
+
+// Вставка книг из INPX в чистую базу; finish - перестроение индексов и ANALYZE
+static int bench_db(const Corpus *corpus, Config *config, BenchStageId insert_stage, BenchStageId finish_stage) {
+    DatabaseHandle *db_handle = db_connect(config);
+    if (!db_handle) return 0;
+
+    int ok = create_database_tables(db_handle, config) && clear_database(db_handle, config);
+    if (ok) {
+        InsertContext ic = {db_handle, config, insert_stage};
+        int bulk_load = db_begin_bulk_load(db_handle, config);
+        ok = for_each_inp_record(corpus->inpx, config->scanner.books_dir, insert_record, &ic);
+
+        double start = now_seconds();
+        ok = db_end_bulk_load(db_handle, bulk_load, config) && ok;
+        stage_add(finish_stage, now_seconds() - start, 0);
+    }
+
+    db_close(db_handle);
+    return ok;
+}
+
+static void write_results(FILE *out, const BenchOptions *opt) {
+    fprintf(out, "{\n  \"corpus\": \"%s\",\n  \"stages\": [\n", opt->corpus);
+    int first = 1;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        BenchStage *stage = &stages[i];
+        if (stage->count == 0) continue;
+        qsort(stage->samples, stage->count, sizeof(double), compare_doubles);
+
+        double seconds = stage->total > 0 ? stage->total : 1e-9;
+        fprintf(out, "%s    {\"stage\": \"%s\", \"items\": %zu, \"bytes\": %llu, \"seconds\": %.6f, "
+                     "\"items_per_sec\": %.1f, \"mb_per_sec\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f}",
+                first ? "" : ",\n", stage_names[i], stage->count, stage->bytes, stage->total,
+                (double)stage->count / seconds, (double)stage->bytes / seconds / 1048576.0,
+                stage_percentile(stage, 0.50) * 1e6, stage_percentile(stage, 0.99) * 1e6);
+        first = 0;
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+// Базовый файл - вывод этой же программы: одна строка на этап
+static int compare_baseline(const BenchOptions *opt, FILE *report) {
+    FILE *file = fopen(opt->baseline, "r");
+    if (!file) {
+        fprintf(report, "No baseline %s - comparison skipped (make bench-baseline creates it)\n", opt->baseline);
+        return 0;
+    }
+
+    int regressions = 0;
+    char line[1024];
+    fprintf(report, "%-18s %14s %14s %8s %10s %10s\n", "stage", "base items/s", "items/s", "change", "base p99", "p99");
+
+    while (fgets(line, sizeof(line), file)) {
+        char name[64];
+        double base_rate, base_p99;
+        const char *p = strstr(line, "\"stage\": \"");
+        const char *rate = strstr(line, "\"items_per_sec\": ");
+        const char *p99 = strstr(line, "\"p99_us\": ");
+        if (!p || !rate || !p99 ||
+            sscanf(p, "\"stage\": \"%63[^\"]\"", name) != 1 ||
+            sscanf(rate, "\"items_per_sec\": %lf", &base_rate) != 1 ||
+            sscanf(p99, "\"p99_us\": %lf", &base_p99) != 1) {
+            continue;
+        }
+
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            BenchStage *stage = &stages[i];
+            if (strcmp(stage_names[i], name) != 0 || stage->count == 0 || base_rate <= 0) continue;
+
+            double current = (double)stage->count / (stage->total > 0 ? stage->total : 1e-9);
+            double change = (current / base_rate - 1.0) * 100.0;
+            int regressed = change < -opt->threshold;
+            regressions += regressed;
+            fprintf(report, "%-18s %14.1f %14.1f %+7.1f%% %10.2f %10.2f%s\n", name, base_rate, current, change,
+                    base_p99, stage_percentile(stage, 0.99) * 1e6, regressed ? "  REGRESSION" : "");
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: bench_scanner --corpus DIR [--output FILE] [--baseline FILE] [--threshold PCT]\n"
+            "                     [--db PATH] [--mysql-config FILE]\n");
+}
+
+static int parse_options(int argc, char **argv, BenchOptions *opt) {
+    memset(opt, 0, sizeof(BenchOptions));
+    opt->db_path = "bench.db";
+    opt->threshold = 10.0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *arg = argv[i];
+        const char *value = argv[i + 1];
+        if (strcmp(arg, "--corpus") == 0) opt->corpus = value;
+        else if (strcmp(arg, "--output") == 0) opt->output = value;
+        else if (strcmp(arg, "--baseline") == 0) opt->baseline = value;
+        else if (strcmp(arg, "--threshold") == 0) opt->threshold = atof(value);
+        else if (strcmp(arg, "--db") == 0) opt->db_path = value;
+        else if (strcmp(arg, "--mysql-config") == 0) opt->mysql_config = value;
+        else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 0;
+        }
+    }
+    if (argc % 2 == 0 || !opt->corpus) {
+        usage();
+        return 0;
+    }
+    return 1;
+}
+
+static int remove_sqlite_files(const char *path) {
+    const char *suffixes[] = {"", "-wal", "-shm", "-journal", NULL};
+    for (int i = 0; suffixes[i]; i++) {
+        char file[MAX_PATH];
+        snprintf(file, sizeof(file), "%s%s", path, suffixes[i]);
+        if (unlink(file) != 0 && errno != ENOENT) return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt;
+    if (!parse_options(argc, argv, &opt)) return BENCH_USAGE;
+
+    // Функции сканера печатают отладку в stdout - на время замеров она уходит в /dev/null
+    int stdout_fd = dup(STDOUT_FILENO);
+    if (stdout_fd < 0 || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Cannot redirect stdout: %s\n", strerror(errno));
+        return BENCH_FAILED;
+    }
+
+    Corpus corpus = {0};
+    int ok = bench_walk(opt.corpus, &corpus);
+    fprintf(stderr, "walk: %zu files, %zu archives, %zu loose books\n",
+            corpus.files.count, corpus.archives.count, corpus.books.count);
+
+    ok = ok && bench_hash(&corpus);
+
+    Config *config = create_default_config();
+    if (config) {
+        config->log_stream = NULL;
+        config->database.path = strdup(opt.db_path);
+        config->scanner.books_dir = strdup(opt.corpus);
+        ok = ok && bench_scan(&corpus);
+
+        if (ok && corpus.inpx) {
+            ok = for_each_inp_record(corpus.inpx, opt.corpus, NULL, NULL) &&
+                 remove_sqlite_files(opt.db_path) &&
+                 bench_db(&corpus, config, STAGE_DB_INSERT_SQLITE, STAGE_DB_FINISH_SQLITE);
+        } else if (ok) {
+            fprintf(stderr, "No INPX in corpus - inp_parse and db_* stages skipped\n");
+        }
+        free_config(config);
+    } else {
+        ok = 0;
+    }
+
+    if (ok && corpus.inpx && opt.mysql_config) {
+        Config *config = read_config(opt.mysql_config);
+        if (!config || strcmp(config->database.type, "mysql") != 0) {
+            fprintf(stderr, "%s is not a MySQL config\n", opt.mysql_config);
+            ok = 0;
+        } else {
+            if (config->log_stream && config->log_stream != stderr) fclose(config->log_stream);
+            config->log_stream = NULL;
+            free(config->scanner.books_dir);
+            config->scanner.books_dir = strdup(opt.corpus);
+            ok = bench_db(&corpus, config, STAGE_DB_INSERT_MYSQL, STAGE_DB_FINISH_MYSQL);
+        }
+        free_config(config);
+    }
+
+    path_list_free(&corpus.files);
+    path_list_free(&corpus.archives);
+    path_list_free(&corpus.books);
+    free(corpus.inpx);
+
+    if (!ok) {
+        fprintf(stderr, "Benchmark failed\n");
+        return BENCH_FAILED;
+    }
+
+    FILE *out = opt.output ? fopen(opt.output, "w") : fdopen(stdout_fd, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write %s: %s\n", opt.output, strerror(errno));
+        return BENCH_FAILED;
+    }
+    write_results(out, &opt);
+    fclose(out);
+    if (opt.output) fprintf(stderr, "Results written to %s\n", opt.output);
+
+    int regressions = opt.baseline ? compare_baseline(&opt, stderr) : 0;
+    for (int i = 0; i < STAGE_COUNT; i++) free(stages[i].samples);
+
+    if (regressions > 0) {
+        fprintf(stderr, "%d stage(s) slower than baseline by more than %.0f%%\n", regressions, opt.threshold);
+        return BENCH_REGRESSION;
+    }
+    return BENCH_OK;
+}
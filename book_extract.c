@@ -0,0 +1,427 @@
+// book_extract.c - выдача книги из архива для веб-загрузки без запуска unzip/unrar/7z
+//
+// Использование:
+//   book_extract [--stat] [--range=SPEC] <archive> <internal_path>
+//   book_extract [--stat] [--range=SPEC] <file>
+//
+// SPEC - диапазон в стиле HTTP: "bytes=0-1023", "100-", "-500".
+// --stat печатает размер распакованной книги и завершается.
+// Данные пишутся в stdout (это может быть и сокет, переданный веб-сервером).
+//
+// Коды возврата: 0 - успех, 1 - ошибка аргументов, 2 - файл не найден,
+// 3 - диапазон не удовлетворим, 4 - ошибка чтения/формата.
+#include "common.h"
+#include "zip_index.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <zlib.h>
+
+#define EXTRACT_OK 0
+#define EXTRACT_USAGE 1
+#define EXTRACT_NOT_FOUND 2
+#define EXTRACT_BAD_RANGE 3
+#define EXTRACT_IO_ERROR 4
+
+#define EXTRACT_BUFFER_SIZE 65536
+
+typedef struct {
+    int has_range;
+    int suffix;          // "-N": последние N байт
+    uint64_t start;
+    uint64_t end;        // включительно; UINT64_MAX - до конца
+} ByteRange;
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 1;
+}
+
+static int parse_range(const char *spec, ByteRange *range) {
+    memset(range, 0, sizeof(ByteRange));
+    range->end = UINT64_MAX;
+
+    if (strncmp(spec, "bytes=", 6) == 0) spec += 6;
+    if (strchr(spec, ',')) return 0; // несколько диапазонов не поддерживаем
+
+    const char *dash = strchr(spec, '-');
+    if (!dash) return 0;
+
+    char *endptr;
+    range->has_range = 1;
+
+    if (dash == spec) {
+        range->suffix = 1;
+        range->start = strtoull(dash + 1, &endptr, 10);
+        return (*endptr == '\0' && dash[1] != '\0');
+    }
+
+    range->start = strtoull(spec, &endptr, 10);
+    if (endptr != dash) return 0;
+
+    if (dash[1] != '\0') {
+        range->end = strtoull(dash + 1, &endptr, 10);
+        if (*endptr != '\0' || range->end < range->start) return 0;
+    }
+    return 1;
+}
+
+// Приводит диапазон к [offset, offset + length) внутри файла размера size
+static int resolve_range(const ByteRange *range, uint64_t size, uint64_t *offset, uint64_t *length) {
+    if (!range->has_range) {
+        *offset = 0;
+        *length = size;
+        return 1;
+    }
+
+    if (range->suffix) {
+        if (range->start == 0) return 0;
+        *length = range->start < size ? range->start : size;
+        *offset = size - *length;
+        return 1;
+    }
+
+    if (range->start >= size) return 0;
+
+    uint64_t last = range->end < size ? range->end : size - 1;
+    *offset = range->start;
+    *length = last - range->start + 1;
+    return 1;
+}
+
+// STORED-данные лежат в архиве как есть - отдаем их ядру через sendfile()
+static int copy_stored(int in_fd, uint64_t offset, uint64_t length) {
+    off_t pos = (off_t)offset;
+    uint64_t left = length;
+
+    while (left > 0) {
+        size_t chunk = left > 0x7ffff000 ? 0x7ffff000 : (size_t)left;
+        ssize_t sent = sendfile(STDOUT_FILENO, in_fd, &pos, chunk);
+        if (sent > 0) {
+            left -= (uint64_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) break; // stdout не поддерживает sendfile
+        return 0;
+    }
+
+    char buffer[EXTRACT_BUFFER_SIZE];
+    while (left > 0) {
+        size_t chunk = left > sizeof(buffer) ? sizeof(buffer) : (size_t)left;
+        ssize_t r = pread(in_fd, buffer, chunk, pos);
+        if (r <= 0) return 0;
+        if (!write_all(STDOUT_FILENO, buffer, (size_t)r)) return 0;
+        pos += r;
+        left -= (uint64_t)r;
+    }
+    return 1;
+}
+
+// Пишет часть распакованного потока, попадающую в диапазон [skip, skip + length)
+static int emit_window(const char *data, size_t size, uint64_t *skip, uint64_t *length) {
+    if (*skip >= size) {
+        *skip -= size;
+        return 1;
+    }
+
+    data += *skip;
+    size -= (size_t)*skip;
+    *skip = 0;
+
+    if (size > *length) size = (size_t)*length;
+    if (!write_all(STDOUT_FILENO, data, size)) return 0;
+    *length -= size;
+    return 1;
+}
+
+// DEFLATE: потоковая распаковка без промежуточного файла
+static int copy_deflated(int in_fd, uint64_t data_offset, uint64_t compressed_size,
+                         uint64_t skip, uint64_t length) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return 0;
+
+    unsigned char in_buf[EXTRACT_BUFFER_SIZE];
+    char out_buf[EXTRACT_BUFFER_SIZE];
+    uint64_t read_pos = 0;
+    int status = Z_OK;
+    int ok = 1;
+
+    while (length > 0 && status != Z_STREAM_END) {
+        if (zs.avail_in == 0) {
+            if (read_pos >= compressed_size) {
+                ok = 0;
+                break;
+            }
+            size_t chunk = compressed_size - read_pos > sizeof(in_buf) ?
+                           sizeof(in_buf) : (size_t)(compressed_size - read_pos);
+            ssize_t r = pread(in_fd, in_buf, chunk, (off_t)(data_offset + read_pos));
+            if (r <= 0) {
+                ok = 0;
+                break;
+            }
+            read_pos += (uint64_t)r;
+            zs.next_in = in_buf;
+            zs.avail_in = (uInt)r;
+        }
+
+        zs.next_out = (Bytef*)out_buf;
+        zs.avail_out = sizeof(out_buf);
+        status = inflate(&zs, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            ok = 0;
+            break;
+        }
+
+        if (!emit_window(out_buf, sizeof(out_buf) - zs.avail_out, &skip, &length)) {
+            ok = 0;
+            break;
+        }
+    }
+
+    // Поток кончился раньше запрошенного диапазона - данные записи обрезаны
+    if (ok && length > 0) {
+        fprintf(stderr, "Deflate stream ended %llu bytes before the end of the range\n",
+                (unsigned long long)length);
+        ok = 0;
+    }
+
+    inflateEnd(&zs);
+    return ok;
+}
+
+// Открывает архив и доходит до записи internal_path: ее данные читаются из *out
+static int open_libarchive_entry(const char *archive_path, const char *internal_path,
+                                 struct archive **out, struct archive_entry **entry) {
+    struct archive *a = archive_read_new();
+    archive_read_support_format_all(a);
+    archive_read_support_filter_all(a);
+
+    if (archive_read_open_filename(a, archive_path, 10240) != ARCHIVE_OK) {
+        fprintf(stderr, "Failed to open archive: %s\n", archive_error_string(a));
+        archive_read_free(a);
+        return EXTRACT_IO_ERROR;
+    }
+
+    while (archive_read_next_header(a, entry) == ARCHIVE_OK) {
+        const char *name = archive_entry_pathname(*entry);
+        if (name && strcmp(name, internal_path) == 0) {
+            *out = a;
+            return EXTRACT_OK;
+        }
+        archive_read_data_skip(a);
+    }
+
+    archive_read_close(a);
+    archive_read_free(a);
+    return EXTRACT_NOT_FOUND;
+}
+
+// Размер записи, которого нет в заголовке (потоковый 7Z, ZIP с дескриптором данных после записи):
+// запись читается до конца. -1 - ошибка распаковки
+static int64_t measure_entry(struct archive *a) {
+    char buffer[EXTRACT_BUFFER_SIZE];
+    int64_t total = 0;
+    la_ssize_t r;
+    while ((r = archive_read_data(a, buffer, sizeof(buffer))) > 0) total += r;
+    return r < 0 ? -1 : total;
+}
+
+// Запасной путь для RAR/7Z и нестандартных методов сжатия ZIP
+static int extract_with_libarchive(const char *archive_path, const char *internal_path,
+                                   const ByteRange *range, int stat_only) {
+    struct archive *a = NULL;
+    struct archive_entry *entry = NULL;
+    int result = open_libarchive_entry(archive_path, internal_path, &a, &entry);
+    if (result != EXTRACT_OK) return result;
+
+    // Размер нужен для --stat и диапазонов. Если заголовок его не содержит, запись сначала
+    // распаковывается до конца ради размера, затем архив открывается заново
+    int size_known = archive_entry_size_is_set(entry);
+    uint64_t size = size_known ? (uint64_t)archive_entry_size(entry) : 0;
+    if (!size_known && (stat_only || range->has_range)) {
+        int64_t measured = measure_entry(a);
+        if (measured < 0) fprintf(stderr, "Failed to read entry: %s\n", archive_error_string(a));
+        archive_read_close(a);
+        archive_read_free(a);
+        if (measured < 0) return EXTRACT_IO_ERROR;
+
+        size = (uint64_t)measured;
+        size_known = 1;
+        if (stat_only) {
+            printf("%llu\n", (unsigned long long)size);
+            return EXTRACT_OK;
+        }
+        result = open_libarchive_entry(archive_path, internal_path, &a, &entry);
+        if (result != EXTRACT_OK) return result;
+    }
+
+    if (stat_only) {
+        printf("%llu\n", (unsigned long long)size);
+    } else {
+        // Без размера и без диапазона запись отдается целиком, до конца ее данных
+        uint64_t skip = 0, length = UINT64_MAX;
+        if (size_known && !resolve_range(range, size, &skip, &length)) {
+            result = EXTRACT_BAD_RANGE;
+        } else {
+            char buffer[EXTRACT_BUFFER_SIZE];
+            la_ssize_t r = 0;
+            while (length > 0 && (r = archive_read_data(a, buffer, sizeof(buffer))) > 0) {
+                if (!emit_window(buffer, (size_t)r, &skip, &length)) {
+                    result = EXTRACT_IO_ERROR;
+                    break;
+                }
+            }
+            if (r < 0) {
+                fprintf(stderr, "Failed to read entry: %s\n", archive_error_string(a));
+                result = EXTRACT_IO_ERROR;
+            }
+            // Данных меньше, чем обещал заголовок - запись обрезана
+            if (size_known && length > 0) result = EXTRACT_IO_ERROR;
+        }
+    }
+
+    archive_read_close(a);
+    archive_read_free(a);
+    return result;
+}
+
+static int extract_from_zip(const char *archive_path, const char *internal_path,
+                            const ByteRange *range, int stat_only) {
+    ZipIndex *index = zip_index_load(archive_path);
+    const ZipEntryInfo *entry = zip_index_find(index, internal_path);
+
+    // Зашифрованные записи и экзотические методы отдаем libarchive
+    if (!entry || (entry->flags & 1) ||
+        (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATED)) {
+        int missing = (index && !entry);
+        zip_index_free(index);
+        if (missing) return EXTRACT_NOT_FOUND;
+        return extract_with_libarchive(archive_path, internal_path, range, stat_only);
+    }
+
+    if (stat_only) {
+        printf("%llu\n", (unsigned long long)entry->uncompressed_size);
+        zip_index_free(index);
+        return EXTRACT_OK;
+    }
+
+    uint64_t offset, length;
+    if (!resolve_range(range, entry->uncompressed_size, &offset, &length)) {
+        zip_index_free(index);
+        return EXTRACT_BAD_RANGE;
+    }
+
+    int fd = open(archive_path, O_RDONLY);
+    int64_t data_offset = fd >= 0 ? zip_entry_data_offset(fd, entry) : -1;
+    if (data_offset < 0) {
+        if (fd >= 0) close(fd);
+        zip_index_free(index);
+        return EXTRACT_IO_ERROR;
+    }
+
+    int ok;
+    if (entry->method == ZIP_METHOD_STORED) {
+        posix_fadvise(fd, (off_t)(data_offset + offset), (off_t)length, POSIX_FADV_SEQUENTIAL);
+        ok = copy_stored(fd, (uint64_t)data_offset + offset, length);
+    } else {
+        posix_fadvise(fd, (off_t)data_offset, (off_t)entry->compressed_size, POSIX_FADV_SEQUENTIAL);
+        ok = copy_deflated(fd, (uint64_t)data_offset, entry->compressed_size, offset, length);
+    }
+
+    close(fd);
+    zip_index_free(index);
+    return ok ? EXTRACT_OK : EXTRACT_IO_ERROR;
+}
+
+static int extract_plain_file(const char *filepath, const ByteRange *range, int stat_only) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd == -1) return EXTRACT_NOT_FOUND;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return EXTRACT_IO_ERROR;
+    }
+
+    if (stat_only) {
+        printf("%lld\n", (long long)st.st_size);
+        close(fd);
+        return EXTRACT_OK;
+    }
+
+    uint64_t offset, length;
+    if (!resolve_range(range, (uint64_t)st.st_size, &offset, &length)) {
+        close(fd);
+        return EXTRACT_BAD_RANGE;
+    }
+
+    int ok = copy_stored(fd, offset, length);
+    close(fd);
+    return ok ? EXTRACT_OK : EXTRACT_IO_ERROR;
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--stat] [--range=bytes=START-END] <archive> <internal_path>\n", program);
+    fprintf(stderr, "       %s [--stat] [--range=bytes=START-END] <file>\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    // Клиент может оборвать загрузку - это не ошибка сервера
+    signal(SIGPIPE, SIG_IGN);
+
+    ByteRange range = {0};
+    int stat_only = 0;
+    const char *positional[2] = {NULL, NULL};
+    int positional_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stat") == 0) {
+            stat_only = 1;
+        } else if (strncmp(argv[i], "--range=", 8) == 0) {
+            if (!parse_range(argv[i] + 8, &range)) {
+                fprintf(stderr, "Invalid range: %s\n", argv[i] + 8);
+                return EXTRACT_BAD_RANGE;
+            }
+        } else if (positional_count < 2) {
+            positional[positional_count++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return EXTRACT_USAGE;
+        }
+    }
+
+    if (positional_count == 0) {
+        print_usage(argv[0]);
+        return EXTRACT_USAGE;
+    }
+
+    if (access(positional[0], R_OK) != 0) {
+        fprintf(stderr, "Cannot access: %s\n", positional[0]);
+        return EXTRACT_NOT_FOUND;
+    }
+
+    if (positional_count == 1) {
+        return extract_plain_file(positional[0], &range, stat_only);
+    }
+
+    const char *ext = strrchr(positional[0], '.');
+    if (ext && strcasecmp(ext, ".zip") == 0) {
+        return extract_from_zip(positional[0], positional[1], &range, stat_only);
+    }
+
+    return extract_with_libarchive(positional[0], positional[1], &range, stat_only);
+}
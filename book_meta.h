@@ -1,6 +1,9 @@
 #ifndef BOOK_META_H
 #define BOOK_META_H
 
+#include <stdint.h>
+#include "arena.h"
+
 typedef struct {
     char *title;
     char *author;
@@ -12,6 +15,10 @@ typedef struct {
     char *publisher;
     char *description;
     long file_size;
+    char *file_hash;
+    char *cover_key;
+    uint64_t text_fingerprint;  // SimHash начала текста (dedupe.h), 0 - не вычислялся
+    Arena *arena;           // владелец всех строк (и самой структуры, если она из book_meta_new)
 } BookMeta;
 
 #endif
@@ -6,6 +6,42 @@
 #include <time.h>
 #include <stdarg.h>
 
+Config* create_default_config(void) {
+    Config *config = calloc(1, sizeof(Config));
+    if (!config) {
+        return NULL;
+    }
+
+    // Устанавливаем значения по умолчанию
+    config->database.type = strdup("sqlite");
+    config->database.port = 0;
+    config->database.pool_size = 4;
+    config->scanner.log_file = NULL;
+    config->scanner.rescan_unchanged = 0;
+    config->scanner.enable_inpx = 0;
+    config->scanner.clear_database_inpx = 0;
+    config->scanner.hash_algorithm = strdup("md5");
+    config->scanner.extract_covers = 0;
+    config->scanner.cover_cache_dir = NULL;
+    config->scanner.log_level = LOG_INFO; // По умолчанию INFO уровень
+    config->scanner.metrics_file = NULL;
+    config->scanner.metrics_interval = 15;
+    config->scanner.metrics_json = 0;
+    config->scanner.io_threads_per_device = 1;
+    config->scanner.parser_threads = 0;
+    config->scanner.queue_depth = 64;
+    config->sqlite.journal_mode = strdup("wal");
+    config->sqlite.synchronous = strdup("normal");
+    config->sqlite.mmap_size = 268435456LL;   // 256 МиБ
+    config->sqlite.cache_size = -65536;       // 64 МиБ
+    config->sqlite.temp_store = strdup("memory");
+    config->sqlite.busy_timeout = 5000;
+    config->sqlite.bulk_mode = SQLITE_BULK_AUTO;
+    config->log_stream = stderr;
+
+    return config;
+}
+
 Config* read_config(const char *config_path) {
     char actual_config_path[MAX_PATH];
 
@@ -42,23 +78,12 @@ Config* read_config(const char *config_path) {
         return NULL;
     }
 
-    Config *config = calloc(1, sizeof(Config));
+    Config *config = create_default_config();
     if (!config) {
         fclose(file);
         return NULL;
     }
 
-    // Устанавливаем значения по умолчанию
-    config->database.type = strdup("sqlite");
-    config->database.port = 0;
-    config->scanner.log_file = NULL;
-    config->scanner.rescan_unchanged = 0;
-    config->scanner.enable_inpx = 0;
-    config->scanner.clear_database_inpx = 0;
-    config->scanner.hash_algorithm = strdup("md5");
-    config->scanner.log_level = LOG_INFO; // По умолчанию INFO уровень
-    config->log_stream = stderr;
-
     char line[MAX_LINE];
     char current_section[64] = {0};
 
@@ -123,6 +148,8 @@ Config* read_config(const char *config_path) {
                 config->database.database = strdup(value);
             } else if (strcmp(key, "port") == 0) {
                 config->database.port = atoi(value);
+            } else if (strcmp(key, "pool_size") == 0) {
+                config->database.pool_size = atoi(value);
             }
         } else if (strcmp(current_section, "scanner") == 0) {
             if (strcmp(key, "books_dir") == 0) {
@@ -140,6 +167,24 @@ Config* read_config(const char *config_path) {
                 config->scanner.enable_inpx = (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0);
             } else if (strcmp(key, "clear_database_inpx") == 0) {
                 config->scanner.clear_database_inpx = (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0);
+            } else if (strcmp(key, "extract_covers") == 0) {
+                config->scanner.extract_covers = (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0);
+            } else if (strcmp(key, "cover_cache_dir") == 0) {
+                free(config->scanner.cover_cache_dir);
+                config->scanner.cover_cache_dir = strdup(value);
+            } else if (strcmp(key, "metrics_file") == 0) {
+                free(config->scanner.metrics_file);
+                config->scanner.metrics_file = strdup(value);
+            } else if (strcmp(key, "metrics_interval") == 0) {
+                config->scanner.metrics_interval = atoi(value);
+            } else if (strcmp(key, "metrics_json") == 0) {
+                config->scanner.metrics_json = (strcasecmp(value, "yes") == 0 || strcasecmp(value, "true") == 0 || strcmp(value, "1") == 0);
+            } else if (strcmp(key, "io_threads_per_device") == 0) {
+                config->scanner.io_threads_per_device = atoi(value);
+            } else if (strcmp(key, "parser_threads") == 0) {
+                config->scanner.parser_threads = atoi(value);
+            } else if (strcmp(key, "queue_depth") == 0) {
+                config->scanner.queue_depth = atoi(value);
             } else if (strcmp(key, "log_level") == 0) {
                 if (strcasecmp(value, "debug") == 0) {
                     config->scanner.log_level = LOG_DEBUG;
@@ -151,6 +196,31 @@ Config* read_config(const char *config_path) {
                     config->scanner.log_level = LOG_ERROR;
                 }
             }
+        } else if (strcmp(current_section, "sqlite") == 0) {
+            if (strcmp(key, "journal_mode") == 0) {
+                free(config->sqlite.journal_mode);
+                config->sqlite.journal_mode = strdup(value);
+            } else if (strcmp(key, "synchronous") == 0) {
+                free(config->sqlite.synchronous);
+                config->sqlite.synchronous = strdup(value);
+            } else if (strcmp(key, "mmap_size") == 0) {
+                config->sqlite.mmap_size = atoll(value);
+            } else if (strcmp(key, "cache_size") == 0) {
+                config->sqlite.cache_size = atoi(value);
+            } else if (strcmp(key, "temp_store") == 0) {
+                free(config->sqlite.temp_store);
+                config->sqlite.temp_store = strdup(value);
+            } else if (strcmp(key, "busy_timeout") == 0) {
+                config->sqlite.busy_timeout = atoi(value);
+            } else if (strcmp(key, "bulk_mode") == 0) {
+                if (strcasecmp(value, "yes") == 0 || strcasecmp(value, "always") == 0) {
+                    config->sqlite.bulk_mode = SQLITE_BULK_ALWAYS;
+                } else if (strcasecmp(value, "no") == 0 || strcasecmp(value, "never") == 0) {
+                    config->sqlite.bulk_mode = SQLITE_BULK_NEVER;
+                } else {
+                    config->sqlite.bulk_mode = SQLITE_BULK_AUTO;
+                }
+            }
         }
     }
 
@@ -186,10 +256,13 @@ void log_message(Config *config, const char *level, const char *format, ...) {
     }
 
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
     char timestamp[20];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
 
+    // Строки потоков сканера не перемешиваются
+    flockfile(config->log_stream);
     fprintf(config->log_stream, "[%s] %s: ", timestamp, level);
 
     va_list args;
@@ -199,6 +272,7 @@ void log_message(Config *config, const char *level, const char *format, ...) {
 
     fprintf(config->log_stream, "\n");
     fflush(config->log_stream);
+    funlockfile(config->log_stream);
 }
 
 char* find_config_file() {
@@ -246,6 +320,11 @@ void free_config(Config *config) {
     free(config->scanner.books_dir);
     free(config->scanner.log_file);
     free(config->scanner.hash_algorithm);
+    free(config->scanner.cover_cache_dir);
+    free(config->scanner.metrics_file);
+    free(config->sqlite.journal_mode);
+    free(config->sqlite.synchronous);
+    free(config->sqlite.temp_store);
 
     if (config->log_stream && config->log_stream != stderr) {
         fclose(config->log_stream);
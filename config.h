@@ -24,8 +24,27 @@ typedef struct {
     int port;
     char *socket;
     int flags;
+    int pool_size;          // соединений MySQL для параллельных потоков (db_thread_attach)
 } DatabaseConfig;
 
+// Режим массовой загрузки SQLite
+typedef enum {
+    SQLITE_BULK_AUTO = 0,   // только при первом импорте или перезагрузке INPX
+    SQLITE_BULK_ALWAYS = 1,
+    SQLITE_BULK_NEVER = 2
+} SQLiteBulkMode;
+
+// Профиль производительности SQLite (секция [sqlite])
+typedef struct {
+    char *journal_mode;     // wal, delete, truncate, persist, memory, off
+    char *synchronous;      // off, normal, full, extra
+    long long mmap_size;    // байт отображения файла в память, 0 - выключено
+    int cache_size;         // как PRAGMA cache_size: < 0 - в КиБ, > 0 - в страницах
+    char *temp_store;       // default, file, memory
+    int busy_timeout;       // мс ожидания чужой блокировки
+    SQLiteBulkMode bulk_mode;
+} SQLiteConfig;
+
 typedef struct {
     char *books_dir;
     char *log_file;
@@ -33,16 +52,27 @@ typedef struct {
     int enable_inpx;
     int clear_database_inpx;
     char *hash_algorithm;
+    int extract_covers;
+    char *cover_cache_dir;
     LogLevel log_level;  // ИСПОЛЬЗУЕМ LogLevel вместо int
+    char *metrics_file;  // textfile для node_exporter (*.prom), NULL - не писать
+    int metrics_interval; // секунд между выгрузками метрик
+    int metrics_json;    // печатать метрики в stdout строкой JSON
+    int io_threads_per_device; // потоков чтения на устройство, 0 - сканирование в одном потоке
+    int parser_threads;  // потоков разбора, 0 - по числу процессоров
+    int queue_depth;     // заданий в очереди устройства и в очереди разбора
 } ScannerConfig;
 
 typedef struct {
     DatabaseConfig database;
     ScannerConfig scanner;
+    SQLiteConfig sqlite;
     FILE *log_stream;
 } Config;
 
 Config* read_config(const char *config_path);
+// Конфигурация со значениями по умолчанию, без чтения файла (лог - в stderr)
+Config* create_default_config(void);
 char* find_config_file();
 void free_config(Config *config);
 void log_message(Config *config, const char *level, const char *format, ...);
@@ -0,0 +1,149 @@
+// cover_cache.c - предварительное извлечение обложек в файловый кэш
+#include "common.h"
+#include "cover_cache.h"
+#include "mobi.h"
+#include "utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+// Расширение по content-type, а если он не указан - по сигнатуре изображения
+static const char* cover_extension(const Fb2Cover *cover) {
+    if (strstr(cover->content_type, "png")) return "png";
+    if (strstr(cover->content_type, "gif")) return "gif";
+    if (strstr(cover->content_type, "jpeg") || strstr(cover->content_type, "jpg")) return "jpg";
+
+    if (cover->size >= 4 && memcmp(cover->data, "\x89PNG", 4) == 0) return "png";
+    if (cover->size >= 4 && memcmp(cover->data, "GIF8", 4) == 0) return "gif";
+    return "jpg";
+}
+
+static int ensure_directory(const char *path) {
+    if (mkdir(path, 0755) == 0 || errno == EEXIST) return 1;
+    return 0;
+}
+
+char* cover_cache_path(const char *cache_dir, const char *cover_key) {
+    if (!cache_dir || !cover_key || strlen(cover_key) < 2) return NULL;
+
+    size_t len = strlen(cache_dir) + strlen(cover_key) + 5;
+    char *path = malloc(len);
+    if (!path) return NULL;
+
+    snprintf(path, len, "%s/%.2s/%s", cache_dir, cover_key, cover_key);
+    return path;
+}
+
+char* cover_cache_store(const char *cache_dir, const Fb2Cover *cover, Config *config) {
+    if (!cache_dir || !cover || !cover->data || cover->size == 0) return NULL;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (EVP_Digest(cover->data, cover->size, digest, &digest_len, EVP_sha1(), NULL) != 1) {
+        return NULL;
+    }
+
+    const char *ext = cover_extension(cover);
+    char *key = malloc(digest_len * 2 + strlen(ext) + 2);
+    if (!key) return NULL;
+
+    for (unsigned int i = 0; i < digest_len; i++) {
+        sprintf(key + i * 2, "%02x", digest[i]);
+    }
+    sprintf(key + digest_len * 2, ".%s", ext);
+
+    char shard_dir[MAX_PATH];
+    snprintf(shard_dir, sizeof(shard_dir), "%s/%.2s", cache_dir, key);
+    if (!ensure_directory(cache_dir) || !ensure_directory(shard_dir)) {
+        log_message(config, "ERROR", "Cannot create cover cache directory: %s", shard_dir);
+        free(key);
+        return NULL;
+    }
+
+    char *path = cover_cache_path(cache_dir, key);
+    if (!path) {
+        free(key);
+        return NULL;
+    }
+
+    // Одинаковые обложки (дубликаты книг) хранятся один раз
+    if (access(path, F_OK) == 0) {
+        free(path);
+        return key;
+    }
+
+    char tmp_path[MAX_PATH];
+    // Одну обложку могут сохранять сразу несколько потоков разбора
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d.%lu", path, (int)getpid(), (unsigned long)pthread_self());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        log_message(config, "ERROR", "Cannot write cover: %s", tmp_path);
+        free(path);
+        free(key);
+        return NULL;
+    }
+
+    size_t written = fwrite(cover->data, 1, cover->size, file);
+    int close_result = fclose(file);
+    if (written != cover->size || close_result != 0 || rename(tmp_path, path) != 0) {
+        log_message(config, "ERROR", "Failed to store cover: %s", path);
+        unlink(tmp_path);
+        free(path);
+        free(key);
+        return NULL;
+    }
+
+    log_message(config, "DEBUG", "Stored cover %s (%zu bytes)", path, cover->size);
+    free(path);
+    return key;
+}
+
+char* extract_fb2_cover(char *content, size_t content_size, Config *config) {
+    if (!config->scanner.extract_covers || !config->scanner.cover_cache_dir) return NULL;
+
+    // Буфер сканера больше не нужен после разбора, поэтому декодируем без лишней копии
+    Fb2Cover cover;
+    if (!fb2_find_cover_inplace(content, content_size, &cover)) return NULL;
+
+    char *key = cover_cache_store(config->scanner.cover_cache_dir, &cover, config);
+    fb2_cover_free(&cover);
+    return key;
+}
+
+char* extract_fb2_cover_file(const char *filepath, Config *config) {
+    if (!config->scanner.extract_covers || !config->scanner.cover_cache_dir) return NULL;
+
+    // Обложка обычно лежит в конце FB2, поэтому файл отображается целиком
+    FileView view;
+    if (!file_view_open(filepath, NULL, &view)) return NULL;
+
+    char *key = extract_fb2_cover(view.data, view.size, config);
+    file_view_close(&view);
+    return key;
+}
+
+char* extract_mobi_cover(const char *filepath, Config *config) {
+    if (!config->scanner.extract_covers || !config->scanner.cover_cache_dir) return NULL;
+
+    Fb2Cover cover;
+    if (!mobi_read_cover(filepath, &cover)) return NULL;
+
+    char *key = cover_cache_store(config->scanner.cover_cache_dir, &cover, config);
+    fb2_cover_free(&cover);
+    return key;
+}
+
+char* extract_mobi_cover_from_memory(char *content, size_t content_size, Config *config) {
+    if (!config->scanner.extract_covers || !config->scanner.cover_cache_dir) return NULL;
+
+    Fb2Cover cover;
+    if (!mobi_find_cover(content, content_size, &cover)) return NULL;
+
+    char *key = cover_cache_store(config->scanner.cover_cache_dir, &cover, config);
+    fb2_cover_free(&cover);
+    return key;
+}
@@ -0,0 +1,21 @@
+#ifndef COVER_CACHE_H
+#define COVER_CACHE_H
+
+#include <stddef.h>
+#include "config.h"
+#include "fb2_cover.h"
+
+// Кэш обложек адресуется содержимым: <cover_cache_dir>/<2 символа ключа>/<sha1>.<ext>
+char* cover_cache_store(const char *cache_dir, const Fb2Cover *cover, Config *config);
+char* cover_cache_path(const char *cache_dir, const char *cover_key);
+
+// Стадия сканера: достает обложку из FB2, уже загруженного в память; возвращает ключ или NULL.
+// Декодирует base64 на месте, поэтому содержимое content после вызова испорчено.
+char* extract_fb2_cover(char *content, size_t content_size, Config *config);
+// То же для FB2 на диске: файл отображается в память, в страницы обложки пишет копия при записи
+char* extract_fb2_cover_file(const char *filepath, Config *config);
+// То же для MOBI/AZW3: запись обложки читается из файла или берется из памяти без копирования
+char* extract_mobi_cover(const char *filepath, Config *config);
+char* extract_mobi_cover_from_memory(char *content, size_t content_size, Config *config);
+
+#endif
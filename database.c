@@ -1,11 +1,44 @@
 #include "common.h"
 #include "database.h"
 #include "database_mysql.h"  // Добавляем заголовок MySQL
+#include "intern.h"
+#include "metrics.h"
+#include "trace.h"
+#include "text_fold.h"
+#include "utils.h"
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <time.h>
 
+static int create_search_index(DatabaseHandle *db_handle, Config *config);
+static void register_sqlite_functions(sqlite3 *db);
+static int create_trigram_index(DatabaseHandle *db_handle, Config *config);
+static int create_dictionary_tables(DatabaseHandle *db_handle, Config *config);
+static sqlite3_int64 sqlite_intern_name(sqlite3 *db, const char *table, const char *name, Config *config);
+static int sqlite_link_book_authors(sqlite3 *db, sqlite3_int64 book_id, const char *author, Config *config);
+static int sqlite_backfill_dictionaries(sqlite3 *db, Config *config);
+static void sqlite_apply_profile(sqlite3 *db, Config *config);
+
+// Соединение MySQL вызывающего потока: выданное ему из пула или основное
+static MySQLConnection* db_mysql_connection(DatabaseHandle *db_handle) {
+    MySQLConnection *own = mysql_pool_current((MySQLPool*)db_handle->pool);
+    return own ? own : (MySQLConnection*)db_handle->connection;
+}
+
+// Общее соединение (SQLite или основное MySQL) потоки сканера используют по очереди.
+// 1 - блокировка взята, ее снимает db_unlock_shared
+static int db_lock_shared(DatabaseHandle *db_handle) {
+    if (db_handle->db_type == DB_MYSQL && mysql_pool_current((MySQLPool*)db_handle->pool)) return 0;
+    pthread_mutex_lock(&db_handle->lock);
+    return 1;
+}
+
+static void db_unlock_shared(DatabaseHandle *db_handle, int locked) {
+    if (locked) pthread_mutex_unlock(&db_handle->lock);
+}
+
 DatabaseHandle* db_connect(Config *config) {
     printf("DEBUG: Attempting to connect to database type: %s\n", config->database.type);
 
@@ -17,6 +50,11 @@ DatabaseHandle* db_connect(Config *config) {
 
     db_handle->connection = NULL;
     db_handle->db_type = -1;
+    db_handle->pool = NULL;
+    pthread_mutex_init(&db_handle->lock, NULL);
+
+    // id словарей, запомненные для прежней базы, к новой не относятся
+    intern_forget_db_ids();
 
     if (strcmp(config->database.type, "sqlite") == 0) {
         printf("DEBUG: Connecting to SQLite database...\n");
@@ -24,6 +62,8 @@ DatabaseHandle* db_connect(Config *config) {
         sqlite3 *db;
         if (sqlite3_open(config->database.path, &db) == SQLITE_OK) {
             db_handle->connection = db;
+            register_sqlite_functions(db);
+            sqlite_apply_profile(db, config);
             printf("SUCCESS: Connected to SQLite database: %s\n", config->database.path);
             log_message(config, "INFO", "Connected to SQLite database: %s", config->database.path);
             return db_handle;
@@ -39,6 +79,8 @@ DatabaseHandle* db_connect(Config *config) {
         MySQLConnection *mysql_conn = mysql_conn_connect(config);
         if (mysql_conn) {
             db_handle->connection = mysql_conn;
+            // Соединения пула открываются при первом db_thread_attach
+            db_handle->pool = mysql_pool_create(config, config->database.pool_size, mysql_conn);
             printf("SUCCESS: Connected to MySQL database\n");
             return db_handle;
         } else {
@@ -52,6 +94,7 @@ DatabaseHandle* db_connect(Config *config) {
     }
 
     printf("ERROR: Database connection failed completely\n");
+    pthread_mutex_destroy(&db_handle->lock);
     free(db_handle);
     return NULL;
 }
@@ -64,21 +107,103 @@ void db_close(DatabaseHandle *db_handle) {
             sqlite3_close((sqlite3*)db_handle->connection);
             break;
         case DB_MYSQL:
+            mysql_pool_destroy((MySQLPool*)db_handle->pool);
             mysql_conn_close((MySQLConnection*)db_handle->connection);
             break;
         case DB_POSTGRESQL:
             break;
     }
+    intern_forget_db_ids();
+    pthread_mutex_destroy(&db_handle->lock);
     free(db_handle);
 }
 
+int db_thread_attach(DatabaseHandle *db_handle) {
+    if (!db_handle) return 0;
+    if (db_handle->db_type != DB_MYSQL) return 1;
+    return mysql_pool_acquire((MySQLPool*)db_handle->pool) != NULL;
+}
+
+void db_thread_detach(DatabaseHandle *db_handle) {
+    if (db_handle && db_handle->db_type == DB_MYSQL) {
+        mysql_pool_release((MySQLPool*)db_handle->pool);
+    }
+}
+
+// Значение из config.ini подставляется в PRAGMA только из списка допустимых
+static const char* sqlite_pragma_choice(const char *value, const char *const *allowed,
+                                        const char *fallback, const char *pragma, Config *config) {
+    if (value) {
+        for (int i = 0; allowed[i]; i++) {
+            if (strcasecmp(value, allowed[i]) == 0) return allowed[i];
+        }
+        log_message(config, "WARNING", "Invalid sqlite %s '%s', using %s", pragma, value, fallback);
+    }
+    return fallback;
+}
+
+static const char *const sqlite_synchronous_values[] = {"off", "normal", "full", "extra", NULL};
+
+static const char* sqlite_safe_synchronous(Config *config) {
+    return sqlite_pragma_choice(config->sqlite.synchronous, sqlite_synchronous_values,
+                                "normal", "synchronous", config);
+}
+
+// Профиль из секции [sqlite]: WAL позволяет веб-интерфейсу и GUI читать,
+// пока сканер пишет; mmap и большой кэш страниц убирают лишние read()
+static void sqlite_apply_profile(sqlite3 *db, Config *config) {
+    static const char *const journal_values[] = {"wal", "delete", "truncate", "persist", "memory", "off", NULL};
+    static const char *const temp_store_values[] = {"default", "file", "memory", NULL};
+
+    const char *journal = sqlite_pragma_choice(config->sqlite.journal_mode, journal_values,
+                                               "wal", "journal_mode", config);
+    const char *synchronous = sqlite_safe_synchronous(config);
+    const char *temp_store = sqlite_pragma_choice(config->sqlite.temp_store, temp_store_values,
+                                                  "memory", "temp_store", config);
+
+    if (config->sqlite.busy_timeout > 0) {
+        sqlite3_busy_timeout(db, config->sqlite.busy_timeout);
+    }
+
+    // journal_mode возвращает фактический режим: WAL недоступен, например, для :memory:
+    char sql[128];
+    snprintf(sql, sizeof(sql), "PRAGMA journal_mode=%s", journal);
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *actual = (const char*)sqlite3_column_text(stmt, 0);
+            if (actual && strcasecmp(actual, journal) != 0) {
+                log_message(config, "WARNING", "SQLite journal_mode=%s requested, got %s", journal, actual);
+            }
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        log_message(config, "WARNING", "Cannot set journal_mode: %s", sqlite3_errmsg(db));
+    }
+
+    snprintf(sql, sizeof(sql),
+             "PRAGMA synchronous=%s; PRAGMA cache_size=%d; PRAGMA mmap_size=%lld; PRAGMA temp_store=%s",
+             synchronous, config->sqlite.cache_size,
+             config->sqlite.mmap_size > 0 ? config->sqlite.mmap_size : 0LL, temp_store);
+    char *err_msg = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_message(config, "WARNING", "Cannot apply SQLite profile: %s", err_msg);
+        sqlite3_free(err_msg);
+    }
+
+    log_message(config, "DEBUG", "SQLite profile: journal_mode=%s synchronous=%s cache_size=%d mmap_size=%lld temp_store=%s",
+                journal, synchronous, config->sqlite.cache_size, config->sqlite.mmap_size, temp_store);
+}
+
 int db_execute(DatabaseHandle *db_handle, const char *sql, Config *config) {
     if (!db_handle || !db_handle->connection) return 0;
 
     switch (db_handle->db_type) {
         case DB_SQLITE: {
             char *err_msg = NULL;
+            trace_begin("db", "sqlite_exec", sql);
             int rc = sqlite3_exec((sqlite3*)db_handle->connection, sql, NULL, NULL, &err_msg);
+            trace_end();
             if (rc != SQLITE_OK) {
                 log_message(config, "ERROR", "SQL error: %s", err_msg);
                 sqlite3_free(err_msg);
@@ -87,7 +212,7 @@ int db_execute(DatabaseHandle *db_handle, const char *sql, Config *config) {
             return 1;
         }
         case DB_MYSQL:
-            return mysql_execute_query((MySQLConnection*)db_handle->connection, sql, config);
+            return mysql_execute_query(db_mysql_connection(db_handle), sql, config);
         default:
             return 0;
     }
@@ -121,16 +246,75 @@ int create_database_tables(DatabaseHandle *db_handle, Config *config) {
                 "    last_modified DATETIME,"
                 "    last_scanned DATETIME,"
                 "    file_mtime INTEGER,"
+                "    cover_key TEXT,"
+                "    title_key TEXT,"
+                "    author_key TEXT,"
+                "    series_key TEXT,"
+                "    text_fingerprint INTEGER,"
+                "    duplicate_of INTEGER,"
                 "    UNIQUE(file_path, archive_path, archive_internal_path)"
                 ");";
 
             if (!db_execute(db_handle, create_books_table, config)) {
                 return 0;
             }
+
+            // Колонки, добавленные после первой версии схемы
+            if (!db_ensure_column(db_handle, "books", "cover_key", "TEXT", config) ||
+                !db_ensure_column(db_handle, "books", "title_key", "TEXT", config) ||
+                !db_ensure_column(db_handle, "books", "author_key", "TEXT", config) ||
+                !db_ensure_column(db_handle, "books", "series_key", "TEXT", config) ||
+                !db_ensure_column(db_handle, "books", "text_fingerprint", "INTEGER", config) ||
+                !db_ensure_column(db_handle, "books", "duplicate_of", "INTEGER", config)) {
+                return 0;
+            }
+
+            if (!create_dictionary_tables(db_handle, config)) {
+                return 0;
+            }
+
+            // Индексы, без которых не обходится вставка: точные дубликаты по содержимому
+            // и дубликаты по названию и автору. Их не снимают даже на время массовой загрузки.
+            if (!db_execute(db_handle, "CREATE INDEX IF NOT EXISTS idx_books_file_hash ON books(file_hash)", config) ||
+                !db_execute(db_handle, "CREATE INDEX IF NOT EXISTS idx_books_title_author ON books(title, author)", config)) {
+                return 0;
+            }
+
+            // Индексы чтения; после прерванной массовой загрузки их может не быть
+            if (!db_ensure_book_indexes(db_handle, config)) {
+                return 0;
+            }
+
+            // Книги от старых версий и из GUI без ключей
+            if (!db_execute(db_handle,
+                            "UPDATE books SET title_key = fold_key(title), author_key = fold_key(author), "
+                            "series_key = fold_key(series) "
+                            "WHERE (title IS NOT NULL AND title_key IS NULL) "
+                            "OR (author IS NOT NULL AND author_key IS NULL) "
+                            "OR (series IS NOT NULL AND series_key IS NULL)", config)) {
+                return 0;
+            }
+
+            if (!sqlite_backfill_dictionaries((sqlite3*)db_handle->connection, config)) {
+                return 0;
+            }
+
+            // Полнотекстовый индекс не обязателен: без FTS5 поиск работает через LIKE
+            if (!create_search_index(db_handle, config)) {
+                log_message(config, "WARNING", "Full-text search index is not available");
+            }
+            if (!create_trigram_index(db_handle, config)) {
+                log_message(config, "WARNING", "Trigram substring index is not available");
+            }
             break;
         }
-        case DB_MYSQL:
-            return mysql_create_tables((MySQLConnection*)db_handle->connection, config);
+        case DB_MYSQL: {
+            MySQLConnection *mysql_conn = db_mysql_connection(db_handle);
+            if (!mysql_create_tables(mysql_conn, config) || !db_ensure_book_indexes(db_handle, config)) {
+                return 0;
+            }
+            return mysql_backfill_search_keys(mysql_conn, config) && mysql_backfill_dictionaries(mysql_conn, config);
+        }
         default:
             return 0;
     }
@@ -143,6 +327,607 @@ int create_database_tables(DatabaseHandle *db_handle, Config *config) {
     return 1;
 }
 
+// fold_key(text) - тот же ключ, что вычисляет сканер при вставке (text_fold.c)
+static void sqlite_fold_key(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *text = (const char*)sqlite3_value_text(argv[0]);
+    if (!text) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+
+    char *key = fold_search_key(text);
+    if (!key) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    sqlite3_result_text(ctx, key, -1, free);
+}
+
+static void register_sqlite_functions(sqlite3 *db) {
+    sqlite3_create_function(db, "fold_key", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                            sqlite_fold_key, NULL, NULL);
+}
+
+// 1, если в базе есть таблица (обычная или виртуальная) с именем name
+static int sqlite_table_exists(sqlite3 *db, const char *name) {
+    int exists = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        exists = (sqlite3_step(stmt) == SQLITE_ROW);
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
+
+// FTS5-таблица с внешним содержимым: хранит только индекс, тексты читаются из books.
+// Синхронизацию ведут триггеры, поэтому индекс видит и книги, добавленные сканером GUI.
+static int create_search_index(DatabaseHandle *db_handle, Config *config) {
+    int existed = sqlite_table_exists((sqlite3*)db_handle->connection, "books_fts");
+
+    const char *create_fts_table =
+        "CREATE VIRTUAL TABLE IF NOT EXISTS books_fts USING fts5("
+        "    title, author, series, genre,"
+        "    content='books', content_rowid='id',"
+        "    tokenize='unicode61 remove_diacritics 2'"
+        ");";
+
+    if (!db_execute(db_handle, create_fts_table, config)) {
+        return 0;
+    }
+
+    const char *create_fts_triggers =
+        "CREATE TRIGGER IF NOT EXISTS books_fts_insert AFTER INSERT ON books BEGIN"
+        "    INSERT INTO books_fts(rowid, title, author, series, genre)"
+        "    VALUES (new.id, new.title, new.author, new.series, new.genre);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS books_fts_delete AFTER DELETE ON books BEGIN"
+        "    INSERT INTO books_fts(books_fts, rowid, title, author, series, genre)"
+        "    VALUES ('delete', old.id, old.title, old.author, old.series, old.genre);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS books_fts_update AFTER UPDATE OF title, author, series, genre ON books BEGIN"
+        "    INSERT INTO books_fts(books_fts, rowid, title, author, series, genre)"
+        "    VALUES ('delete', old.id, old.title, old.author, old.series, old.genre);"
+        "    INSERT INTO books_fts(rowid, title, author, series, genre)"
+        "    VALUES (new.id, new.title, new.author, new.series, new.genre);"
+        "END;";
+
+    if (!db_execute(db_handle, create_fts_triggers, config)) {
+        return 0;
+    }
+
+    // База от старой версии: заполняем индекс по уже имеющимся книгам
+    if (!existed) {
+        log_message(config, "INFO", "Building full-text search index");
+        return db_execute(db_handle, "INSERT INTO books_fts(books_fts) VALUES ('rebuild')", config);
+    }
+    return 1;
+}
+
+// Триграммный индекс для поиска по произвольной подстроке ("толст", "ойна и").
+// Токенизатор trigram (SQLite 3.34+) сам приводит регистр, включая кириллицу.
+static int create_trigram_index(DatabaseHandle *db_handle, Config *config) {
+    int existed = sqlite_table_exists((sqlite3*)db_handle->connection, "books_trigram");
+
+    const char *create_trigram_table =
+        "CREATE VIRTUAL TABLE IF NOT EXISTS books_trigram USING fts5("
+        "    title, author, series,"
+        "    content='books', content_rowid='id',"
+        "    tokenize='trigram'"
+        ");";
+
+    if (!db_execute(db_handle, create_trigram_table, config)) {
+        return 0;
+    }
+
+    const char *create_trigram_triggers =
+        "CREATE TRIGGER IF NOT EXISTS books_trigram_insert AFTER INSERT ON books BEGIN"
+        "    INSERT INTO books_trigram(rowid, title, author, series)"
+        "    VALUES (new.id, new.title, new.author, new.series);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS books_trigram_delete AFTER DELETE ON books BEGIN"
+        "    INSERT INTO books_trigram(books_trigram, rowid, title, author, series)"
+        "    VALUES ('delete', old.id, old.title, old.author, old.series);"
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS books_trigram_update AFTER UPDATE OF title, author, series ON books BEGIN"
+        "    INSERT INTO books_trigram(books_trigram, rowid, title, author, series)"
+        "    VALUES ('delete', old.id, old.title, old.author, old.series);"
+        "    INSERT INTO books_trigram(rowid, title, author, series)"
+        "    VALUES (new.id, new.title, new.author, new.series);"
+        "END;";
+
+    if (!db_execute(db_handle, create_trigram_triggers, config)) {
+        return 0;
+    }
+
+    if (!existed) {
+        log_message(config, "INFO", "Building trigram substring index");
+        return db_execute(db_handle, "INSERT INTO books_trigram(books_trigram) VALUES ('rebuild')", config);
+    }
+    return 1;
+}
+
+// Возвращает id имени в словаре (authors, series или genres), добавляя его при необходимости; 0 при ошибке
+static sqlite3_int64 sqlite_intern_name(sqlite3 *db, const char *table, const char *name, Config *config) {
+    if (!name || !*name) return 0;
+
+    // Повторные имена (тысячи книг одного автора или жанра) не ходят в базу
+    InternKind kind = intern_kind_for_table(table);
+    sqlite3_int64 cached = intern_db_id(kind, name);
+    if (cached) return cached;
+
+    char *short_name = strdup(name);
+    if (!short_name) return 0;
+    utf8_truncate(short_name, DICT_NAME_MAX_CHARS);
+
+    char sql[256];
+    sqlite3_stmt *stmt;
+    sqlite3_int64 id = 0;
+
+    snprintf(sql, sizeof(sql), "SELECT id FROM %s WHERE name = ?", table);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, short_name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            id = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (id == 0) {
+        snprintf(sql, sizeof(sql), "INSERT INTO %s (name, name_key) VALUES (?, ?)", table);
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, short_name, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, fold_search_key(short_name), -1, free);
+            if (sqlite3_step(stmt) == SQLITE_DONE) {
+                id = sqlite3_last_insert_rowid(db);
+            } else {
+                log_message(config, "ERROR", "Failed to add '%s' to %s: %s", short_name, table, sqlite3_errmsg(db));
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    free(short_name);
+    intern_remember_db_id(kind, name, id);
+    return id;
+}
+
+// id основного (первого) жанра из списка жанров книги
+static sqlite3_int64 sqlite_intern_genre(sqlite3 *db, const char *genres, Config *config) {
+    char *genre = primary_genre(genres);
+    sqlite3_int64 id = sqlite_intern_name(db, "genres", genre, config);
+    free(genre);
+    return id;
+}
+
+// Связи книги с авторами; строка авторов может содержать несколько имен через ',' или ';'
+static int sqlite_link_book_authors(sqlite3 *db, sqlite3_int64 book_id, const char *author, Config *config) {
+    int count = 0;
+    char **names = split_author_list(author, &count);
+    if (!names) return 1;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO book_authors (book_id, author_id, position) VALUES (?, ?, ?)",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        log_message(config, "ERROR", "Failed to prepare author link: %s", sqlite3_errmsg(db));
+        free_string_list(names, count);
+        return 0;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        sqlite3_int64 author_id = sqlite_intern_name(db, "authors", names[i], config);
+        if (author_id == 0) {
+            ok = 0;
+            continue;
+        }
+
+        sqlite3_bind_int64(stmt, 1, book_id);
+        sqlite3_bind_int64(stmt, 2, author_id);
+        sqlite3_bind_int(stmt, 3, i);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            log_message(config, "ERROR", "Failed to link author '%s': %s", names[i], sqlite3_errmsg(db));
+            ok = 0;
+        }
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    free_string_list(names, count);
+    return ok;
+}
+
+// Удаляет имена словарей, на которые не ссылается ни одна книга
+static int sqlite_delete_orphan_names(sqlite3 *db, Config *config) {
+    char *error = NULL;
+    int rc = sqlite3_exec(db,
+                          "DELETE FROM authors WHERE id NOT IN (SELECT author_id FROM book_authors);"
+                          "DELETE FROM series WHERE id NOT IN (SELECT series_id FROM books WHERE series_id IS NOT NULL);"
+                          "DELETE FROM genres WHERE id NOT IN (SELECT genre_id FROM books WHERE genre_id IS NOT NULL);",
+                          NULL, NULL, &error);
+    if (rc != SQLITE_OK) {
+        log_message(config, "ERROR", "Failed to delete unused dictionary names: %s", error ? error : "unknown error");
+        sqlite3_free(error);
+        return 0;
+    }
+    return 1;
+}
+
+// Заполняет словари по книгам, которые добавлены старыми версиями или GUI и еще не связаны
+static int sqlite_backfill_dictionaries(sqlite3 *db, Config *config) {
+    const char *select_sql =
+        "SELECT id, author, series, genre FROM books b "
+        "WHERE (author IS NOT NULL AND author != '' "
+        "       AND NOT EXISTS (SELECT 1 FROM book_authors ba WHERE ba.book_id = b.id)) "
+        "OR (series_id IS NULL AND series IS NOT NULL AND series != '') "
+        "OR (genre_id IS NULL AND genre IS NOT NULL AND genre != '')";
+
+    sqlite3_stmt *select_stmt = NULL;
+    sqlite3_stmt *update_stmt = NULL;
+    if (sqlite3_prepare_v2(db, select_sql, -1, &select_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "UPDATE books SET series_id = ?, genre_id = ? WHERE id = ?",
+                           -1, &update_stmt, NULL) != SQLITE_OK) {
+        log_message(config, "ERROR", "Failed to prepare dictionary backfill: %s", sqlite3_errmsg(db));
+        sqlite3_finalize(select_stmt);
+        sqlite3_finalize(update_stmt);
+        return 0;
+    }
+
+    // Одна транзакция на весь проход: иначе каждая вставка в словарь - отдельный fsync
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+    long linked = 0;
+    int ok = 1;
+    while (ok && sqlite3_step(select_stmt) == SQLITE_ROW) {
+        sqlite3_int64 book_id = sqlite3_column_int64(select_stmt, 0);
+        const char *author = (const char*)sqlite3_column_text(select_stmt, 1);
+        const char *series = (const char*)sqlite3_column_text(select_stmt, 2);
+        const char *genre = (const char*)sqlite3_column_text(select_stmt, 3);
+
+        sqlite3_int64 series_id = sqlite_intern_name(db, "series", series, config);
+        sqlite3_int64 genre_id = sqlite_intern_genre(db, genre, config);
+
+        if (series_id) sqlite3_bind_int64(update_stmt, 1, series_id); else sqlite3_bind_null(update_stmt, 1);
+        if (genre_id) sqlite3_bind_int64(update_stmt, 2, genre_id); else sqlite3_bind_null(update_stmt, 2);
+        sqlite3_bind_int64(update_stmt, 3, book_id);
+        ok = (sqlite3_step(update_stmt) == SQLITE_DONE) && sqlite_link_book_authors(db, book_id, author, config);
+        sqlite3_reset(update_stmt);
+        linked++;
+    }
+
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(update_stmt);
+
+    if (!ok) {
+        log_message(config, "ERROR", "Dictionary backfill failed: %s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        intern_forget_db_ids();
+        return 0;
+    }
+
+    // Имена, на которые больше не ссылается ни одна книга (книги удалены из GUI)
+    sqlite_delete_orphan_names(db, config);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    intern_forget_db_ids();
+
+    if (linked > 0) {
+        log_message(config, "INFO", "Linked %ld books to author/series/genre dictionaries", linked);
+    }
+    return 1;
+}
+
+// Словари авторов, серий и жанров с целочисленными id. Навигация (GUI, OPDS) читает
+// несколько тысяч строк словаря вместо SELECT DISTINCT по всей таблице books.
+static int create_dictionary_tables(DatabaseHandle *db_handle, Config *config) {
+    const char *create_dictionaries =
+        "CREATE TABLE IF NOT EXISTS authors ("
+        "    id INTEGER PRIMARY KEY,"
+        "    name TEXT NOT NULL UNIQUE,"
+        "    name_key TEXT"
+        ");"
+        "CREATE TABLE IF NOT EXISTS series ("
+        "    id INTEGER PRIMARY KEY,"
+        "    name TEXT NOT NULL UNIQUE,"
+        "    name_key TEXT"
+        ");"
+        "CREATE TABLE IF NOT EXISTS genres ("
+        "    id INTEGER PRIMARY KEY,"
+        "    name TEXT NOT NULL UNIQUE,"
+        "    name_key TEXT"
+        ");"
+        "CREATE TABLE IF NOT EXISTS book_authors ("
+        "    book_id INTEGER NOT NULL,"
+        "    author_id INTEGER NOT NULL,"
+        "    position INTEGER NOT NULL DEFAULT 0,"
+        "    PRIMARY KEY (book_id, author_id)"
+        ") WITHOUT ROWID;"
+        "CREATE INDEX IF NOT EXISTS idx_authors_name_key ON authors(name_key);"
+        "CREATE INDEX IF NOT EXISTS idx_series_name_key ON series(name_key);"
+        "CREATE INDEX IF NOT EXISTS idx_book_authors_author ON book_authors(author_id, book_id);"
+        // Связи удаляются вместе с книгой, кто бы ее ни удалил
+        "CREATE TRIGGER IF NOT EXISTS book_authors_delete AFTER DELETE ON books BEGIN"
+        "    DELETE FROM book_authors WHERE book_id = old.id;"
+        "END;";
+
+    if (!db_execute(db_handle, create_dictionaries, config)) {
+        return 0;
+    }
+
+    return db_ensure_column(db_handle, "books", "series_id", "INTEGER", config) &&
+           db_ensure_column(db_handle, "books", "genre_id", "INTEGER", config);
+}
+
+// Индексы чтения для запросов GUI и OPDS. Сканер сам создает их, снимает на время массовой
+// загрузки и строит заново в конце - ручные SCRIPTS/create_index.sh больше не нужны.
+// В MySQL колонки TEXT индексируются по префиксу, поэтому там индексы не покрывающие.
+typedef struct {
+    const char *name;
+    const char *sqlite_columns;
+    const char *mysql_columns;
+} BookIndex;
+
+static const BookIndex book_indexes[] = {
+    // Книги автора по сериям: WHERE author = ? ORDER BY series, series_number, title
+    { "idx_books_author_series", "author, series, series_number, title",
+      "author(100), series(100), series_number, title(100)" },
+    // Книги серии по порядку
+    { "idx_books_series_number", "series, series_number", "series(100), series_number" },
+    // Книги жанра по названию
+    { "idx_books_genre_title", "genre, title", "genre(50), title(100)" },
+    // Новые поступления
+    { "idx_books_added_date", "added_date", "added_date" },
+    // Книги архива
+    { "idx_books_archive_path", "archive_path", "archive_path(255)" },
+    // Просмотр по буквам и сортировка по нормализованным ключам
+    { "idx_books_author_key", "author_key, title_key", "author_key, title_key" },
+    { "idx_books_title_key", "title_key", "title_key" },
+    { "idx_books_series_key", "series_key", "series_key" },
+    // Книги серии и жанра из словарей
+    { "idx_books_series_id", "series_id, series_number", "series_id, series_number" },
+    { "idx_books_genre_id", "genre_id", "genre_id" },
+    // Другие издания книги, найденные по отпечатку текста (dedupe.c)
+    { "idx_books_duplicate_of", "duplicate_of", "duplicate_of" },
+};
+
+#define BOOK_INDEX_COUNT (int)(sizeof(book_indexes) / sizeof(book_indexes[0]))
+
+int db_ensure_book_indexes(DatabaseHandle *db_handle, Config *config) {
+    if (!db_handle || !db_handle->connection) return 0;
+
+    for (int i = 0; i < BOOK_INDEX_COUNT; i++) {
+        const BookIndex *index = &book_indexes[i];
+        int ok = 0;
+
+        switch (db_handle->db_type) {
+            case DB_SQLITE: {
+                char sql[512];
+                snprintf(sql, sizeof(sql), "CREATE INDEX IF NOT EXISTS %s ON books(%s)",
+                         index->name, index->sqlite_columns);
+                ok = db_execute(db_handle, sql, config);
+                break;
+            }
+            case DB_MYSQL:
+                ok = mysql_ensure_index(db_mysql_connection(db_handle), "books",
+                                        index->name, index->mysql_columns, config);
+                break;
+            default:
+                return 0;
+        }
+
+        if (!ok) {
+            log_message(config, "ERROR", "Failed to create index %s", index->name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int db_drop_book_indexes(DatabaseHandle *db_handle, Config *config) {
+    if (!db_handle || !db_handle->connection) return 0;
+
+    for (int i = 0; i < BOOK_INDEX_COUNT; i++) {
+        const BookIndex *index = &book_indexes[i];
+        int ok = 0;
+
+        switch (db_handle->db_type) {
+            case DB_SQLITE: {
+                char sql[256];
+                snprintf(sql, sizeof(sql), "DROP INDEX IF EXISTS %s", index->name);
+                ok = db_execute(db_handle, sql, config);
+                break;
+            }
+            case DB_MYSQL:
+                ok = mysql_drop_index(db_mysql_connection(db_handle), "books", index->name, config);
+                break;
+            default:
+                return 0;
+        }
+
+        if (!ok) {
+            log_message(config, "ERROR", "Failed to drop index %s", index->name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Массовая загрузка - первое наполнение пустой базы или INPX-импорт с очисткой:
+// вставка без индексов чтения и одно построение каждого индекса в конце
+// дешевле, чем обновлять десяток B-деревьев на каждую книгу.
+static int db_books_empty(DatabaseHandle *db_handle) {
+    int empty = 0;
+
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2((sqlite3*)db_handle->connection, "SELECT 1 FROM books LIMIT 1",
+                                   -1, &stmt, NULL) == SQLITE_OK) {
+                empty = (sqlite3_step(stmt) == SQLITE_DONE);
+                sqlite3_finalize(stmt);
+            }
+            break;
+        }
+        case DB_MYSQL: {
+            MySQLConnection *mysql_conn = db_mysql_connection(db_handle);
+            if (mysql_query(mysql_conn->mysql, "SELECT 1 FROM books LIMIT 1") == 0) {
+                MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+                if (result) {
+                    empty = (mysql_num_rows(result) == 0);
+                    mysql_free_result(result);
+                }
+            }
+            break;
+        }
+    }
+    return empty;
+}
+
+// Режим bulk для SQLite: без fsync и с монопольной блокировкой файла.
+// Сбой питания посреди импорта может испортить базу, поэтому режим включается
+// только при первом наполнении (или явно через bulk_mode = always)
+static int sqlite_enter_bulk_mode(DatabaseHandle *db_handle, Config *config) {
+    log_message(config, "INFO", "SQLite bulk mode: synchronous=OFF, exclusive locking");
+    return db_execute(db_handle, "PRAGMA synchronous=OFF; PRAGMA locking_mode=EXCLUSIVE", config);
+}
+
+static int sqlite_leave_bulk_mode(DatabaseHandle *db_handle, Config *config) {
+    char sql[128];
+    snprintf(sql, sizeof(sql), "PRAGMA synchronous=%s; PRAGMA locking_mode=NORMAL",
+             sqlite_safe_synchronous(config));
+    if (!db_execute(db_handle, sql, config)) {
+        return 0;
+    }
+
+    // Checkpoint переносит WAL в основной файл, обрезает журнал и заодно
+    // обращается к базе - только после этого монопольная блокировка снимается
+    log_message(config, "INFO", "SQLite bulk mode finished, checkpointing WAL");
+    return db_execute(db_handle, "PRAGMA wal_checkpoint(TRUNCATE)", config);
+}
+
+int db_begin_bulk_load(DatabaseHandle *db_handle, Config *config) {
+    if (!db_handle || !db_handle->connection) return 0;
+
+    int inpx_reload = config->scanner.enable_inpx && config->scanner.clear_database_inpx;
+    int first_load = inpx_reload || db_books_empty(db_handle);
+    int bulk_load = 0;
+
+    if (first_load) {
+        log_message(config, "INFO", "Bulk load: dropping read indexes until the import finishes");
+        printf("INFO: Bulk load mode - read indexes are rebuilt after the import\n");
+
+        if (db_drop_book_indexes(db_handle, config)) {
+            bulk_load |= DB_BULK_INDEXES;
+        } else {
+            // Часть индексов могла остаться - восстанавливаем набор и грузим в обычном режиме
+            db_ensure_book_indexes(db_handle, config);
+        }
+    }
+
+    if (db_handle->db_type == DB_SQLITE &&
+        (config->sqlite.bulk_mode == SQLITE_BULK_ALWAYS ||
+         (config->sqlite.bulk_mode == SQLITE_BULK_AUTO && first_load))) {
+        if (sqlite_enter_bulk_mode(db_handle, config)) {
+            bulk_load |= DB_BULK_SQLITE_PRAGMAS;
+        }
+    }
+    return bulk_load;
+}
+
+int db_end_bulk_load(DatabaseHandle *db_handle, int bulk_load, Config *config) {
+    if (!db_handle || !db_handle->connection) return 0;
+
+    int rebuilt = (bulk_load & DB_BULK_INDEXES) != 0;
+    int ok = 1;
+
+    // Последний неполный пакет MySQL должен попасть в таблицу до индексов и ANALYZE
+    int flushed = db_handle->db_type != DB_MYSQL ||
+                  mysql_flush_books(db_mysql_connection(db_handle), config);
+
+    // Имена, оставшиеся от замененных изданий и неудачных пакетов. Ошибка здесь не мешает
+    // загрузке: сироты только занимают место и будут удалены в следующий раз
+    switch (db_handle->db_type) {
+        case DB_SQLITE:
+            sqlite_delete_orphan_names((sqlite3*)db_handle->connection, config);
+            break;
+        case DB_MYSQL:
+            mysql_delete_orphan_names(db_mysql_connection(db_handle), config);
+            break;
+        default:
+            break;
+    }
+    intern_forget_db_ids();
+
+    if (rebuilt) {
+        log_message(config, "INFO", "Bulk load finished, rebuilding read indexes");
+        printf("INFO: Rebuilding read indexes...\n");
+        ok = db_ensure_book_indexes(db_handle, config);
+    }
+
+    // Статистика для планировщика: после массовой загрузки - полный ANALYZE,
+    // после обычного сканирования SQLite сам решает, какие таблицы пересчитать
+    if (ok) {
+        switch (db_handle->db_type) {
+            case DB_SQLITE:
+                ok = db_execute(db_handle, rebuilt ? "ANALYZE" : "PRAGMA optimize", config);
+                break;
+            case DB_MYSQL:
+                if (rebuilt) {
+                    ok = db_execute(db_handle, "ANALYZE TABLE books, authors, series, genres, book_authors", config);
+                }
+                break;
+            default:
+                ok = 0;
+        }
+    }
+
+    // Безопасные настройки возвращаются даже если перестроение не удалось
+    if ((bulk_load & DB_BULK_SQLITE_PRAGMAS) && !sqlite_leave_bulk_mode(db_handle, config)) {
+        ok = 0;
+    }
+    return ok && flushed;
+}
+
+int db_ensure_column(DatabaseHandle *db_handle, const char *table, const char *column,
+                     const char *definition, Config *config) {
+    if (!db_handle || !db_handle->connection) return 0;
+
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3 *db = (sqlite3*)db_handle->connection;
+            char sql[512];
+            snprintf(sql, sizeof(sql), "PRAGMA table_info(%s)", table);
+
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+                log_message(config, "ERROR", "Failed to read schema of %s: %s", table, sqlite3_errmsg(db));
+                return 0;
+            }
+
+            int exists = 0;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char *name = (const char*)sqlite3_column_text(stmt, 1);
+                if (name && strcmp(name, column) == 0) {
+                    exists = 1;
+                    break;
+                }
+            }
+            sqlite3_finalize(stmt);
+
+            if (exists) return 1;
+
+            snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s", table, column, definition);
+            log_message(config, "INFO", "Adding column %s.%s", table, column);
+            return db_execute(db_handle, sql, config);
+        }
+        case DB_MYSQL:
+            return mysql_ensure_column(db_mysql_connection(db_handle), table, column, definition, config);
+        default:
+            return 0;
+    }
+}
+
 int create_archive_table(DatabaseHandle *db_handle, Config *config) {
     if (!db_handle || !db_handle->connection) return 0;
 
@@ -166,7 +951,7 @@ int create_archive_table(DatabaseHandle *db_handle, Config *config) {
             break;
         }
         case DB_MYSQL:
-            return mysql_create_archive_table((MySQLConnection*)db_handle->connection, config);
+            return mysql_create_archive_table(db_mysql_connection(db_handle), config);
         default:
             return 0;
     }
@@ -174,7 +959,8 @@ int create_archive_table(DatabaseHandle *db_handle, Config *config) {
 }
 
 
-int archive_needs_rescan(DatabaseHandle *db_handle, const char *archive_path, const char *current_hash, Config *config) {
+static int check_archive_rescan(DatabaseHandle *db_handle, const char *archive_path, const char *current_hash,
+                                Config *config) {
     if (!db_handle || !db_handle->connection) {
         printf("DEBUG: [ARCHIVE_NEEDS_RESCAN] No database connection\n");
         return 1; // Нет соединения - нужно сканировать
@@ -251,7 +1037,7 @@ int archive_needs_rescan(DatabaseHandle *db_handle, const char *archive_path, co
         }
 
         case DB_MYSQL:
-            return mysql_archive_needs_rescan((MySQLConnection*)db_handle->connection, archive_path, current_hash, config);
+            return mysql_archive_needs_rescan(db_mysql_connection(db_handle), archive_path, current_hash, config);
 
         default:
             printf("ERROR: [ARCHIVE_NEEDS_RESCAN] Unknown database type: %d\n", db_handle->db_type);
@@ -261,8 +1047,16 @@ int archive_needs_rescan(DatabaseHandle *db_handle, const char *archive_path, co
     return 1; // По умолчанию нужно сканировать
 }
 
-void update_archive_info(DatabaseHandle *db_handle, const char *archive_path, const char *hash,
-                        int file_count, long total_size, Config *config) {
+int archive_needs_rescan(DatabaseHandle *db_handle, const char *archive_path, const char *current_hash, Config *config) {
+    if (!db_handle) return 1;
+    int locked = db_lock_shared(db_handle);
+    int needs_rescan = check_archive_rescan(db_handle, archive_path, current_hash, config);
+    db_unlock_shared(db_handle, locked);
+    return needs_rescan;
+}
+
+static void store_archive_info(DatabaseHandle *db_handle, const char *archive_path, const char *hash,
+                               int file_count, long total_size, Config *config) {
     if (!db_handle || !db_handle->connection) return;
 
     switch (db_handle->db_type) {
@@ -293,13 +1087,22 @@ void update_archive_info(DatabaseHandle *db_handle, const char *archive_path, co
             break;
         }
         case DB_MYSQL:
-            mysql_update_archive_info((MySQLConnection*)db_handle->connection, archive_path, hash, file_count, total_size, config);
+            mysql_pool_update_archive_info((MySQLPool*)db_handle->pool, db_mysql_connection(db_handle),
+                                           archive_path, hash, file_count, total_size, config);
             break;
         default:
             break;
     }
 }
 
+void update_archive_info(DatabaseHandle *db_handle, const char *archive_path, const char *hash,
+                        int file_count, long total_size, Config *config) {
+    if (!db_handle) return;
+    int locked = db_lock_shared(db_handle);
+    store_archive_info(db_handle, archive_path, hash, file_count, total_size, config);
+    db_unlock_shared(db_handle, locked);
+}
+
 int book_exists(DatabaseHandle *db_handle, const char *filepath, const char *archive_path,
                 const char *internal_path, const char *file_hash, Config *config) {
     if (!db_handle || !db_handle->connection) return 0;
@@ -347,7 +1150,7 @@ int book_exists(DatabaseHandle *db_handle, const char *filepath, const char *arc
             break;
         }
         case DB_MYSQL:
-            return mysql_book_exists((MySQLConnection*)db_handle->connection, filepath, archive_path, internal_path, file_hash, config);
+            return mysql_book_exists(db_mysql_connection(db_handle), filepath, archive_path, internal_path, file_hash, config);
         default:
             return 0;
     }
@@ -355,8 +1158,8 @@ int book_exists(DatabaseHandle *db_handle, const char *filepath, const char *arc
     return 0;
 }
 
-void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta *meta,
-                      const char *archive_path, const char *internal_path, Config *config) {
+static void insert_book(DatabaseHandle *db_handle, const char *filepath, BookMeta *meta,
+                        const char *archive_path, const char *internal_path, Config *config) {
     if (!db_handle || !db_handle->connection) {
         printf("ERROR: [INSERT_BOOK_TO_DB] Database handle or connection is NULL\n");
         return;
@@ -380,6 +1183,28 @@ void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta
             printf("DEBUG: [INSERT_BOOK_TO_DB] Using SQLite\n");
             sqlite3 *db = (sqlite3*)db_handle->connection;
 
+            // ТОЧНЫЙ ДУБЛИКАТ: тот же файл уже есть (в том числе в другом архиве)
+            if (meta->file_hash) {
+                const char *hash_sql = "SELECT id FROM books WHERE file_hash = ? LIMIT 1";
+                sqlite3_stmt *hash_stmt;
+
+                if (sqlite3_prepare_v2(db, hash_sql, -1, &hash_stmt, NULL) == SQLITE_OK) {
+                    sqlite3_bind_text(hash_stmt, 1, meta->file_hash, -1, SQLITE_STATIC);
+
+                    trace_begin("db", "sqlite_hash_lookup", NULL);
+                    int hash_rc = sqlite3_step(hash_stmt);
+                    trace_end();
+                    if (hash_rc == SQLITE_ROW) {
+                        printf("DEBUG: [INSERT_BOOK_TO_DB] Exact duplicate (hash %s) of ID=%d, skipping\n",
+                               meta->file_hash, sqlite3_column_int(hash_stmt, 0));
+                        metrics_inc(METRIC_BOOKS_SKIPPED_DUPLICATE_HASH);
+                        sqlite3_finalize(hash_stmt);
+                        return;
+                    }
+                    sqlite3_finalize(hash_stmt);
+                }
+            }
+
             // ПРОВЕРЯЕМ СУЩЕСТВОВАНИЕ КНИГИ ПО АВТОРУ И НАЗВАНИЮ
             if (meta->title && meta->author) {
                 const char *check_sql = "SELECT COUNT(*) FROM books WHERE title = ? AND author = ?";
@@ -389,13 +1214,17 @@ void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta
                     sqlite3_bind_text(check_stmt, 1, meta->title, -1, SQLITE_STATIC);
                     sqlite3_bind_text(check_stmt, 2, meta->author, -1, SQLITE_STATIC);
 
-                    if (sqlite3_step(check_stmt) == SQLITE_ROW) {
+                    trace_begin("db", "sqlite_exists_check", NULL);
+                    int check_rc = sqlite3_step(check_stmt);
+                    trace_end();
+                    if (check_rc == SQLITE_ROW) {
                         int count = sqlite3_column_int(check_stmt, 0);
                         printf("DEBUG: [INSERT_BOOK_TO_DB] Book exists count: %d\n", count);
 
                         if (count > 0) {
                             printf("DEBUG: [INSERT_BOOK_TO_DB] Book already exists, skipping: '%s' by '%s'\n",
                                    meta->title, meta->author);
+                            metrics_inc(METRIC_BOOKS_SKIPPED_EXISTING);
                             sqlite3_finalize(check_stmt);
                             return;
                         }
@@ -407,13 +1236,15 @@ void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta
             // Если книги нет - вставляем
             const char *sql = "INSERT INTO books (file_path, file_name, file_size, file_type, "
                               "archive_path, archive_internal_path, title, author, genre, series, "
-                              "series_number, year, language, publisher, description, last_modified) "
-                              "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, CURRENT_TIMESTAMP)";
+                              "series_number, year, language, publisher, description, file_hash, cover_key, "
+                              "title_key, author_key, series_key, series_id, genre_id, text_fingerprint, last_modified) "
+                              "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, CURRENT_TIMESTAMP)";
 
             sqlite3_stmt *stmt;
             int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
             if (rc != SQLITE_OK) {
                 log_message(config, "ERROR", "Failed to prepare SQL statement: %s", sqlite3_errmsg(db));
+                metrics_inc(METRIC_ERRORS_DB);
                 return;
             }
 
@@ -449,22 +1280,57 @@ void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta
             } else {
                 sqlite3_bind_text(stmt, 15, meta->description, -1, SQLITE_STATIC);
             }
+            sqlite3_bind_text(stmt, 16, meta->file_hash, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 17, meta->cover_key, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 18, fold_search_key(meta->title), -1, free);
+            sqlite3_bind_text(stmt, 19, fold_search_key(meta->author), -1, free);
+            sqlite3_bind_text(stmt, 20, fold_search_key(meta->series), -1, free);
+
+            // Словари, книга и ее связи с авторами пишутся вместе: при ошибке не остается ни
+            // имен без книг, ни книги без связей
+            sqlite3_exec(db, "SAVEPOINT insert_book", NULL, NULL, NULL);
+            sqlite3_int64 series_id = sqlite_intern_name(db, "series", meta->series, config);
+            sqlite3_int64 genre_id = sqlite_intern_genre(db, meta->genre, config);
+            if (series_id) sqlite3_bind_int64(stmt, 21, series_id); else sqlite3_bind_null(stmt, 21);
+            if (genre_id) sqlite3_bind_int64(stmt, 22, genre_id); else sqlite3_bind_null(stmt, 22);
+            // INTEGER в SQLite знаковый: отпечаток хранится как те же 64 бита
+            if (meta->text_fingerprint) {
+                sqlite3_bind_int64(stmt, 23, (sqlite3_int64)meta->text_fingerprint);
+            } else {
+                sqlite3_bind_null(stmt, 23);
+            }
 
+            trace_begin("db", "sqlite_insert", NULL);
             rc = sqlite3_step(stmt);
+            trace_end();
+            int linked = 0;
             if (rc != SQLITE_DONE) {
                 log_message(config, "ERROR", "Failed to insert book: %s", sqlite3_errmsg(db));
             } else {
-                printf("DEBUG: [INSERT_BOOK_TO_DB] Book inserted successfully\n");
+                trace_begin("db", "sqlite_link_authors", NULL);
+                linked = sqlite_link_book_authors(db, sqlite3_last_insert_rowid(db), meta->author, config);
+                trace_end();
             }
-
             sqlite3_finalize(stmt);
+
+            if (linked) {
+                printf("DEBUG: [INSERT_BOOK_TO_DB] Book inserted successfully\n");
+                metrics_inc(METRIC_BOOKS_INSERTED);
+            } else {
+                // Откаченные имена могли попасть в кэш id словарей
+                sqlite3_exec(db, "ROLLBACK TO insert_book", NULL, NULL, NULL);
+                intern_forget_db_ids();
+                metrics_inc(METRIC_ERRORS_DB);
+            }
+            sqlite3_exec(db, "RELEASE insert_book", NULL, NULL, NULL);
             break;
         }
         case DB_MYSQL: {
             printf("DEBUG: [INSERT_BOOK_TO_DB] Using MySQL\n");
-            MySQLConnection *mysql_conn = (MySQLConnection*)db_handle->connection;
+            MySQLConnection *mysql_conn = db_mysql_connection(db_handle);
 
-            if (!mysql_conn || !mysql_conn->mysql) {
+            // mysql == NULL после неудачного переподключения: mysql_insert_book попробует снова
+            if (!mysql_conn) {
                 printf("ERROR: [INSERT_BOOK_TO_DB] MySQL connection is invalid\n");
                 return;
             }
@@ -477,3 +1343,310 @@ void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta
             break;
     }
 }
+
+void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta *meta,
+                      const char *archive_path, const char *internal_path, Config *config) {
+    double started = metrics_now();
+    trace_begin("db", "insert_book", internal_path ? internal_path : filepath);
+    int locked = db_handle ? db_lock_shared(db_handle) : 0;
+    insert_book(db_handle, filepath, meta, archive_path, internal_path, config);
+    if (db_handle) db_unlock_shared(db_handle, locked);
+    trace_end();
+    metrics_observe(METRIC_HIST_DB_INSERT, metrics_now() - started);
+    metrics_maybe_flush();
+}
+
+// Превращает пользовательский ввод в запрос FTS5: каждое слово - префикс в кавычках ("толст"* "война"*)
+static char* build_fts_query(const char *input) {
+    size_t len = strlen(input);
+    char *query = malloc(len * 2 + 16);
+    if (!query) return NULL;
+
+    char *out = query;
+    const char *p = input;
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+
+        if (out != query) *out++ = ' ';
+        *out++ = '"';
+        while (*p && !isspace((unsigned char)*p)) {
+            if (*p == '"') *out++ = '"';
+            *out++ = *p++;
+        }
+        *out++ = '"';
+        *out++ = '*';
+    }
+    *out = '\0';
+
+    if (out == query) {
+        free(query);
+        return NULL;
+    }
+    return query;
+}
+
+// Читает строки (id, title, author, series, score) подготовленного запроса в массив hits
+static int collect_search_hits(sqlite3 *db, sqlite3_stmt *stmt, BookSearchHit **hits, Config *config) {
+    int capacity = 0;
+    int count = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            BookSearchHit *grown = realloc(*hits, capacity * sizeof(BookSearchHit));
+            if (!grown) break;
+            *hits = grown;
+        }
+
+        BookSearchHit *hit = &(*hits)[count++];
+        const char *title = (const char*)sqlite3_column_text(stmt, 1);
+        const char *author = (const char*)sqlite3_column_text(stmt, 2);
+        const char *series = (const char*)sqlite3_column_text(stmt, 3);
+
+        hit->id = sqlite3_column_int(stmt, 0);
+        hit->title = title ? strdup(title) : NULL;
+        hit->author = author ? strdup(author) : NULL;
+        hit->series = series ? strdup(series) : NULL;
+        hit->score = sqlite3_column_double(stmt, 4);
+    }
+
+    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        log_message(config, "ERROR", "Search failed: %s", sqlite3_errmsg(db));
+    }
+    return count;
+}
+
+int db_search_books(DatabaseHandle *db_handle, const char *query, int limit,
+                    BookSearchHit **hits, Config *config) {
+    if (!db_handle || !db_handle->connection || !query || !hits) return -1;
+    *hits = NULL;
+
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3 *db = (sqlite3*)db_handle->connection;
+            char *fts_query = build_fts_query(query);
+            if (!fts_query) return 0;
+
+            // bm25 отрицателен и тем меньше, чем релевантнее; название весит больше автора, серии и жанра
+            const char *sql =
+                "SELECT b.id, b.title, b.author, b.series, -bm25(books_fts, 10.0, 5.0, 2.0, 1.0) AS score "
+                "FROM books_fts JOIN books b ON b.id = books_fts.rowid "
+                "WHERE books_fts MATCH ? ORDER BY score DESC LIMIT ?";
+
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+                log_message(config, "ERROR", "Failed to prepare search query: %s", sqlite3_errmsg(db));
+                free(fts_query);
+                return -1;
+            }
+
+            sqlite3_bind_text(stmt, 1, fts_query, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, limit > 0 ? limit : 50);
+
+            int count = collect_search_hits(db, stmt, hits, config);
+
+            sqlite3_finalize(stmt);
+            free(fts_query);
+            return count;
+        }
+        case DB_MYSQL:
+            return mysql_search_books(db_mysql_connection(db_handle), query, limit, hits, config);
+        default:
+            return -1;
+    }
+}
+
+// Число символов UTF-8 (не байт): триграммы строятся по символам
+static size_t utf8_length(const char *s) {
+    size_t n = 0;
+    for (; *s; s++) {
+        if (((unsigned char)*s & 0xC0) != 0x80) n++;
+    }
+    return n;
+}
+
+int db_search_substring(DatabaseHandle *db_handle, const char *fragment, int limit,
+                        BookSearchHit **hits, Config *config) {
+    if (!db_handle || !db_handle->connection || !fragment || !hits) return -1;
+    *hits = NULL;
+
+    // Пробелы по краям не значимы, внутри - часть подстроки ("war and")
+    while (isspace((unsigned char)*fragment)) fragment++;
+    size_t len = strlen(fragment);
+    while (len > 0 && isspace((unsigned char)fragment[len - 1])) len--;
+    if (len == 0) return 0;
+
+    char *trimmed = strndup(fragment, len);
+    if (!trimmed) return -1;
+
+    int count = -1;
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3 *db = (sqlite3*)db_handle->connection;
+            char *match = NULL;
+            const char *sql;
+
+            // Подстрока из 3+ символов - фраза в триграммном индексе; короче - обычный LIKE
+            if (utf8_length(trimmed) >= 3 && sqlite_table_exists(db, "books_trigram")) {
+                match = malloc(len * 2 + 3);
+                if (!match) break;
+
+                char *out = match;
+                *out++ = '"';
+                for (const char *p = trimmed; *p; p++) {
+                    if (*p == '"') *out++ = '"';
+                    *out++ = *p;
+                }
+                *out++ = '"';
+                *out = '\0';
+
+                sql = "SELECT b.id, b.title, b.author, b.series, 0.0 "
+                      "FROM books_trigram JOIN books b ON b.id = books_trigram.rowid "
+                      "WHERE books_trigram MATCH ? ORDER BY b.author, b.title LIMIT ?";
+            } else {
+                match = malloc(len + 3);
+                if (!match) break;
+                snprintf(match, len + 3, "%%%s%%", trimmed);
+
+                sql = "SELECT id, title, author, series, 0.0 FROM books "
+                      "WHERE title LIKE ?1 OR author LIKE ?1 OR series LIKE ?1 ORDER BY author, title LIMIT ?2";
+            }
+
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+                log_message(config, "ERROR", "Failed to prepare substring query: %s", sqlite3_errmsg(db));
+                free(match);
+                break;
+            }
+
+            sqlite3_bind_text(stmt, 1, match, -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, limit > 0 ? limit : 50);
+
+            count = collect_search_hits(db, stmt, hits, config);
+
+            sqlite3_finalize(stmt);
+            free(match);
+            break;
+        }
+        case DB_MYSQL:
+            count = mysql_search_substring(db_mysql_connection(db_handle), trimmed, limit, hits, config);
+            break;
+        default:
+            break;
+    }
+
+    free(trimmed);
+    return count;
+}
+
+void free_search_hits(BookSearchHit *hits, int count) {
+    if (!hits) return;
+
+    for (int i = 0; i < count; i++) {
+        free(hits[i].title);
+        free(hits[i].author);
+        free(hits[i].series);
+    }
+    free(hits);
+}
+
+// Книги с отпечатком и число заполненных полей метаданных; запрос одинаков для SQLite и MySQL
+static const char *dedupe_select_sql =
+    "SELECT id, text_fingerprint, file_size, "
+    "COALESCE(author <> '' AND author <> 'Unknown Author', 0) + COALESCE(series <> '', 0) + "
+    "COALESCE(genre <> '', 0) + COALESCE(year > 0, 0) + COALESCE(language <> '', 0) + "
+    "COALESCE(publisher <> '', 0) + COALESCE(description <> '', 0) + COALESCE(cover_key <> '', 0) "
+    "FROM books WHERE text_fingerprint IS NOT NULL ORDER BY id";
+
+long db_load_fingerprints(DatabaseHandle *db_handle, DedupeBook **books, Config *config) {
+    if (!db_handle || !db_handle->connection || !books) return -1;
+    *books = NULL;
+
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3 *db = (sqlite3*)db_handle->connection;
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2(db, dedupe_select_sql, -1, &stmt, NULL) != SQLITE_OK) {
+                log_message(config, "ERROR", "Failed to prepare fingerprint query: %s", sqlite3_errmsg(db));
+                return -1;
+            }
+
+            long capacity = 0;
+            long count = 0;
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                if (count == capacity) {
+                    capacity = capacity ? capacity * 2 : 1024;
+                    DedupeBook *grown = realloc(*books, capacity * sizeof(DedupeBook));
+                    if (!grown) {
+                        rc = SQLITE_NOMEM;
+                        break;
+                    }
+                    *books = grown;
+                }
+
+                DedupeBook *book = &(*books)[count++];
+                book->id = sqlite3_column_int64(stmt, 0);
+                book->fingerprint = (uint64_t)sqlite3_column_int64(stmt, 1);
+                book->file_size = sqlite3_column_int64(stmt, 2);
+                book->completeness = sqlite3_column_int(stmt, 3);
+                book->duplicate_of = 0;
+            }
+            sqlite3_finalize(stmt);
+
+            if (rc != SQLITE_DONE) {
+                log_message(config, "ERROR", "Failed to read fingerprints: %s", sqlite3_errmsg(db));
+                free(*books);
+                *books = NULL;
+                return -1;
+            }
+            return count;
+        }
+        case DB_MYSQL:
+            return mysql_load_fingerprints(db_mysql_connection(db_handle), dedupe_select_sql,
+                                           books, config);
+        default:
+            return -1;
+    }
+}
+
+int db_store_duplicates(DatabaseHandle *db_handle, const DedupeBook *books, long count, Config *config) {
+    if (!db_handle || !db_handle->connection || (count > 0 && !books)) return 0;
+
+    switch (db_handle->db_type) {
+        case DB_SQLITE: {
+            sqlite3 *db = (sqlite3*)db_handle->connection;
+            sqlite3_stmt *stmt;
+
+            sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+            if (sqlite3_exec(db, "UPDATE books SET duplicate_of = NULL WHERE duplicate_of IS NOT NULL",
+                             NULL, NULL, NULL) != SQLITE_OK ||
+                sqlite3_prepare_v2(db, "UPDATE books SET duplicate_of = ? WHERE id = ?", -1, &stmt, NULL) != SQLITE_OK) {
+                log_message(config, "ERROR", "Failed to reset duplicates: %s", sqlite3_errmsg(db));
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+                return 0;
+            }
+
+            int ok = 1;
+            for (long i = 0; i < count && ok; i++) {
+                if (!books[i].duplicate_of) continue;
+                sqlite3_bind_int64(stmt, 1, books[i].duplicate_of);
+                sqlite3_bind_int64(stmt, 2, books[i].id);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                sqlite3_reset(stmt);
+            }
+            if (!ok) {
+                log_message(config, "ERROR", "Failed to store duplicates: %s", sqlite3_errmsg(db));
+            }
+            sqlite3_finalize(stmt);
+
+            sqlite3_exec(db, ok ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+            return ok;
+        }
+        case DB_MYSQL:
+            return mysql_store_duplicates(db_mysql_connection(db_handle), books, count, config);
+        default:
+            return 0;
+    }
+}
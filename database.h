@@ -1,8 +1,12 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include "arena.h"
+#include "book_meta.h"
 #include "config.h"
+#include <pthread.h>
 #include <sqlite3.h>
+#include <stdint.h>
 
 #define DB_SQLITE 0
 #define DB_MYSQL 1
@@ -11,25 +15,41 @@
 typedef struct {
     void *connection;
     int db_type;
+    void *pool;             // MySQLPool: соединения потоков, вызвавших db_thread_attach
+    pthread_mutex_t lock;   // очередь потоков к connection: SQLite и MySQL без соединения из пула
 } DatabaseHandle;
 
+// Результат полнотекстового поиска, отсортированный по убыванию score
 typedef struct {
+    int id;
     char *title;
     char *author;
-    char *genre;
     char *series;
-    int series_number;
-    int year;
-    char *language;
-    char *publisher;
-    char *description;
-    long file_size;
-} BookMeta;
+    double score;
+} BookSearchHit;
+
+// Книга с отпечатком текста для поиска почти-дубликатов (dedupe.c)
+typedef struct {
+    long long id;
+    uint64_t fingerprint;
+    long long file_size;
+    int completeness;       // число заполненных полей метаданных
+    long long duplicate_of; // id канонического издания, 0 - книга сама каноническая
+} DedupeBook;
 
 DatabaseHandle* db_connect(Config *config);
 void db_close(DatabaseHandle *db_handle);
+// Поток, работающий с базой параллельно с другими, получает собственное соединение MySQL из пула
+// ([database] pool_size) и пользуется им во всех вызовах db_* до парного db_thread_detach.
+// Вызовы вкладываются. SQLite: соединение общее, вызовы ничего не делают.
+// archive_needs_rescan, update_archive_info и insert_book_to_db можно звать из нескольких потоков:
+// через общее соединение они проходят по одному
+int db_thread_attach(DatabaseHandle *db_handle);
+void db_thread_detach(DatabaseHandle *db_handle);
 int create_database_tables(DatabaseHandle *db_handle, Config *config);
 int create_archive_table(DatabaseHandle *db_handle, Config *config);
+int db_ensure_column(DatabaseHandle *db_handle, const char *table, const char *column,
+                     const char *definition, Config *config);
 int db_execute(DatabaseHandle *db_handle, const char *sql, Config *config);
 int archive_needs_rescan(DatabaseHandle *db_handle, const char *archive_path, const char *current_hash, Config *config);
 void update_archive_info(DatabaseHandle *db_handle, const char *archive_path, const char *hash, int file_count, long total_size, Config *config);
@@ -37,4 +57,28 @@ int book_exists(DatabaseHandle *db_handle, const char *filepath, const char *arc
 void insert_book_to_db(DatabaseHandle *db_handle, const char *filepath, BookMeta *meta,
                       const char *archive_path, const char *internal_path, Config *config);
 
+// Индексы чтения books (покрывающие индексы для GUI и OPDS)
+int db_ensure_book_indexes(DatabaseHandle *db_handle, Config *config);
+int db_drop_book_indexes(DatabaseHandle *db_handle, Config *config);
+// Массовая загрузка: begin снимает индексы чтения, если база пуста или INPX грузится с очисткой,
+// и для SQLite включает режим bulk (см. [sqlite] bulk_mode); возвращает набор флагов DB_BULK_*.
+// end строит индексы заново, обновляет статистику (ANALYZE) и возвращает безопасные настройки
+#define DB_BULK_INDEXES        0x01
+#define DB_BULK_SQLITE_PRAGMAS 0x02
+int db_begin_bulk_load(DatabaseHandle *db_handle, Config *config);
+int db_end_bulk_load(DatabaseHandle *db_handle, int bulk_load, Config *config);
+
+// Поиск по названию, автору, серии и жанру; возвращает число найденных книг или -1 при ошибке
+int db_search_books(DatabaseHandle *db_handle, const char *query, int limit,
+                    BookSearchHit **hits, Config *config);
+// Поиск по произвольной подстроке названия, автора или серии через триграммный индекс
+int db_search_substring(DatabaseHandle *db_handle, const char *fragment, int limit,
+                        BookSearchHit **hits, Config *config);
+void free_search_hits(BookSearchHit *hits, int count);
+
+// Все книги с отпечатком текста; возвращает их число (массив освобождать через free) или -1
+long db_load_fingerprints(DatabaseHandle *db_handle, DedupeBook **books, Config *config);
+// Записывает duplicate_of всех книг одной транзакцией (прежние отметки сбрасываются)
+int db_store_duplicates(DatabaseHandle *db_handle, const DedupeBook *books, long count, Config *config);
+
 #endif
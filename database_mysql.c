@@ -1,5 +1,13 @@
 #include "database_mysql.h"
 #include "common.h"
+#include "intern.h"
+#include "metrics.h"
+#include "trace.h"
+#include "text_fold.h"
+#include "utils.h"
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -22,8 +30,9 @@ MySQLConnection* mysql_conn_connect(Config *config) {
     }
 
     // Инициализируем
-    mysql_conn->mysql = NULL;
-    mysql_conn->stmt = NULL;
+    memset(mysql_conn, 0, sizeof(MySQLConnection));
+    mysql_conn->config = config;
+    mysql_conn->has_ngram_index = -1;
 
     // Инициализируем MySQL
     mysql_conn->mysql = mysql_init(NULL);
@@ -39,7 +48,8 @@ MySQLConnection* mysql_conn_connect(Config *config) {
     mysql_options(mysql_conn->mysql, MYSQL_OPT_READ_TIMEOUT, &timeout);
     mysql_options(mysql_conn->mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
 
-    // ПЕРВОЕ ПОДКЛЮЧЕНИЕ: без указания базы данных
+    // ПЕРВОЕ ПОДКЛЮЧЕНИЕ: без указания базы данных.
+    // CLIENT_MULTI_STATEMENTS: пакет книг уходит на сервер одним запросом (mysql_flush_books)
     if (!mysql_real_connect(mysql_conn->mysql,
                            config->database.host,
                            config->database.user,
@@ -47,7 +57,7 @@ MySQLConnection* mysql_conn_connect(Config *config) {
                            NULL,  // не указываем базу данных
                            config->database.port,
                            config->database.socket,
-                           config->database.flags)) {
+                           config->database.flags | CLIENT_MULTI_STATEMENTS)) {
         printf("ERROR: MySQL connection failed: %s\n", mysql_error(mysql_conn->mysql));
         mysql_close(mysql_conn->mysql);
         free(mysql_conn);
@@ -107,7 +117,10 @@ int mysql_execute_query(MySQLConnection *mysql_conn, const char *sql, Config *co
 
     printf("DEBUG: Executing MySQL query: %s\n", sql);
 
-    if (mysql_query(mysql_conn->mysql, sql)) {
+    trace_begin("db", "mysql_query", sql);
+    int failed = mysql_query(mysql_conn->mysql, sql);
+    trace_end();
+    if (failed) {
         printf("ERROR: MySQL query failed: %s\n", mysql_error(mysql_conn->mysql));
         log_message(config, "ERROR", "MySQL query failed: %s", mysql_error(mysql_conn->mysql));
         return 0;
@@ -123,11 +136,60 @@ int mysql_execute_query(MySQLConnection *mysql_conn, const char *sql, Config *co
     return 1;
 }
 
+// Подготовленные запросы принадлежат соединению и после его закрытия недействительны
+static void mysql_forget_stmts(MySQLConnection *mysql_conn) {
+    for (int i = 0; i < mysql_conn->stmt_count; i++) {
+        mysql_stmt_close(mysql_conn->stmt_cache[i].stmt);
+    }
+    memset(mysql_conn->stmt_cache, 0, sizeof(mysql_conn->stmt_cache));
+    mysql_conn->stmt_count = 0;
+    mysql_conn->stmt_next = 0;
+}
+
+MYSQL_STMT* mysql_cached_stmt(MySQLConnection *mysql_conn, const char *sql, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql || !sql) return NULL;
+
+    for (int i = 0; i < mysql_conn->stmt_count; i++) {
+        if (strcmp(mysql_conn->stmt_cache[i].sql, sql) == 0) return mysql_conn->stmt_cache[i].stmt;
+    }
+
+    MYSQL_STMT *stmt = mysql_stmt_init(mysql_conn->mysql);
+    if (!stmt) return NULL;
+    trace_begin("db", "mysql_prepare", sql);
+    int failed = mysql_stmt_prepare(stmt, sql, strlen(sql));
+    trace_end();
+    if (failed) {
+        log_message(config, "ERROR", "Failed to prepare MySQL statement: %s", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+
+    // Кэш заполнен - вытесняется запрос, подготовленный раньше остальных
+    int slot = mysql_conn->stmt_count;
+    if (slot < MYSQL_STMT_CACHE_SIZE) {
+        mysql_conn->stmt_count++;
+    } else {
+        slot = mysql_conn->stmt_next;
+        mysql_conn->stmt_next = (slot + 1) % MYSQL_STMT_CACHE_SIZE;
+        mysql_stmt_close(mysql_conn->stmt_cache[slot].stmt);
+    }
+    mysql_conn->stmt_cache[slot].sql = sql;
+    mysql_conn->stmt_cache[slot].stmt = stmt;
+    return stmt;
+}
+
 void mysql_conn_close(MySQLConnection *mysql_conn) {
     if (!mysql_conn) return;
 
     printf("DEBUG: Closing MySQL connection...\n");
 
+    // Книги, не отправленные до закрытия
+    if (mysql_conn->batch.count > 0) {
+        mysql_flush_books(mysql_conn, mysql_conn->config);
+    }
+    free(mysql_conn->batch.sql);
+    mysql_forget_stmts(mysql_conn);
+
     // Безопасное закрытие statement
     if (mysql_conn->stmt) {
         printf("DEBUG: Closing MySQL statement...\n");
@@ -157,7 +219,7 @@ int mysql_create_tables(MySQLConnection *mysql_conn, Config *config) {
         "    file_type VARCHAR(10),"
         "    archive_path TEXT,"
         "    archive_internal_path TEXT,"
-        "    file_hash VARCHAR(64),"
+        "    file_hash VARCHAR(128),"
         "    title TEXT,"
         "    author TEXT,"
         "    genre TEXT,"
@@ -171,14 +233,59 @@ int mysql_create_tables(MySQLConnection *mysql_conn, Config *config) {
         "    last_modified TIMESTAMP NULL,"
         "    last_scanned TIMESTAMP NULL,"
         "    file_mtime BIGINT,"
+        "    cover_key VARCHAR(64),"
+        "    title_key VARCHAR(255) COLLATE utf8mb4_bin,"
+        "    author_key VARCHAR(255) COLLATE utf8mb4_bin,"
+        "    series_key VARCHAR(255) COLLATE utf8mb4_bin,"
+        "    text_fingerprint BIGINT UNSIGNED NULL,"
+        "    duplicate_of INT NULL,"
         "    UNIQUE KEY unique_book (file_path(255), archive_path(255), archive_internal_path(255)),"
-        "    UNIQUE KEY unique_title_author (title(255), author(255))"
+        "    UNIQUE KEY unique_title_author (title(255), author(255)),"
+        "    INDEX idx_books_file_hash (file_hash),"
+        "    FULLTEXT INDEX ft_books_search (title, author, series, genre)"
         ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci";
 
     if (!mysql_execute_query(mysql_conn, create_books_table, config)) {
         return 0;
     }
 
+    // Таблицы, созданные старыми версиями, не содержат новых колонок и индексов
+    if (!mysql_ensure_column(mysql_conn, "books", "cover_key", "VARCHAR(64)", config)) {
+        return 0;
+    }
+
+    if (!mysql_ensure_index(mysql_conn, "books", "idx_books_file_hash", "file_hash", config)) {
+        return 0;
+    }
+
+    // Ключи уже свернуты сканером, поэтому сравниваются побайтово (utf8mb4_bin).
+    // Индексы чтения по ним создает db_ensure_book_indexes() вместе с остальными.
+    if (!mysql_ensure_column(mysql_conn, "books", "title_key", "VARCHAR(255) COLLATE utf8mb4_bin", config) ||
+        !mysql_ensure_column(mysql_conn, "books", "author_key", "VARCHAR(255) COLLATE utf8mb4_bin", config) ||
+        !mysql_ensure_column(mysql_conn, "books", "series_key", "VARCHAR(255) COLLATE utf8mb4_bin", config)) {
+        return 0;
+    }
+
+    // Отпечаток текста и каноническое издание для поиска почти-дубликатов (dedupe.c)
+    if (!mysql_ensure_column(mysql_conn, "books", "text_fingerprint", "BIGINT UNSIGNED NULL", config) ||
+        !mysql_ensure_column(mysql_conn, "books", "duplicate_of", "INT NULL", config)) {
+        return 0;
+    }
+
+    if (!mysql_create_dictionary_tables(mysql_conn, config)) {
+        return 0;
+    }
+
+    // FULLTEXT поддерживается InnoDB с MySQL 5.6 и обновляется сервером при каждой вставке
+    if (!mysql_ensure_fulltext_index(mysql_conn, "books", "ft_books_search", "title, author, series, genre", NULL, config)) {
+        log_message(config, "WARNING", "Full-text search index is not available");
+    }
+
+    // Парсер ngram (MySQL 5.7+) индексирует подстроки; в MariaDB его нет - поиск подстроки идет через LIKE
+    if (!mysql_ensure_fulltext_index(mysql_conn, "books", "ft_books_ngram", "title, author, series", "ngram", config)) {
+        log_message(config, "WARNING", "Substring (ngram) index is not available");
+    }
+
     if (!mysql_create_archive_table(mysql_conn, config)) {
         return 0;
     }
@@ -187,6 +294,396 @@ int mysql_create_tables(MySQLConnection *mysql_conn, Config *config) {
     return 1;
 }
 
+// Заполняет title_key/author_key/series_key у книг, добавленных старыми версиями или GUI
+int mysql_backfill_search_keys(MySQLConnection *mysql_conn, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    const char *select_sql =
+        "SELECT id, title, author, series FROM books "
+        "WHERE (title IS NOT NULL AND title_key IS NULL) "
+        "OR (author IS NOT NULL AND author_key IS NULL) "
+        "OR (series IS NOT NULL AND series_key IS NULL) LIMIT 1000";
+
+    long updated = 0;
+    for (;;) {
+        if (mysql_query(mysql_conn->mysql, select_sql)) {
+            log_message(config, "ERROR", "Failed to select books without keys: %s", mysql_error(mysql_conn->mysql));
+            return 0;
+        }
+
+        MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+        if (!result) return 0;
+
+        int rows = (int)mysql_num_rows(result);
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(result))) {
+            char values[3][2 * 4 * FOLD_KEY_MAX_CHARS + 8];
+            for (int i = 0; i < 3; i++) {
+                char *key = fold_search_key(row[i + 1] ? row[i + 1] : "");
+                char escaped[2 * 4 * FOLD_KEY_MAX_CHARS + 1];
+                mysql_real_escape_string(mysql_conn->mysql, escaped, key ? key : "", key ? strlen(key) : 0);
+                snprintf(values[i], sizeof(values[i]), "'%s'", escaped);
+                free(key);
+            }
+
+            char sql[sizeof(values) + 256];
+            snprintf(sql, sizeof(sql),
+                     "UPDATE books SET title_key = %s, author_key = %s, series_key = %s WHERE id = %s",
+                     values[0], values[1], values[2], row[0]);
+            if (!mysql_execute_query(mysql_conn, sql, config)) {
+                mysql_free_result(result);
+                return 0;
+            }
+            updated++;
+        }
+        mysql_free_result(result);
+
+        if (rows < 1000) break;
+    }
+
+    if (updated > 0) {
+        log_message(config, "INFO", "Filled search keys for %ld books", updated);
+    }
+    return 1;
+}
+
+// Словари авторов, серий и жанров с целочисленными id; имена сравниваются побайтово,
+// чтобы "Лев Толстой" и "лев толстой" не слились в одну запись
+int mysql_create_dictionary_tables(MySQLConnection *mysql_conn, Config *config) {
+    const char *dictionaries[] = { "authors", "series", "genres" };
+    for (int i = 0; i < 3; i++) {
+        char sql[1024];
+        snprintf(sql, sizeof(sql),
+                 "CREATE TABLE IF NOT EXISTS %s ("
+                 "    id INT AUTO_INCREMENT PRIMARY KEY,"
+                 "    name VARCHAR(255) COLLATE utf8mb4_bin NOT NULL,"
+                 "    name_key VARCHAR(255) COLLATE utf8mb4_bin,"
+                 "    UNIQUE KEY uq_%s_name (name),"
+                 "    INDEX idx_%s_name_key (name_key)"
+                 ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci",
+                 dictionaries[i], dictionaries[i], dictionaries[i]);
+        if (!mysql_execute_query(mysql_conn, sql, config)) {
+            return 0;
+        }
+    }
+
+    // Связи удаляются вместе с книгой каскадно, кто бы ее ни удалил
+    const char *create_book_authors =
+        "CREATE TABLE IF NOT EXISTS book_authors ("
+        "    book_id INT NOT NULL,"
+        "    author_id INT NOT NULL,"
+        "    position INT NOT NULL DEFAULT 0,"
+        "    PRIMARY KEY (book_id, author_id),"
+        "    INDEX idx_book_authors_author (author_id, book_id),"
+        "    FOREIGN KEY (book_id) REFERENCES books(id) ON DELETE CASCADE,"
+        "    FOREIGN KEY (author_id) REFERENCES authors(id)"
+        ") ENGINE=InnoDB";
+
+    if (!mysql_execute_query(mysql_conn, create_book_authors, config)) {
+        return 0;
+    }
+
+    return mysql_ensure_column(mysql_conn, "books", "series_id", "INT NULL", config) &&
+           mysql_ensure_column(mysql_conn, "books", "genre_id", "INT NULL", config);
+}
+
+// Обрыв связи (рестарт сервера, wait_timeout) виден по коду ошибки самого запроса - без mysql_ping
+static int mysql_connection_lost(MySQLConnection *mysql_conn) {
+    if (!mysql_conn->mysql) return 1;
+    unsigned int error = mysql_errno(mysql_conn->mysql);
+    return error == CR_SERVER_GONE_ERROR || error == CR_SERVER_LOST;
+}
+
+// После неудачного переподключения mysql == NULL
+static const char* mysql_last_error(MySQLConnection *mysql_conn) {
+    return mysql_conn->mysql ? mysql_error(mysql_conn->mysql) : "no connection";
+}
+
+static int mysql_reconnect_counted(MySQLConnection *mysql_conn, Config *config) {
+    LOG_WARNING(config, "MySQL connection lost (%s), reconnecting", mysql_last_error(mysql_conn));
+    if (!mysql_reconnect(mysql_conn, config)) {
+        LOG_ERROR(config, "Reconnection failed");
+        return 0;
+    }
+    metrics_inc(METRIC_DB_RECONNECTS);
+    return 1;
+}
+
+// Запрос без результата; при обрыве связи - переподключение и один повтор.
+// Повтор безопасен: все такие запросы идемпотентны (INSERT IGNORE, ON DUPLICATE KEY UPDATE)
+static int mysql_query_reconnecting(MySQLConnection *mysql_conn, const char *sql, size_t length, Config *config) {
+    if (mysql_conn->mysql && mysql_real_query(mysql_conn->mysql, sql, length) == 0) return 1;
+    if (!mysql_connection_lost(mysql_conn) || !mysql_reconnect_counted(mysql_conn, config)) return 0;
+    return mysql_real_query(mysql_conn->mysql, sql, length) == 0;
+}
+
+// Возвращает id имени в словаре, добавляя его при необходимости; 0 при ошибке.
+// Сначала SELECT: INSERT уже существующего имени тратит значение AUTO_INCREMENT. Вставку двух потоков
+// разрешает ON DUPLICATE KEY UPDATE id = LAST_INSERT_ID(id) - он отдает id и существующей записи
+static my_ulonglong mysql_intern_name(MySQLConnection *mysql_conn, const char *table, const char *name,
+                                      Config *config) {
+    if (!name || !*name) return 0;
+
+    // Повторные имена не требуют запроса к серверу
+    InternKind kind = intern_kind_for_table(table);
+    my_ulonglong cached = (my_ulonglong)intern_db_id(kind, name);
+    if (cached) return cached;
+
+    char short_name[4 * DICT_NAME_MAX_CHARS + 1];
+    snprintf(short_name, sizeof(short_name), "%s", name);
+    utf8_truncate(short_name, DICT_NAME_MAX_CHARS);
+
+    if (!mysql_conn->mysql && !mysql_reconnect_counted(mysql_conn, config)) return 0;
+
+    char escaped_name[2 * sizeof(short_name) + 1];
+    char escaped_key[2 * 4 * FOLD_KEY_MAX_CHARS + 1] = {0};
+    mysql_real_escape_string(mysql_conn->mysql, escaped_name, short_name, strlen(short_name));
+
+    char *key = fold_search_key(short_name);
+    if (key) {
+        mysql_real_escape_string(mysql_conn->mysql, escaped_key, key, strlen(key));
+        free(key);
+    }
+
+    char sql[sizeof(escaped_name) + sizeof(escaped_key) + 256];
+    my_ulonglong id = 0;
+    snprintf(sql, sizeof(sql), "SELECT id FROM %s WHERE name = '%s'", table, escaped_name);
+    if (mysql_query_reconnecting(mysql_conn, sql, strlen(sql), config)) {
+        MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+        MYSQL_ROW row = result ? mysql_fetch_row(result) : NULL;
+        if (row && row[0]) id = strtoull(row[0], NULL, 10);
+        if (result) mysql_free_result(result);
+    }
+
+    if (id == 0) {
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO %s (name, name_key) VALUES ('%s', '%s') "
+                 "ON DUPLICATE KEY UPDATE id = LAST_INSERT_ID(id)",
+                 table, escaped_name, escaped_key);
+
+        if (!mysql_query_reconnecting(mysql_conn, sql, strlen(sql), config)) {
+            log_message(config, "ERROR", "Failed to add '%s' to %s: %s", short_name, table, mysql_last_error(mysql_conn));
+            return 0;
+        }
+        id = mysql_insert_id(mysql_conn->mysql);
+    }
+    intern_remember_db_id(kind, name, (int64_t)id);
+    return id;
+}
+
+// id основного (первого) жанра из списка жанров книги
+static my_ulonglong mysql_intern_genre(MySQLConnection *mysql_conn, const char *genres, Config *config) {
+    char *genre = primary_genre(genres);
+    my_ulonglong id = mysql_intern_name(mysql_conn, "genres", genre, config);
+    free(genre);
+    return id;
+}
+
+// Связи книги с авторами; строка авторов может содержать несколько имен через ',' или ';'
+static int mysql_link_book_authors(MySQLConnection *mysql_conn, my_ulonglong book_id, const char *author,
+                                   Config *config) {
+    int count = 0;
+    char **names = split_author_list(author, &count);
+    if (!names) return 1;
+
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        my_ulonglong author_id = mysql_intern_name(mysql_conn, "authors", names[i], config);
+        if (author_id == 0) {
+            ok = 0;
+            continue;
+        }
+
+        char sql[256];
+        snprintf(sql, sizeof(sql),
+                 "INSERT IGNORE INTO book_authors (book_id, author_id, position) VALUES (%llu, %llu, %d)",
+                 (unsigned long long)book_id, (unsigned long long)author_id, i);
+        if (mysql_query(mysql_conn->mysql, sql)) {
+            log_message(config, "ERROR", "Failed to link author '%s': %s", names[i], mysql_error(mysql_conn->mysql));
+            ok = 0;
+        }
+    }
+
+    free_string_list(names, count);
+    return ok;
+}
+
+int mysql_delete_orphan_names(MySQLConnection *mysql_conn, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    return mysql_execute_query(mysql_conn,
+                               "DELETE a FROM authors a LEFT JOIN book_authors ba ON ba.author_id = a.id "
+                               "WHERE ba.author_id IS NULL", config) &&
+           mysql_execute_query(mysql_conn,
+                               "DELETE s FROM series s LEFT JOIN books b ON b.series_id = s.id WHERE b.id IS NULL", config) &&
+           mysql_execute_query(mysql_conn,
+                               "DELETE g FROM genres g LEFT JOIN books b ON b.genre_id = g.id WHERE b.id IS NULL", config);
+}
+
+// Заполняет словари по книгам, которые добавлены старыми версиями или GUI и еще не связаны
+int mysql_backfill_dictionaries(MySQLConnection *mysql_conn, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    // Постранично по id: книги без авторов остаются в выборке, но не зацикливают проход
+    unsigned long long last_id = 0;
+    long linked = 0;
+    for (;;) {
+        char select_sql[1024];
+        snprintf(select_sql, sizeof(select_sql),
+                 "SELECT id, author, series, genre FROM books b WHERE id > %llu AND ("
+                 "(author IS NOT NULL AND author != '' "
+                 " AND NOT EXISTS (SELECT 1 FROM book_authors ba WHERE ba.book_id = b.id)) "
+                 "OR (series_id IS NULL AND series IS NOT NULL AND series != '') "
+                 "OR (genre_id IS NULL AND genre IS NOT NULL AND genre != '')) "
+                 "ORDER BY id LIMIT 1000", last_id);
+
+        if (mysql_query(mysql_conn->mysql, select_sql)) {
+            log_message(config, "ERROR", "Failed to select unlinked books: %s", mysql_error(mysql_conn->mysql));
+            return 0;
+        }
+
+        MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+        if (!result) return 0;
+
+        int rows = (int)mysql_num_rows(result);
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(result))) {
+            last_id = strtoull(row[0], NULL, 10);
+            my_ulonglong series_id = mysql_intern_name(mysql_conn, "series", row[2], config);
+            my_ulonglong genre_id = mysql_intern_genre(mysql_conn, row[3], config);
+
+            char series_value[32] = "NULL";
+            char genre_value[32] = "NULL";
+            if (series_id) snprintf(series_value, sizeof(series_value), "%llu", (unsigned long long)series_id);
+            if (genre_id) snprintf(genre_value, sizeof(genre_value), "%llu", (unsigned long long)genre_id);
+
+            char sql[256];
+            snprintf(sql, sizeof(sql), "UPDATE books SET series_id = %s, genre_id = %s WHERE id = %llu",
+                     series_value, genre_value, last_id);
+            if (mysql_query(mysql_conn->mysql, sql) ||
+                !mysql_link_book_authors(mysql_conn, last_id, row[1], config)) {
+                log_message(config, "ERROR", "Failed to link book %llu: %s", last_id, mysql_error(mysql_conn->mysql));
+                mysql_free_result(result);
+                intern_forget_db_ids();
+                return 0;
+            }
+            linked++;
+        }
+        mysql_free_result(result);
+
+        if (rows < 1000) break;
+    }
+
+    // Имена, на которые больше не ссылается ни одна книга (книги удалены из GUI)
+    mysql_delete_orphan_names(mysql_conn, config);
+    intern_forget_db_ids();
+
+    if (linked > 0) {
+        log_message(config, "INFO", "Linked %ld books to author/series/genre dictionaries", linked);
+    }
+    return 1;
+}
+
+static int mysql_index_exists(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                              Config *config) {
+    // В MySQL нет CREATE INDEX IF NOT EXISTS - проверяем через information_schema
+    char sql[1024];
+    snprintf(sql, sizeof(sql),
+             "SELECT COUNT(*) FROM information_schema.statistics "
+             "WHERE table_schema = DATABASE() AND table_name = '%s' AND index_name = '%s'",
+             table, index_name);
+
+    if (mysql_query(mysql_conn->mysql, sql)) {
+        log_message(config, "ERROR", "Failed to check index %s: %s", index_name, mysql_error(mysql_conn->mysql));
+        return -1;
+    }
+
+    MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+    if (!result) return -1;
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    int exists = (row && row[0] && atoi(row[0]) > 0);
+    mysql_free_result(result);
+    return exists;
+}
+
+// Растет при каждом создании или удалении индекса любым соединением процесса: сведения
+// об индексах, закэшированные соединением при прежней эпохе, проверяются заново
+static uint32_t index_epoch;
+
+static void forget_index_state(void) {
+    __atomic_add_fetch(&index_epoch, 1, __ATOMIC_RELEASE);
+}
+
+static int ensure_index_of_kind(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                                const char *kind, const char *columns, const char *parser, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    int exists = mysql_index_exists(mysql_conn, table, index_name, config);
+    if (exists < 0) return 0;
+    if (exists) return 1;
+
+    char sql[1024];
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD %s %s (%s)%s%s", table, kind, index_name, columns,
+             parser ? " WITH PARSER " : "", parser ? parser : "");
+    int ok = mysql_execute_query(mysql_conn, sql, config);
+    forget_index_state();
+    return ok;
+}
+
+int mysql_ensure_index(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                       const char *columns, Config *config) {
+    return ensure_index_of_kind(mysql_conn, table, index_name, "INDEX", columns, NULL, config);
+}
+
+int mysql_ensure_fulltext_index(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                                const char *columns, const char *parser, Config *config) {
+    return ensure_index_of_kind(mysql_conn, table, index_name, "FULLTEXT INDEX", columns, parser, config);
+}
+
+// InnoDB не умеет отключать индексы (DISABLE KEYS работает только для MyISAM) - индекс удаляется
+int mysql_drop_index(MySQLConnection *mysql_conn, const char *table, const char *index_name, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    int exists = mysql_index_exists(mysql_conn, table, index_name, config);
+    if (exists < 0) return 0;
+    if (!exists) return 1;
+
+    char sql[512];
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s DROP INDEX %s", table, index_name);
+    int ok = mysql_execute_query(mysql_conn, sql, config);
+    forget_index_state();
+    return ok;
+}
+
+int mysql_ensure_column(MySQLConnection *mysql_conn, const char *table, const char *column,
+                        const char *definition, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    char sql[1024];
+    snprintf(sql, sizeof(sql),
+             "SELECT COUNT(*) FROM information_schema.columns "
+             "WHERE table_schema = DATABASE() AND table_name = '%s' AND column_name = '%s'",
+             table, column);
+
+    if (mysql_query(mysql_conn->mysql, sql)) {
+        log_message(config, "ERROR", "Failed to check column %s: %s", column, mysql_error(mysql_conn->mysql));
+        return 0;
+    }
+
+    MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+    if (!result) return 0;
+
+    MYSQL_ROW row = mysql_fetch_row(result);
+    int exists = (row && row[0] && atoi(row[0]) > 0);
+    mysql_free_result(result);
+
+    if (exists) return 1;
+
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s", table, column, definition);
+    return mysql_execute_query(mysql_conn, sql, config);
+}
+
 int mysql_create_archive_table(MySQLConnection *mysql_conn, Config *config) {
     const char *create_archives_table =
         "CREATE TABLE IF NOT EXISTS archives ("
@@ -224,15 +721,6 @@ int mysql_archive_needs_rescan(MySQLConnection *mysql_conn, const char *archive_
         return 1;
     }
 
-    // Проверяем соединение
-    if (mysql_ping(mysql_conn->mysql)) {
-        printf("WARNING: [MYSQL_ARCHIVE_NEEDS_RESCAN] Connection lost, reconnecting...\n");
-        if (!mysql_reconnect(mysql_conn, config)) {
-            printf("ERROR: [MYSQL_ARCHIVE_NEEDS_RESCAN] Reconnection failed\n");
-            return 1;
-        }
-    }
-
     // Используем простой запрос вместо prepared statement для надежности
     char *escaped_path = malloc(strlen(archive_path) * 2 + 1);
     if (!escaped_path) {
@@ -249,8 +737,9 @@ int mysql_archive_needs_rescan(MySQLConnection *mysql_conn, const char *archive_
 
     printf("DEBUG: [MYSQL_ARCHIVE_NEEDS_RESCAN] Executing SQL: %s\n", sql);
 
-    if (mysql_query(mysql_conn->mysql, sql)) {
-        printf("ERROR: [MYSQL_ARCHIVE_NEEDS_RESCAN] Query failed: %s\n", mysql_error(mysql_conn->mysql));
+    // Обрыв связи виден по ошибке самого запроса: переподключение и повтор вместо mysql_ping
+    if (!mysql_query_reconnecting(mysql_conn, sql, strlen(sql), config)) {
+        printf("ERROR: [MYSQL_ARCHIVE_NEEDS_RESCAN] Query failed: %s\n", mysql_last_error(mysql_conn));
         free(escaped_path);
         return 1;
     }
@@ -319,26 +808,20 @@ int mysql_archive_needs_rescan(MySQLConnection *mysql_conn, const char *archive_
     return needs_rescan;
 }
 
-void mysql_update_archive_info(MySQLConnection *mysql_conn, const char *archive_path, const char *hash,
-                              int file_count, long total_size, Config *config) {
+// Строка архива без отправки пакета: вызывающий уже убедился, что книги архива записаны
+static void mysql_write_archive_info(MySQLConnection *mysql_conn, const char *archive_path, const char *hash,
+                                     int file_count, long total_size, Config *config) {
     if (!mysql_conn || !mysql_conn->mysql) return;
 
     struct stat st;
     if (stat(archive_path, &st) != 0) return;
 
-    const char *sql = "INSERT INTO archives (archive_path, archive_hash, file_count, total_size, last_modified, last_scanned, needs_rescan) "
-                      "VALUES (?, ?, ?, ?, ?, CURRENT_TIMESTAMP, FALSE) "
-                      "ON DUPLICATE KEY UPDATE archive_hash = VALUES(archive_hash), file_count = VALUES(file_count), "
-                      "total_size = VALUES(total_size), last_modified = VALUES(last_modified), "
-                      "last_scanned = VALUES(last_scanned), needs_rescan = VALUES(needs_rescan)";
-
-    MYSQL_STMT *stmt = mysql_stmt_init(mysql_conn->mysql);
-    if (!stmt) return;
-
-    if (mysql_stmt_prepare(stmt, sql, strlen(sql))) {
-        mysql_stmt_close(stmt);
-        return;
-    }
+    static const char sql[] =
+        "INSERT INTO archives (archive_path, archive_hash, file_count, total_size, last_modified, last_scanned, needs_rescan) "
+        "VALUES (?, ?, ?, ?, ?, CURRENT_TIMESTAMP, FALSE) "
+        "ON DUPLICATE KEY UPDATE archive_hash = VALUES(archive_hash), file_count = VALUES(file_count), "
+        "total_size = VALUES(total_size), last_modified = VALUES(last_modified), "
+        "last_scanned = VALUES(last_scanned), needs_rescan = VALUES(needs_rescan)";
 
     // Привязываем параметры
     MYSQL_BIND bind[5];
@@ -372,29 +855,79 @@ void mysql_update_archive_info(MySQLConnection *mysql_conn, const char *archive_
     bind[4].buffer_type = MYSQL_TYPE_LONGLONG;
     bind[4].buffer = &st.st_mtime;
 
-    if (mysql_stmt_bind_param(stmt, bind)) {
-        mysql_stmt_close(stmt);
+    // Запрос готовится один раз на соединение; после обрыва связи - переподключение и повтор
+    for (int attempt = 0; attempt < 2; attempt++) {
+        MYSQL_STMT *stmt = mysql_cached_stmt(mysql_conn, sql, config);
+        if (stmt && !mysql_stmt_bind_param(stmt, bind) && !mysql_stmt_execute(stmt)) {
+            log_message(config, "DEBUG", "Updated archive info: %s (%d files, %ld bytes)",
+                       archive_path, file_count, total_size);
+            return;
+        }
+
+        unsigned int error = stmt ? mysql_stmt_errno(stmt) : mysql_errno(mysql_conn->mysql);
+        if (attempt > 0 || (error != CR_SERVER_GONE_ERROR && error != CR_SERVER_LOST) ||
+            !mysql_reconnect_counted(mysql_conn, config)) {
+            log_message(config, "ERROR", "Failed to update archive info: %s",
+                        stmt ? mysql_stmt_error(stmt) : mysql_last_error(mysql_conn));
+            return;
+        }
+    }
+}
+
+void mysql_update_archive_info(MySQLConnection *mysql_conn, const char *archive_path, const char *hash,
+                              int file_count, long total_size, Config *config) {
+    if (!mysql_conn) return;
+
+    // Строка архива без его книг означала бы, что следующее сканирование архив пропустит
+    if (!mysql_flush_books(mysql_conn, config)) {
+        LOG_WARNING(config, "Archive %s is not recorded: its books were not written", archive_path);
         return;
     }
+    mysql_write_archive_info(mysql_conn, archive_path, hash, file_count, total_size, config);
+}
 
-    if (mysql_stmt_execute(stmt)) {
-        log_message(config, "ERROR", "Failed to update archive info: %s", mysql_stmt_error(stmt));
-    } else {
-        log_message(config, "DEBUG", "Updated archive info: %s (%d files, %ld bytes)",
-                   archive_path, file_count, total_size);
+int mysql_book_hash_exists(MySQLConnection *mysql_conn, const char *file_hash) {
+    if (!mysql_conn || !mysql_conn->mysql || !file_hash) return 0;
+
+    char escaped_hash[260];
+    size_t hash_len = strlen(file_hash);
+    if (hash_len > 128) return 0;
+    mysql_real_escape_string(mysql_conn->mysql, escaped_hash, file_hash, hash_len);
+
+    char sql[512];
+    snprintf(sql, sizeof(sql), "SELECT id FROM books WHERE file_hash = '%s' LIMIT 1", escaped_hash);
+
+    if (mysql_query(mysql_conn->mysql, sql)) {
+        printf("ERROR: [MYSQL_BOOK_HASH_EXISTS] Query failed: %s\n", mysql_error(mysql_conn->mysql));
+        return 0;
     }
 
-    mysql_stmt_close(stmt);
+    MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+    if (!result) return 0;
+
+    int exists = (mysql_num_rows(result) > 0);
+    mysql_free_result(result);
+    return exists;
 }
 
 int mysql_book_exists(MySQLConnection *mysql_conn, const char *filepath, const char *archive_path,
                      const char *internal_path, const char *file_hash, Config *config) {
-    (void)config;
-
     if (!mysql_conn || !mysql_conn->mysql) return 0;
 
+    // Книги из пакета записи еще не на сервере
+    mysql_flush_books(mysql_conn, config);
+    if (!mysql_conn->mysql) return 0;
+
+    (void)archive_path;
+    (void)internal_path;
+
     printf("DEBUG: [MYSQL_BOOK_EXISTS] Checking if book exists: %s\n", filepath);
 
+    if (file_hash && mysql_book_hash_exists(mysql_conn, file_hash)) {
+        printf("DEBUG: [MYSQL_BOOK_EXISTS] Book exists (hash match): %s\n", file_hash);
+        return 1;
+    }
+
     // Экранируем filepath
     char *escaped_filepath = malloc(strlen(filepath) * 2 + 1);
     if (!escaped_filepath) return 0;
@@ -431,6 +964,7 @@ int mysql_book_exists(MySQLConnection *mysql_conn, const char *filepath, const c
 int mysql_reconnect(MySQLConnection *mysql_conn, Config *config) {
   //  printf("DEBUG: [MYSQL_RECONNECT] Attempting to reconnect...\n");
 
+    mysql_forget_stmts(mysql_conn);
     if (mysql_conn->mysql) {
         mysql_close(mysql_conn->mysql);
         mysql_conn->mysql = NULL;
@@ -457,7 +991,7 @@ int mysql_reconnect(MySQLConnection *mysql_conn, Config *config) {
                            config->database.database,
                            config->database.port,
                            config->database.socket,
-                           config->database.flags)) {
+                           config->database.flags | CLIENT_MULTI_STATEMENTS)) {
     //    printf("ERROR: [MYSQL_RECONNECT] Reconnection failed: %s\n", mysql_error(mysql_conn->mysql));
         mysql_close(mysql_conn->mysql);
         mysql_conn->mysql = NULL;
@@ -472,11 +1006,114 @@ int mysql_reconnect(MySQLConnection *mysql_conn, Config *config) {
 }
 
 
+// Запись книги заменяет существующую с тем же путем или тем же названием и автором
+// (UNIQUE KEY), только если новый файл больше чем на 10%: вероятно, это полная версия.
+// Иначе строка не меняется. Размер сравнивается в каждом столбце, поэтому file_size - последним
+#define REPLACE_IF_LARGER(column) \
+    column " = IF(incoming.file_size > books.file_size * 1.1, incoming." column ", books." column "), "
+
+static const char mysql_book_upsert[] =
+    " ON DUPLICATE KEY UPDATE id = LAST_INSERT_ID(books.id), "
+    REPLACE_IF_LARGER("file_path") REPLACE_IF_LARGER("file_name") REPLACE_IF_LARGER("file_type")
+    REPLACE_IF_LARGER("archive_path") REPLACE_IF_LARGER("archive_internal_path")
+    REPLACE_IF_LARGER("title") REPLACE_IF_LARGER("author") REPLACE_IF_LARGER("genre")
+    REPLACE_IF_LARGER("series") REPLACE_IF_LARGER("series_number") REPLACE_IF_LARGER("year")
+    REPLACE_IF_LARGER("language") REPLACE_IF_LARGER("publisher") REPLACE_IF_LARGER("file_hash")
+    REPLACE_IF_LARGER("cover_key") REPLACE_IF_LARGER("title_key") REPLACE_IF_LARGER("author_key")
+    REPLACE_IF_LARGER("series_key") REPLACE_IF_LARGER("series_id") REPLACE_IF_LARGER("genre_id")
+    REPLACE_IF_LARGER("text_fingerprint") REPLACE_IF_LARGER("last_modified")
+    "file_size = IF(incoming.file_size > books.file_size * 1.1, incoming.file_size, books.file_size)";
+
+// Добавляет оператор в пакет; первый оператор пакета идет без разделителя
+static int batch_append(MySQLBookBatch *batch, const char *sql, size_t length) {
+    size_t needed = batch->length + length + 2;
+    if (needed > batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity : MYSQL_BATCH_BYTES + 65536;
+        while (capacity < needed) capacity *= 2;
+        char *grown = realloc(batch->sql, capacity);
+        if (!grown) return 0;
+        batch->sql = grown;
+        batch->capacity = capacity;
+    }
+
+    if (batch->count > 0) batch->sql[batch->length++] = ';';
+    batch->starts[batch->count++] = batch->length;
+    memcpy(batch->sql + batch->length, sql, length);
+    batch->length += length;
+    batch->sql[batch->length] = '\0';
+    return 1;
+}
+
+static void batch_clear(MySQLBookBatch *batch) {
+    batch->count = 0;
+    batch->length = 0;
+}
+
+// Запрос, собираемый по частям: списки id и значений для всего пакета
+typedef struct {
+    char *sql;
+    size_t length;
+    size_t capacity;
+    int failed;             // не хватило памяти - запрос не отправляется
+} SqlBuilder;
+
+static void sql_append(SqlBuilder *builder, const char *format, ...) {
+    if (builder->failed) return;
+
+    for (;;) {
+        size_t room = builder->capacity - builder->length;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(builder->sql ? builder->sql + builder->length : NULL, room, format, args);
+        va_end(args);
+        if (written < 0) {
+            builder->failed = 1;
+            return;
+        }
+        if ((size_t)written < room) {
+            builder->length += (size_t)written;
+            return;
+        }
+
+        size_t capacity = builder->capacity ? builder->capacity * 2 : 4096;
+        while (capacity - builder->length <= (size_t)written) capacity *= 2;
+        char *grown = realloc(builder->sql, capacity);
+        if (!grown) {
+            builder->failed = 1;
+            return;
+        }
+        builder->sql = grown;
+        builder->capacity = capacity;
+    }
+}
+
+// Несколько операторов через ';' одним запросом; результаты вычитываются до конца.
+// Ошибка посреди запроса откатывает начатую в нем транзакцию
+static int mysql_run_statements(MySQLConnection *mysql_conn, const char *sql, size_t length, Config *config) {
+    if (!mysql_query_reconnecting(mysql_conn, sql, length, config)) {
+        log_message(config, "ERROR", "MySQL statement failed: %s", mysql_last_error(mysql_conn));
+        return 0;
+    }
+
+    int status;
+    do {
+        MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+        if (result) mysql_free_result(result);
+    } while ((status = mysql_next_result(mysql_conn->mysql)) == 0);
+
+    if (status > 0) {
+        log_message(config, "ERROR", "MySQL statement failed: %s", mysql_error(mysql_conn->mysql));
+        mysql_query(mysql_conn->mysql, "ROLLBACK");
+        return 0;
+    }
+    return 1;
+}
+
 void mysql_insert_book(MySQLConnection *mysql_conn, const char *filepath, BookMeta *meta,
                       const char *archive_path, const char *internal_path, Config *config) {
     DBG("[MYSQL_INSERT_BOOK] ENTER FUNCTION\n");
 
-    if (!mysql_conn || !mysql_conn->mysql) {
+    if (!mysql_conn) {
          LOG_ERROR(config, "MySQL connection is not valid");
         return;
     }
@@ -486,32 +1123,13 @@ void mysql_insert_book(MySQLConnection *mysql_conn, const char *filepath, BookMe
         return;
     }
 
-    // Проверяем соединение
-    if (mysql_ping(mysql_conn->mysql)) {
-        LOG_WARNING(config, "MySQL connection lost, attempting to reconnect...");
-        if (!mysql_reconnect(mysql_conn, config)) {
-           LOG_ERROR(config, "Reconnection failed");
-            return;
-        }
-    }
-
-
-    LOG_INFO(config, "Inserting book: %s", filepath);
-    DBG("[MYSQL_INSERT_BOOK] Book data - Title: '%s', Author: '%s'\n",
-        meta->title ? meta->title : "Unknown",
-        meta->author ? meta->author : "Unknown");
-
-    int should_skip = check_book_exists_smart(mysql_conn, meta, config);
-
-    if (should_skip) {
-        printf("DEBUG: [MYSQL_INSERT_BOOK] Book should be skipped based on smart check\n");
+    // Прошлое переподключение не удалось - пробуем снова, иначе книги не записать
+    if (!mysql_conn->mysql && !mysql_reconnect_counted(mysql_conn, config)) {
+        metrics_inc(METRIC_ERRORS_DB);
         return;
     }
 
-
-
-
-
+    LOG_INFO(config, "Inserting book: %s", filepath);
 
     // Подготавливаем данные
     const char *filename = "unknown";
@@ -557,8 +1175,12 @@ void mysql_insert_book(MySQLConnection *mysql_conn, const char *filepath, BookMe
     char escaped_series[512] = {0};
     char escaped_language[64] = {0};
     char escaped_publisher[1024] = {0};
-    char escaped_archive[4096] = {0};
-    char escaped_internal[1024] = {0};
+    char archive_value[4100] = "NULL";
+    char internal_value[1030] = "NULL";
+    char hash_value[300] = "NULL";
+    char cover_value[160] = "NULL";
+    // Точный дубликат по содержимому отсекает сам оператор: SELECT без строк ничего не вставляет
+    char hash_condition[360] = "";
 
     // Экранируем основные поля
     mysql_real_escape_string(mysql_conn->mysql, escaped_filepath, filepath, strlen(filepath));
@@ -571,47 +1193,326 @@ void mysql_insert_book(MySQLConnection *mysql_conn, const char *filepath, BookMe
     mysql_real_escape_string(mysql_conn->mysql, escaped_language, language, strlen(language));
     mysql_real_escape_string(mysql_conn->mysql, escaped_publisher, publisher, strlen(publisher));
 
-    // Используем INSERT IGNORE для избежания дубликатов
-    char sql[16384];
-
     if (archive_path && internal_path) {
+        char escaped_archive[4096] = {0};
+        char escaped_internal[1024] = {0};
         mysql_real_escape_string(mysql_conn->mysql, escaped_archive, archive_path, strlen(archive_path));
         mysql_real_escape_string(mysql_conn->mysql, escaped_internal, internal_path, strlen(internal_path));
+        snprintf(archive_value, sizeof(archive_value), "'%s'", escaped_archive);
+        snprintf(internal_value, sizeof(internal_value), "'%s'", escaped_internal);
+    }
 
-        snprintf(sql, sizeof(sql),
-            "INSERT IGNORE INTO books (file_path, file_name, file_size, file_type, "
-            "archive_path, archive_internal_path, title, author, genre, series, "
-            "series_number, year, language, publisher, last_modified) VALUES ("
-            "'%s', '%s', %ld, '%s', '%s', '%s', '%s', '%s', '%s', '%s', %d, %d, '%s', '%s', NOW())",
-            escaped_filepath, escaped_filename, file_size, escaped_filetype,
-            escaped_archive, escaped_internal, escaped_title, escaped_author,
-            escaped_genre, escaped_series, series_number, year, escaped_language,
-            escaped_publisher);
-    } else {
-        snprintf(sql, sizeof(sql),
-            "INSERT IGNORE INTO books (file_path, file_name, file_size, file_type, "
-            "title, author, genre, series, series_number, year, language, publisher, last_modified) VALUES ("
-            "'%s', '%s', %ld, '%s', '%s', '%s', '%s', '%s', %d, %d, '%s', '%s', NOW())",
-            escaped_filepath, escaped_filename, file_size, escaped_filetype,
-            escaped_title, escaped_author, escaped_genre, escaped_series,
-            series_number, year, escaped_language, escaped_publisher);
+    if (meta->file_hash && strlen(meta->file_hash) <= 128) {
+        char escaped_hash[260];
+        mysql_real_escape_string(mysql_conn->mysql, escaped_hash, meta->file_hash, strlen(meta->file_hash));
+        snprintf(hash_value, sizeof(hash_value), "'%s'", escaped_hash);
+        snprintf(hash_condition, sizeof(hash_condition),
+                 " WHERE NOT EXISTS (SELECT 1 FROM books WHERE file_hash = '%s')", escaped_hash);
     }
 
-    //printf("DEBUG: [MYSQL_INSERT_BOOK] Executing INSERT IGNORE...\n");
+    if (meta->cover_key && strlen(meta->cover_key) <= 64) {
+        char escaped_cover[130];
+        mysql_real_escape_string(mysql_conn->mysql, escaped_cover, meta->cover_key, strlen(meta->cover_key));
+        snprintf(cover_value, sizeof(cover_value), "'%s'", escaped_cover);
+    }
 
-    // Выполняем запрос
-    if (mysql_query(mysql_conn->mysql, sql)) {
-        LOG_ERROR(config, "INSERT failed: %s", mysql_error(mysql_conn->mysql));
-    } else {
-        my_ulonglong affected_rows = mysql_affected_rows(mysql_conn->mysql);
-        LOG_INFO(config, "Book inserted successfully. Affected rows: %llu", affected_rows);
+    // Нормализованные ключи для поиска и сортировки (не длиннее FOLD_KEY_MAX_CHARS символов)
+    char escaped_title_key[2 * 4 * FOLD_KEY_MAX_CHARS + 1] = {0};
+    char escaped_author_key[2 * 4 * FOLD_KEY_MAX_CHARS + 1] = {0};
+    char escaped_series_key[2 * 4 * FOLD_KEY_MAX_CHARS + 1] = {0};
+    char *title_key = fold_search_key(title);
+    char *author_key = fold_search_key(author);
+    char *series_key = fold_search_key(series);
+    if (title_key) mysql_real_escape_string(mysql_conn->mysql, escaped_title_key, title_key, strlen(title_key));
+    if (author_key) mysql_real_escape_string(mysql_conn->mysql, escaped_author_key, author_key, strlen(author_key));
+    if (series_key) mysql_real_escape_string(mysql_conn->mysql, escaped_series_key, series_key, strlen(series_key));
+    free(title_key);
+    free(author_key);
+    free(series_key);
+
+    // Отпечаток текста для поиска почти-дубликатов
+    char fingerprint_value[32] = "NULL";
+    if (meta->text_fingerprint) {
+        snprintf(fingerprint_value, sizeof(fingerprint_value), "%llu", (unsigned long long)meta->text_fingerprint);
+    }
+
+    // Значения идут производной таблицей incoming, чтобы ON DUPLICATE KEY UPDATE мог сравнить
+    // размеры новой и существующей книги (VALUES() в MySQL 8 устарел). series_id и genre_id
+    // проставляет mysql_link_batch_dictionaries по сохраненной строке; замена издания их сбрасывает
+    char sql[24576];
+    int length = snprintf(sql, sizeof(sql),
+        "INSERT INTO books (file_path, file_name, file_size, file_type, "
+        "archive_path, archive_internal_path, title, author, genre, series, "
+        "series_number, year, language, publisher, file_hash, cover_key, "
+        "title_key, author_key, series_key, series_id, genre_id, text_fingerprint, last_modified) "
+        "SELECT * FROM (SELECT '%s' AS file_path, '%s' AS file_name, %ld AS file_size, '%s' AS file_type, "
+        "%s AS archive_path, %s AS archive_internal_path, '%s' AS title, '%s' AS author, '%s' AS genre, "
+        "'%s' AS series, %d AS series_number, %d AS year, '%s' AS language, '%s' AS publisher, "
+        "%s AS file_hash, %s AS cover_key, '%s' AS title_key, '%s' AS author_key, '%s' AS series_key, "
+        "NULL AS series_id, NULL AS genre_id, %s AS text_fingerprint, NOW() AS last_modified) AS incoming%s%s",
+        escaped_filepath, escaped_filename, file_size, escaped_filetype,
+        archive_value, internal_value, escaped_title, escaped_author, escaped_genre,
+        escaped_series, series_number, year, escaped_language, escaped_publisher,
+        hash_value, cover_value, escaped_title_key, escaped_author_key, escaped_series_key,
+        fingerprint_value, hash_condition, mysql_book_upsert);
+
+    if (length < 0 || (size_t)length >= sizeof(sql)) {
+        LOG_ERROR(config, "INSERT for %s does not fit in %zu bytes", filepath, sizeof(sql));
+        metrics_inc(METRIC_ERRORS_DB);
+        return;
+    }
 
-        if (affected_rows == 0) {
-            //printf("DEBUG: [MYSQL_INSERT_BOOK] Book already existed (INSERT IGNORE worked)\n");
+    MySQLBookBatch *batch = &mysql_conn->batch;
+    if (batch->count > 0 && batch->length + (size_t)length > MYSQL_BATCH_BYTES) {
+        mysql_flush_books(mysql_conn, config);
+    }
+    if (!batch_append(batch, sql, (size_t)length)) {
+        LOG_ERROR(config, "Out of memory while queueing %s", filepath);
+        metrics_inc(METRIC_ERRORS_DB);
+        return;
+    }
+    __atomic_store_n(&mysql_conn->unflushed, batch->count, __ATOMIC_RELEASE);
+    if (batch->count >= MYSQL_BATCH_BOOKS) {
+        mysql_flush_books(mysql_conn, config);
+    }
+}
+
+// Словари записанных книг пакета: серия, основной жанр и связи с авторами. Имена читаются из
+// сохраненных строк books, а не из пакета: ON DUPLICATE KEY UPDATE мог оставить прежнюю книгу,
+// а в словари попадают только имена записанных книг. У замененной книги (affected = 2) прежние
+// связи удаляются - иначе при ней остались бы авторы меньшего издания
+static int mysql_link_batch_dictionaries(MySQLConnection *mysql_conn, const my_ulonglong *book_ids,
+                                         const my_ulonglong *affected, int count, Config *config) {
+    SqlBuilder select = {0};
+    SqlBuilder replaced = {0};
+    sql_append(&select, "SELECT id, author, series, genre FROM books WHERE id IN (");
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        if (!book_ids[i]) continue;
+        sql_append(&select, "%s%llu", written++ ? ", " : "", (unsigned long long)book_ids[i]);
+        if (affected[i] == 2) {
+            sql_append(&replaced, "%s%llu", replaced.length ? ", " : "", (unsigned long long)book_ids[i]);
         }
     }
+    sql_append(&select, ")");
+
+    int ok = !select.failed && !replaced.failed;
+    if (!written || !ok) {
+        free(select.sql);
+        free(replaced.sql);
+        return ok;
+    }
+
+    trace_begin("db", "mysql_link_dictionaries", NULL);
+    MYSQL_RES *result = NULL;
+    if (!mysql_query_reconnecting(mysql_conn, select.sql, select.length, config) ||
+        !(result = mysql_store_result(mysql_conn->mysql))) {
+        log_message(config, "ERROR", "Failed to read names of written books: %s", mysql_last_error(mysql_conn));
+        free(select.sql);
+        free(replaced.sql);
+        trace_end();
+        return 0;
+    }
+    free(select.sql);
 
-   //LOG_INFO(config, "Book inserted successfully. Affected rows: %llu", affected_rows);
+    // id серии и жанра - одним UPDATE с CASE по id книги
+    SqlBuilder series_case = {0};
+    SqlBuilder genre_case = {0};
+    SqlBuilder ids = {0};
+    SqlBuilder links = {0};
+    size_t header = 0;
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        my_ulonglong series_id = mysql_intern_name(mysql_conn, "series", row[2], config);
+        my_ulonglong genre_id = mysql_intern_genre(mysql_conn, row[3], config);
+        sql_append(&ids, "%s%s", ids.length ? ", " : "", row[0]);
+        if (series_id) sql_append(&series_case, " WHEN %s THEN %llu", row[0], (unsigned long long)series_id);
+        if (genre_id) sql_append(&genre_case, " WHEN %s THEN %llu", row[0], (unsigned long long)genre_id);
+
+        int name_count = 0;
+        char **names = split_author_list(row[1], &name_count);
+        for (int j = 0; j < name_count; j++) {
+            my_ulonglong author_id = mysql_intern_name(mysql_conn, "authors", names[j], config);
+            if (author_id == 0) {
+                ok = 0;
+                continue;
+            }
+            if (!header) {
+                sql_append(&links, ";INSERT IGNORE INTO book_authors (book_id, author_id, position) VALUES ");
+                header = links.length;
+            }
+            sql_append(&links, "%s(%s, %llu, %d)", links.length > header ? ", " : "", row[0],
+                       (unsigned long long)author_id, j);
+        }
+        free_string_list(names, name_count);
+    }
+    mysql_free_result(result);
+
+    // Удаление, новые связи и id словарей - одной транзакцией: повтор после обрыва связи дает тот же итог
+    SqlBuilder batch = {0};
+    sql_append(&batch, "START TRANSACTION");
+    if (ids.length) {
+        // Без ветки WHEN остается NULL: у книги нет серии или жанра
+        sql_append(&batch, ";UPDATE books SET series_id = %s%s%s, genre_id = %s%s%s WHERE id IN (%s)",
+                   series_case.length ? "CASE id" : "NULL", series_case.length ? series_case.sql : "",
+                   series_case.length ? " END" : "",
+                   genre_case.length ? "CASE id" : "NULL", genre_case.length ? genre_case.sql : "",
+                   genre_case.length ? " END" : "", ids.sql);
+    }
+    if (replaced.length) {
+        sql_append(&batch, ";DELETE FROM book_authors WHERE book_id IN (%s)", replaced.sql);
+    }
+    if (links.length) sql_append(&batch, "%s", links.sql);
+    sql_append(&batch, ";COMMIT");
+
+    if (batch.failed || series_case.failed || genre_case.failed || ids.failed || links.failed) {
+        LOG_ERROR(config, "Out of memory while linking books to dictionaries");
+        ok = 0;
+    } else if (!mysql_run_statements(mysql_conn, batch.sql, batch.length, config)) {
+        ok = 0;
+    }
+    free(batch.sql);
+    free(series_case.sql);
+    free(genre_case.sql);
+    free(ids.sql);
+    free(links.sql);
+    free(replaced.sql);
+    trace_end();
+    return ok;
+}
+
+// Ошибки, после которых пакет повторяется целиком: транзакция уже откачена сервером
+static int batch_error_retryable(MySQLConnection *mysql_conn) {
+    return mysql_connection_lost(mysql_conn) ||
+           mysql_errno(mysql_conn->mysql) == ER_LOCK_DEADLOCK;
+}
+
+static void mysql_pool_write_ready_archives(MySQLPool *pool, MySQLConnection *mysql_conn, Config *config);
+
+int mysql_flush_books(MySQLConnection *mysql_conn, Config *config) {
+    if (!mysql_conn) return 0;
+    MySQLBookBatch *batch = &mysql_conn->batch;
+    if (batch->count == 0) return 1;
+
+    trace_begin("db", "mysql_flush_books", NULL);
+
+    // Для каждой книги: строк затронуто (1 - добавлена, 2 - заменила меньшее издание) и ее id
+    my_ulonglong affected[MYSQL_BATCH_BOOKS];
+    my_ulonglong ids[MYSQL_BATCH_BOOKS];
+    memset(ids, 0, sizeof(ids));
+
+    static const char begin_sql[] = "START TRANSACTION;";
+    static const char commit_sql[] = ";COMMIT";
+    char *query = malloc(sizeof(begin_sql) + batch->length + sizeof(commit_sql));
+
+    int first = 0;
+    int retries = 0;
+    int ok = query != NULL;
+    while (ok && first < batch->count) {
+        if (!mysql_conn->mysql && !mysql_reconnect_counted(mysql_conn, config)) {
+            ok = 0;
+            break;
+        }
+
+        // Пакет в одной транзакции: одна фиксация InnoDB на сотни книг, а при обрыве связи
+        // сервер откатывает все, и пакет можно просто повторить с книги first
+        size_t tail = batch->length - batch->starts[first];
+        size_t length = sizeof(begin_sql) - 1;
+        memcpy(query, begin_sql, length);
+        memcpy(query + length, batch->sql + batch->starts[first], tail);
+        length += tail;
+        memcpy(query + length, commit_sql, sizeof(commit_sql));
+        length += sizeof(commit_sql) - 1;
+
+        // Результаты идут по порядку: START TRANSACTION, книги first..count-1, COMMIT
+        int results = batch->count - first + 2;
+        int result = 0;
+        trace_begin("db", "mysql_batch", NULL);
+        int status = mysql_real_query(mysql_conn->mysql, query, length);
+        while (status == 0) {
+            int book = first + result - 1;
+            if (result > 0 && book < batch->count) {
+                affected[book] = mysql_affected_rows(mysql_conn->mysql);
+                ids[book] = affected[book] ? mysql_insert_id(mysql_conn->mysql) : 0;
+            }
+            result++;
+            status = mysql_next_result(mysql_conn->mysql);
+        }
+        trace_end();
+        metrics_inc(METRIC_DB_BATCHES);
+
+        int last = batch->count;
+        if (status > 0 || result < results) {
+            // Ошибка в операторе номер result: следующие сервер не выполнял
+            if (batch_error_retryable(mysql_conn)) {
+                if (++retries > MYSQL_BATCH_RETRIES) {
+                    LOG_ERROR(config, "MySQL batch failed after %d retries: %s",
+                              MYSQL_BATCH_RETRIES, mysql_last_error(mysql_conn));
+                    ok = 0;
+                    break;
+                }
+                if (mysql_connection_lost(mysql_conn) && !mysql_reconnect_counted(mysql_conn, config)) {
+                    ok = 0;
+                    break;
+                }
+                continue;
+            }
+
+            int failed = first + result - 1;
+            if (result == 0 || failed >= batch->count) {
+                LOG_ERROR(config, "MySQL batch transaction failed: %s", mysql_last_error(mysql_conn));
+                mysql_query(mysql_conn->mysql, "ROLLBACK");
+                ok = 0;
+                break;
+            }
+
+            // Книга с ошибкой пропускается, книги до нее фиксируются
+            LOG_ERROR(config, "INSERT failed: %s", mysql_error(mysql_conn->mysql));
+            metrics_inc(METRIC_ERRORS_DB);
+            if (mysql_query(mysql_conn->mysql, "COMMIT")) {
+                if (batch_error_retryable(mysql_conn) && ++retries <= MYSQL_BATCH_RETRIES &&
+                    (!mysql_connection_lost(mysql_conn) || mysql_reconnect_counted(mysql_conn, config))) {
+                    continue;
+                }
+                LOG_ERROR(config, "MySQL batch commit failed: %s", mysql_last_error(mysql_conn));
+                ok = 0;
+                break;
+            }
+            ids[failed] = 0;
+            affected[failed] = 0;
+            last = failed;
+        }
+
+        for (int i = first; i < last; i++) {
+            if (affected[i] == 0) {
+                metrics_inc(METRIC_BOOKS_SKIPPED_EXISTING);
+            } else {
+                metrics_inc(METRIC_BOOKS_INSERTED);
+            }
+        }
+        LOG_INFO(config, "MySQL batch: %d books written", last - first);
+        first = last == batch->count ? last : last + 1;
+    }
+
+    if (!ok) {
+        // Неотправленные книги считаются ошибками записи, их id не связываются со словарями
+        metrics_add(METRIC_ERRORS_DB, (uint64_t)(batch->count - first));
+        for (int i = first; i < batch->count; i++) ids[i] = 0;
+    }
+    free(query);
+
+    mysql_link_batch_dictionaries(mysql_conn, ids, affected, batch->count, config);
+    batch_clear(batch);
+
+    // Сначала пакет пуст, затем номер отправки: mysql_pool_update_archive_info читает их в обратном порядке
+    __atomic_store_n(&mysql_conn->unflushed, 0, __ATOMIC_RELEASE);
+    if (!ok) __atomic_add_fetch(&mysql_conn->flush_failures, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&mysql_conn->flush_seq, 1, __ATOMIC_RELEASE);
+    trace_end();
+
+    if (mysql_conn->pool) mysql_pool_write_ready_archives(mysql_conn->pool, mysql_conn, config);
+    return ok;
 }
 
 
@@ -651,110 +1552,540 @@ int check_book_exists(MySQLConnection *mysql_conn, const char *filepath, BookMet
 
 
 
-int check_book_exists_smart(MySQLConnection *mysql_conn, BookMeta *meta, Config *config) {
-    if (!mysql_conn || !mysql_conn->mysql || !meta || !meta->title || !meta->author) {
+// Читает результат запроса (id, title, author, series, score) в массив hits
+static int collect_search_hits(MySQLConnection *mysql_conn, BookSearchHit **hits) {
+    MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+    if (!result) return -1;
+
+    int count = 0;
+    int rows = (int)mysql_num_rows(result);
+    if (rows > 0) {
+        *hits = calloc(rows, sizeof(BookSearchHit));
+        if (!*hits) {
+            mysql_free_result(result);
+            return -1;
+        }
+
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(result)) && count < rows) {
+            BookSearchHit *hit = &(*hits)[count++];
+            hit->id = row[0] ? atoi(row[0]) : 0;
+            hit->title = row[1] ? strdup(row[1]) : NULL;
+            hit->author = row[2] ? strdup(row[2]) : NULL;
+            hit->series = row[3] ? strdup(row[3]) : NULL;
+            hit->score = row[4] ? atof(row[4]) : 0.0;
+        }
+    }
+
+    mysql_free_result(result);
+    return count;
+}
+
+int mysql_search_books(MySQLConnection *mysql_conn, const char *query, int limit,
+                       BookSearchHit **hits, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql || !query || !hits) return -1;
+    *hits = NULL;
+
+    // Запрос в BOOLEAN MODE: каждое слово обязательно и ищется как префикс (+толст* +война*).
+    // Операторы полнотекстового синтаксиса из ввода выбрасываем.
+    size_t len = strlen(query);
+    char *boolean_query = malloc(len * 3 + 1);
+    if (!boolean_query) return -1;
+
+    char *out = boolean_query;
+    const char *p = query;
+    while (*p) {
+        while (*p && (isspace((unsigned char)*p) || strchr("+-<>()~*\"@", *p))) p++;
+        if (!*p) break;
+
+        if (out != boolean_query) *out++ = ' ';
+        *out++ = '+';
+        while (*p && !isspace((unsigned char)*p)) {
+            if (!strchr("+-<>()~*\"@", *p)) *out++ = *p;
+            p++;
+        }
+        *out++ = '*';
+    }
+    *out = '\0';
+
+    if (out == boolean_query) {
+        free(boolean_query);
         return 0;
     }
 
-    printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] Checking: '%s' by '%s' (size: %ld)\n",
-           meta->title, meta->author, meta->file_size);
+    size_t escaped_len = strlen(boolean_query) * 2 + 1;
+    char *escaped = malloc(escaped_len);
+    if (!escaped) {
+        free(boolean_query);
+        return -1;
+    }
+    mysql_real_escape_string(mysql_conn->mysql, escaped, boolean_query, strlen(boolean_query));
+    free(boolean_query);
+
+    size_t sql_len = strlen(escaped) * 2 + 512;
+    char *sql = malloc(sql_len);
+    if (!sql) {
+        free(escaped);
+        return -1;
+    }
+    snprintf(sql, sql_len,
+             "SELECT id, title, author, series, "
+             "MATCH(title, author, series, genre) AGAINST ('%s' IN BOOLEAN MODE) AS score "
+             "FROM books WHERE MATCH(title, author, series, genre) AGAINST ('%s' IN BOOLEAN MODE) "
+             "ORDER BY score DESC LIMIT %d",
+             escaped, escaped, limit > 0 ? limit : 50);
+    free(escaped);
 
-    // Экранируем строки
-    char *escaped_title = malloc(strlen(meta->title) * 2 + 1);
-    char *escaped_author = malloc(strlen(meta->author) * 2 + 1);
+    if (mysql_query(mysql_conn->mysql, sql)) {
+        log_message(config, "ERROR", "Search failed: %s", mysql_error(mysql_conn->mysql));
+        free(sql);
+        return -1;
+    }
+    free(sql);
 
-    mysql_real_escape_string(mysql_conn->mysql, escaped_title, meta->title, strlen(meta->title));
-    mysql_real_escape_string(mysql_conn->mysql, escaped_author, meta->author, strlen(meta->author));
+    return collect_search_hits(mysql_conn, hits);
+}
 
-    // Ищем книги с тем же автором и названием
-    char sql[4096];
-    snprintf(sql, sizeof(sql),
-        "SELECT id, file_size, file_path FROM books WHERE title = '%s' AND author = '%s' ORDER BY file_size DESC",
-        escaped_title, escaped_author);
+int mysql_search_substring(MySQLConnection *mysql_conn, const char *fragment, int limit,
+                           BookSearchHit **hits, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql || !fragment || !hits) return -1;
+    *hits = NULL;
+
+    // Наличие ft_books_ngram кэшируется в соединении до следующего изменения индексов.
+    // Ошибка проверки не кэшируется: этот поиск идет через LIKE, следующий проверит снова
+    uint32_t epoch = __atomic_load_n(&index_epoch, __ATOMIC_ACQUIRE);
+    int use_ngram = mysql_conn->has_ngram_index;
+    if (use_ngram < 0 || mysql_conn->index_epoch != epoch) {
+        use_ngram = mysql_index_exists(mysql_conn, "books", "ft_books_ngram", config);
+        if (use_ngram >= 0) {
+            mysql_conn->has_ngram_index = use_ngram;
+            mysql_conn->index_epoch = epoch;
+        }
+    }
+
+    size_t len = strlen(fragment);
+    char *escaped = malloc(len * 2 + 1);
+    if (!escaped) return -1;
+    mysql_real_escape_string(mysql_conn->mysql, escaped, fragment, len);
+
+    size_t sql_len = strlen(escaped) * 2 + 512;
+    char *sql = malloc(sql_len);
+    if (!sql) {
+        free(escaped);
+        return -1;
+    }
 
-    printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] SQL: %s\n", sql);
+    if (use_ngram > 0 && !strchr(fragment, '"')) {
+        // Фраза в кавычках: все n-граммы подряд, то есть вхождение подстроки
+        snprintf(sql, sql_len,
+                 "SELECT id, title, author, series, 0 FROM books "
+                 "WHERE MATCH(title, author, series) AGAINST ('\"%s\"' IN BOOLEAN MODE) "
+                 "ORDER BY author, title LIMIT %d",
+                 escaped, limit > 0 ? limit : 50);
+    } else {
+        // utf8mb4_unicode_ci делает LIKE регистронезависимым и для кириллицы
+        snprintf(sql, sql_len,
+                 "SELECT id, title, author, series, 0 FROM books "
+                 "WHERE title LIKE '%%%s%%' OR author LIKE '%%%s%%' OR series LIKE '%%%s%%' "
+                 "ORDER BY author, title LIMIT %d",
+                 escaped, escaped, escaped, limit > 0 ? limit : 50);
+    }
+    free(escaped);
 
     if (mysql_query(mysql_conn->mysql, sql)) {
-        printf("ERROR: [CHECK_BOOK_EXISTS_SMART] Query failed: %s\n", mysql_error(mysql_conn->mysql));
-        free(escaped_title);
-        free(escaped_author);
-        return 0;
+        log_message(config, "ERROR", "Substring search failed: %s", mysql_error(mysql_conn->mysql));
+        free(sql);
+        return -1;
     }
+    free(sql);
 
-    MYSQL_RES *result = mysql_store_result(mysql_conn->mysql);
+    return collect_search_hits(mysql_conn, hits);
+}
+
+long mysql_load_fingerprints(MySQLConnection *mysql_conn, const char *select_sql,
+                             DedupeBook **books, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql || !select_sql || !books) return -1;
+    *books = NULL;
+
+    if (mysql_query(mysql_conn->mysql, select_sql)) {
+        log_message(config, "ERROR", "Failed to select fingerprints: %s", mysql_error(mysql_conn->mysql));
+        return -1;
+    }
+
+    // Строки читаются потоком: вся выборка в памяти клиента была бы вдвое больше массива
+    MYSQL_RES *result = mysql_use_result(mysql_conn->mysql);
     if (!result) {
-        printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] No existing books found\n");
-        free(escaped_title);
-        free(escaped_author);
-        return 0;
+        log_message(config, "ERROR", "Failed to read fingerprints: %s", mysql_error(mysql_conn->mysql));
+        return -1;
+    }
+
+    long capacity = 0;
+    long count = 0;
+    int failed = 0;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result))) {
+        if (failed) continue;   // строки потока нужно дочитать до конца
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            DedupeBook *grown = realloc(*books, capacity * sizeof(DedupeBook));
+            if (!grown) {
+                failed = 1;
+                continue;
+            }
+            *books = grown;
+        }
+
+        DedupeBook *book = &(*books)[count++];
+        book->id = row[0] ? strtoll(row[0], NULL, 10) : 0;
+        book->fingerprint = row[1] ? strtoull(row[1], NULL, 10) : 0;
+        book->file_size = row[2] ? strtoll(row[2], NULL, 10) : 0;
+        book->completeness = row[3] ? atoi(row[3]) : 0;
+        book->duplicate_of = 0;
     }
 
-    int existing_count = mysql_num_rows(result);
-    printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] Found %d existing books\n", existing_count);
+    if (mysql_errno(mysql_conn->mysql)) {
+        log_message(config, "ERROR", "Failed to read fingerprints: %s", mysql_error(mysql_conn->mysql));
+        failed = 1;
+    }
+    mysql_free_result(result);
 
-    if (existing_count == 0) {
-        mysql_free_result(result);
-        free(escaped_title);
-        free(escaped_author);
+    if (failed) {
+        free(*books);
+        *books = NULL;
+        return -1;
+    }
+    return count;
+}
+
+// Книг в одном UPDATE ... CASE id: одна команда на сотни книг вместо команды на каждую
+#define DUPLICATES_BATCH 500
+
+int mysql_store_duplicates(MySQLConnection *mysql_conn, const DedupeBook *books, long count, Config *config) {
+    if (!mysql_conn || !mysql_conn->mysql) return 0;
+
+    // "WHEN id THEN id " и "id," - не больше 64 байт на книгу
+    size_t sql_size = DUPLICATES_BATCH * 64 + 256;
+    char *sql = malloc(sql_size);
+    char *id_list = malloc(DUPLICATES_BATCH * 24 + 1);
+    if (!sql || !id_list) {
+        free(sql);
+        free(id_list);
         return 0;
     }
 
-    // Анализируем найденные книги
-    MYSQL_ROW row;
-    int should_skip = 0;
-    char decision_reason[256] = {0};
+    int ok = mysql_execute_query(mysql_conn, "START TRANSACTION", config) &&
+             mysql_execute_query(mysql_conn, "UPDATE books SET duplicate_of = NULL WHERE duplicate_of IS NOT NULL", config);
+
+    long i = 0;
+    while (ok && i < count) {
+        size_t sql_len = (size_t)snprintf(sql, sql_size, "UPDATE books SET duplicate_of = CASE id ");
+        size_t list_len = 0;
+        int batched = 0;
+
+        for (; i < count && batched < DUPLICATES_BATCH; i++) {
+            if (!books[i].duplicate_of) continue;
+            sql_len += (size_t)snprintf(sql + sql_len, sql_size - sql_len, "WHEN %lld THEN %lld ",
+                                        books[i].id, books[i].duplicate_of);
+            list_len += (size_t)sprintf(id_list + list_len, "%s%lld", batched ? "," : "", books[i].id);
+            batched++;
+        }
+        if (batched == 0) break;
 
-    while ((row = mysql_fetch_row(result))) {
-        int existing_id = atoi(row[0]);
-        long existing_size = row[1] ? atol(row[1]) : 0;
-        const char *existing_path = row[2] ? row[2] : "unknown";
+        snprintf(sql + sql_len, sql_size - sql_len, "END WHERE id IN (%s)", id_list);
+        ok = mysql_execute_query(mysql_conn, sql, config);
+    }
 
-        printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] Existing book: ID=%d, Size=%ld, Path=%s\n",
-               existing_id, existing_size, existing_path);
+    if (ok) {
+        ok = mysql_execute_query(mysql_conn, "COMMIT", config);
+    } else {
+        mysql_execute_query(mysql_conn, "ROLLBACK", config);
+    }
 
-        // ЛОГИКА ПРИНЯТИЯ РЕШЕНИЯ:
+    free(sql);
+    free(id_list);
+    return ok;
+}
 
-        // 1. Если новая книга значительно меньше существующей (менее 50%) - вероятно, это сокращенная версия
-        if (meta->file_size > 0 && existing_size > 0 && meta->file_size < existing_size * 0.5) {
-            snprintf(decision_reason, sizeof(decision_reason),
-                     "new book is much smaller (%ld vs %ld) - probably abridged version",
-                     meta->file_size, existing_size);
-            should_skip = 1;
-            break;
+// Поток, вызвавший mysql_thread_init, должен вызвать mysql_thread_end перед завершением
+static pthread_key_t mysql_thread_key;
+static pthread_once_t mysql_thread_once = PTHREAD_ONCE_INIT;
+
+static void mysql_thread_exit(void *value) {
+    (void)value;
+    mysql_thread_end();
+}
+
+static void mysql_thread_key_create(void) {
+    pthread_key_create(&mysql_thread_key, mysql_thread_exit);
+}
+
+static void mysql_thread_attach(void) {
+    pthread_once(&mysql_thread_once, mysql_thread_key_create);
+    if (!pthread_getspecific(mysql_thread_key)) {
+        mysql_thread_init();
+        pthread_setspecific(mysql_thread_key, (void*)1);
+    }
+}
+
+// Соединение, чей пакет ждет отложенный архив: слот пула или основное (slot < 0)
+typedef struct {
+    int slot;
+    uint32_t flush_failures;
+    uint32_t flush_seq;
+} MySQLArchiveWait;
+
+struct MySQLPendingArchive {
+    char *archive_path;
+    char *hash;
+    int file_count;
+    long total_size;
+    int failed;             // пакет с книгами архива не записан - строку не пишем
+    int wait_count;
+    MySQLPendingArchive *next;
+    MySQLArchiveWait waits[];
+};
+
+static MySQLConnection* pool_watched(MySQLPool *pool, int slot) {
+    return slot < 0 ? pool->main : pool->connections[slot];
+}
+
+static void pending_archive_free(MySQLPendingArchive *archive) {
+    free(archive->archive_path);
+    free(archive->hash);
+    free(archive);
+}
+
+// Вызывается под pool->lock. 1 - все пакеты, которых ждал архив, ушли на сервер
+static int pending_archive_ready(MySQLPool *pool, MySQLPendingArchive *archive) {
+    for (int i = 0; i < archive->wait_count; i++) {
+        const MySQLArchiveWait *wait = &archive->waits[i];
+        MySQLConnection *conn = pool_watched(pool, wait->slot);
+        if (!conn) continue;
+        if (__atomic_load_n(&conn->flush_seq, __ATOMIC_ACQUIRE) == wait->flush_seq) return 0;
+        if (__atomic_load_n(&conn->flush_failures, __ATOMIC_ACQUIRE) != wait->flush_failures) {
+            archive->failed = 1;
+        }
+    }
+    return 1;
+}
+
+// Пишет через mysql_conn строки архивов, дождавшихся своих пакетов. Вызывается владельцем
+// mysql_conn после каждой отправки его пакета
+static void mysql_pool_write_ready_archives(MySQLPool *pool, MySQLConnection *mysql_conn, Config *config) {
+    // Готовые архивы снимаются с очереди под блокировкой, а пишутся без нее
+    MySQLPendingArchive *ready = NULL;
+    pthread_mutex_lock(&pool->lock);
+    MySQLPendingArchive **link = &pool->pending_archives;
+    while (*link) {
+        MySQLPendingArchive *archive = *link;
+        if (pending_archive_ready(pool, archive)) {
+            *link = archive->next;
+            archive->next = ready;
+            ready = archive;
+        } else {
+            link = &archive->next;
         }
+    }
+    pthread_mutex_unlock(&pool->lock);
 
-        // 2. Если новая книга значительно больше существующей (более 150%) - вероятно, это полная версия
-        if (meta->file_size > 0 && existing_size > 0 && meta->file_size > existing_size * 1.1) {
-            snprintf(decision_reason, sizeof(decision_reason),
-                     "new book is much larger (%ld vs %ld) - probably full version, will replace",
-                     meta->file_size, existing_size);
-            // Удаляем старую (меньшую) версию
-            char delete_sql[512];
-            snprintf(delete_sql, sizeof(delete_sql), "DELETE FROM books WHERE id = %d", existing_id);
-            mysql_query(mysql_conn->mysql, delete_sql);
-            printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] Deleted smaller version: ID=%d\n", existing_id);
-            should_skip = 0; // Продолжаем с добавлением новой книги
-            break;
+    while (ready) {
+        MySQLPendingArchive *archive = ready;
+        ready = archive->next;
+        if (archive->failed) {
+            LOG_WARNING(config, "Archive %s is not recorded: its books were not written", archive->archive_path);
+        } else {
+            mysql_write_archive_info(mysql_conn, archive->archive_path, archive->hash,
+                                     archive->file_count, archive->total_size, config);
         }
+        pending_archive_free(archive);
+    }
+}
+
+void mysql_pool_update_archive_info(MySQLPool *pool, MySQLConnection *mysql_conn, const char *archive_path,
+                                    const char *hash, int file_count, long total_size, Config *config) {
+    if (!pool) {
+        mysql_update_archive_info(mysql_conn, archive_path, hash, file_count, total_size, config);
+        return;
+    }
+    if (!mysql_conn) return;
 
-        // 3. Если размеры сопоставимы (±50%) - считаем это той же книгой
-        if (meta->file_size > 0 && existing_size > 0 &&
-            meta->file_size >= existing_size * 0.5 &&
-            meta->file_size <= existing_size * 1.5) {
-            snprintf(decision_reason, sizeof(decision_reason),
-                     "sizes are comparable (%ld vs %ld) - probably same book",
-                     meta->file_size, existing_size);
-            should_skip = 1;
+    if (!mysql_flush_books(mysql_conn, config)) {
+        LOG_WARNING(config, "Archive %s is not recorded: its books were not written", archive_path);
+        return;
+    }
+
+    MySQLPendingArchive *archive = calloc(1, sizeof(MySQLPendingArchive) +
+                                             (size_t)(pool->capacity + 1) * sizeof(MySQLArchiveWait));
+    if (archive) {
+        archive->archive_path = strdup(archive_path);
+        archive->hash = hash ? strdup(hash) : NULL;
+        archive->file_count = file_count;
+        archive->total_size = total_size;
+    }
+    if (!archive || !archive->archive_path || (hash && !archive->hash)) {
+        LOG_ERROR(config, "Out of memory while recording archive %s", archive_path);
+        if (archive) pending_archive_free(archive);
+        return;
+    }
+
+    // Все книги архива уже в пакетах (сканер зовет запись после последней). Ждем соединения с
+    // непустым пакетом до следующей их отправки. Порядок чтения обратен mysql_flush_books:
+    // отправка, завершившаяся между чтениями, не теряется и не теряет свою ошибку
+    pthread_mutex_lock(&pool->lock);
+    for (int slot = -1; slot < pool->size; slot++) {
+        MySQLConnection *conn = pool_watched(pool, slot);
+        if (!conn || conn == mysql_conn) continue;
+        uint32_t failures = __atomic_load_n(&conn->flush_failures, __ATOMIC_ACQUIRE);
+        uint32_t seq = __atomic_load_n(&conn->flush_seq, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&conn->unflushed, __ATOMIC_ACQUIRE) == 0) continue;
+        archive->waits[archive->wait_count++] = (MySQLArchiveWait){slot, failures, seq};
+    }
+    archive->next = pool->pending_archives;
+    pool->pending_archives = archive;
+    pthread_mutex_unlock(&pool->lock);
+
+    // Без ожиданий архив пишется сразу; пакеты, ушедшие до постановки в очередь, проверку уже не позовут
+    mysql_pool_write_ready_archives(pool, mysql_conn, config);
+}
+
+MySQLPool* mysql_pool_create(Config *config, int capacity, MySQLConnection *main) {
+    if (!config) return NULL;
+    if (capacity < 1) capacity = 1;
+
+    MySQLPool *pool = calloc(1, sizeof(MySQLPool));
+    if (!pool) return NULL;
+
+    pool->connections = calloc(capacity, sizeof(MySQLConnection*));
+    pool->busy = calloc(capacity, sizeof(int));
+    if (!pool->connections || !pool->busy || pthread_key_create(&pool->owned, NULL) != 0) {
+        free(pool->connections);
+        free(pool->busy);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->released, NULL);
+    pool->capacity = capacity;
+    pool->config = config;
+    pool->main = main;
+    if (main) main->pool = pool;
+    return pool;
+}
+
+void mysql_pool_destroy(MySQLPool *pool) {
+    if (!pool) return;
+
+    // Остатки пакетов отправляются до закрытия соединений: отложенные архивы пишутся через открытые
+    for (int i = 0; i < pool->size; i++) {
+        if (pool->busy[i]) {
+            log_message(pool->config, "WARNING", "MySQL pool closed while connection %d is checked out", i);
+        }
+        if (pool->connections[i]) mysql_flush_books(pool->connections[i], pool->config);
+    }
+    if (pool->main) {
+        mysql_flush_books(pool->main, pool->config);
+        mysql_pool_write_ready_archives(pool, pool->main, pool->config);
+        pool->main->pool = NULL;
+    }
+    while (pool->pending_archives) {
+        MySQLPendingArchive *archive = pool->pending_archives;
+        pool->pending_archives = archive->next;
+        log_message(pool->config, "WARNING", "Archive %s is not recorded: its books were not written",
+                    archive->archive_path);
+        pending_archive_free(archive);
+    }
+
+    for (int i = 0; i < pool->size; i++) {
+        if (pool->connections[i]) mysql_conn_close(pool->connections[i]);
+    }
+    pthread_key_delete(pool->owned);
+    pthread_cond_destroy(&pool->released);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->connections);
+    free(pool->busy);
+    free(pool);
+}
+
+MySQLConnection* mysql_pool_current(MySQLPool *pool) {
+    return pool ? pthread_getspecific(pool->owned) : NULL;
+}
+
+// Освобождает слот, не отдавая соединение потоку
+static void mysql_pool_put(MySQLPool *pool, int slot) {
+    pthread_mutex_lock(&pool->lock);
+    pool->busy[slot] = 0;
+    pthread_cond_signal(&pool->released);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+MySQLConnection* mysql_pool_acquire(MySQLPool *pool) {
+    if (!pool) return NULL;
+
+    MySQLConnection *own = pthread_getspecific(pool->owned);
+    if (own) {
+        own->checkouts++;
+        return own;
+    }
+    mysql_thread_attach();
+
+    // Сначала свободное открытое соединение, затем новый слот; иначе ждем возврата
+    pthread_mutex_lock(&pool->lock);
+    int slot = -1;
+    for (;;) {
+        for (int i = 0; i < pool->size; i++) {
+            if (!pool->busy[i] && (slot < 0 || pool->connections[i])) slot = i;
+        }
+        if (slot >= 0) break;
+        if (pool->size < pool->capacity) {
+            slot = pool->size++;
             break;
         }
+        pthread_cond_wait(&pool->released, &pool->lock);
+    }
+    pool->busy[slot] = 1;
+    MySQLConnection *conn = pool->connections[slot];
+    pthread_mutex_unlock(&pool->lock);
+
+    // Соединение открывается и проверяется вне блокировки: остальные потоки не ждут сеть
+    if (!conn) {
+        conn = mysql_conn_connect(pool->config);
+        if (!conn) {
+            log_message(pool->config, "ERROR", "MySQL pool: failed to open connection %d", slot);
+            mysql_pool_put(pool, slot);
+            return NULL;
+        }
+        conn->pool_slot = slot;
+        conn->pool = pool;
+        pthread_mutex_lock(&pool->lock);
+        pool->connections[slot] = conn;
+        pthread_mutex_unlock(&pool->lock);
+    } else if (!conn->mysql || metrics_now() - conn->last_used > MYSQL_POOL_IDLE_CHECK) {
+        // Сервер мог закрыть простаивающее соединение по wait_timeout
+        trace_begin("db", "mysql_ping", NULL);
+        int lost = !conn->mysql || mysql_ping(conn->mysql);
+        trace_end();
+        if (lost && !mysql_reconnect_counted(conn, pool->config)) {
+            mysql_pool_put(pool, slot);
+            return NULL;
+        }
     }
 
-    mysql_free_result(result);
-    free(escaped_title);
-    free(escaped_author);
+    conn->checkouts = 1;
+    pthread_setspecific(pool->owned, conn);
+    metrics_gauge_add(METRIC_GAUGE_DB_CONNECTIONS_BUSY, 1);
+    return conn;
+}
+
+void mysql_pool_release(MySQLPool *pool) {
+    if (!pool) return;
 
-    printf("DEBUG: [CHECK_BOOK_EXISTS_SMART] Decision: %s (%s)\n",
-           should_skip ? "SKIP" : "INSERT", decision_reason);
+    MySQLConnection *conn = pthread_getspecific(pool->owned);
+    if (!conn || --conn->checkouts > 0) return;
 
-    return should_skip;
+    // Книги потока не должны застрять в простаивающем соединении
+    mysql_flush_books(conn, pool->config);
+    conn->last_used = metrics_now();
+    pthread_setspecific(pool->owned, NULL);
+    metrics_gauge_add(METRIC_GAUGE_DB_CONNECTIONS_BUSY, -1);
+    mysql_pool_put(pool, conn->pool_slot);
 }
@@ -4,23 +4,132 @@
 #include "config.h"
 #include "database.h"
 #include <mysql/mysql.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Книги в пакете записи и размер запроса, после которых пакет отправляется на сервер
+#define MYSQL_BATCH_BOOKS 256
+#define MYSQL_BATCH_BYTES (1024 * 1024)
+// Сколько раз пакет повторяется после обрыва связи или взаимной блокировки
+#define MYSQL_BATCH_RETRIES 3
+
+// Книги, ожидающие записи: по оператору INSERT на книгу, отправляются одним запросом (multi-statements)
+typedef struct {
+    char *sql;                              // операторы через ';'
+    size_t length;
+    size_t capacity;
+    size_t starts[MYSQL_BATCH_BOOKS];       // начало оператора каждой книги в sql
+    int count;
+} MySQLBookBatch;
+
+// Подготовленных запросов на соединение (mysql_cached_stmt)
+#define MYSQL_STMT_CACHE_SIZE 16
+// Соединение из пула, простоявшее дольше стольких секунд, проверяется mysql_ping перед выдачей
+#define MYSQL_POOL_IDLE_CHECK 60
+
+typedef struct {
+    const char *sql;
+    MYSQL_STMT *stmt;
+} MySQLCachedStmt;
+
+typedef struct MySQLPool MySQLPool;
 
 // Структура для MySQL соединения
 typedef struct {
     MYSQL *mysql;
     MYSQL_STMT *stmt;
+    Config *config;         // для записи остатка пакета при закрытии
+    MySQLBookBatch batch;
+    MySQLCachedStmt stmt_cache[MYSQL_STMT_CACHE_SIZE];
+    int stmt_count;
+    int stmt_next;          // следующая вытесняемая запись заполненного кэша
+    int checkouts;          // вложенных mysql_pool_acquire владеющего потока
+    int pool_slot;
+    double last_used;       // metrics_now() возврата в пул
+    int has_ngram_index;    // есть ли ft_books_ngram, -1 - еще не проверяли
+    uint32_t index_epoch;   // эпоха индексов, при которой проверяли has_ngram_index
+    MySQLPool *pool;        // пул, ждущий отправки пакетов этого соединения (mysql_pool_update_archive_info)
+    int unflushed;          // книг в пакете; читается другими потоками (__atomic)
+    uint32_t flush_seq;     // отправленных пакетов (__atomic)
+    uint32_t flush_failures; // из них не записанных (__atomic)
 } MySQLConnection;
 
+// Архив, чья строка в archives ждет отправки пакетов других соединений с его книгами
+typedef struct MySQLPendingArchive MySQLPendingArchive;
+
+// Пул соединений для потоков, работающих с базой параллельно. Соединения открываются по мере
+// надобности, не больше capacity; когда все заняты, mysql_pool_acquire ждет освобождения
+struct MySQLPool {
+    MySQLConnection **connections;
+    int *busy;
+    int size;               // слотов занято, соединение слота может быть еще не открыто (NULL)
+    int capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    pthread_key_t owned;    // соединение, выданное текущему потоку
+    Config *config;
+    MySQLConnection *main;  // основное соединение, не из пула; его пакет тоже ждут архивы
+    MySQLPendingArchive *pending_archives; // защищены lock
+};
+
 // Переименуем функции, чтобы избежать конфликта с MySQL библиотекой
 MySQLConnection* mysql_conn_connect(Config *config);
 void mysql_conn_close(MySQLConnection *mysql_conn);
 int mysql_execute_query(MySQLConnection *mysql_conn, const char *sql, Config *config);
 int mysql_create_tables(MySQLConnection *mysql_conn, Config *config);
 int mysql_create_archive_table(MySQLConnection *mysql_conn, Config *config);
+int mysql_ensure_column(MySQLConnection *mysql_conn, const char *table, const char *column,
+                        const char *definition, Config *config);
+int mysql_ensure_index(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                       const char *columns, Config *config);
+int mysql_ensure_fulltext_index(MySQLConnection *mysql_conn, const char *table, const char *index_name,
+                                const char *columns, const char *parser, Config *config);
+int mysql_drop_index(MySQLConnection *mysql_conn, const char *table, const char *index_name, Config *config);
+int mysql_backfill_search_keys(MySQLConnection *mysql_conn, Config *config);
+int mysql_create_dictionary_tables(MySQLConnection *mysql_conn, Config *config);
+int mysql_backfill_dictionaries(MySQLConnection *mysql_conn, Config *config);
+// Удаляет имена словарей, на которые не ссылается ни одна книга
+int mysql_delete_orphan_names(MySQLConnection *mysql_conn, Config *config);
 int mysql_archive_needs_rescan(MySQLConnection *mysql_conn, const char *archive_path, const char *current_hash, Config *config);
+// Отправляет пакет соединения и записывает строку архива: книги архива должны попасть в books раньше нее
 void mysql_update_archive_info(MySQLConnection *mysql_conn, const char *archive_path, const char *hash, int file_count, long total_size, Config *config);
 int check_book_exists(MySQLConnection *mysql_conn, const char *filepath, BookMeta *meta,
                      const char *archive_path, const char *internal_path, Config *config);
+// Ставит книгу в пакет записи; пакет уходит на сервер, когда заполнится, или в mysql_flush_books
 void mysql_insert_book(MySQLConnection *mysql_conn, const char *filepath, BookMeta *meta,
                       const char *archive_path, const char *internal_path, Config *config);
+int mysql_book_exists(MySQLConnection *mysql_conn, const char *filepath, const char *archive_path,
+                     const char *internal_path, const char *file_hash, Config *config);
+int mysql_book_hash_exists(MySQLConnection *mysql_conn, const char *file_hash);
+int mysql_reconnect(MySQLConnection *mysql_conn, Config *config);
+// Отправляет накопленный mysql_insert_book пакет; вызывается перед чтением books и при закрытии
+int mysql_flush_books(MySQLConnection *mysql_conn, Config *config);
+int mysql_search_books(MySQLConnection *mysql_conn, const char *query, int limit,
+                       BookSearchHit **hits, Config *config);
+int mysql_search_substring(MySQLConnection *mysql_conn, const char *fragment, int limit,
+                           BookSearchHit **hits, Config *config);
+// Подготовленный запрос соединения: готовится при первом вызове и живет до переподключения.
+// sql сравнивается по содержимому и не копируется (строковая константа); кэш на MYSQL_STMT_CACHE_SIZE запросов
+MYSQL_STMT* mysql_cached_stmt(MySQLConnection *mysql_conn, const char *sql, Config *config);
+
+// main - основное соединение: архивы ждут и его пакет
+MySQLPool* mysql_pool_create(Config *config, int capacity, MySQLConnection *main);
+void mysql_pool_destroy(MySQLPool *pool);
+// Соединение текущего потока: повторный вызов в том же потоке возвращает то же соединение.
+// Долго простаивавшее соединение проверяется и при необходимости переподключается. NULL - ошибка
+MySQLConnection* mysql_pool_acquire(MySQLPool *pool);
+// Парный вызов; последний возвращает соединение в пул, отправив пакет книг
+void mysql_pool_release(MySQLPool *pool);
+// Соединение, выданное текущему потоку, или NULL
+MySQLConnection* mysql_pool_current(MySQLPool *pool);
+// mysql_update_archive_info для сканирования в несколько соединений: книги архива могут лежать
+// в пакетах других соединений, и строка архива откладывается, пока все они не уйдут на сервер.
+// mysql_conn - соединение вызывающего потока (из пула или основное)
+void mysql_pool_update_archive_info(MySQLPool *pool, MySQLConnection *mysql_conn, const char *archive_path,
+                                    const char *hash, int file_count, long total_size, Config *config);
+
+// Отпечатки текста для dedupe: select_sql - общий с SQLite запрос из database.c
+long mysql_load_fingerprints(MySQLConnection *mysql_conn, const char *select_sql,
+                             DedupeBook **books, Config *config);
+int mysql_store_duplicates(MySQLConnection *mysql_conn, const DedupeBook *books, long count, Config *config);
 #endif
@@ -0,0 +1,292 @@
+// dedupe.c - отпечатки текста (SimHash) и поиск почти-дубликатов через LSH
+#include "common.h"
+#include "dedupe.h"
+#include "metrics.h"
+#include "text_fold.h"
+#include "trace.h"
+
+// Меньше троек слов - отпечаток случайный (пустая книга, одна картинка, заглушка)
+#define DEDUPE_MIN_SHINGLES 32
+// Книг одной таблицы с тем же ключом, с которыми сравнивается каждая книга: тысячи одинаковых
+// отпечатков (одна и та же книга из разных сборников) иначе дают квадратичное число сравнений
+#define DEDUPE_BUCKET_WINDOW 2048
+// Отпечаток делится на DEDUPE_MAX_DISTANCE + 2 блока; у отпечатков на расстоянии не больше
+// DEDUPE_MAX_DISTANCE хотя бы два блока совпадают, поэтому ключ таблицы - пара блоков
+#define DEDUPE_BLOCKS (DEDUPE_MAX_DISTANCE + 2)
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// FNV-1a слова из свернутого текста
+static uint64_t word_hash(const char *word, size_t len) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)word[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+// Разметка не должна сливать слова: теги и сущности заменяются пробелом
+static char* strip_markup(const char *text, size_t len) {
+    char *plain = malloc(len + 1);
+    if (!plain) return NULL;
+
+    char *out = plain;
+    int in_tag = 0;
+    for (size_t i = 0; i < len && text[i]; i++) {
+        char c = text[i];
+        if (in_tag) {
+            if (c == '>') in_tag = 0;
+            continue;
+        }
+        if (c == '<') {
+            in_tag = 1;
+            *out++ = ' ';
+            continue;
+        }
+        if (c == '&') {
+            size_t j = i + 1;
+            while (j < len && j - i <= 10 && (isalnum((unsigned char)text[j]) || text[j] == '#')) j++;
+            if (j < len && text[j] == ';') {
+                i = j;
+                *out++ = ' ';
+                continue;
+            }
+        }
+        *out++ = c;
+    }
+    *out = '\0';
+    return plain;
+}
+
+uint64_t text_fingerprint(const char *text, size_t len) {
+    if (!text || len == 0) return 0;
+
+    char *plain = strip_markup(text, len);
+    char *folded = fold_text(plain);
+    free(plain);
+    if (!folded) return 0;
+
+    // Каждая тройка слов голосует за биты своего хеша
+    int votes[64] = {0};
+    uint64_t window[3] = {0, 0, 0};
+    long words = 0;
+    long shingles = 0;
+
+    const char *p = folded;
+    while (*p && (size_t)(p - folded) < DEDUPE_TEXT_BYTES) {
+        const char *end = strchr(p, ' ');
+        size_t word_len = end ? (size_t)(end - p) : strlen(p);
+
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = word_hash(p, word_len);
+        if (++words >= 3) {
+            uint64_t shingle = splitmix64(window[0] ^ rotl64(window[1], 21) ^ rotl64(window[2], 42));
+            for (int bit = 0; bit < 64; bit++) {
+                votes[bit] += (shingle >> bit) & 1 ? 1 : -1;
+            }
+            shingles++;
+        }
+
+        p += word_len;
+        if (*p == ' ') p++;
+    }
+    free(folded);
+
+    if (shingles < DEDUPE_MIN_SHINGLES) return 0;
+
+    uint64_t fingerprint = 0;
+    for (int bit = 0; bit < 64; bit++) {
+        if (votes[bit] > 0) fingerprint |= 1ULL << bit;
+    }
+    // 0 в базе означает "нет отпечатка"
+    return fingerprint ? fingerprint : 1;
+}
+
+// Система непересекающихся множеств по индексам массива книг
+static long find_root(long *parent, long i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void join_sets(long *parent, long a, long b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a != b) parent[a > b ? a : b] = a < b ? a : b;
+}
+
+// Самый широкий блок и ключ таблицы из двух блоков
+#define DEDUPE_BLOCK_MAX_BITS ((64 + DEDUPE_BLOCKS - 1) / DEDUPE_BLOCKS)
+#define DEDUPE_KEY_BITS (2 * DEDUPE_BLOCK_MAX_BITS)
+
+typedef struct {
+    uint64_t fingerprint;
+    long index;
+} BlockEntry;
+
+static int compare_block_entries(const void *a, const void *b) {
+    const BlockEntry *x = a;
+    const BlockEntry *y = b;
+    if (x->fingerprint != y->fingerprint) return x->fingerprint < y->fingerprint ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Биты блока: 64 бита делятся на DEDUPE_BLOCKS почти равных частей
+static uint32_t fingerprint_block(uint64_t fingerprint, int block) {
+    int first = block * 64 / DEDUPE_BLOCKS;
+    int last = (block + 1) * 64 / DEDUPE_BLOCKS;
+    return (uint32_t)((fingerprint >> first) & ((1ULL << (last - first)) - 1));
+}
+
+static uint32_t table_key(uint64_t fingerprint, int first, int second) {
+    return fingerprint_block(fingerprint, first) << DEDUPE_BLOCK_MAX_BITS | fingerprint_block(fingerprint, second);
+}
+
+// Сравнивает книги с одним ключом таблицы. Большие группы сортируются по отпечатку, чтобы
+// окно DEDUPE_BUCKET_WINDOW захватывало ближайшие отпечатки и цепочки одинаковых
+static void join_bucket(long *parent, BlockEntry *bucket, long size) {
+    if (size > DEDUPE_BUCKET_WINDOW) {
+        qsort(bucket, size, sizeof(BlockEntry), compare_block_entries);
+    }
+    for (long i = 0; i < size; i++) {
+        for (long j = i + 1; j < size && j - i <= DEDUPE_BUCKET_WINDOW; j++) {
+            if (__builtin_popcountll(bucket[i].fingerprint ^ bucket[j].fingerprint) <= DEDUPE_MAX_DISTANCE) {
+                join_sets(parent, bucket[i].index, bucket[j].index);
+            }
+        }
+    }
+}
+
+// Каноническое издание: больше метаданных, затем больше файл, затем раньше добавлено
+static int better_edition(const DedupeBook *a, const DedupeBook *b) {
+    if (a->completeness != b->completeness) return a->completeness > b->completeness;
+    if (a->file_size != b->file_size) return a->file_size > b->file_size;
+    return a->id < b->id;
+}
+
+long dedupe_cluster(DedupeBook *books, long count) {
+    if (!books || count <= 0) return 0;
+
+    long *parent = malloc(count * sizeof(long));
+    BlockEntry *entries = malloc(count * sizeof(BlockEntry));
+    uint32_t *offsets = malloc(((1UL << DEDUPE_KEY_BITS) + 1) * sizeof(uint32_t));
+    if (!parent || !entries || !offsets || count > UINT32_MAX) {
+        free(parent);
+        free(entries);
+        free(offsets);
+        return -1;
+    }
+    for (long i = 0; i < count; i++) {
+        parent[i] = i;
+        books[i].duplicate_of = 0;
+    }
+
+    // Сравниваются только книги с общим ключом хотя бы в одной из C(DEDUPE_BLOCKS, 2) таблиц:
+    // при миллионах книг у ключа единицы книг. Таблица раскладывается сортировкой подсчетом
+    const size_t key_count = 1UL << DEDUPE_KEY_BITS;
+    for (int first = 0; first < DEDUPE_BLOCKS; first++) {
+        for (int second = first + 1; second < DEDUPE_BLOCKS; second++) {
+            memset(offsets, 0, (key_count + 1) * sizeof(uint32_t));
+            for (long i = 0; i < count; i++) {
+                offsets[table_key(books[i].fingerprint, first, second) + 1]++;
+            }
+            for (size_t key = 0; key < key_count; key++) {
+                offsets[key + 1] += offsets[key];
+            }
+            for (long i = 0; i < count; i++) {
+                uint32_t slot = offsets[table_key(books[i].fingerprint, first, second)]++;
+                entries[slot].fingerprint = books[i].fingerprint;
+                entries[slot].index = i;
+            }
+
+            // После раскладки offsets[key] - конец группы ключа
+            long start = 0;
+            for (size_t key = 0; key < key_count; key++) {
+                long end = offsets[key];
+                if (end - start > 1) join_bucket(parent, entries + start, end - start);
+                start = end;
+            }
+        }
+    }
+    free(offsets);
+    free(entries);
+
+    // Корень группы - ее наименьший индекс, поэтому он встречается раньше остальных книг группы
+    long *best = malloc(count * sizeof(long));
+    if (!best) {
+        free(parent);
+        return -1;
+    }
+    for (long i = 0; i < count; i++) {
+        long root = find_root(parent, i);
+        if (root == i) {
+            best[i] = i;
+        } else if (better_edition(&books[i], &books[best[root]])) {
+            best[root] = i;
+        }
+    }
+
+    long duplicates = 0;
+    for (long i = 0; i < count; i++) {
+        long canonical = best[find_root(parent, i)];
+        if (canonical != i) {
+            books[i].duplicate_of = books[canonical].id;
+            duplicates++;
+        }
+    }
+
+    free(best);
+    free(parent);
+    return duplicates;
+}
+
+int run_dedupe(DatabaseHandle *db_handle, Config *config) {
+    double started = metrics_now();
+
+    DedupeBook *books = NULL;
+    trace_begin("dedupe", "load_fingerprints", NULL);
+    long count = db_load_fingerprints(db_handle, &books, config);
+    trace_end();
+    if (count < 0) {
+        log_message(config, "ERROR", "Dedupe: failed to load text fingerprints");
+        return 0;
+    }
+    log_message(config, "INFO", "Dedupe: %ld books with text fingerprints", count);
+
+    trace_begin("dedupe", "cluster", NULL);
+    long duplicates = dedupe_cluster(books, count);
+    trace_end();
+    if (duplicates < 0) {
+        log_message(config, "ERROR", "Dedupe: out of memory while clustering %ld books", count);
+        free(books);
+        return 0;
+    }
+
+    trace_begin("dedupe", "store_duplicates", NULL);
+    int ok = db_store_duplicates(db_handle, books, count, config);
+    trace_end();
+    free(books);
+
+    if (!ok) {
+        log_message(config, "ERROR", "Dedupe: failed to store duplicate_of");
+        return 0;
+    }
+
+    metrics_add(METRIC_BOOKS_MARKED_DUPLICATE, (uint64_t)duplicates);
+    log_message(config, "INFO", "Dedupe: %ld books marked as other editions in %.1f s",
+                duplicates, metrics_now() - started);
+    return 1;
+}
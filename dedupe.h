@@ -0,0 +1,31 @@
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "database.h"
+
+// Сколько байт текста книги без разметки, после свертки регистра и пунктуации, входит в отпечаток.
+// Граница по чистому тексту не зависит от кодировки файла и от того, сколько в нем тегов
+#define DEDUPE_TEXT_BYTES 65536
+// Сколько байт исходного документа читать ради DEDUPE_TEXT_BYTES текста (с запасом на разметку)
+#define DEDUPE_READ_BYTES (2 * DEDUPE_TEXT_BYTES)
+// Отпечатки, различающиеся не больше чем в стольких битах, считаются одним текстом
+#define DEDUPE_MAX_DISTANCE 4
+
+// 64-битный SimHash по тройкам соседних слов: теги и сущности XML/HTML выбрасываются,
+// регистр и знаки препинания сворачиваются (fold_text), берутся первые DEDUPE_TEXT_BYTES байт.
+// Текст в UTF-8, не длиннее len байт. 0 - текста слишком мало для надежного отпечатка
+uint64_t text_fingerprint(const char *text, size_t len);
+
+// Разбивает книги на группы почти-дубликатов (LSH: отпечаток делится на DEDUPE_MAX_DISTANCE + 2
+// блока, кандидаты - книги с совпадающей парой блоков) и заполняет duplicate_of у всех, кроме
+// канонического издания группы: больше заполненных полей, затем больше файл, затем меньше id.
+// Возвращает число книг, отмеченных как дубликаты
+long dedupe_cluster(DedupeBook *books, long count);
+
+// Полный проход по библиотеке: читает отпечатки, группирует и записывает duplicate_of
+int run_dedupe(DatabaseHandle *db_handle, Config *config);
+
+#endif
@@ -0,0 +1,234 @@
+// epub.c - метаданные EPUB из OPF без распаковки содержимого книги
+#include "common.h"
+#include "epub.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utils.h"
+#include "xml_scan.h"
+#include "zip_index.h"
+
+#define EPUB_CONTAINER_PATH "META-INF/container.xml"
+// container.xml и OPF - небольшие XML; запись больше этого считаем битой
+#define EPUB_XML_MAX (4 * 1024 * 1024)
+#define EPUB_DESCRIPTION_MAX_CHARS 1000
+
+// EPUB, открытый для чтения отдельных записей: файл (fd) или буфер в памяти (data)
+typedef struct {
+    int fd;
+    const char *data;
+    size_t size;
+    ZipIndex *index;
+} EpubPackage;
+
+// Текст первого элемента name в [start, end)
+static char* first_element_text(const char *start, const char *end, const char *name, Arena *arena) {
+    XmlElement el;
+    const char *cursor = start;
+    while (xml_next_element(&cursor, end, name, &el)) {
+        char *text = xml_element_text(&el, arena);
+        if (text) return text;
+    }
+    return NULL;
+}
+
+// Все авторы через ", " (как в FB2). Создатели с другой ролью (редактор, переводчик) пропускаются
+static char* join_creators(const char *start, const char *end, Arena *arena) {
+    char *authors = NULL;
+    size_t authors_len = 0;
+
+    XmlElement el;
+    const char *cursor = start;
+    while (xml_next_element(&cursor, end, "creator", &el)) {
+        size_t role_len = 0;
+        if (xml_element_attr(&el, "role", &role_len) && !xml_attr_equals(&el, "role", "aut")) continue;
+
+        char *name = xml_element_text(&el, arena);
+        if (!name) continue;
+
+        size_t len = strlen(name);
+        char *joined = arena_alloc(arena, authors_len + len + 3);
+        if (!joined) break;
+        if (authors_len > 0) {
+            memcpy(joined, authors, authors_len);
+            memcpy(joined + authors_len, ", ", 2);
+            authors_len += 2;
+        }
+        memcpy(joined + authors_len, name, len + 1);
+        authors_len += len;
+        authors = joined;
+    }
+    return authors;
+}
+
+// Год из первого dc:date, кроме даты изменения файла (opf:event="modification")
+static int extract_year(const char *start, const char *end) {
+    XmlElement el;
+    const char *cursor = start;
+    while (xml_next_element(&cursor, end, "date", &el)) {
+        if (xml_attr_equals(&el, "event", "modification")) continue;
+
+        for (const char *p = el.text; p + 4 <= el.text_end; p++) {
+            if (isdigit((unsigned char)p[0]) && isdigit((unsigned char)p[1]) &&
+                isdigit((unsigned char)p[2]) && isdigit((unsigned char)p[3])) {
+                return (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+            }
+        }
+    }
+    return 0;
+}
+
+// Серия: <meta name="calibre:series" content=...> (EPUB 2 от calibre) или
+// <meta property="belongs-to-collection"> с group-position (EPUB 3)
+static void extract_series(const char *start, const char *end, BookMeta *meta, Arena *arena) {
+    char *collection = NULL;
+    int position = 0;
+
+    XmlElement el;
+    const char *cursor = start;
+    while (xml_next_element(&cursor, end, "meta", &el)) {
+        if (xml_attr_equals(&el, "name", "calibre:series")) {
+            if (!meta->series) meta->series = xml_element_attr_string(&el, "content", arena);
+        } else if (xml_attr_equals(&el, "name", "calibre:series_index")) {
+            char *index = xml_element_attr_string(&el, "content", arena);
+            if (index && meta->series_number == 0) meta->series_number = atoi(index);
+        } else if (xml_attr_equals(&el, "property", "belongs-to-collection")) {
+            if (!collection) collection = xml_element_text(&el, arena);
+        } else if (xml_attr_equals(&el, "property", "group-position")) {
+            char *index = xml_element_text(&el, arena);
+            if (index && position == 0) position = atoi(index);
+        }
+    }
+
+    if (!meta->series && collection) {
+        meta->series = collection;
+        if (meta->series_number == 0) meta->series_number = position;
+    }
+    if (meta->series_number < 0) meta->series_number = 0;
+}
+
+static BookMeta* parse_opf(const char *opf, size_t opf_size, Arena *arena) {
+    BookMeta *meta = book_meta_new(arena);
+    if (!meta) return NULL;
+
+    // Поиск ограничиваем блоком <metadata>, манифест и spine бывают намного больше
+    const char *start = opf;
+    const char *end = opf + opf_size;
+    XmlElement metadata;
+    const char *cursor = opf;
+    if (xml_next_element(&cursor, end, "metadata", &metadata)) {
+        start = metadata.text;
+        end = metadata.text_end;
+    }
+
+    meta->title = first_element_text(start, end, "title", arena);
+    meta->author = intern_meta_field(INTERN_AUTHORS, join_creators(start, end, arena));
+    meta->genre = intern_meta_field(INTERN_GENRES, first_element_text(start, end, "subject", arena));
+    meta->language = intern_meta_field(INTERN_LANGUAGES, first_element_text(start, end, "language", arena));
+    meta->publisher = first_element_text(start, end, "publisher", arena);
+    meta->year = extract_year(start, end);
+    extract_series(start, end, meta, arena);
+    meta->series = intern_meta_field(INTERN_SERIES, meta->series);
+
+    // Аннотация в OPF - экранированный HTML: после раскрытия сущностей убираем теги
+    char *description = first_element_text(start, end, "description", arena);
+    if (description) {
+        strip_html_tags(description);
+        utf8_truncate(description, EPUB_DESCRIPTION_MAX_CHARS);
+        meta->description = description[0] ? description : NULL;
+    }
+
+    return meta;
+}
+
+static char* read_package_entry(const EpubPackage *pkg, const char *name, size_t *size_out) {
+    const ZipEntryInfo *entry = zip_index_find(pkg->index, name);
+    if (!entry) return NULL;
+
+    if (pkg->data) {
+        return zip_entry_read_memory(pkg->data, pkg->size, entry, EPUB_XML_MAX, size_out);
+    }
+    return zip_entry_read(pkg->fd, entry, EPUB_XML_MAX, size_out);
+}
+
+// Путь к OPF из container.xml; без него - первая запись *.opf в архиве
+static char* find_opf_path(const EpubPackage *pkg, Arena *arena) {
+    char *container = read_package_entry(pkg, EPUB_CONTAINER_PATH, NULL);
+    char *path = NULL;
+
+    if (container) {
+        XmlElement el;
+        const char *cursor = container;
+        const char *end = container + strlen(container);
+        while (!path && xml_next_element(&cursor, end, "rootfile", &el)) {
+            size_t type_len = 0;
+            if (xml_element_attr(&el, "media-type", &type_len) &&
+                !xml_attr_equals(&el, "media-type", "application/oebps-package+xml")) {
+                continue;
+            }
+            path = xml_element_attr_string(&el, "full-path", arena);
+        }
+        free(container);
+    }
+
+    if (path) {
+        while (*path == '/') path++;
+        return path;
+    }
+
+    for (size_t i = 0; i < pkg->index->count; i++) {
+        const char *name = pkg->index->entries[i].name;
+        size_t len = strlen(name);
+        if (len > 4 && strcasecmp(name + len - 4, ".opf") == 0) {
+            return arena_strdup(arena, name);
+        }
+    }
+    return NULL;
+}
+
+static BookMeta* parse_package(const EpubPackage *pkg, Arena *arena) {
+    char *opf_path = find_opf_path(pkg, arena);
+    if (!opf_path) return NULL;
+
+    size_t opf_size = 0;
+    char *opf = read_package_entry(pkg, opf_path, &opf_size);
+    if (!opf) return NULL;
+
+    BookMeta *meta = parse_opf(opf, opf_size, arena);
+    free(opf);
+
+    if (meta) metrics_inc(METRIC_EPUB_PARSED);
+    return meta;
+}
+
+BookMeta* parse_epub(const char *filepath, Arena *arena) {
+    trace_begin("parse", "epub_parse", NULL);
+    EpubPackage pkg = {-1, NULL, 0, zip_index_load(filepath)};
+    BookMeta *meta = NULL;
+
+    if (pkg.index) {
+        pkg.fd = open(filepath, O_RDONLY);
+        if (pkg.fd >= 0) {
+            meta = parse_package(&pkg, arena);
+            close(pkg.fd);
+        }
+        zip_index_free(pkg.index);
+    }
+
+    trace_end();
+    return meta;
+}
+
+BookMeta* parse_epub_from_memory(const char *content, size_t content_size, Arena *arena) {
+    trace_begin("parse", "epub_parse", NULL);
+    EpubPackage pkg = {-1, content, content_size, zip_index_load_memory(content, content_size)};
+    BookMeta *meta = NULL;
+
+    if (pkg.index) {
+        meta = parse_package(&pkg, arena);
+        zip_index_free(pkg.index);
+    }
+
+    trace_end();
+    return meta;
+}
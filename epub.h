@@ -0,0 +1,15 @@
+#ifndef EPUB_H
+#define EPUB_H
+
+#include <stddef.h>
+#include "database.h"
+
+// Метаданные EPUB из OPF (dc:title, dc:creator, dc:subject, dc:language, dc:date, dc:publisher,
+// dc:description, calibre:series/series_index или belongs-to-collection EPUB 3).
+// Через центральный каталог ZIP распаковываются только META-INF/container.xml и сам OPF,
+// файлы содержимого не читаются. Строки выделяются в арене. NULL - файл не EPUB или OPF не найден
+BookMeta* parse_epub(const char *filepath, Arena *arena);
+// То же для EPUB, уже извлеченного из архива коллекции в память
+BookMeta* parse_epub_from_memory(const char *content, size_t content_size, Arena *arena);
+
+#endif
@@ -0,0 +1,133 @@
+// fb2_cover.c - поиск и декодирование обложки FB2 без XML-парсера
+#include "common.h"
+#include "fb2_cover.h"
+#include "base64.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Ищет значение атрибута внутри тега [tag, tag_end); name может идти после пробела или префикса "l:"
+static const char* find_attribute(const char *tag, const char *tag_end, const char *name, size_t *value_len) {
+    size_t name_len = strlen(name);
+    const char *p = tag;
+
+    while (p < tag_end) {
+        const char *found = memmem(p, tag_end - p, name, name_len);
+        if (!found) return NULL;
+
+        const char *after = found + name_len;
+        char before = found > tag ? found[-1] : ' ';
+        if ((before == ' ' || before == '\t' || before == '\n' || before == '\r' || before == ':') &&
+            after + 1 < tag_end && after[0] == '=' && (after[1] == '"' || after[1] == '\'')) {
+            char quote = after[1];
+            const char *value = after + 2;
+            const char *value_end = memchr(value, quote, tag_end - value);
+            if (!value_end) return NULL;
+            *value_len = value_end - value;
+            return value;
+        }
+        p = found + name_len;
+    }
+    return NULL;
+}
+
+int fb2_locate_cover(const char *content, size_t content_size, Fb2CoverSpan *span) {
+    if (!content || !span) return 0;
+    memset(span, 0, sizeof(Fb2CoverSpan));
+
+    const char *end = content + content_size;
+    const char *coverpage = memmem(content, content_size, "<coverpage", 10);
+    if (!coverpage) return 0;
+
+    const char *coverpage_end = memmem(coverpage, end - coverpage, "</coverpage>", 12);
+    if (!coverpage_end) return 0;
+
+    const char *image = memmem(coverpage, coverpage_end - coverpage, "<image", 6);
+    if (!image) return 0;
+
+    const char *image_end = memchr(image, '>', coverpage_end - image);
+    if (!image_end) return 0;
+
+    size_t href_len = 0;
+    const char *href = find_attribute(image, image_end, "href", &href_len);
+    if (!href || href_len < 2 || href[0] != '#') return 0;
+    href++;
+    href_len--;
+
+    // Бинарные разделы идут после тела книги, поэтому ищем вперед от обложки
+    const char *p = coverpage_end;
+    while (p < end) {
+        const char *binary = memmem(p, end - p, "<binary", 7);
+        if (!binary) return 0;
+
+        const char *tag_end = memchr(binary, '>', end - binary);
+        if (!tag_end) return 0;
+
+        size_t id_len = 0;
+        const char *id = find_attribute(binary, tag_end, "id", &id_len);
+        if (id && id_len == href_len && memcmp(id, href, id_len) == 0) {
+            size_t type_len = 0;
+            const char *type = find_attribute(binary, tag_end, "content-type", &type_len);
+            if (type && type_len < sizeof(span->content_type)) {
+                memcpy(span->content_type, type, type_len);
+                span->content_type[type_len] = '\0';
+            }
+
+            const char *data = tag_end + 1;
+            const char *data_end = memchr(data, '<', end - data);
+            if (!data_end) data_end = end;
+
+            span->base64 = data;
+            span->base64_len = data_end - data;
+            return span->base64_len > 0;
+        }
+        p = tag_end + 1;
+    }
+
+    return 0;
+}
+
+int fb2_find_cover(const char *content, size_t content_size, Fb2Cover *cover) {
+    if (!cover) return 0;
+    memset(cover, 0, sizeof(Fb2Cover));
+
+    Fb2CoverSpan span;
+    if (!fb2_locate_cover(content, content_size, &span)) return 0;
+
+    cover->data = malloc(BASE64_DECODED_MAX(span.base64_len));
+    if (!cover->data) return 0;
+    cover->owned = 1;
+    memcpy(cover->content_type, span.content_type, sizeof(cover->content_type));
+
+    cover->size = base64_decode(span.base64, span.base64_len, cover->data);
+    if (cover->size == 0) {
+        fb2_cover_free(cover);
+        return 0;
+    }
+    return 1;
+}
+
+int fb2_find_cover_inplace(char *content, size_t content_size, Fb2Cover *cover) {
+    if (!cover) return 0;
+    memset(cover, 0, sizeof(Fb2Cover));
+
+    Fb2CoverSpan span;
+    if (!fb2_locate_cover(content, content_size, &span)) return 0;
+
+    // Декодированные байты пишутся поверх base64 того же <binary>: результат всегда короче
+    unsigned char *dst = (unsigned char*)content + (span.base64 - content);
+    cover->size = base64_decode(span.base64, span.base64_len, dst);
+    if (cover->size == 0) return 0;
+
+    cover->data = dst;
+    memcpy(cover->content_type, span.content_type, sizeof(cover->content_type));
+    return 1;
+}
+
+void fb2_cover_free(Fb2Cover *cover) {
+    if (!cover) return;
+
+    if (cover->owned) free(cover->data);
+    cover->owned = 0;
+    cover->data = NULL;
+    cover->size = 0;
+}
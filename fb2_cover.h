@@ -0,0 +1,40 @@
+#ifndef FB2_COVER_H
+#define FB2_COVER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Положение обложки в сыром FB2: base64 внутри <binary>, на который ссылается <coverpage>
+typedef struct {
+    const char *base64;
+    size_t base64_len;
+    char content_type[64];
+} Fb2CoverSpan;
+
+// Обложка FB2: декодированный <binary>
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    char content_type[64];
+    int owned;              // data выделена через malloc и освобождается fb2_cover_free
+} Fb2Cover;
+
+// Ищет обложку в сыром содержимом FB2 (кодировка документа не важна - base64 всегда ASCII)
+int fb2_locate_cover(const char *content, size_t content_size, Fb2CoverSpan *span);
+
+// Декодирует обложку в новый буфер
+int fb2_find_cover(const char *content, size_t content_size, Fb2Cover *cover);
+
+// Декодирует обложку на месте, затирая base64 в content; cover->data указывает внутрь content
+int fb2_find_cover_inplace(char *content, size_t content_size, Fb2Cover *cover);
+
+void fb2_cover_free(Fb2Cover *cover);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
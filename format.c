@@ -0,0 +1,125 @@
+// format.c - определение формата по сигнатуре и таблица обработчиков
+#include "common.h"
+#include "format.h"
+#include "cover_cache.h"
+#include "epub.h"
+#include "metadata.h"
+#include "mobi.h"
+#include "pdf_meta.h"
+
+// Индекс таблицы совпадает с BookFormat
+static const FormatHandler format_handlers[BOOK_FORMAT_COUNT] = {
+    [BOOK_FORMAT_UNKNOWN] = {BOOK_FORMAT_UNKNOWN, "unknown", 0, NULL, NULL, NULL, NULL},
+    [BOOK_FORMAT_FB2] = {BOOK_FORMAT_FB2, "fb2", 0, parse_fb2, parse_fb2_from_memory,
+                         extract_fb2_cover_file, extract_fb2_cover},
+    [BOOK_FORMAT_EPUB] = {BOOK_FORMAT_EPUB, "epub", 0, parse_epub, parse_epub_from_memory, NULL, NULL},
+    [BOOK_FORMAT_PDF] = {BOOK_FORMAT_PDF, "pdf", 0, parse_pdf, parse_pdf_from_memory, NULL, NULL},
+    [BOOK_FORMAT_MOBI] = {BOOK_FORMAT_MOBI, "mobi", 0, parse_mobi, parse_mobi_from_memory,
+                          extract_mobi_cover, extract_mobi_cover_from_memory},
+    [BOOK_FORMAT_TXT] = {BOOK_FORMAT_TXT, "txt", 0, NULL, NULL, NULL, NULL},
+    [BOOK_FORMAT_ZIP] = {BOOK_FORMAT_ZIP, "zip", 1, NULL, NULL, NULL, NULL},
+    [BOOK_FORMAT_RAR] = {BOOK_FORMAT_RAR, "rar", 1, NULL, NULL, NULL, NULL},
+    [BOOK_FORMAT_7Z] = {BOOK_FORMAT_7Z, "7z", 1, NULL, NULL, NULL, NULL}
+};
+
+static const struct {
+    const char *name;
+    BookFormat format;
+} format_names[] = {
+    {"fb2", BOOK_FORMAT_FB2},
+    {"epub", BOOK_FORMAT_EPUB},
+    {"pdf", BOOK_FORMAT_PDF},
+    {"mobi", BOOK_FORMAT_MOBI},
+    {"azw3", BOOK_FORMAT_MOBI},
+    {"azw", BOOK_FORMAT_MOBI},
+    {"txt", BOOK_FORMAT_TXT},
+    {"zip", BOOK_FORMAT_ZIP},
+    {"rar", BOOK_FORMAT_RAR},
+    {"7z", BOOK_FORMAT_7Z}
+};
+
+#define ZIP_LOCAL_NAME_OFFSET 30
+#define EPUB_MIMETYPE "application/epub+zip"
+#define MOBI_TYPE_OFFSET 60
+
+const FormatHandler* format_handler(BookFormat format) {
+    if ((unsigned)format >= BOOK_FORMAT_COUNT) format = BOOK_FORMAT_UNKNOWN;
+    return &format_handlers[format];
+}
+
+BookFormat format_from_name(const char *name) {
+    if (!name) return BOOK_FORMAT_UNKNOWN;
+
+    for (size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++) {
+        if (strcasecmp(name, format_names[i].name) == 0) return format_names[i].format;
+    }
+    return BOOK_FORMAT_UNKNOWN;
+}
+
+BookFormat format_from_extension(const char *filename) {
+    const char *ext = filename ? strrchr(filename, '.') : NULL;
+    return ext ? format_from_name(ext + 1) : BOOK_FORMAT_UNKNOWN;
+}
+
+// ZIP: EPUB по спецификации OCF начинается с несжатой записи mimetype
+static BookFormat sniff_zip(const unsigned char *head, size_t head_len) {
+    if (head_len < ZIP_LOCAL_NAME_OFFSET) return BOOK_FORMAT_ZIP;
+
+    size_t name_len = head[26] | (head[27] << 8);
+    size_t extra_len = head[28] | (head[29] << 8);
+    size_t data = ZIP_LOCAL_NAME_OFFSET + name_len + extra_len;
+    if (name_len == 8 && memcmp(head + ZIP_LOCAL_NAME_OFFSET, "mimetype", 8) == 0 &&
+        data + strlen(EPUB_MIMETYPE) <= head_len &&
+        memcmp(head + data, EPUB_MIMETYPE, strlen(EPUB_MIMETYPE)) == 0) {
+        return BOOK_FORMAT_EPUB;
+    }
+    return BOOK_FORMAT_ZIP;
+}
+
+BookFormat format_sniff(const char *head, size_t head_len) {
+    const unsigned char *p = (const unsigned char*)head;
+    if (!p) return BOOK_FORMAT_UNKNOWN;
+
+    if (head_len >= 4 && memcmp(p, "PK\x03\x04", 4) == 0) return sniff_zip(p, head_len);
+    if (head_len >= 4 && memcmp(p, "PK\x05\x06", 4) == 0) return BOOK_FORMAT_ZIP;
+    if (head_len >= 6 && memcmp(p, "Rar!\x1a\x07", 6) == 0) return BOOK_FORMAT_RAR;
+    if (head_len >= 6 && memcmp(p, "7z\xbc\xaf\x27\x1c", 6) == 0) return BOOK_FORMAT_7Z;
+    if (head_len >= 5 && memcmp(p, "%PDF-", 5) == 0) return BOOK_FORMAT_PDF;
+    if (head_len >= MOBI_TYPE_OFFSET + 8 && memcmp(p + MOBI_TYPE_OFFSET, "BOOKMOBI", 8) == 0) {
+        return BOOK_FORMAT_MOBI;
+    }
+
+    // FB2: XML (возможно, с BOM UTF-8) с корнем <FictionBook в начале файла
+    size_t i = (head_len >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) ? 3 : 0;
+    while (i < head_len && isspace(p[i])) i++;
+    if (i < head_len && p[i] == '<' && memmem(p + i, head_len - i, "<FictionBook", 12)) {
+        return BOOK_FORMAT_FB2;
+    }
+    return BOOK_FORMAT_UNKNOWN;
+}
+
+// Сигнатура важнее расширения; исключение - EPUB, записанный без mimetype первой записью
+static BookFormat resolve_format(BookFormat sniffed, BookFormat by_extension) {
+    if (sniffed == BOOK_FORMAT_UNKNOWN) return by_extension;
+    if (sniffed == BOOK_FORMAT_ZIP && by_extension == BOOK_FORMAT_EPUB) return BOOK_FORMAT_EPUB;
+    return sniffed;
+}
+
+BookFormat detect_format(const char *filepath) {
+    char head[FORMAT_SNIFF_SIZE];
+    ssize_t head_len = -1;
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd >= 0) {
+        head_len = pread(fd, head, sizeof(head), 0);
+        close(fd);
+    }
+
+    BookFormat sniffed = head_len > 0 ? format_sniff(head, (size_t)head_len) : BOOK_FORMAT_UNKNOWN;
+    return resolve_format(sniffed, format_from_extension(filepath));
+}
+
+BookFormat detect_format_memory(const char *content, size_t content_size, const char *filename) {
+    size_t head_len = content_size < FORMAT_SNIFF_SIZE ? content_size : FORMAT_SNIFF_SIZE;
+    return resolve_format(format_sniff(content, head_len), format_from_extension(filename));
+}
@@ -0,0 +1,53 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include "config.h"
+#include "database.h"
+
+// Форматы файлов, которые понимает сканер
+typedef enum {
+    BOOK_FORMAT_UNKNOWN = 0,
+    BOOK_FORMAT_FB2,
+    BOOK_FORMAT_EPUB,
+    BOOK_FORMAT_PDF,
+    BOOK_FORMAT_MOBI,
+    BOOK_FORMAT_TXT,
+    BOOK_FORMAT_ZIP,
+    BOOK_FORMAT_RAR,
+    BOOK_FORMAT_7Z,
+    BOOK_FORMAT_COUNT
+} BookFormat;
+
+// Сколько байт начала файла читается для определения формата по сигнатуре
+#define FORMAT_SNIFF_SIZE 4096
+
+// Обработчики формата. NULL - у формата нет разбора (название берется из имени файла)
+// или обложки. Буфер parse_memory и cover_memory всегда завершен нулем (content[content_size] == 0).
+// cover_memory может портить буфер: он больше не нужен после разбора
+typedef struct {
+    BookFormat format;
+    const char *name;           // тип для parse_metadata и логов
+    int is_archive;             // ZIP/RAR/7Z обходятся process_archive
+    BookMeta* (*parse_file)(const char *filepath, Arena *arena);
+    BookMeta* (*parse_memory)(const char *content, size_t content_size, Arena *arena);
+    char* (*cover_file)(const char *filepath, Config *config);
+    char* (*cover_memory)(char *content, size_t content_size, Config *config);
+} FormatHandler;
+
+// Обработчик формата из статической таблицы (для BOOK_FORMAT_UNKNOWN - пустой)
+const FormatHandler* format_handler(BookFormat format);
+
+// По имени типа или расширению без точки (fb2, azw3, 7z); BOOK_FORMAT_UNKNOWN - не поддерживается
+BookFormat format_from_name(const char *name);
+// По расширению имени файла
+BookFormat format_from_extension(const char *filename);
+
+// По сигнатуре в первых байтах: PK (EPUB по записи mimetype), Rar!, 7z, %PDF, BOOKMOBI,
+// XML с <FictionBook. BOOK_FORMAT_UNKNOWN - сигнатура не распознана
+BookFormat format_sniff(const char *head, size_t head_len);
+// Сигнатура, а если она не распознана или файл - EPUB без записи mimetype в начале, расширение
+BookFormat detect_format(const char *filepath);
+BookFormat detect_format_memory(const char *content, size_t content_size, const char *filename);
+
+#endif
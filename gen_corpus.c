@@ -0,0 +1,626 @@
+// gen_corpus.c - генератор синтетической библиотеки для замеров производительности сканера
+//
+// Использование:
+//   gen_corpus --out DIR [--books N] [--seed S] [--per-zip N] [--loose-percent P]
+//              [--epub-percent P] [--cp1251-percent P] [--stored-percent P]
+//              [--body-kb K] [--no-inpx]
+//
+// Результат при одинаковых параметрах побайтно воспроизводим:
+//   DIR/fb2-NNNNNN-NNNNNN.zip  - FB2 в ZIP (часть архивов stored, часть deflate)
+//   DIR/loose/NNN/*.fb2        - отдельные FB2 (по 1000 в каталоге)
+//   DIR/epub/*.epub            - EPUB
+//   DIR/synthetic.inpx         - INPX с .inp на каждый ZIP (имена совпадают)
+// Часть FB2 записывается в windows-1251, остальные в UTF-8.
+//
+// Коды возврата: 0 - успех, 1 - ошибка аргументов, 2 - ошибка записи.
+#include "common.h"
+#include <errno.h>
+#include <iconv.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <archive.h>
+#include <archive_entry.h>
+
+#define GEN_OK 0
+#define GEN_USAGE 1
+#define GEN_IO_ERROR 2
+
+#define GEN_LOOSE_PER_DIR 1000
+#define GEN_MAX_AUTHORS 3
+
+// Фиксированное время записей в архивах - для воспроизводимости
+#define GEN_ENTRY_MTIME 1262304000
+
+typedef struct {
+    const char *out_dir;
+    long books;
+    uint64_t seed;
+    int per_zip;
+    int loose_percent;
+    int epub_percent;
+    int cp1251_percent;
+    int stored_percent;
+    int body_kb;
+    int inpx;
+} GenOptions;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} GenBuffer;
+
+typedef struct {
+    int author_count;
+    int authors[GEN_MAX_AUTHORS];   // индексы в таблицах имен
+    char title[256];
+    int genre;
+    int series;                     // -1 - без серии
+    int series_number;
+    int year;
+    int lang_en;
+    int cp1251;
+} GenBook;
+
+typedef struct {
+    long loose;
+    long zipped;
+    long epub;
+    long cp1251;
+    int archives;
+    unsigned long long bytes;
+} GenStats;
+
+static const char *last_names[] = {
+    "Толстой", "Достоевский", "Чехов", "Булгаков", "Пастернак", "Набоков", "Тургенев",
+    "Гончаров", "Лесков", "Куприн", "Бунин", "Паустовский", "Стругацкий", "Ефремов",
+    "Беляев", "Каверин", "Шолохов", "Платонов", "Зощенко", "Ильф", "Петров", "Олеша",
+    "Грин", "Катаев", "Житков", "Носов", "Драгунский", "Лукьяненко", "Пелевин", "Акунин",
+    "Иванов", "Смирнов", "Кузнецов", "Попов", "Васильев", "Соколов", "Михайлов", "Новиков",
+    "Фёдоров", "Морозов", "Волков", "Алексеев", "Лебедев", "Семёнов", "Егоров", "Павлов",
+    "Asimov", "Bradbury", "Clarke", "Heinlein", "Le Guin", "Lem", "Pratchett", "Gaiman"
+};
+
+static const char *first_names[] = {
+    "Лев", "Фёдор", "Антон", "Михаил", "Борис", "Владимир", "Иван", "Николай", "Александр",
+    "Константин", "Аркадий", "Иван", "Сергей", "Алексей", "Виктор", "Юрий", "Евгений",
+    "Анна", "Марина", "Ольга", "Татьяна", "Людмила", "Вера", "Наталья", "Дарья", "Елена",
+    "Isaac", "Ray", "Arthur", "Robert", "Ursula", "Stanislaw", "Terry", "Neil"
+};
+
+static const char *middle_names[] = {
+    "Николаевич", "Михайлович", "Павлович", "Афанасьевич", "Леонидович", "Сергеевич",
+    "Иванович", "Александрович", "Петрович", "Алексеевна", "Ивановна", "Сергеевна", ""
+};
+
+static const char *title_words[] = {
+    "война", "мир", "тень", "ветер", "звезда", "город", "дорога", "море", "тайна", "сад",
+    "время", "свет", "огонь", "остров", "зима", "лето", "ночь", "рассвет", "песня", "дом",
+    "путь", "берег", "камень", "река", "небо", "память", "сон", "зеркало", "ключ", "мост",
+    "последний", "первый", "тихий", "далёкий", "забытый", "северный", "красный", "золотой",
+    "железный", "хрустальный", "потерянный", "чужой", "вечный", "белый", "старый", "новый",
+    "Ёлка", "Foundation", "Dune", "Solaris", "Night", "Garden", "Empire", "Machine"
+};
+
+static const char *series_names[] = {
+    "Хроники Севера", "Полдень", "Мир Реки", "Дозоры", "Приключения Эраста Фандорина",
+    "Библиотека приключений", "Звёздный путь", "Хроники Амбера", "Ведьмак", "Плоский мир",
+    "Foundation", "Earthsea", "Летопись Кайта", "Тёмная башня", "Лабиринты Ехо"
+};
+
+// Коды жанров FB2 и названия для INPX
+static const char *genres[] = {
+    "sf", "sf_fantasy", "sf_history", "det_classic", "det_irony", "prose_classic",
+    "prose_contemporary", "love_contemporary", "adv_history", "child_tale", "poetry",
+    "sci_history", "nonf_biography", "humor_prose", "thriller"
+};
+
+static const char *body_words[] = {
+    "и", "в", "не", "на", "он", "она", "что", "как", "было", "уже", "только", "когда",
+    "вдруг", "снова", "долго", "тихо", "сказал", "подумал", "посмотрел", "увидел",
+    "дверь", "окно", "улица", "человек", "рука", "глаза", "голос", "день", "вечер",
+    "письмо", "книга", "поезд", "станция", "солнце", "дождь", "снег", "лес", "поле"
+};
+
+#define COUNT_OF(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// splitmix64: у каждой книги свой поток, поэтому форма корпуса не меняет сами книги
+static uint64_t gen_next(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int gen_range(uint64_t *state, int n) {
+    return (int)(gen_next(state) % (uint64_t)n);
+}
+
+static int gen_percent(uint64_t *state, int percent) {
+    return gen_range(state, 100) < percent;
+}
+
+static int buffer_reserve(GenBuffer *buf, size_t extra) {
+    if (buf->len + extra + 1 <= buf->cap) return 1;
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < buf->len + extra + 1) cap *= 2;
+    char *data = realloc(buf->data, cap);
+    if (!data) return 0;
+    buf->data = data;
+    buf->cap = cap;
+    return 1;
+}
+
+static int buffer_append(GenBuffer *buf, const char *text) {
+    size_t len = strlen(text);
+    if (!buffer_reserve(buf, len)) return 0;
+    memcpy(buf->data + buf->len, text, len + 1);
+    buf->len += len;
+    return 1;
+}
+
+static int buffer_printf(GenBuffer *buf, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static int buffer_printf(GenBuffer *buf, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0 || !buffer_reserve(buf, (size_t)needed)) return 0;
+
+    va_start(args, format);
+    vsnprintf(buf->data + buf->len, (size_t)needed + 1, format, args);
+    va_end(args);
+    buf->len += (size_t)needed;
+    return 1;
+}
+
+static int make_dirs(const char *path) {
+    char tmp[MAX_PATH];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return 0;
+        *p = '/';
+    }
+    return mkdir(tmp, 0755) == 0 || errno == EEXIST;
+}
+
+static void make_book(const GenOptions *opt, long index, GenBook *book) {
+    uint64_t state = opt->seed * 0x100000001B3ULL + (uint64_t)index;
+    memset(book, 0, sizeof(GenBook));
+
+    // Примерно каждая двадцатая книга написана в соавторстве
+    book->author_count = gen_percent(&state, 5) ? 2 + gen_range(&state, GEN_MAX_AUTHORS - 1) : 1;
+    for (int i = 0; i < book->author_count; i++) {
+        book->authors[i] = gen_range(&state, COUNT_OF(last_names) * COUNT_OF(first_names));
+    }
+
+    int words = 1 + gen_range(&state, 4);
+    size_t pos = 0;
+    for (int i = 0; i < words; i++) {
+        const char *word = title_words[gen_range(&state, COUNT_OF(title_words))];
+        pos += snprintf(book->title + pos, sizeof(book->title) - pos, "%s%s", i ? " " : "", word);
+    }
+    // Первая буква названия заглавная (только ASCII и двухбайтовая кириллица)
+    unsigned char *t = (unsigned char*)book->title;
+    if (t[0] >= 'a' && t[0] <= 'z') {
+        t[0] -= 0x20;
+    } else if (t[0] == 0xD0 && t[1] >= 0xB0 && t[1] <= 0xBF) {
+        t[1] -= 0x20;
+    } else if (t[0] == 0xD1 && t[1] >= 0x80 && t[1] <= 0x8F) {
+        t[0] = 0xD0;
+        t[1] += 0x20;
+    }
+    snprintf(book->title + pos, sizeof(book->title) - pos, " %ld", index + 1);
+
+    book->genre = gen_range(&state, COUNT_OF(genres));
+    book->series = gen_percent(&state, 40) ? gen_range(&state, COUNT_OF(series_names)) : -1;
+    book->series_number = book->series >= 0 ? 1 + gen_range(&state, 12) : 0;
+    book->year = 1950 + gen_range(&state, 75);
+    book->lang_en = gen_percent(&state, 10);
+    book->cp1251 = gen_percent(&state, opt->cp1251_percent);
+}
+
+static const char* author_last(int author) { return last_names[author / COUNT_OF(first_names)]; }
+static const char* author_first(int author) { return first_names[author % COUNT_OF(first_names)]; }
+static const char* author_middle(int author) { return middle_names[author % COUNT_OF(middle_names)]; }
+
+static int build_fb2(const GenOptions *opt, long index, const GenBook *book, GenBuffer *out) {
+    uint64_t state = opt->seed ^ ((uint64_t)index << 20) ^ 0xF2B00C5ULL;
+    int ok = 1;
+
+    out->len = 0;
+    ok &= buffer_printf(out, "<?xml version=\"1.0\" encoding=\"%s\"?>\n",
+                        book->cp1251 ? "windows-1251" : "UTF-8");
+    ok &= buffer_append(out, "<FictionBook xmlns=\"http://www.gribuser.ru/xml/fictionbook/2.0\" "
+                             "xmlns:l=\"http://www.w3.org/1999/xlink\">\n<description>\n<title-info>\n");
+    ok &= buffer_printf(out, "<genre>%s</genre>\n", genres[book->genre]);
+    for (int i = 0; i < book->author_count; i++) {
+        int a = book->authors[i];
+        ok &= buffer_printf(out, "<author><first-name>%s</first-name>", author_first(a));
+        if (author_middle(a)[0]) {
+            ok &= buffer_printf(out, "<middle-name>%s</middle-name>", author_middle(a));
+        }
+        ok &= buffer_printf(out, "<last-name>%s</last-name></author>\n", author_last(a));
+    }
+    ok &= buffer_printf(out, "<book-title>%s</book-title>\n", book->title);
+    ok &= buffer_append(out, "<annotation><p>Синтетическая книга для замеров производительности.</p></annotation>\n");
+    ok &= buffer_printf(out, "<date value=\"%d-01-01\">%d</date>\n", book->year, book->year);
+    ok &= buffer_printf(out, "<lang>%s</lang>\n", book->lang_en ? "en" : "ru");
+    if (book->series >= 0) {
+        ok &= buffer_printf(out, "<sequence name=\"%s\" number=\"%d\"/>\n",
+                            series_names[book->series], book->series_number);
+    }
+    ok &= buffer_append(out, "</title-info>\n<publish-info>\n");
+    ok &= buffer_printf(out, "<publisher>Издательство %d</publisher>\n<year>%d</year>\n",
+                        1 + book->genre, book->year);
+    ok &= buffer_printf(out, "</publish-info>\n<document-info><id>synthetic-%016llx-%ld</id></document-info>\n",
+                        (unsigned long long)opt->seed, index);
+    ok &= buffer_append(out, "</description>\n<body>\n<section>\n");
+
+    // Текст: абзацы случайной длины, пока не наберется body_kb килобайт
+    size_t body_limit = out->len + (size_t)opt->body_kb * 1024;
+    while (ok && out->len < body_limit) {
+        ok &= buffer_append(out, "<p>");
+        int words = 20 + gen_range(&state, 60);
+        for (int i = 0; i < words; i++) {
+            ok &= buffer_append(out, body_words[gen_range(&state, COUNT_OF(body_words))]);
+            ok &= buffer_append(out, i + 1 < words ? " " : ".");
+        }
+        ok &= buffer_append(out, "</p>\n");
+    }
+    ok &= buffer_append(out, "</section>\n</body>\n</FictionBook>\n");
+
+    if (!ok || !book->cp1251) return ok;
+
+    // Все строки таблиц представимы в windows-1251
+    iconv_t cd = iconv_open("WINDOWS-1251", "UTF-8");
+    if (cd == (iconv_t)-1) return 0;
+
+    char *converted = malloc(out->len + 1);
+    if (!converted) {
+        iconv_close(cd);
+        return 0;
+    }
+    char *in = out->data;
+    size_t in_left = out->len;
+    char *dst = converted;
+    size_t out_left = out->len;
+    size_t rc = iconv(cd, &in, &in_left, &dst, &out_left);
+    iconv_close(cd);
+    if (rc == (size_t)-1) {
+        free(converted);
+        return 0;
+    }
+
+    out->len = (size_t)(dst - converted);
+    memcpy(out->data, converted, out->len);
+    out->data[out->len] = '\0';
+    free(converted);
+    return 1;
+}
+
+static int build_epub_opf(const GenBook *book, long index, GenBuffer *out) {
+    int ok = 1;
+    out->len = 0;
+    ok &= buffer_append(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                             "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\" unique-identifier=\"bookid\">\n"
+                             "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:opf=\"http://www.idpf.org/2007/opf\">\n");
+    ok &= buffer_printf(out, "<dc:title>%s</dc:title>\n", book->title);
+    for (int i = 0; i < book->author_count; i++) {
+        int a = book->authors[i];
+        ok &= buffer_printf(out, "<dc:creator opf:role=\"aut\">%s %s</dc:creator>\n",
+                            author_first(a), author_last(a));
+    }
+    ok &= buffer_printf(out, "<dc:language>%s</dc:language>\n", book->lang_en ? "en" : "ru");
+    ok &= buffer_printf(out, "<dc:date>%d</dc:date>\n", book->year);
+    ok &= buffer_printf(out, "<dc:subject>%s</dc:subject>\n", genres[book->genre]);
+    ok &= buffer_printf(out, "<dc:identifier id=\"bookid\">urn:synthetic:%ld</dc:identifier>\n", index);
+    if (book->series >= 0) {
+        ok &= buffer_printf(out, "<meta name=\"calibre:series\" content=\"%s\"/>\n"
+                                 "<meta name=\"calibre:series_index\" content=\"%d\"/>\n",
+                            series_names[book->series], book->series_number);
+    }
+    ok &= buffer_append(out, "</metadata>\n"
+                             "<manifest><item id=\"text\" href=\"text.xhtml\" media-type=\"application/xhtml+xml\"/></manifest>\n"
+                             "<spine><itemref idref=\"text\"/></spine>\n"
+                             "</package>\n");
+    return ok;
+}
+
+static struct archive* zip_open(const char *path, int stored) {
+    struct archive *a = archive_write_new();
+    if (!a) return NULL;
+    if (archive_write_set_format_zip(a) != ARCHIVE_OK ||
+        archive_write_set_options(a, stored ? "zip:compression=store" : "zip:compression=deflate") != ARCHIVE_OK ||
+        archive_write_open_filename(a, path) != ARCHIVE_OK) {
+        fprintf(stderr, "Cannot create %s: %s\n", path, archive_error_string(a));
+        archive_write_free(a);
+        return NULL;
+    }
+    return a;
+}
+
+static int zip_add(struct archive *a, const char *name, const void *data, size_t len) {
+    struct archive_entry *entry = archive_entry_new();
+    if (!entry) return 0;
+
+    archive_entry_set_pathname(entry, name);
+    archive_entry_set_size(entry, (la_int64_t)len);
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_entry_set_mtime(entry, GEN_ENTRY_MTIME, 0);
+
+    int ok = archive_write_header(a, entry) == ARCHIVE_OK &&
+             archive_write_data(a, data, len) == (la_ssize_t)len;
+    archive_entry_free(entry);
+    if (!ok) fprintf(stderr, "Cannot write %s: %s\n", name, archive_error_string(a));
+    return ok;
+}
+
+static int zip_close(struct archive *a) {
+    int ok = archive_write_close(a) == ARCHIVE_OK;
+    archive_write_free(a);
+    return ok;
+}
+
+static int write_file(const char *path, const char *data, size_t len) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    int ok = fwrite(data, 1, len, file) == len;
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+static int write_epub(const char *path, const GenBook *book, long index, GenBuffer *scratch) {
+    // mimetype обязан идти первым и без сжатия; libarchive не меняет метод сжатия
+    // между записями, поэтому весь EPUB пишется stored (спецификация это допускает)
+    struct archive *a = zip_open(path, 1);
+    if (!a) return 0;
+
+    static const char mimetype[] = "application/epub+zip";
+    static const char container[] =
+        "<?xml version=\"1.0\"?>\n"
+        "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+        "<rootfiles><rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/></rootfiles>\n"
+        "</container>\n";
+
+    int ok = zip_add(a, "mimetype", mimetype, sizeof(mimetype) - 1);
+    ok = ok && zip_add(a, "META-INF/container.xml", container, sizeof(container) - 1);
+    ok = ok && build_epub_opf(book, index, scratch);
+    ok = ok && zip_add(a, "OEBPS/content.opf", scratch->data, scratch->len);
+
+    scratch->len = 0;
+    ok = ok && buffer_printf(scratch, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                      "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>%s</title></head>"
+                                      "<body><h1>%s</h1><p>Синтетическая книга.</p></body></html>\n",
+                             book->title, book->title);
+    ok = ok && zip_add(a, "OEBPS/text.xhtml", scratch->data, scratch->len);
+
+    return zip_close(a) && ok;
+}
+
+// Запись INP: AUTHOR;GENRE;TITLE;SERIES;SERNO;FILE;SIZE;LIBID;DEL;EXT;DATE;LANG;KEYWORDS
+static int append_inp_record(GenBuffer *inp, const GenBook *book, long libid, size_t size) {
+    int ok = 1;
+    for (int i = 0; i < book->author_count; i++) {
+        int a = book->authors[i];
+        ok &= buffer_printf(inp, "%s,%s,%s:", author_last(a), author_first(a), author_middle(a));
+    }
+    ok &= buffer_printf(inp, "\x04%s:\x04%s\x04%s\x04", genres[book->genre], book->title,
+                        book->series >= 0 ? series_names[book->series] : "");
+    if (book->series >= 0) ok &= buffer_printf(inp, "%d", book->series_number);
+    ok &= buffer_printf(inp, "\x04%ld\x04%zu\x04%ld\x04" "0\x04" "fb2\x04%d-01-01\x04%s\x04\x04\r\n",
+                        libid, size, libid, book->year, book->lang_en ? "en" : "ru");
+    return ok;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: gen_corpus --out DIR [--books N] [--seed S] [--per-zip N]\n"
+            "                  [--loose-percent P] [--epub-percent P] [--cp1251-percent P]\n"
+            "                  [--stored-percent P] [--body-kb K] [--no-inpx]\n");
+}
+
+static int parse_percent(const char *value, int *out) {
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (*end != '\0' || v < 0 || v > 100) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+static int parse_options(int argc, char **argv, GenOptions *opt) {
+    opt->out_dir = NULL;
+    opt->books = 10000;
+    opt->seed = 1;
+    opt->per_zip = 1000;
+    opt->loose_percent = 10;
+    opt->epub_percent = 5;
+    opt->cp1251_percent = 30;
+    opt->stored_percent = 50;
+    opt->body_kb = 8;
+    opt->inpx = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (strcmp(arg, "--no-inpx") == 0) {
+            opt->inpx = 0;
+            continue;
+        }
+        if (!value) {
+            usage();
+            return 0;
+        }
+
+        if (strcmp(arg, "--out") == 0) opt->out_dir = value;
+        else if (strcmp(arg, "--books") == 0) ok = (opt->books = atol(value)) > 0;
+        else if (strcmp(arg, "--seed") == 0) opt->seed = strtoull(value, NULL, 10);
+        else if (strcmp(arg, "--per-zip") == 0) ok = (opt->per_zip = atoi(value)) > 0;
+        else if (strcmp(arg, "--loose-percent") == 0) ok = parse_percent(value, &opt->loose_percent);
+        else if (strcmp(arg, "--epub-percent") == 0) ok = parse_percent(value, &opt->epub_percent);
+        else if (strcmp(arg, "--cp1251-percent") == 0) ok = parse_percent(value, &opt->cp1251_percent);
+        else if (strcmp(arg, "--stored-percent") == 0) ok = parse_percent(value, &opt->stored_percent);
+        else if (strcmp(arg, "--body-kb") == 0) ok = (opt->body_kb = atoi(value)) >= 0;
+        else ok = 0;
+
+        if (!ok) {
+            fprintf(stderr, "Invalid option: %s %s\n", arg, value);
+            usage();
+            return 0;
+        }
+        i++;
+    }
+
+    if (!opt->out_dir) {
+        usage();
+        return 0;
+    }
+    if (opt->loose_percent + opt->epub_percent > 100) {
+        fprintf(stderr, "--loose-percent + --epub-percent must not exceed 100\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Закрывает текущий ZIP и дописывает его .inp в INPX
+static int finish_archive(struct archive **zip, struct archive *inpx, const char *zip_name,
+                          GenBuffer *inp) {
+    int ok = zip_close(*zip);
+    *zip = NULL;
+
+    if (inpx) {
+        char inp_name[256];
+        snprintf(inp_name, sizeof(inp_name), "%.*s.inp", (int)(strlen(zip_name) - 4), zip_name);
+        ok = ok && zip_add(inpx, inp_name, inp->data ? inp->data : "", inp->len);
+    }
+    inp->len = 0;
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    GenOptions opt;
+    if (!parse_options(argc, argv, &opt)) return GEN_USAGE;
+
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/loose", opt.out_dir);
+    if (!make_dirs(path)) {
+        fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+        return GEN_IO_ERROR;
+    }
+    snprintf(path, sizeof(path), "%s/epub", opt.out_dir);
+    if (!make_dirs(path)) {
+        fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+        return GEN_IO_ERROR;
+    }
+
+    struct archive *inpx = NULL;
+    if (opt.inpx) {
+        snprintf(path, sizeof(path), "%s/synthetic.inpx", opt.out_dir);
+        inpx = zip_open(path, 0);
+        if (!inpx) return GEN_IO_ERROR;
+
+        static const char collection[] = "Synthetic benchmark library\r\nsynthetic\r\n0\r\n";
+        static const char version[] = "20240101\r\n";
+        if (!zip_add(inpx, "collection.info", collection, sizeof(collection) - 1) ||
+            !zip_add(inpx, "version.info", version, sizeof(version) - 1)) {
+            zip_close(inpx);
+            return GEN_IO_ERROR;
+        }
+    }
+
+    GenBuffer content = {0};
+    GenBuffer inp = {0};
+    GenStats stats = {0};
+    struct archive *zip = NULL;
+    char zip_name[64] = {0};
+    long zip_first = 0;
+    int zip_entries = 0;
+    int ok = 1;
+
+    for (long i = 0; ok && i < opt.books; i++) {
+        GenBook book;
+        make_book(&opt, i, &book);
+
+        // Вид книги выбирается отдельным потоком, чтобы смена долей не меняла метаданные
+        uint64_t kind_state = (opt.seed << 1) ^ ((uint64_t)i * 0xD6E8FEB86659FD93ULL);
+        int kind = gen_range(&kind_state, 100);
+
+        if (kind < opt.epub_percent) {
+            snprintf(path, sizeof(path), "%s/epub/%06ld.epub", opt.out_dir, i + 1);
+            ok = write_epub(path, &book, i, &content);
+            stats.epub++;
+            continue;
+        }
+
+        ok = build_fb2(&opt, i, &book, &content);
+        if (!ok) {
+            fprintf(stderr, "Cannot build FB2 for book %ld\n", i + 1);
+            break;
+        }
+        stats.bytes += content.len;
+        if (book.cp1251) stats.cp1251++;
+
+        if (kind < opt.epub_percent + opt.loose_percent) {
+            snprintf(path, sizeof(path), "%s/loose/%03ld", opt.out_dir, i / GEN_LOOSE_PER_DIR);
+            ok = make_dirs(path);
+            snprintf(path, sizeof(path), "%s/loose/%03ld/%06ld.fb2", opt.out_dir, i / GEN_LOOSE_PER_DIR, i + 1);
+            ok = ok && write_file(path, content.data, content.len);
+            stats.loose++;
+            continue;
+        }
+
+        if (!zip) {
+            // Имя архива по диапазону LIBID, как в библиотеках lib.rus.ec/Флибусты
+            zip_first = i + 1;
+            snprintf(zip_name, sizeof(zip_name), "fb2-%06ld-%06ld.zip", zip_first,
+                     zip_first + opt.per_zip - 1);
+            snprintf(path, sizeof(path), "%s/%s", opt.out_dir, zip_name);
+
+            uint64_t zip_state = opt.seed ^ ((uint64_t)stats.archives << 32);
+            zip = zip_open(path, gen_percent(&zip_state, opt.stored_percent));
+            if (!zip) {
+                ok = 0;
+                break;
+            }
+            zip_entries = 0;
+            stats.archives++;
+        }
+
+        char entry_name[32];
+        snprintf(entry_name, sizeof(entry_name), "%ld.fb2", i + 1);
+        ok = zip_add(zip, entry_name, content.data, content.len);
+        ok = ok && (!inpx || append_inp_record(&inp, &book, i + 1, content.len));
+        stats.zipped++;
+
+        if (ok && ++zip_entries >= opt.per_zip) {
+            ok = finish_archive(&zip, inpx, zip_name, &inp);
+        }
+    }
+
+    if (zip && !finish_archive(&zip, inpx, zip_name, &inp)) ok = 0;
+    if (inpx && !zip_close(inpx)) ok = 0;
+
+    free(content.data);
+    free(inp.data);
+
+    if (!ok) {
+        fprintf(stderr, "Corpus generation failed\n");
+        return GEN_IO_ERROR;
+    }
+
+    printf("{\"books\": %ld, \"zipped\": %ld, \"archives\": %d, \"loose\": %ld, \"epub\": %ld, "
+           "\"cp1251\": %ld, \"fb2_bytes\": %llu, \"inpx\": %s}\n",
+           opt.books, stats.zipped, stats.archives, stats.loose, stats.epub,
+           stats.cp1251, stats.bytes, opt.inpx ? "true" : "false");
+    return GEN_OK;
+}
@@ -1,4 +1,6 @@
 #include "inpx_parser.h"
+#include "metrics.h"
+#include "trace.h"
 #include "utils.h"
 #include <archive.h>
 #include <archive_entry.h>
@@ -8,6 +10,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include "database.h"
+#include "intern.h"
 
 #define FIELD_SEP '\x04'
 #define RECORD_SEP1 '\x0D'  // CR
@@ -70,8 +73,8 @@ void get_inpx_fields(const char *structure_info, TImportContext *ctx) {
     free(s);
 }
 
-// Функция для парсинга CSV строки с разделителем \x04
-int parse_csv_line(const char *line, char **fields, int max_fields) {
+// Функция для парсинга CSV строки с разделителем \x04. Поля выделяются в арене записи
+static int parse_csv_line(const char *line, char **fields, int max_fields, Arena *arena) {
     if (!line || !fields) return 0;
 
     int field_count = 0;
@@ -79,11 +82,8 @@ int parse_csv_line(const char *line, char **fields, int max_fields) {
 
     for (int i = 0; line[i] != '\0' && field_count < max_fields; i++) {
         if (line[i] == FIELD_SEP || line[i] == '\0') {
-            int len = &line[i] - start;
-            fields[field_count] = malloc(len + 1);
+            fields[field_count] = arena_strndup(arena, start, &line[i] - start);
             if (fields[field_count]) {
-                strncpy(fields[field_count], start, len);
-                fields[field_count][len] = '\0';
                 field_count++;
             }
             start = &line[i + 1];
@@ -94,10 +94,8 @@ int parse_csv_line(const char *line, char **fields, int max_fields) {
 
     // Добавляем последнее поле если нужно
     if (field_count < max_fields && start < line + strlen(line)) {
-        int len = strlen(start);
-        fields[field_count] = malloc(len + 1);
+        fields[field_count] = arena_strdup(arena, start);
         if (fields[field_count]) {
-            strcpy(fields[field_count], start);
             field_count++;
         }
     }
@@ -105,23 +103,24 @@ int parse_csv_line(const char *line, char **fields, int max_fields) {
     return field_count;
 }
 
-void free_csv_fields(char **fields, int count) {
-    if (!fields) return;
-
-    for (int i = 0; i < count; i++) {
-        free(fields[i]);
-    }
+// Авторы, серии, жанры и языки в коллекции повторяются тысячи раз: берем их из пулов intern.c.
+// Строки пулов неизменяемы и переживают арену записи
+static char* intern_field(InternKind kind, const char *str, size_t len, Arena *arena) {
+    const char *interned = intern_string(kind, str, len, NULL);
+    // Пустая подстрока (жанр ":x") в пул не попадает - оставляем ее в арене, как раньше
+    return interned ? (char*)interned : arena_strndup(arena, str, len);
 }
 
 void parse_inpx_data(const char *input, TImportContext *ctx, int online_collection, BookMeta *meta,
                     char **file_name_ptr, char **file_ext_ptr) {
     (void)online_collection;
 
-    if (!input || !ctx || !meta || !file_name_ptr || !file_ext_ptr) return;
+    if (!input || !ctx || !meta || !meta->arena || !file_name_ptr || !file_ext_ptr) return;
+    Arena *arena = meta->arena;
 
     // Парсим CSV строку
     char *fields[20] = {0};
-    int field_count = parse_csv_line(input, fields, 20);
+    int field_count = parse_csv_line(input, fields, 20, arena);
 
     if (field_count == 0) {
         return;
@@ -138,6 +137,7 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                 if (!meta->author) {
                     char *author_str = fields[i];
                     char *last_name = author_str;
+                    char author_buf[304];
                     char *first_name = strchr(author_str, ':');
 
                     if (first_name) {
@@ -175,8 +175,7 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                             }
                             *dst = '\0';
 
-                            meta->author = malloc(strlen(clean_last) + strlen(clean_first) + strlen(clean_middle) + 3);
-                            sprintf(meta->author, "%s %s %s", clean_last, clean_first, clean_middle);
+                            snprintf(author_buf, sizeof(author_buf), "%s %s %s", clean_last, clean_first, clean_middle);
                         } else {
                             // Имя
                             dst = clean_first;
@@ -185,8 +184,7 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                             }
                             *dst = '\0';
 
-                            meta->author = malloc(strlen(clean_last) + strlen(clean_first) + 2);
-                            sprintf(meta->author, "%s %s", clean_last, clean_first);
+                            snprintf(author_buf, sizeof(author_buf), "%s %s", clean_last, clean_first);
                         }
                     } else {
                         // Только фамилия
@@ -196,15 +194,16 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                             *dst++ = (*src == ',') ? ' ' : *src;
                         }
                         *dst = '\0';
-                        meta->author = strdup(clean_last);
+                        snprintf(author_buf, sizeof(author_buf), "%s", clean_last);
                     }
+                    meta->author = intern_field(INTERN_AUTHORS, author_buf, strlen(author_buf), arena);
                 }
                 break;
             }
 
             case flTitle:  // 3-е поле
                 if (!meta->title) {
-                    meta->title = strdup(fields[i]);
+                    meta->title = fields[i];
                 }
                 break;
 
@@ -224,12 +223,10 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                             series_len--;
                         }
 
-                        meta->series = malloc(series_len + 1);
-                        strncpy(meta->series, series_str, series_len);
-                        meta->series[series_len] = '\0';
+                        meta->series = intern_field(INTERN_SERIES, series_str, series_len, arena);
                     } else {
                         // Нет скобок - берем всю строку
-                        meta->series = strdup(series_str);
+                        meta->series = intern_field(INTERN_SERIES, series_str, strlen(series_str), arena);
                     }
 
                     log_message(NULL, "DEBUG", "Parsed series: '%s' (from: '%s')",
@@ -260,11 +257,11 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
 
             case flFile:  // 6-е поле - ИМЯ ФАЙЛА
                 // Сохраняем FILE для имени файла
-                *file_name_ptr = strdup(fields[i]);
+                *file_name_ptr = fields[i];
                 break;
 
             case flExt:  // 10-е поле - расширение файла
-                *file_ext_ptr = strdup(fields[i]);
+                *file_ext_ptr = fields[i];
                 break;
 
             case flGenre:  // 2-е поле
@@ -275,19 +272,17 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
                     if (first_colon) {
                         // Берем только часть до первого двоеточия
                         size_t genre_len = first_colon - genre_str;
-                        meta->genre = malloc(genre_len + 1);
-                        strncpy(meta->genre, genre_str, genre_len);
-                        meta->genre[genre_len] = '\0';
+                        meta->genre = intern_field(INTERN_GENRES, genre_str, genre_len, arena);
                     } else {
                         // Если двоеточий нет, берем весь жанр
-                        meta->genre = strdup(genre_str);
+                        meta->genre = intern_field(INTERN_GENRES, genre_str, strlen(genre_str), arena);
                     }
                 }
                 break;
 
             case flLang:  // 12-е поле
                 if (!meta->language) {
-                    meta->language = strdup(fields[i]);
+                    meta->language = intern_field(INTERN_LANGUAGES, fields[i], strlen(fields[i]), arena);
                 }
                 break;
 
@@ -302,7 +297,6 @@ void parse_inpx_data(const char *input, TImportContext *ctx, int online_collecti
         }
     }
 
-    free_csv_fields(fields, field_count);
 }
 
 int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle, Config *config) {
@@ -419,6 +413,8 @@ int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle,
         }
 
         files_processed++;
+        metrics_inc(METRIC_INPX_FILES);
+        double inp_started = metrics_now();
         printf("DEBUG: >>> Found INP file: %s (size: %lld)\n", filename, size);
         log_message(config, "INFO", "Processing INP file: %s", filename);
 
@@ -442,15 +438,31 @@ int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle,
             continue;
         }
 
+        trace_begin("io", "decompress", filename);
         la_ssize_t bytes_read = archive_read_data(a, content, size);
+        trace_end();
         if (bytes_read != size) {
             printf("ERROR: Failed to read INP file: %s (read %zd of %lld bytes)\n",
                    filename, bytes_read, size);
+            metrics_inc(METRIC_ERRORS_READ);
             free(content);
             archive_read_data_skip(a);
             continue;
         }
         content[size] = '\0';
+        metrics_add(METRIC_BYTES_READ, (uint64_t)size);
+        trace_begin("inpx", "inp_file", filename);
+
+        // Поля записей живут в арене, которая сбрасывается после каждой строки
+        Arena record_arena;
+        arena_init(&record_arena, 0);
+
+        // Очередь строк текущего .inp для датчика inpx_records_pending
+        int64_t pending = 0;
+        for (const char *nl = content; (nl = memchr(nl, RECORD_SEP2, content + size - nl)) != NULL; nl++) {
+            pending++;
+        }
+        metrics_gauge_set(METRIC_GAUGE_INPX_RECORDS_PENDING, pending);
 
         printf("DEBUG: Successfully read INP file: %s (%zd bytes)\n", filename, bytes_read);
         printf("DEBUG: First 500 chars:\n%.500s\n", content);
@@ -484,12 +496,14 @@ int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle,
             // Пропускаем пустые строки
             if (strlen(line) > 10) {
                 BookMeta meta = {0};
+                meta.arena = &record_arena;
                 char *file_name = NULL;
                 char *file_ext = NULL;
 
                 printf("DEBUG: Line %d: %.200s\n", line_num, line);
 
                 parse_inpx_data(line, &ctx, 0, &meta, &file_name, &file_ext);
+                metrics_inc(METRIC_INPX_RECORDS);
 
                 printf("DEBUG: Parsed - Title: '%s', Author: '%s', File: '%s', Ext: '%s'\n",
                        meta.title ? meta.title : "NULL",
@@ -537,15 +551,16 @@ int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle,
                         printf("INFO: Imported %d books...\n", books_imported);
                         log_message(config, "INFO", "Imported %d books...", books_imported);
                     }
+                } else {
+                    metrics_inc(METRIC_INPX_RECORDS_REJECTED);
                 }
 
-                free(file_name);
-                free(file_ext);
                 free_book_meta(&meta);
             }
 
             line = next_line;
             line_num++;
+            metrics_gauge_add(METRIC_GAUGE_INPX_RECORDS_PENDING, -1);
 
             // Ограничим для отладки
         //    if (books_imported >= 50) {
@@ -556,6 +571,10 @@ int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle,
 
         printf("DEBUG: Processed %d lines in INP file, imported %d books\n", line_num, books_in_file);
         free(content);
+        arena_destroy(&record_arena);
+        trace_end();
+        metrics_gauge_set(METRIC_GAUGE_INPX_RECORDS_PENDING, 0);
+        metrics_observe(METRIC_HIST_INPX_FILE, metrics_now() - inp_started);
 
         //if (books_imported >= 50) {
         //    break;
@@ -45,6 +45,7 @@ typedef struct {
 
 // Основные функции INPX парсера
 int import_inpx_collection(const char *inpx_filename, DatabaseHandle *db_handle, Config *config);
+// Строки записи (поля meta, *file_name_ptr, *file_ext_ptr) выделяются в meta->arena
 void parse_inpx_data(const char *input, TImportContext *ctx, int online_collection, BookMeta *meta,
                     char **file_name_ptr, char **file_ext_ptr);
 void get_inpx_fields(const char *structure_info, TImportContext *ctx);
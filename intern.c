@@ -0,0 +1,192 @@
+// intern.c - пулы строк авторов, серий, жанров и языков для сканирования
+#include "common.h"
+#include "intern.h"
+#include "arena.h"
+#include <pthread.h>
+
+// Таблица разбита на шарды со своими мьютексами - потоки почти не ждут друг друга
+#define INTERN_SHARDS 16
+#define INTERN_INITIAL_SLOTS 64
+
+typedef struct {
+    const char *str;
+    size_t len;
+    uint64_t hash;
+    uint32_t id;
+    uint32_t db_epoch;      // db_id действителен, пока совпадает с текущей эпохой db_epoch
+    int64_t db_id;
+} InternEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    InternEntry **slots;    // открытая адресация, capacity - степень двойки
+    size_t capacity;
+    size_t count;
+    Arena storage;          // записи и строки; не сбрасывается, поэтому указатели стабильны
+} InternShard;
+
+typedef struct {
+    InternShard shards[INTERN_SHARDS];
+    uint32_t next_id;
+} InternPool;
+
+static InternPool pools[INTERN_KIND_COUNT];
+static uint32_t db_epoch = 1;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static void init_pools(void) {
+    for (int k = 0; k < INTERN_KIND_COUNT; k++) {
+        for (int s = 0; s < INTERN_SHARDS; s++) {
+            pthread_mutex_init(&pools[k].shards[s].lock, NULL);
+        }
+    }
+}
+
+// FNV-1a
+static uint64_t hash_string(const char *str, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Вызывается под lock шарда. Возвращает слот с записью или пустой слот для вставки
+static InternEntry** find_slot(InternShard *shard, const char *str, size_t len, uint64_t hash) {
+    size_t mask = shard->capacity - 1;
+    size_t index = (size_t)(hash >> 8) & mask;
+    while (shard->slots[index]) {
+        InternEntry *entry = shard->slots[index];
+        if (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return &shard->slots[index];
+}
+
+static int grow_shard(InternShard *shard) {
+    size_t capacity = shard->capacity ? shard->capacity * 2 : INTERN_INITIAL_SLOTS;
+    InternEntry **slots = calloc(capacity, sizeof(InternEntry*));
+    if (!slots) return 0;
+
+    InternEntry **old_slots = shard->slots;
+    size_t old_capacity = shard->capacity;
+    shard->slots = slots;
+    shard->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i]) {
+            *find_slot(shard, old_slots[i]->str, old_slots[i]->len, old_slots[i]->hash) = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 1;
+}
+
+// Вызывается под lock шарда
+static InternEntry* lookup_locked(InternPool *pool, InternShard *shard, const char *str, size_t len,
+                                  uint64_t hash, int create) {
+    if (shard->capacity) {
+        InternEntry *entry = *find_slot(shard, str, len, hash);
+        if (entry || !create) return entry;
+    } else if (!create) {
+        return NULL;
+    }
+
+    // Заполнение не больше 3/4, иначе линейное пробирование начинает буксовать
+    if ((shard->count + 1) * 4 > shard->capacity * 3 && !grow_shard(shard)) {
+        return NULL;
+    }
+
+    InternEntry *entry = arena_alloc(&shard->storage, sizeof(InternEntry));
+    char *copy = arena_strndup(&shard->storage, str, len);
+    if (!entry || !copy) return NULL;
+
+    entry->str = copy;
+    entry->len = len;
+    entry->hash = hash;
+    entry->id = __atomic_add_fetch(&pool->next_id, 1, __ATOMIC_RELAXED);
+    entry->db_epoch = 0;
+    entry->db_id = 0;
+    *find_slot(shard, str, len, hash) = entry;
+    shard->count++;
+    return entry;
+}
+
+const char* intern_string(InternKind kind, const char *str, size_t len, uint32_t *id) {
+    if (!str || len == 0) return NULL;
+    pthread_once(&pools_once, init_pools);
+
+    InternPool *pool = &pools[kind];
+    uint64_t hash = hash_string(str, len);
+    InternShard *shard = &pool->shards[hash % INTERN_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    InternEntry *entry = lookup_locked(pool, shard, str, len, hash, 1);
+    const char *result = entry ? entry->str : NULL;
+    if (entry && id) *id = entry->id;
+    pthread_mutex_unlock(&shard->lock);
+    return result;
+}
+
+InternKind intern_kind_for_table(const char *table) {
+    if (strcmp(table, "authors") == 0) return INTERN_AUTHORS;
+    if (strcmp(table, "series") == 0) return INTERN_SERIES;
+    if (strcmp(table, "genres") == 0) return INTERN_GENRES;
+    return INTERN_KIND_COUNT;
+}
+
+int64_t intern_db_id(InternKind kind, const char *str) {
+    if (kind >= INTERN_KIND_COUNT || !str || !*str) return 0;
+    pthread_once(&pools_once, init_pools);
+
+    InternPool *pool = &pools[kind];
+    size_t len = strlen(str);
+    uint64_t hash = hash_string(str, len);
+    InternShard *shard = &pool->shards[hash % INTERN_SHARDS];
+    uint32_t epoch = __atomic_load_n(&db_epoch, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&shard->lock);
+    InternEntry *entry = lookup_locked(pool, shard, str, len, hash, 0);
+    int64_t db_id = (entry && entry->db_epoch == epoch) ? entry->db_id : 0;
+    pthread_mutex_unlock(&shard->lock);
+    return db_id;
+}
+
+void intern_remember_db_id(InternKind kind, const char *str, int64_t db_id) {
+    if (kind >= INTERN_KIND_COUNT || !str || !*str || db_id <= 0) return;
+    pthread_once(&pools_once, init_pools);
+
+    InternPool *pool = &pools[kind];
+    size_t len = strlen(str);
+    uint64_t hash = hash_string(str, len);
+    InternShard *shard = &pool->shards[hash % INTERN_SHARDS];
+    uint32_t epoch = __atomic_load_n(&db_epoch, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&shard->lock);
+    InternEntry *entry = lookup_locked(pool, shard, str, len, hash, 1);
+    if (entry) {
+        entry->db_id = db_id;
+        entry->db_epoch = epoch;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void intern_forget_db_ids(void) {
+    // Записи с прежней эпохой считаются незаполненными - обходить таблицы не нужно
+    __atomic_add_fetch(&db_epoch, 1, __ATOMIC_RELEASE);
+}
+
+size_t intern_count(InternKind kind) {
+    pthread_once(&pools_once, init_pools);
+
+    size_t total = 0;
+    for (int s = 0; s < INTERN_SHARDS; s++) {
+        InternShard *shard = &pools[kind].shards[s];
+        pthread_mutex_lock(&shard->lock);
+        total += shard->count;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return total;
+}
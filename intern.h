@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Пулы повторяющихся строк сканирования. Строка из пула неизменяема и живет до конца процесса,
+// одинаковые значения получают один указатель и один плотный id (1, 2, ...) внутри пула
+typedef enum {
+    INTERN_AUTHORS,
+    INTERN_SERIES,
+    INTERN_GENRES,
+    INTERN_LANGUAGES,
+    INTERN_KIND_COUNT
+} InternKind;
+
+// Возвращает строку из пула (добавляя ее при необходимости) или NULL для пустой строки.
+// id (если не NULL) получает номер строки в пуле. Потокобезопасно
+const char* intern_string(InternKind kind, const char *str, size_t len, uint32_t *id);
+
+// Кэш id строк словарей authors/series/genres в открытой базе: 0 - id неизвестен
+InternKind intern_kind_for_table(const char *table);   // INTERN_KIND_COUNT для прочих таблиц
+int64_t intern_db_id(InternKind kind, const char *str);
+void intern_remember_db_id(InternKind kind, const char *str, int64_t db_id);
+// Сбрасывает все запомненные id (новое соединение, очистка или чистка словарей)
+void intern_forget_db_ids(void);
+
+// Число различных строк в пуле
+size_t intern_count(InternKind kind);
+
+#endif
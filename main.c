@@ -1,8 +1,12 @@
 #include "common.h"
 #include "config.h"
 #include "database.h"
+#include "dedupe.h"
+#include "intern.h"
+#include "metrics.h"
 #include "scanner.h"
 #include "scanner_integration.h"
+#include "trace.h"
 #include "utils.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -12,17 +16,33 @@
 int main(int argc, char *argv[]) {
     printf("=== SCANNER STARTING ===\n");
 
-    char *config_path;
+    char *config_path = NULL;
+    const char *search_query = NULL;
+    const char *trace_path = NULL;
+    int search_substring = 0;
+    int dedupe_only = 0;
+
+    // book_scanner [config.ini] [--search "слова" | --substring "фрагмент" | --dedupe] [--trace out.json]
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "--search") == 0 || strcmp(argv[i], "--substring") == 0) && i + 1 < argc) {
+            search_substring = (strcmp(argv[i], "--substring") == 0);
+            search_query = argv[++i];
+        } else if (strcmp(argv[i], "--dedupe") == 0) {
+            dedupe_only = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!config_path) {
+            config_path = strdup(argv[i]);
+        }
+    }
 
-    if (argc == 1) {
+    if (!config_path) {
         config_path = find_config_file();
         if (!config_path) {
             fprintf(stderr, "No config file specified and no default config found\n");
             return 1;
         }
         printf("Using auto-detected config file: %s\n", config_path);
-    } else {
-        config_path = strdup(argv[1]);
     }
 
     printf("DEBUG: Reading config from: %s\n", config_path);
@@ -71,8 +91,64 @@ int main(int argc, char *argv[]) {
         printf("SUCCESS: Database tables created\n");
     }
 
+    // Режим поиска: сканирование не выполняем, только выводим найденные книги
+    if (search_query) {
+        BookSearchHit *hits = NULL;
+        int found = search_substring
+            ? db_search_substring(db_handle, search_query, 50, &hits, config)
+            : db_search_books(db_handle, search_query, 50, &hits, config);
+        if (found < 0) {
+            printf("ERROR: Search failed\n");
+        } else {
+            printf("=== SEARCH RESULTS: %d ===\n", found);
+            for (int i = 0; i < found; i++) {
+                printf("%d\t%.3f\t%s\t%s\t%s\n", hits[i].id, hits[i].score,
+                       hits[i].author ? hits[i].author : "",
+                       hits[i].title ? hits[i].title : "",
+                       hits[i].series ? hits[i].series : "");
+            }
+        }
+        free_search_hits(hits, found);
+        db_close(db_handle);
+        free_config(config);
+        return found < 0 ? 1 : 0;
+    }
+
+    // Метрики сканирования выгружаются каждые metrics_interval секунд и в конце
+    metrics_configure(config);
+
+    // Трассировка для chrome://tracing и Perfetto: интервалы каталогов, архивов, записей, разбора и SQL
+    if (trace_path) {
+        if (trace_open(trace_path)) {
+            printf("INFO: Writing trace events to %s\n", trace_path);
+        } else {
+            printf("ERROR: Cannot open trace file %s, continuing without trace\n", trace_path);
+        }
+    }
+
+    // Режим поиска почти-дубликатов: группирует книги по отпечаткам текста, собранным
+    // при сканировании, и отмечает в duplicate_of все издания, кроме канонического
+    if (dedupe_only) {
+        int deduped = run_dedupe(db_handle, config);
+        if (!deduped) {
+            printf("ERROR: Dedupe failed\n");
+        }
+        metrics_flush();
+        if (trace_path) {
+            trace_close();
+        }
+        db_close(db_handle);
+        free_config(config);
+        return deduped ? 0 : 1;
+    }
+
+    // Первое наполнение базы: индексы чтения строятся один раз после импорта
+    int bulk_load = db_begin_bulk_load(db_handle, config);
+
     printf("DEBUG: Starting INPX processing...\n");
+    trace_begin("inpx", "inpx_import", NULL);
     int inpx_imported = process_inpx_if_enabled(db_handle, config);
+    trace_end();
 
 
     // Проверяем, был ли выполнен импорт INPX
@@ -98,6 +174,19 @@ if (inpx_imported == -1) {
     }
 
     printf("DEBUG: Book scanning completed\n");
+    log_message(config, "INFO", "Distinct values: %zu authors, %zu series, %zu genres, %zu languages",
+                intern_count(INTERN_AUTHORS), intern_count(INTERN_SERIES),
+                intern_count(INTERN_GENRES), intern_count(INTERN_LANGUAGES));
+
+    trace_begin("db", "end_bulk_load", NULL);
+    if (!db_end_bulk_load(db_handle, bulk_load, config)) {
+        printf("ERROR: Failed to rebuild indexes after scanning\n");
+    }
+    trace_end();
+    metrics_flush();
+    if (trace_path) {
+        trace_close();
+    }
 
     db_close(db_handle);
     free_config(config);
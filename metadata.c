@@ -1,119 +1,144 @@
 // #define _POSIX_C_SOURCE 200809L
 // #define _GNU_SOURCE
 
+#include "common.h"
 #include "metadata.h"
+#include "dedupe.h"
+#include "format.h"
+#include "metrics.h"
+#include "trace.h"
 #include "utils.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-BookMeta* parse_metadata(const char *filepath, const char *file_type) {
-    printf("DEBUG: [PARSE_METADATA] Parsing: %s, type: %s\n", filepath, file_type);
+char* intern_meta_field(InternKind kind, char *str) {
+    if (!str || !*str) return str;
+    const char *interned = intern_string(kind, str, strlen(str), NULL);
+    return interned ? (char*)interned : str;
+}
 
-    BookMeta *meta = calloc(1, sizeof(BookMeta));
-    if (!meta) {
-        printf("ERROR: [PARSE_METADATA] Failed to allocate BookMeta\n");
-        return NULL;
-    }
+BookMeta* book_meta_new(Arena *arena) {
+    BookMeta *meta = arena_calloc(arena, sizeof(BookMeta));
+    if (meta) meta->arena = arena;
+    return meta;
+}
 
-    // Инициализируем все поля
-    meta->title = NULL;
-    meta->author = NULL;
-    meta->genre = NULL;
-    meta->series = NULL;
-    meta->language = NULL;
-    meta->publisher = NULL;
-    meta->description = NULL;
-    meta->file_size = 0;
-    meta->series_number = 0;
-    meta->year = 0;
-
-    if (strcasecmp(file_type, "fb2") == 0) {
-        BookMeta *fb2_meta = parse_fb2(filepath);
-        if (fb2_meta) {
-            // Копируем данные из fb2_meta в meta
-            if (fb2_meta->title) meta->title = strdup(fb2_meta->title);
-            if (fb2_meta->author) meta->author = strdup(fb2_meta->author);
-            if (fb2_meta->genre) meta->genre = strdup(fb2_meta->genre);
-            if (fb2_meta->series) meta->series = strdup(fb2_meta->series);
-            if (fb2_meta->language) meta->language = strdup(fb2_meta->language);
-            if (fb2_meta->publisher) meta->publisher = strdup(fb2_meta->publisher);
-            meta->series_number = fb2_meta->series_number;
-            meta->year = fb2_meta->year;
-
-            free_book_meta(fb2_meta);
-            printf("DEBUG: [PARSE_METADATA] Successfully parsed FB2: %s\n", filepath);
-        } else {
-            printf("DEBUG: [PARSE_METADATA] Failed to parse FB2, using fallback: %s\n", filepath);
-            // Используем fallback логику
+// Общий хвост parse_metadata и parse_metadata_view: название и автор из имени файла, если их нет
+static BookMeta* finish_metadata(BookMeta *meta, const char *filepath, Arena *arena) {
+    if (!meta) {
+        meta = book_meta_new(arena);
+        if (!meta) {
+            printf("ERROR: [PARSE_METADATA] Failed to allocate BookMeta\n");
+            return NULL;
         }
     }
 
-    // Fallback: если не удалось распарсить или не FB2
+    // Fallback: если не удалось распарсить, в метаданных нет названия или формат без разбора
     if (!meta->title) {
         const char *filename = strrchr(filepath, '/');
         filename = filename ? filename + 1 : filepath;
 
         char *dash = strstr(filename, " - ");
         if (dash) {
-            meta->author = strndup(filename, dash - filename);
+            meta->author = arena_strndup(arena, filename, dash - filename);
             const char *title_start = dash + 3;
             const char *dot = strrchr(title_start, '.');
             if (dot) {
-                meta->title = strndup(title_start, dot - title_start);
+                meta->title = arena_strndup(arena, title_start, dot - title_start);
             } else {
-                meta->title = strdup(title_start);
+                meta->title = arena_strdup(arena, title_start);
             }
         } else {
             const char *dot = strrchr(filename, '.');
             if (dot) {
-                meta->title = strndup(filename, dot - filename);
+                meta->title = arena_strndup(arena, filename, dot - filename);
             } else {
-                meta->title = strdup(filename);
+                meta->title = arena_strdup(arena, filename);
             }
         }
     }
 
     // Гарантируем, что title и author не NULL
-    if (!meta->title) meta->title = strdup("Unknown Title");
-    if (!meta->author) meta->author = strdup("Unknown Author");
+    if (!meta->title) meta->title = arena_strdup(arena, "Unknown Title");
+    if (!meta->author) meta->author = arena_strdup(arena, "Unknown Author");
 
-    printf("DEBUG: [PARSE_METADATA] Final - Title: %s, Author: %s\n", meta->title, meta->author);
+    DBG("[PARSE_METADATA] Final - Title: %s, Author: %s\n", meta->title, meta->author);
 
     return meta;
 }
 
-BookMeta* parse_fb2(const char *filepath) {
-    BookMeta *meta = calloc(1, sizeof(BookMeta));
-    if (!meta) return NULL;
+BookMeta* parse_metadata(const char *filepath, const char *file_type, Arena *arena) {
+    printf("DEBUG: [PARSE_METADATA] Parsing: %s, type: %s\n", filepath, file_type);
 
-    char *content = read_file_content(filepath);
-    if (!content) {
-        free_book_meta(meta);
-        return NULL;
+    // Разобранная книга уже лежит в той же арене - копировать поля не нужно
+    BookMeta *meta = NULL;
+    const FormatHandler *handler = format_handler(format_from_name(file_type));
+    if (handler->parse_file) {
+        meta = handler->parse_file(filepath, arena);
+        if (meta) {
+            printf("DEBUG: [PARSE_METADATA] Successfully parsed %s: %s\n", handler->name, filepath);
+        } else {
+            printf("DEBUG: [PARSE_METADATA] Failed to parse %s, using fallback: %s\n", handler->name, filepath);
+        }
     }
 
+    return finish_metadata(meta, filepath, arena);
+}
+
+BookMeta* parse_metadata_view(const char *filepath, const char *file_type, FileView *view, Arena *arena) {
+    DBG("[PARSE_METADATA] Parsing view: %s, type: %s\n", filepath, file_type);
+
+    BookMeta *meta = NULL;
+    BookFormat format = format_from_name(file_type);
+    const FormatHandler *handler = format_handler(format);
+    if (format == BOOK_FORMAT_FB2) {
+        meta = parse_fb2_view(filepath, view, arena);
+    } else if (handler->parse_memory) {
+        meta = handler->parse_memory(view->data, view->size, arena);
+    }
+    if (!meta && (format == BOOK_FORMAT_FB2 || handler->parse_memory)) {
+        DBG("[PARSE_METADATA] Failed to parse %s, using fallback: %s\n", handler->name, filepath);
+    }
+
+    return finish_metadata(meta, filepath, arena);
+}
+
+// Разбор FB2 из строки, завершенной нулем. Все строки метаданных выделяются в арене.
+// В encoding возвращается кодировка документа (как у detect_encoding) для текста книги
+static BookMeta* parse_fb2_text(const char *content, int *encoding, Arena *arena) {
+    BookMeta *meta = book_meta_new(arena);
+    if (!meta) return NULL;
+    double started = metrics_now();
+    trace_begin("parse", "fb2_parse", NULL);
+
     // ОПРЕДЕЛЯЕМ кодировку
     int content_encoding = detect_encoding(content);
+    *encoding = content_encoding;
 
-    // КОНВЕРТИРУЕМ ВЕСЬ КОНТЕНТ если нужно
+    // КОНВЕРТИРУЕМ ВЕСЬ КОНТЕНТ если нужно (размер результата iconv заранее неизвестен - буфер из кучи)
     char *converted_content = NULL;
     if (content_encoding == 2) { // Windows-1251
+        trace_begin("parse", "iconv", "WINDOWS-1251");
         converted_content = convert_encoding(content, "WINDOWS-1251", "UTF-8");
+        trace_end();
+        metrics_inc(METRIC_FB2_CONVERTED_CP1251);
     }
 
     // Используем конвертированный контент если он есть, иначе оригинальный
-    char *content_to_parse = converted_content ? converted_content : content;
+    const char *content_to_parse = converted_content ? converted_content : content;
 
     // ИЗВЛЕКАЕМ метаданные из уже конвертированного контента
-    meta->title = extract_xml_tag_content(content_to_parse, "book-title");
-    meta->author = extract_fb2_author(content_to_parse);
-    meta->genre = extract_xml_tag_content(content_to_parse, "genre");
-    meta->series = extract_fb2_sequence(content_to_parse);
+    meta->title = extract_xml_tag_content(content_to_parse, "book-title", arena);
+    meta->author = intern_meta_field(INTERN_AUTHORS, extract_fb2_author(content_to_parse, arena));
+    meta->genre = intern_meta_field(INTERN_GENRES, extract_xml_tag_content(content_to_parse, "genre", arena));
+    meta->series = intern_meta_field(INTERN_SERIES, extract_fb2_sequence(content_to_parse, arena));
     meta->series_number = extract_fb2_sequence_number(content_to_parse);
 
     // Извлечение года публикации
-    char *date = extract_xml_tag_content(content_to_parse, "date");
+    char *date = extract_xml_tag_content(content_to_parse, "date", arena);
     if (date) {
         char *year_ptr = date;
         while (*year_ptr) {
@@ -126,114 +151,142 @@ BookMeta* parse_fb2(const char *filepath) {
             }
             year_ptr++;
         }
-        free(date);
     }
 
-    meta->language = extract_xml_tag_content(content_to_parse, "lang");
-    meta->publisher = extract_xml_tag_content(content_to_parse, "publisher");
+    meta->language = intern_meta_field(INTERN_LANGUAGES, extract_xml_tag_content(content_to_parse, "lang", arena));
+    meta->publisher = extract_xml_tag_content(content_to_parse, "publisher", arena);
 
-    // Аннотация
-    char *annotation = extract_xml_tag_content(content_to_parse, "annotation");
-    if (annotation) {
-        if (strlen(annotation) > 1000) {
-            meta->description = strndup(annotation, 1000);
-        } else {
-            meta->description = annotation;
-        }
+    // Аннотация: обрезаем на месте, строка и так принадлежит арене
+    char *annotation = extract_xml_tag_content(content_to_parse, "annotation", arena);
+    if (annotation && strlen(annotation) > 1000) {
+        annotation[1000] = '\0';
     }
+    meta->description = annotation;
 
-    // Если название не найдено, используем имя файла
-    if (!meta->title) {
-        const char *filename = strrchr(filepath, '/');
-        filename = filename ? filename + 1 : filepath;
-        const char *dot = strrchr(filename, '.');
-        if (dot) {
-            meta->title = strndup(filename, dot - filename);
-        } else {
-            meta->title = strdup(filename);
-        }
-    }
+    free(converted_content);
+
+    trace_end();
+    metrics_inc(METRIC_FB2_PARSED);
+    metrics_observe(METRIC_HIST_FB2_PARSE, metrics_now() - started);
+    return meta;
+}
 
-    // Очищаем память
-    free(content);
-    if (converted_content) {
-        free(converted_content);
+// Отпечаток начала текста книги: до DEDUPE_READ_BYTES байт от <body>, приведенных к UTF-8
+static void fb2_fingerprint_text(BookMeta *meta, const char *text, size_t text_len, int encoding) {
+    const char *body = memmem(text, text_len, "<body", 5);
+    if (body) {
+        text_len -= (size_t)(body - text);
+        text = body;
+    }
+    if (text_len > DEDUPE_READ_BYTES) text_len = DEDUPE_READ_BYTES;
+
+    // Windows-1251 однобайтовая - обрезка по любой границе не портит символы
+    char *converted = NULL;
+    if (encoding == 2) {
+        char *raw = strndup(text, text_len);
+        converted = raw ? convert_encoding(raw, "WINDOWS-1251", "UTF-8") : NULL;
+        free(raw);
+        if (!converted) return;
+        text = converted;
+        text_len = strlen(converted);
     }
 
-    return meta;
+    trace_begin("parse", "text_fingerprint", NULL);
+    meta->text_fingerprint = text_fingerprint(text, text_len);
+    trace_end();
+    if (meta->text_fingerprint) metrics_inc(METRIC_TEXT_FINGERPRINTS);
+    free(converted);
 }
 
-BookMeta* parse_fb2_from_memory(const char *content, size_t content_size) {
-    BookMeta *meta = calloc(1, sizeof(BookMeta));
-    if (!meta) return NULL;
+// Отображение файла кончается на </description>: начало текста дочитывается отдельно
+static void fb2_fingerprint_file(BookMeta *meta, const char *filepath, size_t offset, int encoding) {
+    char *buffer = malloc(DEDUPE_READ_BYTES);
+    if (!buffer) return;
 
-    char *content_copy = malloc(content_size + 1);
-    if (!content_copy) {
-        free_book_meta(meta);
-        return NULL;
+    ssize_t got = -1;
+    int fd = open(filepath, O_RDONLY);
+    if (fd >= 0) {
+        got = pread(fd, buffer, DEDUPE_READ_BYTES, (off_t)offset);
+        close(fd);
     }
-    memcpy(content_copy, content, content_size);
-    content_copy[content_size] = '\0';
+    if (got > 0) fb2_fingerprint_text(meta, buffer, (size_t)got, encoding);
+    free(buffer);
+}
 
-    // ОПРЕДЕЛЯЕМ кодировку
-    int content_encoding = detect_encoding(content_copy);
+// Если название не найдено, используем имя файла
+static void fb2_title_from_filename(BookMeta *meta, const char *filepath, Arena *arena) {
+    if (meta->title) return;
 
-    // КОНВЕРТИРУЕМ ВЕСЬ КОНТЕНТ если нужно
-    char *converted_content = NULL;
-    if (content_encoding == 2) { // Windows-1251
-        converted_content = convert_encoding(content_copy, "WINDOWS-1251", "UTF-8");
+    const char *filename = strrchr(filepath, '/');
+    filename = filename ? filename + 1 : filepath;
+    const char *dot = strrchr(filename, '.');
+    if (dot) {
+        meta->title = arena_strndup(arena, filename, dot - filename);
+    } else {
+        meta->title = arena_strdup(arena, filename);
     }
+}
 
-    // Используем конвертированный контент если он есть, иначе оригинальный
-    char *content_to_parse = converted_content ? converted_content : content_copy;
-
-    // ИЗВЛЕКАЕМ метаданные из уже конвертированного контента
-    meta->title = extract_xml_tag_content(content_to_parse, "book-title");
-    meta->author = extract_fb2_author(content_to_parse);
-    meta->genre = extract_xml_tag_content(content_to_parse, "genre");
-    meta->series = extract_fb2_sequence(content_to_parse);
-    meta->series_number = extract_fb2_sequence_number(content_to_parse);
+BookMeta* parse_fb2(const char *filepath, Arena *arena) {
+    // Все метаданные FB2 лежат в <description>: отображаем файл только до ее конца,
+    // даже если перед ней стоят большие встроенные <binary>. Строки копируются в арену,
+    // так что отображение закрывается сразу после разбора
+    FileView view;
+    if (!file_view_open(filepath, "</description>", &view)) {
+        return NULL;
+    }
 
-    char *date = extract_xml_tag_content(content_to_parse, "date");
-    if (date) {
-        char *year_ptr = date;
-        while (*year_ptr) {
-            if (isdigit((unsigned char)*year_ptr) &&
-                isdigit((unsigned char)*(year_ptr+1)) &&
-                isdigit((unsigned char)*(year_ptr+2)) &&
-                isdigit((unsigned char)*(year_ptr+3))) {
-                meta->year = atoi(year_ptr);
-                break;
-            }
-            year_ptr++;
+    int encoding = 0;
+    BookMeta *meta = parse_fb2_text(view.data, &encoding, arena);
+    if (meta) {
+        // Без mmap view.data - уже весь файл
+        if (view.map_len == 0) {
+            fb2_fingerprint_text(meta, view.data, view.size, encoding);
+        } else if (view.size < view.file_size) {
+            fb2_fingerprint_file(meta, filepath, view.size, encoding);
         }
-        free(date);
     }
+    file_view_close(&view);
+    if (!meta) return NULL;
 
-    meta->language = extract_xml_tag_content(content_to_parse, "lang");
-    meta->publisher = extract_xml_tag_content(content_to_parse, "publisher");
+    fb2_title_from_filename(meta, filepath, arena);
+    return meta;
+}
 
-    char *annotation = extract_xml_tag_content(content_to_parse, "annotation");
-    if (annotation) {
-        if (strlen(annotation) > 1000) {
-            meta->description = strndup(annotation, 1000);
-        } else {
-            meta->description = annotation;
-        }
-    }
+BookMeta* parse_fb2_view(const char *filepath, FileView *view, Arena *arena) {
+    // <description> разбирается как строка C: ноль на время разбора ставится прямо за ней
+    // (отображение MAP_PRIVATE, файл не меняется), отпечаток текста берется из того же view
+    const char *description_end = memmem(view->data, view->size, "</description>", 14);
+    size_t head = description_end ? (size_t)(description_end - view->data) + 14 : view->size;
+    char saved = view->data[head];
+    view->data[head] = '\0';
+
+    int encoding = 0;
+    BookMeta *meta = parse_fb2_text(view->data, &encoding, arena);
+    view->data[head] = saved;
+    if (!meta) return NULL;
 
-    // Очищаем память
-    free(content_copy);
-    if (converted_content) {
-        free(converted_content);
-    }
+    fb2_fingerprint_text(meta, view->data + head, view->size - head, encoding);
+    fb2_title_from_filename(meta, filepath, arena);
+    return meta;
+}
 
+BookMeta* parse_fb2_from_memory(const char *content, size_t content_size, Arena *arena) {
+    // Запись архива (process_archive_entry) и view файла уже завершены нулем - разбираем на месте,
+    // без копии: запись бывает до 10 МБ, больше ARENA_KEEP_MAX
+    int encoding = 0;
+    BookMeta *meta = parse_fb2_text(content, &encoding, arena);
+    if (meta) {
+        const char *description_end = strstr(content, "</description>");
+        size_t offset = description_end ? (size_t)(description_end - content) : 0;
+        fb2_fingerprint_text(meta, content + offset, content_size - offset, encoding);
+    }
     return meta;
 }
 
 // Остальные функции БЕЗ ИЗМЕНЕНИЙ:
 
-char* extract_fb2_sequence(const char *xml) {
+char* extract_fb2_sequence(const char *xml, Arena *arena) {
     // Ищем тег sequence разными способами
     char *sequence_start = strstr(xml, "<sequence");
     if (!sequence_start) {
@@ -250,11 +303,8 @@ char* extract_fb2_sequence(const char *xml) {
         name_start += 6;
         name_end = strchr(name_start, '"');
         if (name_end) {
-            size_t name_len = name_end - name_start;
-            char *series_name = malloc(name_len + 1);
+            char *series_name = arena_strndup(arena, name_start, name_end - name_start);
             if (series_name) {
-                strncpy(series_name, name_start, name_len);
-                series_name[name_len] = '\0';
                 return series_name;
             }
         }
@@ -268,15 +318,12 @@ char* extract_fb2_sequence(const char *xml) {
         if (close_tag) {
             size_t content_len = close_tag - tag_end;
             if (content_len > 0 && content_len < 1000) {
-                char *series_name = malloc(content_len + 1);
+                char *series_name = arena_strndup(arena, tag_end, content_len);
                 if (series_name) {
-                    strncpy(series_name, tag_end, content_len);
-                    series_name[content_len] = '\0';
                     trim_string(series_name);
                     if (strlen(series_name) > 0) {
                         return series_name;
                     }
-                    free(series_name);
                 }
             }
         }
@@ -317,7 +364,7 @@ int extract_fb2_sequence_number(const char *xml) {
     return 0;
 }
 
-char* extract_xml_tag_content(const char *xml, const char *tag_name) {
+char* extract_xml_tag_content(const char *xml, const char *tag_name, Arena *arena) {
     char open_tag[256], close_tag[256];
     snprintf(open_tag, sizeof(open_tag), "<%s>", tag_name);
     snprintf(close_tag, sizeof(close_tag), "</%s>", tag_name);
@@ -329,86 +376,75 @@ char* extract_xml_tag_content(const char *xml, const char *tag_name) {
     char *end = strstr(start, close_tag);
     if (!end) return NULL;
 
-    size_t len = end - start;
-    char *content = malloc(len + 1);
+    char *content = arena_strndup(arena, start, end - start);
     if (!content) return NULL;
 
-    strncpy(content, start, len);
-    content[len] = '\0';
-
     trim_string(content);
 
     if (strcmp(tag_name, "annotation") == 0) {
-        char *cleaned = clean_html_tags(content);
-        if (cleaned) {
-            free(content);
-            content = cleaned;
-        }
+        strip_html_tags(content);
+        if (content[0] == '\0') return NULL;
     }
 
     return content; // УБРАНА конвертация - контент уже в UTF-8
 }
 
-char* extract_fb2_author(const char *xml) {
-    char *author_start = strstr(xml, "<author>");
-    if (!author_start) return NULL;
-
-    char *author_end = strstr(author_start, "</author>");
-    if (!author_end) return NULL;
-
-    char *first_name = extract_xml_tag_content(author_start, "first-name");
-    char *last_name = extract_xml_tag_content(author_start, "last-name");
+// Имя одного автора из блока <author>...</author>
+static char* extract_single_author(const char *block, Arena *arena) {
+    char *first_name = extract_xml_tag_content(block, "first-name", arena);
+    char *last_name = extract_xml_tag_content(block, "last-name", arena);
 
     if (!first_name && !last_name) {
         return NULL;
     }
 
-    char *author = NULL;
     if (first_name && last_name) {
-        author = malloc(strlen(first_name) + strlen(last_name) + 2);
-        sprintf(author, "%s %s", first_name, last_name);
-    } else if (first_name) {
-        author = strdup(first_name);
-    } else {
-        author = strdup(last_name);
+        char *author = arena_alloc(arena, strlen(first_name) + strlen(last_name) + 2);
+        if (author) sprintf(author, "%s %s", first_name, last_name);
+        return author;
     }
+    return first_name ? first_name : last_name;
+}
 
-    free(first_name);
-    free(last_name);
+// Все авторы книги из <title-info> через ", " (авторы из <document-info> - это составители файла)
+char* extract_fb2_author(const char *xml, Arena *arena) {
+    const char *limit = strstr(xml, "</title-info>");
+    char *authors = NULL;
+    size_t authors_len = 0;
+
+    const char *author_start = strstr(xml, "<author>");
+    while (author_start && (!limit || author_start < limit)) {
+        const char *author_end = strstr(author_start, "</author>");
+        if (!author_end) break;
+
+        // Ищем имена только внутри текущего блока
+        char *block = arena_strndup(arena, author_start, author_end - author_start + strlen("</author>"));
+        char *author = block ? extract_single_author(block, arena) : NULL;
+
+        if (author) {
+            size_t len = strlen(author);
+            char *joined = arena_alloc(arena, authors_len + len + (authors ? 3 : 1));
+            if (joined) {
+                if (authors_len > 0) {
+                    memcpy(joined, authors, authors_len);
+                    memcpy(joined + authors_len, ", ", 2);
+                    authors_len += 2;
+                }
+                memcpy(joined + authors_len, author, len + 1);
+                authors_len += len;
+                authors = joined;
+            }
+        }
+
+        author_start = strstr(author_end, "<author>");
+    }
 
-    return author;
+    return authors;
 }
 
+// Строки книги принадлежат арене - "освобождение" сбрасывает ее целиком.
+// Если meta выделена через book_meta_new, после вызова она тоже недействительна
 void free_book_meta(BookMeta *meta) {
-    if (!meta) return;
-
-    // Проверяем каждый указатель перед освобождением
-    if (meta->title) {
-        free(meta->title);
-        meta->title = NULL;
-    }
-    if (meta->author) {
-        free(meta->author);
-        meta->author = NULL;
-    }
-    if (meta->genre) {
-        free(meta->genre);
-        meta->genre = NULL;
-    }
-    if (meta->series) {
-        free(meta->series);
-        meta->series = NULL;
-    }
-    if (meta->language) {
-        free(meta->language);
-        meta->language = NULL;
-    }
-    if (meta->publisher) {
-        free(meta->publisher);
-        meta->publisher = NULL;
-    }
-    if (meta->description) {
-        free(meta->description);
-        meta->description = NULL;
-    }
+    if (!meta || !meta->arena) return;
+    arena_reset(meta->arena);
 }
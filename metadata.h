@@ -2,15 +2,27 @@
 #define METADATA_H
 
 #include "database.h"
+#include "intern.h"
+#include "utils.h"
 
 
-BookMeta* parse_metadata(const char *filepath, const char *file_type);
-BookMeta* parse_fb2(const char *filepath);
-BookMeta* parse_fb2_from_memory(const char *content, size_t content_size);
+// Пустая BookMeta в арене; ее строки (и она сама) живут до free_book_meta/arena_reset
+BookMeta* book_meta_new(Arena *arena);
+// Повторяющиеся поля книги (автор, серия, жанр, язык) переносит в пулы intern.c: одна копия
+// на всё сканирование. Пустая строка или нехватка памяти - возвращается str из арены
+char* intern_meta_field(InternKind kind, char *str);
+BookMeta* parse_metadata(const char *filepath, const char *file_type, Arena *arena);
+// То же по файлу, уже отображенному целиком (file_view_open с end_marker NULL): разбор идет
+// из view без повторного чтения. Буфер может временно меняться, поэтому view не const
+BookMeta* parse_metadata_view(const char *filepath, const char *file_type, FileView *view, Arena *arena);
+BookMeta* parse_fb2(const char *filepath, Arena *arena);
+BookMeta* parse_fb2_view(const char *filepath, FileView *view, Arena *arena);
+// content должен быть завершен нулем (content[content_size] == 0): разбирается на месте
+BookMeta* parse_fb2_from_memory(const char *content, size_t content_size, Arena *arena);
 void free_book_meta(BookMeta *meta);
-char* extract_xml_tag_content(const char *xml, const char *tag_name);
-char* extract_fb2_author(const char *xml);
-char* extract_fb2_sequence(const char *xml);
+char* extract_xml_tag_content(const char *xml, const char *tag_name, Arena *arena);
+char* extract_fb2_author(const char *xml, Arena *arena);
+char* extract_fb2_sequence(const char *xml, Arena *arena);
 int extract_fb2_sequence_number(const char *xml);
 
 // Добавьте этот прототип
@@ -0,0 +1,255 @@
+// metrics.c - счетчики, датчики и гистограммы сканера с выгрузкой в textfile Prometheus и JSON
+#include "common.h"
+#include "metrics.h"
+#include <errno.h>
+
+#define METRIC_BUCKET_COUNT 16
+
+typedef struct {
+    const char *name;       // имя в Prometheus
+    const char *labels;     // метки без фигурных скобок или NULL
+    const char *json_key;
+    const char *help;
+} MetricDef;
+
+// Метрики одного семейства (одно имя с разными метками) должны идти подряд
+static const MetricDef counter_defs[METRIC_COUNTER_COUNT] = {
+    {"book_scanner_directories_scanned_total", NULL, "directories_scanned", "Directories opened by the scanner"},
+    {"book_scanner_files_seen_total", NULL, "files_seen", "Regular files found while walking books_dir"},
+    {"book_scanner_files_processed_total", NULL, "files_processed", "Book files and archives handed to the parser"},
+    {"book_scanner_files_skipped_total", "reason=\"unsupported\"", "files_skipped_unsupported", "Files skipped by reason"},
+    {"book_scanner_files_skipped_total", "reason=\"stat_failed\"", "files_skipped_stat_failed", "Files skipped by reason"},
+    {"book_scanner_files_format_mismatch_total", NULL, "files_format_mismatch", "Files whose signature disagrees with the extension"},
+    {"book_scanner_bytes_read_total", NULL, "bytes_read", "Bytes of book content read from files and archives"},
+    {"book_scanner_archives_processed_total", NULL, "archives_processed", "Archives opened and scanned"},
+    {"book_scanner_archives_skipped_total", "reason=\"unchanged\"", "archives_skipped_unchanged", "Archives skipped by reason"},
+    {"book_scanner_archives_single_entry_total", NULL, "archives_single_entry", "Single-book ZIP archives read through the central directory"},
+    {"book_scanner_archive_entries_total", NULL, "archive_entries", "Archive entries enumerated"},
+    {"book_scanner_archive_entries_skipped_total", "reason=\"unsupported\"", "archive_entries_skipped_unsupported", "Archive entries skipped by reason"},
+    {"book_scanner_archive_entries_skipped_total", "reason=\"too_large\"", "archive_entries_skipped_too_large", "Archive entries skipped by reason"},
+    {"book_scanner_fb2_parsed_total", NULL, "fb2_parsed", "FB2 documents parsed"},
+    {"book_scanner_fb2_converted_total", "encoding=\"cp1251\"", "fb2_converted_cp1251", "FB2 documents converted to UTF-8"},
+    {"book_scanner_epub_parsed_total", NULL, "epub_parsed", "EPUB packages parsed from OPF"},
+    {"book_scanner_pdf_parsed_total", NULL, "pdf_parsed", "PDF documents parsed from /Info and XMP"},
+    {"book_scanner_mobi_parsed_total", NULL, "mobi_parsed", "MOBI/AZW3 headers parsed from record 0"},
+    {"book_scanner_text_fingerprints_total", NULL, "text_fingerprints", "Book texts fingerprinted for near-duplicate detection"},
+    {"book_scanner_inpx_files_total", NULL, "inpx_files", "INP files read from INPX collections"},
+    {"book_scanner_inpx_records_total", NULL, "inpx_records", "INP records parsed"},
+    {"book_scanner_inpx_records_rejected_total", NULL, "inpx_records_rejected", "INP records without title, author or file name"},
+    {"book_scanner_books_inserted_total", NULL, "books_inserted", "Rows inserted into books"},
+    {"book_scanner_books_skipped_total", "reason=\"duplicate_hash\"", "books_skipped_duplicate_hash", "Books not inserted by reason"},
+    {"book_scanner_books_skipped_total", "reason=\"existing\"", "books_skipped_existing", "Books not inserted by reason"},
+    {"book_scanner_books_marked_duplicate_total", NULL, "books_marked_duplicate", "Books marked as another edition by the dedupe pass"},
+    {"book_scanner_db_batches_total", NULL, "db_batches", "Multi-statement MySQL batches sent, including replays"},
+    {"book_scanner_db_reconnects_total", NULL, "db_reconnects", "MySQL reconnects after a statement failed with a lost connection"},
+    {"book_scanner_errors_total", "stage=\"directory\"", "errors_directory", "Errors by pipeline stage"},
+    {"book_scanner_errors_total", "stage=\"archive\"", "errors_archive", "Errors by pipeline stage"},
+    {"book_scanner_errors_total", "stage=\"read\"", "errors_read", "Errors by pipeline stage"},
+    {"book_scanner_errors_total", "stage=\"parse\"", "errors_parse", "Errors by pipeline stage"},
+    {"book_scanner_errors_total", "stage=\"db\"", "errors_db", "Errors by pipeline stage"}
+};
+
+static const MetricDef gauge_defs[METRIC_GAUGE_COUNT] = {
+    {"book_scanner_scan_depth", NULL, "scan_depth", "Directories currently on the walk stack"},
+    {"book_scanner_archive_entries_pending", NULL, "archive_entries_pending", "Entries of the current archive not read yet"},
+    {"book_scanner_inpx_records_pending", NULL, "inpx_records_pending", "Lines of the current INP file not parsed yet"},
+    {"book_scanner_start_time_seconds", NULL, "start_time_seconds", "Unix time the scan started"},
+    {"book_scanner_db_connections_busy", NULL, "db_connections_busy", "Pooled MySQL connections checked out by threads"},
+    {"book_scanner_scan_read_queue", NULL, "scan_read_queue", "Files waiting for a device reader thread"},
+    {"book_scanner_scan_parse_queue", NULL, "scan_parse_queue", "Books read into memory and waiting for a parser thread"},
+    {"book_scanner_scan_parse_queue_bytes", NULL, "scan_parse_queue_bytes", "Bytes of books waiting for a parser thread"}
+};
+
+static const MetricDef histogram_defs[METRIC_HIST_COUNT] = {
+    {"book_scanner_archive_duration_seconds", NULL, "archive_seconds", "Time to scan one archive"},
+    {"book_scanner_fb2_parse_duration_seconds", NULL, "fb2_parse_seconds", "Time to parse one FB2 document"},
+    {"book_scanner_inpx_file_duration_seconds", NULL, "inpx_file_seconds", "Time to import one INP file"},
+    {"book_scanner_db_insert_duration_seconds", NULL, "db_insert_seconds", "Time of one insert_book_to_db call"}
+};
+
+// Верхние границы корзин, секунды (последняя корзина - +Inf)
+static const double bucket_bounds[METRIC_BUCKET_COUNT - 1] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 10
+};
+
+typedef struct {
+    uint64_t buckets[METRIC_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum_ns;
+} Histogram;
+
+static uint64_t counters[METRIC_COUNTER_COUNT];
+static int64_t gauges[METRIC_GAUGE_COUNT];
+static Histogram histograms[METRIC_HIST_COUNT];
+
+static char metrics_path[MAX_PATH];
+static int metrics_json = 0;
+static int metrics_interval = 15;
+static int64_t last_flush = 0;
+static double started_at = 0;
+
+void metrics_add(MetricCounter counter, uint64_t value) {
+    __atomic_fetch_add(&counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void metrics_inc(MetricCounter counter) {
+    __atomic_fetch_add(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_set(MetricGauge gauge, int64_t value) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_add(MetricGauge gauge, int64_t delta) {
+    __atomic_fetch_add(&gauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(MetricHistogram histogram, double seconds) {
+    Histogram *h = &histograms[histogram];
+    int bucket = 0;
+    while (bucket < METRIC_BUCKET_COUNT - 1 && seconds > bucket_bounds[bucket]) bucket++;
+
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, (uint64_t)(seconds > 0 ? seconds * 1e9 : 0), __ATOMIC_RELAXED);
+}
+
+double metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void metrics_configure(Config *config) {
+    metrics_path[0] = '\0';
+    if (config->scanner.metrics_file) {
+        snprintf(metrics_path, sizeof(metrics_path), "%s", config->scanner.metrics_file);
+    }
+    metrics_json = config->scanner.metrics_json;
+    metrics_interval = config->scanner.metrics_interval > 0 ? config->scanner.metrics_interval : 15;
+
+    started_at = metrics_now();
+    last_flush = (int64_t)time(NULL);
+    metrics_gauge_set(METRIC_GAUGE_START_TIME, last_flush);
+}
+
+void metrics_maybe_flush(void) {
+    if (!metrics_path[0] && !metrics_json) return;
+
+    int64_t now = (int64_t)time(NULL);
+    int64_t last = __atomic_load_n(&last_flush, __ATOMIC_RELAXED);
+    if (now - last < metrics_interval) return;
+
+    // Выгружает только тот поток, который первым сдвинул отметку
+    if (__atomic_compare_exchange_n(&last_flush, &last, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        metrics_flush();
+    }
+}
+
+static void write_family_header(FILE *out, const MetricDef *defs, int index, const char *type) {
+    if (index > 0 && strcmp(defs[index - 1].name, defs[index].name) == 0) return;
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", defs[index].name, defs[index].help, defs[index].name, type);
+}
+
+static void write_prometheus(FILE *out) {
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        write_family_header(out, counter_defs, i, "counter");
+        uint64_t value = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+        if (counter_defs[i].labels) {
+            fprintf(out, "%s{%s} %llu\n", counter_defs[i].name, counter_defs[i].labels, (unsigned long long)value);
+        } else {
+            fprintf(out, "%s %llu\n", counter_defs[i].name, (unsigned long long)value);
+        }
+    }
+
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        write_family_header(out, gauge_defs, i, "gauge");
+        fprintf(out, "%s %lld\n", gauge_defs[i].name, (long long)__atomic_load_n(&gauges[i], __ATOMIC_RELAXED));
+    }
+
+    for (int i = 0; i < METRIC_HIST_COUNT; i++) {
+        Histogram *h = &histograms[i];
+        write_family_header(out, histogram_defs, i, "histogram");
+
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKET_COUNT; b++) {
+            cumulative += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+            if (b < METRIC_BUCKET_COUNT - 1) {
+                fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", histogram_defs[i].name, bucket_bounds[b],
+                        (unsigned long long)cumulative);
+            } else {
+                fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", histogram_defs[i].name, (unsigned long long)cumulative);
+            }
+        }
+        fprintf(out, "%s_sum %.6f\n%s_count %llu\n",
+                histogram_defs[i].name, (double)__atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9,
+                histogram_defs[i].name, (unsigned long long)__atomic_load_n(&h->count, __ATOMIC_RELAXED));
+    }
+}
+
+// Одна строка JSON: счетчики, датчики, средние скорости с начала сканирования и гистограммы
+static void write_json(FILE *out) {
+    double elapsed = metrics_now() - started_at;
+    if (elapsed <= 0) elapsed = 1e-9;
+
+    fprintf(out, "{\"book_scanner_metrics\": {\"timestamp\": %lld, \"elapsed_seconds\": %.3f, \"counters\": {",
+            (long long)time(NULL), elapsed);
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", counter_defs[i].json_key,
+                (unsigned long long)__atomic_load_n(&counters[i], __ATOMIC_RELAXED));
+    }
+
+    fprintf(out, "}, \"gauges\": {");
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %lld", i ? ", " : "", gauge_defs[i].json_key,
+                (long long)__atomic_load_n(&gauges[i], __ATOMIC_RELAXED));
+    }
+
+    fprintf(out, "}, \"rates\": {\"files_per_sec\": %.1f, \"bytes_per_sec\": %.1f, \"db_rows_per_sec\": %.1f}",
+            (double)__atomic_load_n(&counters[METRIC_FILES_PROCESSED], __ATOMIC_RELAXED) / elapsed,
+            (double)__atomic_load_n(&counters[METRIC_BYTES_READ], __ATOMIC_RELAXED) / elapsed,
+            (double)__atomic_load_n(&counters[METRIC_BOOKS_INSERTED], __ATOMIC_RELAXED) / elapsed);
+
+    fprintf(out, ", \"histograms\": {");
+    for (int i = 0; i < METRIC_HIST_COUNT; i++) {
+        Histogram *h = &histograms[i];
+        fprintf(out, "%s\"%s\": {\"count\": %llu, \"sum\": %.6f, \"buckets\": [", i ? ", " : "",
+                histogram_defs[i].json_key, (unsigned long long)__atomic_load_n(&h->count, __ATOMIC_RELAXED),
+                (double)__atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKET_COUNT - 1; b++) {
+            cumulative += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+            fprintf(out, "%s[%g, %llu]", b ? ", " : "", bucket_bounds[b], (unsigned long long)cumulative);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}}\n");
+}
+
+int metrics_flush(void) {
+    int ok = 1;
+
+    if (metrics_path[0]) {
+        // textfile collector читает файл в любой момент - пишем во временный и переименовываем
+        char tmp_path[MAX_PATH + 32];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", metrics_path, (int)getpid());
+
+        FILE *out = fopen(tmp_path, "w");
+        if (out) {
+            write_prometheus(out);
+            ok = (fclose(out) == 0) && rename(tmp_path, metrics_path) == 0;
+            if (!ok) unlink(tmp_path);
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Cannot write metrics file %s: %s\n", metrics_path, strerror(errno));
+        }
+    }
+
+    if (metrics_json) {
+        write_json(stdout);
+        fflush(stdout);
+    }
+    return ok;
+}
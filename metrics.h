@@ -0,0 +1,81 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "config.h"
+#include <stdint.h>
+
+// Счетчики сканера. Порядок совпадает с таблицей counter_defs в metrics.c
+typedef enum {
+    METRIC_DIRECTORIES_SCANNED,
+    METRIC_FILES_SEEN,
+    METRIC_FILES_PROCESSED,
+    METRIC_FILES_SKIPPED_UNSUPPORTED,
+    METRIC_FILES_SKIPPED_STAT_FAILED,
+    METRIC_FILES_FORMAT_MISMATCH,
+    METRIC_BYTES_READ,
+    METRIC_ARCHIVES_PROCESSED,
+    METRIC_ARCHIVES_SKIPPED_UNCHANGED,
+    METRIC_ARCHIVES_SINGLE_ENTRY,
+    METRIC_ARCHIVE_ENTRIES,
+    METRIC_ARCHIVE_ENTRIES_SKIPPED_UNSUPPORTED,
+    METRIC_ARCHIVE_ENTRIES_SKIPPED_TOO_LARGE,
+    METRIC_FB2_PARSED,
+    METRIC_FB2_CONVERTED_CP1251,
+    METRIC_EPUB_PARSED,
+    METRIC_PDF_PARSED,
+    METRIC_MOBI_PARSED,
+    METRIC_TEXT_FINGERPRINTS,
+    METRIC_INPX_FILES,
+    METRIC_INPX_RECORDS,
+    METRIC_INPX_RECORDS_REJECTED,
+    METRIC_BOOKS_INSERTED,
+    METRIC_BOOKS_SKIPPED_DUPLICATE_HASH,
+    METRIC_BOOKS_SKIPPED_EXISTING,
+    METRIC_BOOKS_MARKED_DUPLICATE,
+    METRIC_DB_BATCHES,
+    METRIC_DB_RECONNECTS,
+    METRIC_ERRORS_DIRECTORY,
+    METRIC_ERRORS_ARCHIVE,
+    METRIC_ERRORS_READ,
+    METRIC_ERRORS_PARSE,
+    METRIC_ERRORS_DB,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRIC_GAUGE_SCAN_DEPTH,                // каталогов в стеке обхода
+    METRIC_GAUGE_ARCHIVE_ENTRIES_PENDING,   // записей текущего архива, которые еще предстоит прочитать
+    METRIC_GAUGE_INPX_RECORDS_PENDING,      // строк текущего .inp, которые еще предстоит разобрать
+    METRIC_GAUGE_START_TIME,                // unix time начала сканирования
+    METRIC_GAUGE_DB_CONNECTIONS_BUSY,       // соединений пула MySQL, выданных потокам
+    METRIC_GAUGE_SCAN_READ_QUEUE,           // файлов, ждущих потоков чтения (все устройства)
+    METRIC_GAUGE_SCAN_PARSE_QUEUE,          // распакованных книг, ждущих потоков разбора
+    METRIC_GAUGE_SCAN_PARSE_QUEUE_BYTES,    // байт в очереди разбора
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+typedef enum {
+    METRIC_HIST_ARCHIVE,
+    METRIC_HIST_FB2_PARSE,
+    METRIC_HIST_INPX_FILE,
+    METRIC_HIST_DB_INSERT,
+    METRIC_HIST_COUNT
+} MetricHistogram;
+
+// Счетчики и гистограммы атомарны - их можно обновлять из любого потока
+void metrics_add(MetricCounter counter, uint64_t value);
+void metrics_inc(MetricCounter counter);
+void metrics_gauge_set(MetricGauge gauge, int64_t value);
+void metrics_gauge_add(MetricGauge gauge, int64_t delta);
+void metrics_observe(MetricHistogram histogram, double seconds);
+// Монотонное время в секундах для замеров длительности
+double metrics_now(void);
+
+// Берет metrics_file, metrics_interval и metrics_json из [scanner]
+void metrics_configure(Config *config);
+// Выгружает метрики, если с прошлой выгрузки прошло metrics_interval секунд
+void metrics_maybe_flush(void);
+// Выгружает метрики немедленно: textfile для Prometheus (через rename) и JSON в stdout
+int metrics_flush(void);
+
+#endif
@@ -0,0 +1,430 @@
+// mobi.c - метаданные MOBI/AZW3 из записи 0 без чтения текста книги
+#include "common.h"
+#include "mobi.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utils.h"
+#include "xml_scan.h"
+#include <stdint.h>
+
+#define PALMDB_HEADER_SIZE 78
+#define PALMDB_RECORD_ENTRY_SIZE 8
+// Запись 0 обычно занимает 1-4 КБ; больше этого читаем только начало
+#define MOBI_RECORD0_MAX (64 * 1024)
+#define MOBI_COVER_MAX (4 * 1024 * 1024)
+#define MOBI_DESCRIPTION_MAX_CHARS 1000
+#define MOBI_NO_IMAGE 0xFFFFFFFFu
+
+// Смещения полей внутри записи 0 (PalmDOC 16 байт + заголовок MOBI)
+#define MOBI_MAGIC_OFFSET 16
+#define MOBI_HEADER_LENGTH_OFFSET 20
+#define MOBI_ENCODING_OFFSET 28
+#define MOBI_FULL_NAME_OFFSET 84
+#define MOBI_FULL_NAME_LENGTH_OFFSET 88
+#define MOBI_LOCALE_OFFSET 92
+#define MOBI_FIRST_IMAGE_OFFSET 108
+#define MOBI_EXTH_FLAGS_OFFSET 128
+#define MOBI_EXTH_PRESENT 0x40
+
+#define MOBI_ENCODING_UTF8 65001
+
+// Типы записей EXTH
+#define EXTH_AUTHOR 100
+#define EXTH_PUBLISHER 101
+#define EXTH_DESCRIPTION 103
+#define EXTH_SUBJECT 105
+#define EXTH_PUBLISHING_DATE 106
+#define EXTH_COVER_OFFSET 201
+#define EXTH_UPDATED_TITLE 503
+#define EXTH_LANGUAGE 524
+
+// Книга в файле (fd) или в памяти (data); из памяти блоки отдаются без копирования
+typedef struct {
+    int fd;
+    const unsigned char *data;
+    uint64_t size;
+} MobiSource;
+
+// Прочитанный участок: ptr указывает в data источника или в owned
+typedef struct {
+    const unsigned char *ptr;
+    size_t len;
+    unsigned char *owned;
+} MobiBlock;
+
+// Разобранная запись 0
+typedef struct {
+    const unsigned char *rec;
+    size_t len;
+    int utf8;
+    uint32_t first_image;
+    uint32_t cover_offset;
+    const unsigned char *exth;      // первая запись EXTH и их количество
+    const unsigned char *exth_end;
+    uint32_t exth_count;
+} MobiHeader;
+
+// Основной язык из LANGID Windows (младшие 10 бит локали)
+static const char *locale_languages[] = {
+    [0x01] = "ar", [0x02] = "bg", [0x03] = "ca", [0x04] = "zh", [0x05] = "cs", [0x06] = "da",
+    [0x07] = "de", [0x08] = "el", [0x09] = "en", [0x0A] = "es", [0x0B] = "fi", [0x0C] = "fr",
+    [0x0D] = "he", [0x0E] = "hu", [0x0F] = "is", [0x10] = "it", [0x11] = "ja", [0x12] = "ko",
+    [0x13] = "nl", [0x14] = "no", [0x15] = "pl", [0x16] = "pt", [0x18] = "ro", [0x19] = "ru",
+    [0x1A] = "hr", [0x1B] = "sk", [0x1C] = "sq", [0x1D] = "sv", [0x1E] = "th", [0x1F] = "tr",
+    [0x22] = "uk", [0x23] = "be", [0x24] = "sl", [0x25] = "et", [0x26] = "lv", [0x27] = "lt",
+    [0x2A] = "vi", [0x2B] = "hy", [0x37] = "ka", [0x3F] = "kk"
+};
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const unsigned char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static int mobi_read(const MobiSource *src, uint64_t offset, size_t len, MobiBlock *block) {
+    memset(block, 0, sizeof(MobiBlock));
+    if (offset >= src->size) return 0;
+    if (len > src->size - offset) len = (size_t)(src->size - offset);
+    if (len == 0) return 0;
+
+    if (src->data) {
+        block->ptr = src->data + offset;
+        block->len = len;
+        return 1;
+    }
+
+    block->owned = malloc(len);
+    if (!block->owned) return 0;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(src->fd, block->owned + done, len - done, (off_t)(offset + done));
+        if (r <= 0) break;
+        done += (size_t)r;
+    }
+    if (done == 0) {
+        free(block->owned);
+        block->owned = NULL;
+        return 0;
+    }
+    block->ptr = block->owned;
+    block->len = done;
+    return 1;
+}
+
+static void mobi_block_free(MobiBlock *block) {
+    free(block->owned);
+    memset(block, 0, sizeof(MobiBlock));
+}
+
+// Границы записи index по списку записей PalmDB; последняя запись тянется до конца файла
+static int record_bounds(const MobiSource *src, uint16_t record_count, uint32_t index,
+                         uint64_t *start, uint64_t *end) {
+    if (index >= record_count) return 0;
+
+    MobiBlock entries;
+    size_t want = index + 1 < record_count ? 2 * PALMDB_RECORD_ENTRY_SIZE : PALMDB_RECORD_ENTRY_SIZE;
+    if (!mobi_read(src, PALMDB_HEADER_SIZE + (uint64_t)index * PALMDB_RECORD_ENTRY_SIZE, want, &entries) ||
+        entries.len < want) {
+        mobi_block_free(&entries);
+        return 0;
+    }
+    *start = be32(entries.ptr);
+    *end = want > PALMDB_RECORD_ENTRY_SIZE ? be32(entries.ptr + PALMDB_RECORD_ENTRY_SIZE) : src->size;
+    mobi_block_free(&entries);
+
+    if (*end > src->size) *end = src->size;
+    return *start < *end;
+}
+
+// Заголовок PalmDB: тип BOOKMOBI и число записей
+static int read_palmdb(const MobiSource *src, uint16_t *record_count) {
+    MobiBlock header;
+    if (!mobi_read(src, 0, PALMDB_HEADER_SIZE, &header)) return 0;
+
+    int ok = header.len == PALMDB_HEADER_SIZE && memcmp(header.ptr + 60, "BOOKMOBI", 8) == 0;
+    if (ok) *record_count = be16(header.ptr + 76);
+    mobi_block_free(&header);
+    return ok && *record_count > 0;
+}
+
+static int read_record0(const MobiSource *src, uint16_t record_count, MobiBlock *block) {
+    uint64_t start = 0, end = 0;
+    if (!record_bounds(src, record_count, 0, &start, &end)) return 0;
+
+    size_t len = end - start > MOBI_RECORD0_MAX ? MOBI_RECORD0_MAX : (size_t)(end - start);
+    return mobi_read(src, start, len, block);
+}
+
+static int parse_header(const unsigned char *rec, size_t len, MobiHeader *hdr) {
+    memset(hdr, 0, sizeof(MobiHeader));
+    if (len < MOBI_FIRST_IMAGE_OFFSET + 4 || memcmp(rec + MOBI_MAGIC_OFFSET, "MOBI", 4) != 0) return 0;
+
+    hdr->rec = rec;
+    hdr->len = len;
+    hdr->utf8 = be32(rec + MOBI_ENCODING_OFFSET) == MOBI_ENCODING_UTF8;
+
+    // Поля после конца заголовка MOBI (короткие заголовки старых версий) не читаем
+    uint32_t header_end = MOBI_MAGIC_OFFSET + be32(rec + MOBI_HEADER_LENGTH_OFFSET);
+    if (header_end > len) header_end = (uint32_t)len;
+    hdr->first_image = header_end >= MOBI_FIRST_IMAGE_OFFSET + 4 ? be32(rec + MOBI_FIRST_IMAGE_OFFSET) : MOBI_NO_IMAGE;
+    hdr->cover_offset = MOBI_NO_IMAGE;
+
+    if (header_end < MOBI_EXTH_FLAGS_OFFSET + 4 || !(be32(rec + MOBI_EXTH_FLAGS_OFFSET) & MOBI_EXTH_PRESENT)) {
+        return 1;
+    }
+
+    const unsigned char *exth = rec + header_end;
+    const unsigned char *end = rec + len;
+    if (end - exth < 12 || memcmp(exth, "EXTH", 4) != 0) return 1;
+
+    uint32_t exth_len = be32(exth + 4);
+    if (exth_len >= 12 && exth_len <= (size_t)(end - exth)) end = exth + exth_len;
+    hdr->exth = exth + 12;
+    hdr->exth_end = end;
+    hdr->exth_count = be32(exth + 8);
+    return 1;
+}
+
+// Следующая запись EXTH после *cursor (NULL - с первой); 0 - записей больше нет
+static int next_exth(const MobiHeader *hdr, const unsigned char **cursor, uint32_t *seen,
+                     uint32_t *type, const unsigned char **data, size_t *data_len) {
+    const unsigned char *p = *cursor ? *cursor : hdr->exth;
+    if (!p || *seen >= hdr->exth_count || hdr->exth_end - p < 8) return 0;
+
+    uint32_t len = be32(p + 4);
+    if (len < 8 || len > (size_t)(hdr->exth_end - p)) return 0;
+
+    *type = be32(p);
+    *data = p + 8;
+    *data_len = len - 8;
+    *cursor = p + len;
+    (*seen)++;
+    return 1;
+}
+
+// Строка заголовка в UTF-8 в арене: CP1252 перекодируется, лишние пробелы обрезаются
+static char* mobi_string(const MobiHeader *hdr, const unsigned char *data, size_t len, Arena *arena) {
+    while (len > 0 && data[len - 1] == '\0') len--;
+    if (len == 0) return NULL;
+
+    char *text = arena_strndup(arena, (const char*)data, len);
+    if (!text) return NULL;
+
+    if (!hdr->utf8) {
+        char *converted = convert_encoding(text, "WINDOWS-1252", "UTF-8");
+        if (converted) {
+            text = arena_strdup(arena, converted);
+            free(converted);
+            if (!text) return NULL;
+        }
+    }
+
+    trim_string(text);
+    while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n') text++;
+    return *text ? text : NULL;
+}
+
+static char* join_names(char *joined, const char *name, Arena *arena) {
+    if (!joined) return (char*)name;
+
+    size_t joined_len = strlen(joined), len = strlen(name);
+    char *result = arena_alloc(arena, joined_len + len + 3);
+    if (!result) return joined;
+    memcpy(result, joined, joined_len);
+    memcpy(result + joined_len, ", ", 2);
+    memcpy(result + joined_len + 2, name, len + 1);
+    return result;
+}
+
+static int year_from_date(const char *date) {
+    if (!date) return 0;
+    for (const char *p = date; p[0] && p[1] && p[2] && p[3]; p++) {
+        if (isdigit((unsigned char)p[0]) && isdigit((unsigned char)p[1]) &&
+            isdigit((unsigned char)p[2]) && isdigit((unsigned char)p[3])) {
+            return (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+        }
+    }
+    return 0;
+}
+
+static BookMeta* parse_header_meta(MobiHeader *hdr, Arena *arena) {
+    BookMeta *meta = book_meta_new(arena);
+    if (!meta) return NULL;
+
+    char *author = NULL, *title = NULL, *date = NULL;
+    const unsigned char *cursor = NULL, *data = NULL;
+    uint32_t seen = 0, type = 0;
+    size_t data_len = 0;
+    while (next_exth(hdr, &cursor, &seen, &type, &data, &data_len)) {
+        switch (type) {
+            case EXTH_AUTHOR: {
+                char *name = mobi_string(hdr, data, data_len, arena);
+                if (name) author = join_names(author, name, arena);
+                break;
+            }
+            case EXTH_PUBLISHER:
+                if (!meta->publisher) meta->publisher = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_DESCRIPTION:
+                if (!meta->description) meta->description = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_SUBJECT:
+                if (!meta->genre) meta->genre = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_PUBLISHING_DATE:
+                if (!date) date = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_UPDATED_TITLE:
+                if (!title) title = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_LANGUAGE:
+                if (!meta->language) meta->language = mobi_string(hdr, data, data_len, arena);
+                break;
+            case EXTH_COVER_OFFSET:
+                if (data_len >= 4) hdr->cover_offset = be32(data);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Полное название из заголовка MOBI, если EXTH 503 нет
+    if (!title) {
+        uint32_t name_offset = be32(hdr->rec + MOBI_FULL_NAME_OFFSET);
+        uint32_t name_len = be32(hdr->rec + MOBI_FULL_NAME_LENGTH_OFFSET);
+        if (name_offset < hdr->len && name_len <= hdr->len - name_offset) {
+            title = mobi_string(hdr, hdr->rec + name_offset, name_len, arena);
+        }
+    }
+    if (!meta->language) {
+        uint32_t lang_id = be32(hdr->rec + MOBI_LOCALE_OFFSET) & 0x3FF;
+        if (lang_id < sizeof(locale_languages) / sizeof(locale_languages[0]) && locale_languages[lang_id]) {
+            meta->language = arena_strdup(arena, locale_languages[lang_id]);
+        }
+    }
+
+    meta->title = title;
+    meta->year = year_from_date(date);
+    // Аннотация в EXTH - HTML: сначала убираем теги, затем раскрываем сущности
+    if (meta->description) {
+        strip_html_tags(meta->description);
+        meta->description = xml_string(meta->description, strlen(meta->description), arena);
+        if (meta->description) utf8_truncate(meta->description, MOBI_DESCRIPTION_MAX_CHARS);
+    }
+    meta->author = intern_meta_field(INTERN_AUTHORS, author);
+    meta->genre = intern_meta_field(INTERN_GENRES, meta->genre);
+    meta->language = intern_meta_field(INTERN_LANGUAGES, meta->language);
+    return meta;
+}
+
+static BookMeta* parse_source(const MobiSource *src, Arena *arena) {
+    uint16_t record_count = 0;
+    if (!read_palmdb(src, &record_count)) return NULL;
+
+    MobiBlock record0;
+    if (!read_record0(src, record_count, &record0)) return NULL;
+
+    BookMeta *meta = NULL;
+    MobiHeader hdr;
+    if (parse_header(record0.ptr, record0.len, &hdr)) {
+        meta = parse_header_meta(&hdr, arena);
+    }
+    mobi_block_free(&record0);
+
+    if (meta) metrics_inc(METRIC_MOBI_PARSED);
+    return meta;
+}
+
+// Запись обложки: проверяется сигнатура изображения, чтобы не сохранить шрифт или HD-контейнер
+static int find_cover(const MobiSource *src, Fb2Cover *cover) {
+    memset(cover, 0, sizeof(Fb2Cover));
+
+    uint16_t record_count = 0;
+    MobiBlock record0;
+    if (!read_palmdb(src, &record_count) || !read_record0(src, record_count, &record0)) return 0;
+
+    MobiHeader hdr;
+    uint32_t cover_record = MOBI_NO_IMAGE;
+    if (parse_header(record0.ptr, record0.len, &hdr)) {
+        const unsigned char *cursor = NULL, *data = NULL;
+        uint32_t seen = 0, type = 0;
+        size_t data_len = 0;
+        while (next_exth(&hdr, &cursor, &seen, &type, &data, &data_len)) {
+            if (type == EXTH_COVER_OFFSET && data_len >= 4) hdr.cover_offset = be32(data);
+        }
+        if (hdr.first_image < record_count && hdr.cover_offset < record_count) {
+            cover_record = hdr.first_image + hdr.cover_offset;
+        }
+    }
+    mobi_block_free(&record0);
+
+    uint64_t start = 0, end = 0;
+    if (cover_record == MOBI_NO_IMAGE || !record_bounds(src, record_count, cover_record, &start, &end) ||
+        end - start > MOBI_COVER_MAX) {
+        return 0;
+    }
+
+    MobiBlock image;
+    if (!mobi_read(src, start, (size_t)(end - start), &image)) return 0;
+
+    const char *content_type = NULL;
+    if (image.len >= 3 && memcmp(image.ptr, "\xFF\xD8\xFF", 3) == 0) content_type = "image/jpeg";
+    else if (image.len >= 4 && memcmp(image.ptr, "\x89PNG", 4) == 0) content_type = "image/png";
+    else if (image.len >= 4 && memcmp(image.ptr, "GIF8", 4) == 0) content_type = "image/gif";
+    if (!content_type) {
+        mobi_block_free(&image);
+        return 0;
+    }
+
+    cover->data = image.owned ? image.owned : (unsigned char*)image.ptr;
+    cover->size = image.len;
+    cover->owned = image.owned != NULL;
+    snprintf(cover->content_type, sizeof(cover->content_type), "%s", content_type);
+    return 1;
+}
+
+BookMeta* parse_mobi(const char *filepath, Arena *arena) {
+    trace_begin("parse", "mobi_parse", NULL);
+    BookMeta *meta = NULL;
+
+    int fd = open(filepath, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        MobiSource src = {fd, NULL, (uint64_t)st.st_size};
+        meta = parse_source(&src, arena);
+    }
+    if (fd >= 0) close(fd);
+
+    trace_end();
+    return meta;
+}
+
+BookMeta* parse_mobi_from_memory(const char *content, size_t content_size, Arena *arena) {
+    trace_begin("parse", "mobi_parse", NULL);
+    MobiSource src = {-1, (const unsigned char*)content, content_size};
+    BookMeta *meta = parse_source(&src, arena);
+    trace_end();
+    return meta;
+}
+
+int mobi_read_cover(const char *filepath, Fb2Cover *cover) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    int found = 0;
+    if (fstat(fd, &st) == 0) {
+        MobiSource src = {fd, NULL, (uint64_t)st.st_size};
+        found = find_cover(&src, cover);
+    }
+    close(fd);
+    return found;
+}
+
+int mobi_find_cover(const char *content, size_t content_size, Fb2Cover *cover) {
+    MobiSource src = {-1, (const unsigned char*)content, content_size};
+    return find_cover(&src, cover);
+}
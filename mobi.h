@@ -0,0 +1,21 @@
+#ifndef MOBI_H
+#define MOBI_H
+
+#include <stddef.h>
+#include "database.h"
+#include "fb2_cover.h"
+
+// Метаданные MOBI/AZW/AZW3 из заголовка PalmDB и записи 0: заголовок MOBI (полное название,
+// кодировка, локаль) и EXTH (100 автор, 101 издатель, 103 аннотация, 105 тема, 106 дата,
+// 503 название, 524 язык). Текст книги не читается. Строки выделяются в арене.
+// NULL - не MOBI (в том числе простой PalmDOC без заголовка MOBI)
+BookMeta* parse_mobi(const char *filepath, Arena *arena);
+// То же для книги, уже извлеченной из архива в память; данные не копируются
+BookMeta* parse_mobi_from_memory(const char *content, size_t content_size, Arena *arena);
+
+// Обложка: запись first_image + смещение из EXTH 201. Из файла читается в новый буфер,
+// из памяти - cover->data указывает внутрь content (owned = 0)
+int mobi_read_cover(const char *filepath, Fb2Cover *cover);
+int mobi_find_cover(const char *content, size_t content_size, Fb2Cover *cover);
+
+#endif
@@ -0,0 +1,1139 @@
+// pdf_meta.c - метаданные PDF из /Info и XMP с чтением только хвоста и нужных объектов
+#include "common.h"
+#include "pdf_meta.h"
+#include "metadata.h"
+#include "metrics.h"
+#include "trace.h"
+#include "utils.h"
+#include "xml_scan.h"
+#include <stdint.h>
+#include <zlib.h>
+
+// Сколько байт файла можно прочитать на одну книгу, каким бы большим ни был PDF
+#define PDF_READ_BUDGET (256 * 1024)
+// Хвост с startxref; после %%EOF бывает мусор, поэтому берем с запасом
+#define PDF_TAIL_SIZE 8192
+// Первое чтение объекта; словарь /Info с длинными строками дочитывается до PDF_OBJECT_MAX
+#define PDF_OBJECT_WINDOW 4096
+#define PDF_OBJECT_MAX (64 * 1024)
+// Окно для строки заголовка подраздела классической таблицы xref
+#define PDF_XREF_WINDOW 256
+#define PDF_XREF_ENTRY_SIZE 20
+// Цепочка /Prev обновлений и распакованные потоки ограничены, чтобы битый файл не зациклил разбор
+#define PDF_MAX_XREF_SECTIONS 16
+#define PDF_MAX_STREAM (4 * 1024 * 1024)
+#define PDF_MAX_INDEX_PAIRS 64
+#define PDF_DESCRIPTION_MAX_CHARS 1000
+// Вложенность массивов и словарей при пропуске значения: "[[[[..." в пределах бюджета не должен
+// исчерпать стек. Глубже значение считается оборванным - разбор словаря на нем останавливается
+#define PDF_MAX_NESTING 64
+
+// Распакованная секция xref в виде потока (PDF 1.5+)
+typedef struct {
+    uint64_t offset;
+    unsigned char *rows;
+    size_t rows_len;
+    int w[3];
+    int64_t index[PDF_MAX_INDEX_PAIRS * 2];
+    int index_pairs;
+    int64_t prev;
+} PdfXrefStream;
+
+// PDF, открытый для выборочного чтения: файл (fd) или буфер в памяти (data)
+typedef struct {
+    int fd;
+    const char *data;
+    uint64_t size;
+    size_t budget;          // сколько байт еще можно прочитать
+    uint64_t xref_offset;   // последний startxref
+    PdfXrefStream streams[PDF_MAX_XREF_SECTIONS];
+    int stream_count;
+} PdfFile;
+
+// Положение объекта по xref: type 1 - смещение в файле, type 2 - номер в потоке объектов
+typedef struct {
+    int type;
+    uint64_t offset;
+    uint32_t stream_num;
+    uint32_t index;
+} PdfXrefEntry;
+
+// Текст объекта [body, end) после "N G obj"; buf - прочитанное окно или распакованный поток объектов
+typedef struct {
+    char *buf;
+    const char *body;
+    const char *end;
+    uint64_t offset;        // смещение buf в файле (для потоков внутри объекта)
+    int in_object_stream;
+} PdfObject;
+
+// ---------------------------------------------------------------------------
+// Чтение в пределах бюджета
+
+static char* pdf_read(PdfFile *pdf, uint64_t offset, size_t len, size_t *got) {
+    if (offset >= pdf->size) return NULL;
+    if (len > pdf->size - offset) len = (size_t)(pdf->size - offset);
+    if (len > pdf->budget) len = pdf->budget;
+    if (len == 0) return NULL;
+
+    char *buf = malloc(len + 1);
+    if (!buf) return NULL;
+
+    size_t done = 0;
+    if (pdf->data) {
+        memcpy(buf, pdf->data + offset, len);
+        done = len;
+    } else {
+        while (done < len) {
+            ssize_t r = pread(pdf->fd, buf + done, len - done, (off_t)(offset + done));
+            if (r <= 0) break;
+            done += (size_t)r;
+        }
+    }
+    if (done == 0) {
+        free(buf);
+        return NULL;
+    }
+
+    pdf->budget -= done;
+    buf[done] = '\0';
+    *got = done;
+    return buf;
+}
+
+// ---------------------------------------------------------------------------
+// Лексер: значения разбираются на месте в [p, end)
+
+static int is_pdf_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\0';
+}
+
+static int is_pdf_delim(char c) {
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' ||
+           c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+static const char* skip_space(const char *p, const char *end) {
+    while (p < end) {
+        if (is_pdf_space(*p)) {
+            p++;
+        } else if (*p == '%') {
+            while (p < end && *p != '\n' && *p != '\r') p++;
+        } else {
+            break;
+        }
+    }
+    return p;
+}
+
+static const char* skip_value_nested(const char *p, const char *end, int depth);
+
+// Пропускает одну лексему-объект; ссылку "N G R" не склеивает (это делает skip_value).
+// depth - вложенность массивов и словарей; глубже PDF_MAX_NESTING возвращается end
+static const char* skip_token_nested(const char *p, const char *end, int depth) {
+    p = skip_space(p, end);
+    if (p >= end) return end;
+
+    if (*p == '(') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '\\') {
+                p += 2;
+                continue;
+            }
+            if (*p == '(') depth++;
+            if (*p == ')' && --depth == 0) return p + 1;
+            p++;
+        }
+        return end;
+    }
+    if (*p == '<' && p + 1 < end && p[1] == '<') {
+        if (depth >= PDF_MAX_NESTING) return end;
+        p += 2;
+        while (1) {
+            p = skip_space(p, end);
+            if (p >= end) return end;
+            if (*p == '>' && p + 1 < end && p[1] == '>') return p + 2;
+            p = skip_value_nested(p, end, depth + 1);
+        }
+    }
+    if (*p == '<') {
+        const char *gt = memchr(p, '>', end - p);
+        return gt ? gt + 1 : end;
+    }
+    if (*p == '[') {
+        if (depth >= PDF_MAX_NESTING) return end;
+        p++;
+        while (1) {
+            p = skip_space(p, end);
+            if (p >= end) return end;
+            if (*p == ']') return p + 1;
+            p = skip_value_nested(p, end, depth + 1);
+        }
+    }
+    if (*p == '/') {
+        p++;
+    } else if (is_pdf_delim(*p)) {
+        return p + 1;
+    }
+    while (p < end && !is_pdf_space(*p) && !is_pdf_delim(*p)) p++;
+    return p;
+}
+
+static const char* skip_token(const char *p, const char *end) {
+    return skip_token_nested(p, end, 0);
+}
+
+static int parse_int(const char *p, const char *end, int64_t *value, const char **next) {
+    p = skip_space(p, end);
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    if (p >= end || !isdigit((unsigned char)*p)) return 0;
+
+    int64_t v = 0;
+    while (p < end && isdigit((unsigned char)*p)) {
+        if (v < INT64_MAX / 10) v = v * 10 + (*p - '0');
+        p++;
+    }
+    // 1.5 - не целое
+    if (p < end && *p == '.') return 0;
+    *value = negative ? -v : v;
+    if (next) *next = p;
+    return 1;
+}
+
+// Ссылка "N G R"
+static int parse_ref(const char *p, const char *end, uint32_t *num) {
+    int64_t n = 0, gen = 0;
+    const char *q = NULL;
+    if (!parse_int(p, end, &n, &q) || !parse_int(q, end, &gen, &q)) return 0;
+    q = skip_space(q, end);
+    if (q >= end || *q != 'R' || (q + 1 < end && !is_pdf_space(q[1]) && !is_pdf_delim(q[1]))) return 0;
+    if (n <= 0 || n > UINT32_MAX) return 0;
+    *num = (uint32_t)n;
+    return 1;
+}
+
+static const char* skip_value_nested(const char *p, const char *end, int depth) {
+    const char *next = skip_token_nested(p, end, depth);
+    uint32_t num = 0;
+    if (parse_ref(p, end, &num)) {
+        // Число уже пропущено - пропускаем поколение и R
+        next = skip_token(next, end);
+        next = skip_token(next, end);
+    }
+    return next;
+}
+
+static const char* skip_value(const char *p, const char *end) {
+    return skip_value_nested(p, end, 0);
+}
+
+// Значение ключа key (без '/') в словаре, начинающемся в p; NULL - ключа нет
+static const char* dict_get(const char *p, const char *end, const char *key) {
+    p = skip_space(p, end);
+    if (end - p < 2 || p[0] != '<' || p[1] != '<') return NULL;
+    p += 2;
+
+    size_t key_len = strlen(key);
+    while (1) {
+        p = skip_space(p, end);
+        if (p >= end || *p == '>') return NULL;
+        if (*p != '/') {
+            p = skip_value(p, end);
+            continue;
+        }
+
+        const char *name = p + 1;
+        const char *name_end = name;
+        while (name_end < end && !is_pdf_space(*name_end) && !is_pdf_delim(*name_end)) name_end++;
+        const char *value = skip_space(name_end, end);
+        if ((size_t)(name_end - name) == key_len && memcmp(name, key, key_len) == 0) {
+            return value;
+        }
+        p = skip_value(value, end);
+    }
+}
+
+static int value_is_name(const char *p, const char *end, const char *name) {
+    p = skip_space(p, end);
+    size_t len = strlen(name);
+    return p < end && *p == '/' && (size_t)(end - p - 1) >= len && memcmp(p + 1, name, len) == 0 &&
+           (p + 1 + len == end || is_pdf_space(p[1 + len]) || is_pdf_delim(p[1 + len]));
+}
+
+// ---------------------------------------------------------------------------
+// Строки PDF -> UTF-8
+
+// Байты 0x80-0xA0 PDFDocEncoding, которые отличаются от Latin-1 (Приложение D спецификации)
+static const unsigned short pdfdoc_high[33] = {
+    0x2022, 0x2020, 0x2021, 0x2026, 0x2014, 0x2013, 0x0192, 0x2044,
+    0x2039, 0x203A, 0x2212, 0x2030, 0x201E, 0x201C, 0x201D, 0x2018,
+    0x2019, 0x201A, 0x2122, 0xFB01, 0xFB02, 0x0141, 0x0152, 0x0160,
+    0x0178, 0x017D, 0x0131, 0x0142, 0x0153, 0x0161, 0x017E, 0xFFFD,
+    0x20AC
+};
+
+// Текстовая строка (литерал или шестнадцатеричная) в UTF-8: UTF-16BE с BOM, UTF-8 с BOM
+// (PDF 2.0) или PDFDocEncoding. Управляющие символы заменяются пробелами. NULL для пустой
+static char* pdf_string(const char *p, const char *end, Arena *arena) {
+    p = skip_space(p, end);
+    if (p >= end || (*p != '(' && *p != '<')) return NULL;
+
+    unsigned char *raw = arena_alloc(arena, (size_t)(end - p) + 1);
+    if (!raw) return NULL;
+    size_t n = 0;
+
+    if (*p == '(') {
+        int depth = 1;
+        for (p++; p < end; p++) {
+            char c = *p;
+            if (c == '(') {
+                depth++;
+            } else if (c == ')' && --depth == 0) {
+                break;
+            } else if (c == '\\' && p + 1 < end) {
+                c = *++p;
+                switch (c) {
+                    case 'n': raw[n++] = '\n'; continue;
+                    case 'r': raw[n++] = '\r'; continue;
+                    case 't': raw[n++] = '\t'; continue;
+                    case 'b': raw[n++] = '\b'; continue;
+                    case 'f': raw[n++] = '\f'; continue;
+                    case '\r':
+                        if (p + 1 < end && p[1] == '\n') p++;
+                        continue;
+                    case '\n':
+                        continue;
+                    default:
+                        break;
+                }
+                if (c >= '0' && c <= '7') {
+                    int value = c - '0';
+                    for (int i = 0; i < 2 && p + 1 < end && p[1] >= '0' && p[1] <= '7'; i++) {
+                        value = value * 8 + (*++p - '0');
+                    }
+                    raw[n++] = (unsigned char)value;
+                    continue;
+                }
+            }
+            raw[n++] = (unsigned char)c;
+        }
+    } else {
+        int high = -1;
+        for (p++; p < end && *p != '>'; p++) {
+            int digit = isdigit((unsigned char)*p) ? *p - '0' :
+                        (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 :
+                        (*p >= 'A' && *p <= 'F') ? *p - 'A' + 10 : -1;
+            if (digit < 0) continue;
+            if (high < 0) {
+                high = digit;
+            } else {
+                raw[n++] = (unsigned char)(high * 16 + digit);
+                high = -1;
+            }
+        }
+        if (high >= 0) raw[n++] = (unsigned char)(high * 16);
+    }
+
+    // Символ UTF-16 дает до 3 байт UTF-8 (пара суррогатов - 4 байта на 4 входных),
+    // символ PDFDocEncoding - до 3 байт
+    char *out = arena_alloc(arena, n * 3 + 1);
+    if (!out) return NULL;
+    size_t o = 0;
+
+    if (n >= 2 && raw[0] == 0xFE && raw[1] == 0xFF) {
+        for (size_t i = 2; i + 1 < n; i += 2) {
+            unsigned long cp = ((unsigned long)raw[i] << 8) | raw[i + 1];
+            if (cp >= 0xD800 && cp <= 0xDBFF && i + 3 < n) {
+                unsigned long low = ((unsigned long)raw[i + 2] << 8) | raw[i + 3];
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD;
+            o += utf8_encode(cp < 0x20 ? ' ' : cp, out + o);
+        }
+    } else if (n >= 3 && raw[0] == 0xEF && raw[1] == 0xBB && raw[2] == 0xBF) {
+        for (size_t i = 3; i < n; i++) out[o++] = raw[i] < 0x20 ? ' ' : (char)raw[i];
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            unsigned long cp = raw[i];
+            if (cp >= 0x80 && cp <= 0xA0) cp = pdfdoc_high[cp - 0x80];
+            o += utf8_encode(cp < 0x20 ? ' ' : cp, out + o);
+        }
+    }
+    out[o] = '\0';
+
+    trim_string(out);
+    char *text = out;
+    while (*text == ' ') text++;
+    return *text ? text : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Объекты и потоки
+
+static int find_object(PdfFile *pdf, uint32_t num, PdfXrefEntry *entry);
+static int load_object(PdfFile *pdf, uint32_t num, PdfObject *obj);
+
+static void free_object(PdfObject *obj) {
+    free(obj->buf);
+    obj->buf = NULL;
+}
+
+static const char* find_keyword(const char *p, const char *end, const char *keyword) {
+    return end > p ? memmem(p, end - p, keyword, strlen(keyword)) : NULL;
+}
+
+// Объект по смещению: "N G obj ... endobj". num == 0 - номер не проверяется (секция xref)
+static int load_object_at(PdfFile *pdf, uint64_t offset, uint32_t num, PdfObject *obj) {
+    memset(obj, 0, sizeof(PdfObject));
+
+    size_t window = PDF_OBJECT_WINDOW;
+    while (1) {
+        size_t got = 0;
+        char *buf = pdf_read(pdf, offset, window, &got);
+        if (!buf) return 0;
+
+        const char *end = buf + got;
+        int64_t obj_num = 0, gen = 0;
+        const char *p = NULL;
+        if (!parse_int(buf, end, &obj_num, &p) || !parse_int(p, end, &gen, &p) ||
+            (num && obj_num != num)) {
+            free(buf);
+            return 0;
+        }
+        p = skip_space(p, end);
+        if (end - p < 3 || memcmp(p, "obj", 3) != 0) {
+            free(buf);
+            return 0;
+        }
+
+        const char *obj_end = find_keyword(p + 3, end, "endobj");
+        const char *stream = find_keyword(p + 3, end, "stream");
+        // Поток дочитывается отдельно по /Length, словарю окна достаточно
+        if (obj_end || stream || got < window || window >= PDF_OBJECT_MAX) {
+            obj->buf = buf;
+            obj->body = p + 3;
+            obj->end = obj_end ? obj_end : end;
+            obj->offset = offset;
+            return 1;
+        }
+
+        free(buf);
+        window = PDF_OBJECT_MAX;
+    }
+}
+
+// Разжатие FlateDecode (формат zlib) с ограничением PDF_MAX_STREAM
+static unsigned char* inflate_stream(const unsigned char *data, size_t len, size_t *out_len) {
+    size_t capacity = len * 4 + 1024;
+    if (capacity > PDF_MAX_STREAM) capacity = PDF_MAX_STREAM;
+    unsigned char *out = malloc(capacity);
+    if (!out) return NULL;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)len;
+
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (stream.total_out == capacity) {
+            if (capacity >= PDF_MAX_STREAM) break;
+            size_t grown = capacity * 2 > PDF_MAX_STREAM ? PDF_MAX_STREAM : capacity * 2;
+            unsigned char *bigger = realloc(out, grown);
+            if (!bigger) break;
+            out = bigger;
+            capacity = grown;
+        }
+        stream.next_out = out + stream.total_out;
+        stream.avail_out = (uInt)(capacity - stream.total_out);
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    // Обрезанный поток (Z_BUF_ERROR) тоже годится: нужное обычно в начале
+    int ok = (status == Z_STREAM_END || status == Z_BUF_ERROR || status == Z_OK) && stream.total_out > 0;
+    *out_len = stream.total_out;
+    inflateEnd(&stream);
+
+    if (!ok) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// PNG-предикторы (/Predictor >= 10): у каждой строки первый байт - тип фильтра
+static int unpredict_png(unsigned char *data, size_t len, size_t columns, size_t *out_len) {
+    size_t row = columns + 1;
+    if (columns == 0 || len < row) return 0;
+
+    size_t rows = len / row;
+    unsigned char *prev = NULL;
+    for (size_t r = 0; r < rows; r++) {
+        unsigned char *src = data + r * row;
+        unsigned char filter = src[0];
+        unsigned char *cur = data + r * columns;
+        memmove(cur, src + 1, columns);
+
+        for (size_t i = 0; i < columns; i++) {
+            unsigned char left = i ? cur[i - 1] : 0;
+            unsigned char up = prev ? prev[i] : 0;
+            unsigned char up_left = (prev && i) ? prev[i - 1] : 0;
+            switch (filter) {
+                case 1: cur[i] += left; break;
+                case 2: cur[i] += up; break;
+                case 3: cur[i] += (unsigned char)((left + up) / 2); break;
+                case 4: {
+                    int pa = abs(up - up_left), pb = abs(left - up_left), pc = abs(left + up - 2 * up_left);
+                    cur[i] += (pa <= pb && pa <= pc) ? left : (pb <= pc ? up : up_left);
+                    break;
+                }
+                default: break;
+            }
+        }
+        prev = cur;
+    }
+    *out_len = rows * columns;
+    return 1;
+}
+
+static int resolve_int(PdfFile *pdf, const char *p, const char *end, int64_t *value) {
+    uint32_t num = 0;
+    if (!parse_ref(p, end, &num)) return parse_int(p, end, value, NULL);
+
+    PdfObject obj;
+    if (!load_object(pdf, num, &obj)) return 0;
+    int ok = parse_int(obj.body, obj.end, value, NULL);
+    free_object(&obj);
+    return ok;
+}
+
+// Данные потока объекта, распакованные (FlateDecode или без фильтра) и с PNG-предиктором
+static unsigned char* load_stream(PdfFile *pdf, const PdfObject *obj, size_t *out_len) {
+    const char *dict = skip_space(obj->body, obj->end);
+    const char *dict_end = skip_value(dict, obj->end);
+    const char *keyword = skip_space(dict_end, obj->end);
+    if (obj->end - keyword < 6 || memcmp(keyword, "stream", 6) != 0) return NULL;
+
+    const char *data = keyword + 6;
+    if (data < obj->end && *data == '\r') data++;
+    if (data < obj->end && *data == '\n') data++;
+
+    int64_t length = 0;
+    const char *length_value = dict_get(dict, dict_end, "Length");
+    if (!length_value || !resolve_int(pdf, length_value, dict_end, &length) ||
+        length <= 0 || length > PDF_READ_BUDGET) {
+        return NULL;
+    }
+
+    // Потоки внутри потоков объектов спецификация запрещает
+    if (obj->in_object_stream) return NULL;
+
+    // Окно объекта могло кончиться раньше данных, поэтому поток дочитывается ровно по /Length
+    size_t raw_len = 0;
+    unsigned char *raw = (unsigned char*)pdf_read(pdf, obj->offset + (uint64_t)(data - obj->buf),
+                                                  (size_t)length, &raw_len);
+    if (!raw) return NULL;
+
+    const char *filter = dict_get(dict, dict_end, "Filter");
+    if (filter) {
+        const char *name = skip_space(filter, dict_end);
+        if (name < dict_end && *name == '[') name = skip_space(name + 1, dict_end);
+        if (!value_is_name(name, dict_end, "FlateDecode")) {
+            free(raw);
+            return NULL;
+        }
+        // Фильтры после FlateDecode (цепочки) не поддерживаются
+        const char *after = skip_space(skip_token(name, dict_end), dict_end);
+        if (*skip_space(filter, dict_end) == '[' && after < dict_end && *after != ']') {
+            free(raw);
+            return NULL;
+        }
+
+        size_t inflated_len = 0;
+        unsigned char *inflated = inflate_stream(raw, raw_len, &inflated_len);
+        free(raw);
+        if (!inflated) return NULL;
+        raw = inflated;
+        raw_len = inflated_len;
+    }
+
+    const char *params = dict_get(dict, dict_end, "DecodeParms");
+    int64_t predictor = 0, columns = 1;
+    if (params) {
+        const char *params_end = skip_value(params, dict_end);
+        const char *value = dict_get(params, params_end, "Predictor");
+        if (value) parse_int(value, params_end, &predictor, NULL);
+        value = dict_get(params, params_end, "Columns");
+        if (value) parse_int(value, params_end, &columns, NULL);
+    }
+    if (predictor >= 10) {
+        if (columns <= 0 || columns > 4096 || !unpredict_png(raw, raw_len, (size_t)columns, &raw_len)) {
+            free(raw);
+            return NULL;
+        }
+    } else if (predictor > 1) {
+        free(raw);      // TIFF-предиктор в метаданных не встречается
+        return NULL;
+    }
+
+    *out_len = raw_len;
+    return raw;
+}
+
+// Объект из потока объектов (/Type /ObjStm): заголовок из пар "номер смещение", данные с /First
+static int load_compressed_object(PdfFile *pdf, const PdfXrefEntry *entry, uint32_t num, PdfObject *obj) {
+    PdfObject container;
+    PdfXrefEntry container_entry;
+    if (!find_object(pdf, entry->stream_num, &container_entry) || container_entry.type != 1 ||
+        !load_object_at(pdf, container_entry.offset, entry->stream_num, &container)) {
+        return 0;
+    }
+
+    const char *dict = skip_space(container.body, container.end);
+    const char *dict_end = skip_value(dict, container.end);
+    int64_t count = 0, first = 0;
+    const char *value = dict_get(dict, dict_end, "N");
+    int ok = value && parse_int(value, dict_end, &count, NULL);
+    value = dict_get(dict, dict_end, "First");
+    ok = ok && value && parse_int(value, dict_end, &first, NULL) && first >= 0;
+
+    size_t len = 0;
+    unsigned char *data = ok ? load_stream(pdf, &container, &len) : NULL;
+    free_object(&container);
+    if (!data) return 0;
+
+    // Ищем пару с нужным номером; индекс из xref - подсказка, но проверяем номер
+    int64_t data_len = (int64_t)len;
+    const char *p = (const char*)data;
+    const char *header_end = (const char*)data + (first < data_len ? first : data_len);
+    int64_t start = -1, next_start = -1;
+    for (int64_t i = 0; i < count; i++) {
+        int64_t obj_num = 0, obj_offset = 0;
+        if (!parse_int(p, header_end, &obj_num, &p) || !parse_int(p, header_end, &obj_offset, &p)) break;
+        if (start >= 0) {
+            next_start = obj_offset;
+            break;
+        }
+        if (obj_num == num) start = obj_offset;
+    }
+
+    // Смещения из файла: отрицательные и first + start за концом потока (без переполнения) отбрасываем
+    if (start < 0 || first >= data_len || start >= data_len - first) {
+        free(data);
+        return 0;
+    }
+
+    memset(obj, 0, sizeof(PdfObject));
+    obj->buf = (char*)data;
+    obj->body = (const char*)data + first + start;
+    obj->end = (next_start > start && next_start <= data_len - first) ?
+               (const char*)data + first + next_start : (const char*)data + len;
+    obj->in_object_stream = 1;
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Таблицы xref
+
+static PdfXrefStream* load_xref_stream(PdfFile *pdf, uint64_t offset) {
+    for (int i = 0; i < pdf->stream_count; i++) {
+        if (pdf->streams[i].offset == offset) return &pdf->streams[i];
+    }
+    if (pdf->stream_count == PDF_MAX_XREF_SECTIONS) return NULL;
+
+    PdfObject obj;
+    if (!load_object_at(pdf, offset, 0, &obj)) return NULL;
+
+    const char *dict = skip_space(obj.body, obj.end);
+    const char *dict_end = skip_value(dict, obj.end);
+    PdfXrefStream *xs = &pdf->streams[pdf->stream_count];
+    memset(xs, 0, sizeof(PdfXrefStream));
+    xs->offset = offset;
+    xs->prev = -1;
+
+    const char *type = dict_get(dict, dict_end, "Type");
+    int ok = type && value_is_name(type, dict_end, "XRef");
+    const char *w = dict_get(dict, dict_end, "W");
+    if (ok && w && *w == '[') {
+        const char *p = w + 1;
+        for (int i = 0; i < 3 && ok; i++) {
+            int64_t width = 0;
+            ok = parse_int(p, dict_end, &width, &p) && width >= 0 && width <= 8;
+            xs->w[i] = (int)width;
+        }
+    } else {
+        ok = 0;
+    }
+
+    const char *index = dict_get(dict, dict_end, "Index");
+    if (ok && index && *index == '[') {
+        const char *p = index + 1;
+        while (xs->index_pairs < PDF_MAX_INDEX_PAIRS &&
+               parse_int(p, dict_end, &xs->index[xs->index_pairs * 2], &p) &&
+               parse_int(p, dict_end, &xs->index[xs->index_pairs * 2 + 1], &p)) {
+            xs->index_pairs++;
+        }
+    } else if (ok) {
+        const char *size = dict_get(dict, dict_end, "Size");
+        ok = size && parse_int(size, dict_end, &xs->index[1], NULL);
+        xs->index_pairs = 1;
+    }
+
+    const char *prev = dict_get(dict, dict_end, "Prev");
+    if (prev) parse_int(prev, dict_end, &xs->prev, NULL);
+
+    xs->rows = ok ? load_stream(pdf, &obj, &xs->rows_len) : NULL;
+    free_object(&obj);
+    if (!xs->rows) return NULL;
+
+    pdf->stream_count++;
+    return xs;
+}
+
+static uint64_t read_field(const unsigned char *p, int width) {
+    uint64_t value = 0;
+    for (int i = 0; i < width; i++) value = (value << 8) | p[i];
+    return value;
+}
+
+// 1 - найдено, 0 - номера нет в этой секции, -1 - объект удален (свободная запись)
+static int find_in_xref_stream(const PdfXrefStream *xs, uint32_t num, PdfXrefEntry *entry) {
+    size_t row = (size_t)(xs->w[0] + xs->w[1] + xs->w[2]);
+    if (row == 0) return 0;
+
+    uint64_t base = 0;
+    for (int i = 0; i < xs->index_pairs; i++) {
+        int64_t start = xs->index[i * 2], count = xs->index[i * 2 + 1];
+        if (start < 0 || count < 0) return 0;
+        if ((int64_t)num >= start && (int64_t)num < start + count) {
+            uint64_t pos = (base + (uint64_t)(num - start)) * row;
+            if (pos + row > xs->rows_len) return 0;
+
+            const unsigned char *p = xs->rows + pos;
+            uint64_t type = xs->w[0] ? read_field(p, xs->w[0]) : 1;
+            uint64_t f2 = read_field(p + xs->w[0], xs->w[1]);
+            uint64_t f3 = read_field(p + xs->w[0] + xs->w[1], xs->w[2]);
+            if (type == 1) {
+                entry->type = 1;
+                entry->offset = f2;
+                return 1;
+            }
+            if (type == 2) {
+                entry->type = 2;
+                entry->stream_num = (uint32_t)f2;
+                entry->index = (uint32_t)f3;
+                return 1;
+            }
+            return -1;
+        }
+        base += (uint64_t)count;
+    }
+    return 0;
+}
+
+// Классическая таблица: подразделы "start count" и записи по 20 байт, читаются точечно.
+// *next получает /Prev трейлера (или -1), *xref_stm - /XRefStm гибридного файла (или -1)
+static int find_in_xref_table(PdfFile *pdf, uint64_t offset, uint32_t num, PdfXrefEntry *entry,
+                              int64_t *next, int64_t *xref_stm) {
+    *next = -1;
+    *xref_stm = -1;
+
+    size_t got = 0;
+    char *buf = pdf_read(pdf, offset, PDF_XREF_WINDOW, &got);
+    if (!buf) return 0;
+    const char *p = skip_space(buf, buf + got) + 4;     // "xref" проверен вызывающим
+    uint64_t pos = offset + (uint64_t)(p - buf);
+
+    for (int guard = 0; guard < 1024; guard++) {
+        const char *end = buf + got;
+        p = skip_space(p, end);
+
+        int64_t start = 0, count = 0;
+        const char *q = NULL;
+        if (!parse_int(p, end, &start, &q) || !parse_int(q, end, &count, &q) || start < 0 || count < 0) {
+            break;
+        }
+        // Записи начинаются сразу после конца строки заголовка
+        q = skip_space(q, end);
+        uint64_t entries = pos + (uint64_t)(q - p);
+
+        if ((int64_t)num >= start && (int64_t)num < start + count) {
+            free(buf);
+            buf = pdf_read(pdf, entries + (uint64_t)(num - start) * PDF_XREF_ENTRY_SIZE,
+                           PDF_XREF_ENTRY_SIZE, &got);
+            if (!buf) return 0;
+            int64_t entry_offset = 0, gen = 0;
+            const char *e = NULL;
+            int ok = parse_int(buf, buf + got, &entry_offset, &e) && parse_int(e, buf + got, &gen, &e);
+            e = ok ? skip_space(e, buf + got) : NULL;
+            int found = (e && e < buf + got && *e == 'n') ? 1 : (e && *e == 'f') ? -1 : 0;
+            free(buf);
+            if (found == 1) {
+                entry->type = 1;
+                entry->offset = (uint64_t)entry_offset;
+            }
+            return found;
+        }
+
+        pos = entries + (uint64_t)count * PDF_XREF_ENTRY_SIZE;
+        free(buf);
+        buf = pdf_read(pdf, pos, PDF_XREF_WINDOW, &got);
+        if (!buf) return 0;
+        p = buf;
+    }
+
+    // Дошли до трейлера этой секции
+    const char *end = buf + got;
+    const char *trailer = find_keyword(buf, end, "trailer");
+    if (trailer) {
+        const char *dict = skip_space(trailer + 7, end);
+        const char *value = dict_get(dict, end, "Prev");
+        if (value) parse_int(value, end, next, NULL);
+        value = dict_get(dict, end, "XRefStm");
+        if (value) parse_int(value, end, xref_stm, NULL);
+    }
+    free(buf);
+    return 0;
+}
+
+static int is_xref_table(PdfFile *pdf, uint64_t offset) {
+    size_t got = 0;
+    char *buf = pdf_read(pdf, offset, 16, &got);
+    if (!buf) return -1;
+    const char *p = skip_space(buf, buf + got);
+    int table = (buf + got - p >= 4 && memcmp(p, "xref", 4) == 0);
+    free(buf);
+    return table;
+}
+
+static int find_object(PdfFile *pdf, uint32_t num, PdfXrefEntry *entry) {
+    int64_t offset = (int64_t)pdf->xref_offset;
+
+    for (int hops = 0; hops < PDF_MAX_XREF_SECTIONS && offset >= 0; hops++) {
+        int table = is_xref_table(pdf, (uint64_t)offset);
+        if (table < 0) return 0;
+
+        int found = 0;
+        int64_t next = -1;
+        if (table) {
+            int64_t xref_stm = -1;
+            found = find_in_xref_table(pdf, (uint64_t)offset, num, entry, &next, &xref_stm);
+            if (found == 0 && xref_stm >= 0) {
+                PdfXrefStream *xs = load_xref_stream(pdf, (uint64_t)xref_stm);
+                if (xs) found = find_in_xref_stream(xs, num, entry);
+            }
+        } else {
+            PdfXrefStream *xs = load_xref_stream(pdf, (uint64_t)offset);
+            if (!xs) return 0;
+            found = find_in_xref_stream(xs, num, entry);
+            next = xs->prev;
+        }
+
+        if (found) return found > 0;
+        if (next == offset) break;
+        offset = next;
+    }
+    return 0;
+}
+
+static int load_object(PdfFile *pdf, uint32_t num, PdfObject *obj) {
+    PdfXrefEntry entry;
+    if (!find_object(pdf, num, &entry)) return 0;
+    if (entry.type == 2) return load_compressed_object(pdf, &entry, num, obj);
+    return load_object_at(pdf, entry.offset, num, obj);
+}
+
+// ---------------------------------------------------------------------------
+// Разбор метаданных
+
+// Трейлер последней секции: классический словарь после таблицы или словарь потока xref
+static int read_trailer(PdfFile *pdf, const char *tail, size_t tail_len, uint32_t *info, uint32_t *root,
+                        int *encrypted) {
+    int table = is_xref_table(pdf, pdf->xref_offset);
+    if (table < 0) return 0;
+
+    PdfObject obj;
+    const char *dict = NULL, *end = NULL;
+    memset(&obj, 0, sizeof(obj));
+
+    if (table) {
+        // Трейлер стоит прямо перед startxref, то есть в уже прочитанном хвосте
+        const char *last = NULL;
+        const char *p = tail;
+        const char *tail_end = tail + tail_len;
+        while ((p = find_keyword(p, tail_end, "trailer")) != NULL) {
+            last = p;
+            p += 7;
+        }
+        if (!last) return 0;
+        dict = skip_space(last + 7, tail_end);
+        end = tail_end;
+    } else {
+        if (!load_object_at(pdf, pdf->xref_offset, 0, &obj)) return 0;
+        dict = skip_space(obj.body, obj.end);
+        end = obj.end;
+    }
+
+    const char *value = dict_get(dict, end, "Info");
+    if (value) parse_ref(value, end, info);
+    value = dict_get(dict, end, "Root");
+    if (value) parse_ref(value, end, root);
+    *encrypted = dict_get(dict, end, "Encrypt") != NULL;
+
+    free_object(&obj);
+    // Без /Root и /Info читать нечего: трейлер битый или оборван слишком глубокой вложенностью
+    return *info || *root;
+}
+
+// Строковое значение ключа словаря; косвенная строка ("12 0 R") разрешается
+static char* dict_string(PdfFile *pdf, const char *dict, const char *end, const char *key, Arena *arena) {
+    const char *value = dict_get(dict, end, key);
+    if (!value) return NULL;
+
+    uint32_t num = 0;
+    if (!parse_ref(value, end, &num)) return pdf_string(value, end, arena);
+
+    PdfObject obj;
+    if (!load_object(pdf, num, &obj)) return NULL;
+    char *text = pdf_string(obj.body, obj.end, arena);
+    free_object(&obj);
+    return text;
+}
+
+static int year_from_text(const char *text) {
+    if (!text) return 0;
+    for (const char *p = text; p[0] && p[1] && p[2] && p[3]; p++) {
+        if (isdigit((unsigned char)p[0]) && isdigit((unsigned char)p[1]) &&
+            isdigit((unsigned char)p[2]) && isdigit((unsigned char)p[3])) {
+            int year = (p[0] - '0') * 1000 + (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+            return (year >= 1000 && year <= 2999) ? year : 0;
+        }
+    }
+    return 0;
+}
+
+static void parse_info(PdfFile *pdf, uint32_t num, BookMeta *meta, Arena *arena) {
+    PdfObject obj;
+    if (!load_object(pdf, num, &obj)) return;
+
+    const char *dict = skip_space(obj.body, obj.end);
+    if (!meta->title) meta->title = dict_string(pdf, dict, obj.end, "Title", arena);
+    if (!meta->author) meta->author = dict_string(pdf, dict, obj.end, "Author", arena);
+    if (!meta->description) meta->description = dict_string(pdf, dict, obj.end, "Subject", arena);
+    if (!meta->year) meta->year = year_from_text(dict_string(pdf, dict, obj.end, "CreationDate", arena));
+    free_object(&obj);
+}
+
+// Текст первого rdf:li внутри элемента (или сам текст элемента, если списка нет)
+static char* xmp_first_item(const XmlElement *el, Arena *arena) {
+    XmlElement item;
+    const char *cursor = el->text;
+    if (xml_next_element(&cursor, el->text_end, "li", &item)) return xml_element_text(&item, arena);
+    return xml_element_text(el, arena);
+}
+
+static char* xmp_field(const char *xmp, const char *end, const char *name, Arena *arena) {
+    XmlElement el;
+    const char *cursor = xmp;
+    while (xml_next_element(&cursor, end, name, &el)) {
+        char *text = xmp_first_item(&el, arena);
+        if (text) return text;
+    }
+    return NULL;
+}
+
+// Все rdf:li в dc:creator через ", "
+static char* xmp_creators(const char *xmp, const char *end, Arena *arena) {
+    XmlElement creator, item;
+    const char *cursor = xmp;
+    if (!xml_next_element(&cursor, end, "creator", &creator)) return NULL;
+
+    char *authors = NULL;
+    size_t authors_len = 0;
+    cursor = creator.text;
+    while (xml_next_element(&cursor, creator.text_end, "li", &item)) {
+        char *name = xml_element_text(&item, arena);
+        if (!name) continue;
+
+        size_t len = strlen(name);
+        char *joined = arena_alloc(arena, authors_len + len + 3);
+        if (!joined) break;
+        if (authors_len > 0) {
+            memcpy(joined, authors, authors_len);
+            memcpy(joined + authors_len, ", ", 2);
+            authors_len += 2;
+        }
+        memcpy(joined + authors_len, name, len + 1);
+        authors_len += len;
+        authors = joined;
+    }
+    return authors ? authors : xml_element_text(&creator, arena);
+}
+
+// XMP (Dublin Core) - основной источник в PDF 2.0, /Info дополняет недостающее
+static void parse_xmp(const char *xmp, size_t len, BookMeta *meta, Arena *arena) {
+    const char *end = xmp + len;
+
+    meta->title = xmp_field(xmp, end, "title", arena);
+    meta->author = xmp_creators(xmp, end, arena);
+    meta->language = xmp_field(xmp, end, "language", arena);
+    meta->publisher = xmp_field(xmp, end, "publisher", arena);
+    meta->description = xmp_field(xmp, end, "description", arena);
+
+    // Серия от calibre: <calibre:series rdf:parseType="Resource"><rdf:value>...</rdf:value>
+    XmlElement el;
+    const char *cursor = xmp;
+    if (xml_next_element(&cursor, end, "series", &el)) {
+        XmlElement value;
+        const char *inner = el.text;
+        meta->series = xml_next_element(&inner, el.text_end, "value", &value) ?
+                       xml_element_text(&value, arena) : xml_element_text(&el, arena);
+        inner = el.text;
+        if (xml_next_element(&inner, el.text_end, "series_index", &value)) {
+            char *index = xml_element_text(&value, arena);
+            if (index) meta->series_number = atoi(index);
+        }
+    }
+
+    // Дата создания бывает элементом или атрибутом rdf:Description
+    char *date = xmp_field(xmp, end, "CreateDate", arena);
+    if (!date) date = xmp_field(xmp, end, "date", arena);
+    cursor = xmp;
+    while (!date && xml_next_element(&cursor, end, "Description", &el)) {
+        date = xml_element_attr_string(&el, "CreateDate", arena);
+    }
+    meta->year = year_from_text(date);
+}
+
+static void parse_catalog(PdfFile *pdf, uint32_t root, BookMeta *meta, Arena *arena) {
+    PdfObject catalog;
+    if (!load_object(pdf, root, &catalog)) return;
+
+    const char *dict = skip_space(catalog.body, catalog.end);
+    char *lang = dict_string(pdf, dict, catalog.end, "Lang", arena);
+
+    uint32_t metadata_num = 0;
+    const char *value = dict_get(dict, catalog.end, "Metadata");
+    int has_xmp = value && parse_ref(value, catalog.end, &metadata_num);
+    free_object(&catalog);
+
+    if (has_xmp) {
+        PdfObject metadata;
+        if (load_object(pdf, metadata_num, &metadata)) {
+            size_t len = 0;
+            unsigned char *xmp = load_stream(pdf, &metadata, &len);
+            free_object(&metadata);
+            if (xmp) {
+                parse_xmp((const char*)xmp, len, meta, arena);
+                free(xmp);
+            }
+        }
+    }
+
+    if (!meta->language) meta->language = lang;
+}
+
+static BookMeta* parse_pdf_file(PdfFile *pdf, Arena *arena) {
+    size_t got = 0;
+    char *head = pdf_read(pdf, 0, 8, &got);
+    int is_pdf = head && got >= 5 && memcmp(head, "%PDF-", 5) == 0;
+    free(head);
+    if (!is_pdf) return NULL;
+
+    uint64_t tail_offset = pdf->size > PDF_TAIL_SIZE ? pdf->size - PDF_TAIL_SIZE : 0;
+    size_t tail_len = 0;
+    char *tail = pdf_read(pdf, tail_offset, PDF_TAIL_SIZE, &tail_len);
+    if (!tail) return NULL;
+
+    // Последний startxref: у файлов с дописанными обновлениями их несколько
+    const char *startxref = NULL;
+    const char *p = tail;
+    while ((p = find_keyword(p, tail + tail_len, "startxref")) != NULL) {
+        startxref = p;
+        p += 9;
+    }
+    int64_t xref_offset = -1;
+    if (!startxref || !parse_int(startxref + 9, tail + tail_len, &xref_offset, NULL) ||
+        xref_offset <= 0 || (uint64_t)xref_offset >= pdf->size) {
+        free(tail);
+        return NULL;
+    }
+    pdf->xref_offset = (uint64_t)xref_offset;
+
+    uint32_t info = 0, root = 0;
+    int encrypted = 0;
+    int ok = read_trailer(pdf, tail, (size_t)(startxref - tail), &info, &root, &encrypted);
+    free(tail);
+    // Строки зашифрованного документа без ключа не прочитать - остается имя файла
+    if (!ok || encrypted) return NULL;
+
+    BookMeta *meta = book_meta_new(arena);
+    if (!meta) return NULL;
+
+    if (root) parse_catalog(pdf, root, meta, arena);
+    if (info) parse_info(pdf, info, meta, arena);
+
+    if (meta->description) {
+        strip_html_tags(meta->description);
+        utf8_truncate(meta->description, PDF_DESCRIPTION_MAX_CHARS);
+        if (!meta->description[0]) meta->description = NULL;
+    }
+    meta->author = intern_meta_field(INTERN_AUTHORS, meta->author);
+    meta->series = intern_meta_field(INTERN_SERIES, meta->series);
+    meta->language = intern_meta_field(INTERN_LANGUAGES, meta->language);
+    if (meta->series_number < 0) meta->series_number = 0;
+
+    metrics_inc(METRIC_PDF_PARSED);
+    return meta;
+}
+
+static void close_pdf(PdfFile *pdf) {
+    for (int i = 0; i < pdf->stream_count; i++) {
+        free(pdf->streams[i].rows);
+    }
+}
+
+BookMeta* parse_pdf(const char *filepath, Arena *arena) {
+    trace_begin("parse", "pdf_parse", NULL);
+    BookMeta *meta = NULL;
+
+    int fd = open(filepath, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        PdfFile pdf;
+        memset(&pdf, 0, sizeof(pdf));
+        pdf.fd = fd;
+        pdf.size = (uint64_t)st.st_size;
+        pdf.budget = PDF_READ_BUDGET;
+        meta = parse_pdf_file(&pdf, arena);
+        close_pdf(&pdf);
+    }
+    if (fd >= 0) close(fd);
+
+    trace_end();
+    return meta;
+}
+
+BookMeta* parse_pdf_from_memory(const char *content, size_t content_size, Arena *arena) {
+    trace_begin("parse", "pdf_parse", NULL);
+
+    PdfFile pdf;
+    memset(&pdf, 0, sizeof(pdf));
+    pdf.fd = -1;
+    pdf.data = content;
+    pdf.size = content_size;
+    pdf.budget = PDF_READ_BUDGET;
+    BookMeta *meta = parse_pdf_file(&pdf, arena);
+    close_pdf(&pdf);
+
+    trace_end();
+    return meta;
+}
@@ -0,0 +1,15 @@
+#ifndef PDF_META_H
+#define PDF_META_H
+
+#include <stddef.h>
+#include "database.h"
+
+// Метаданные PDF из словаря /Info и потока XMP (/Metadata каталога) плюс /Lang каталога.
+// Файл читается с конца: startxref -> xref (таблица или поток) -> только нужные объекты,
+// не больше PDF_READ_BUDGET байт на книгу независимо от размера PDF.
+// Строки выделяются в арене. NULL - не PDF, xref не разобран или документ зашифрован
+BookMeta* parse_pdf(const char *filepath, Arena *arena);
+// То же для PDF, уже извлеченного из архива коллекции в память
+BookMeta* parse_pdf_from_memory(const char *content, size_t content_size, Arena *arena);
+
+#endif
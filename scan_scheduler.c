@@ -0,0 +1,298 @@
+// scan_scheduler.c - потоки чтения по устройствам и пул разбора с ограниченными очередями
+#include "common.h"
+#include "scan_scheduler.h"
+#include "metrics.h"
+#include "scanner.h"
+#include <pthread.h>
+
+// Потоков разбора, если число процессоров узнать не удалось
+#define SCAN_DEFAULT_PARSERS 4
+
+typedef struct {
+    ScanTask task;
+    void *arg;
+    size_t bytes;
+} ScanJob;
+
+// Кольцевая очередь заданий, защищена блокировкой планировщика
+typedef struct {
+    ScanJob *jobs;
+    int capacity;
+    int head;
+    int count;
+    size_t bytes;
+    size_t max_bytes;           // 0 - без предела по памяти
+    int closed;                 // заданий больше не будет: потоки выходят, опустошив очередь
+    MetricGauge depth_gauge;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} ScanQueue;
+
+// Устройство со своей очередью и потоками чтения
+typedef struct {
+    ScanScheduler *scheduler;
+    dev_t device;
+    ScanQueue queue;
+    pthread_t *threads;
+    int thread_count;
+} ScanDevice;
+
+struct ScanScheduler {
+    DatabaseHandle *db_handle;
+    Config *config;
+    pthread_mutex_t lock;       // все очереди и список устройств
+    ScanDevice **devices;
+    int device_count;
+    int device_capacity;
+    ScanQueue parse_queue;
+    pthread_t *parsers;
+    int parser_count;
+    int readers_per_device;
+    int queue_depth;
+};
+
+static int queue_init(ScanQueue *queue, int capacity, size_t max_bytes, MetricGauge depth_gauge) {
+    memset(queue, 0, sizeof(*queue));
+    queue->jobs = calloc(capacity, sizeof(ScanJob));
+    if (!queue->jobs) return 0;
+    queue->capacity = capacity;
+    queue->max_bytes = max_bytes;
+    queue->depth_gauge = depth_gauge;
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return 1;
+}
+
+static void queue_destroy(ScanQueue *queue) {
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->jobs);
+}
+
+static int queue_has_room(const ScanQueue *queue, size_t bytes) {
+    if (queue->count == queue->capacity) return 0;
+    return queue->count == 0 || !queue->max_bytes || queue->bytes + bytes <= queue->max_bytes;
+}
+
+// Вызывается под scheduler->lock; ждет места в очереди
+static void queue_push(ScanScheduler *scheduler, ScanQueue *queue, ScanJob job) {
+    while (!queue_has_room(queue, job.bytes)) {
+        pthread_cond_wait(&queue->not_full, &scheduler->lock);
+    }
+    queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+    queue->count++;
+    queue->bytes += job.bytes;
+    metrics_gauge_add(queue->depth_gauge, 1);
+    if (queue->max_bytes) metrics_gauge_add(METRIC_GAUGE_SCAN_PARSE_QUEUE_BYTES, (int64_t)job.bytes);
+    pthread_cond_signal(&queue->not_empty);
+}
+
+// Вызывается под scheduler->lock. 0 - очередь закрыта и пуста
+static int queue_pop(ScanScheduler *scheduler, ScanQueue *queue, ScanJob *job) {
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &scheduler->lock);
+    }
+    if (queue->count == 0) return 0;
+
+    *job = queue->jobs[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    queue->bytes -= job->bytes;
+    metrics_gauge_add(queue->depth_gauge, -1);
+    if (queue->max_bytes) metrics_gauge_add(METRIC_GAUGE_SCAN_PARSE_QUEUE_BYTES, -(int64_t)job->bytes);
+    // Писатели ждут разного объема памяти - будим всех
+    pthread_cond_broadcast(&queue->not_full);
+    return 1;
+}
+
+static void queue_close(ScanScheduler *scheduler, ScanQueue *queue) {
+    pthread_mutex_lock(&scheduler->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+// Поток разбора держит соединение из пула все время работы: книги копятся в его пакете вставки.
+// Без своего соединения вызовы базы идут через основное, по очереди с другими такими потоками
+static void* parser_thread(void *arg) {
+    ScanScheduler *scheduler = arg;
+    int attached = db_thread_attach(scheduler->db_handle);
+    if (!attached) {
+        log_message(scheduler->config, "WARNING", "Parser thread has no own database connection, sharing the main one");
+    }
+
+    ScanJob job;
+    for (;;) {
+        pthread_mutex_lock(&scheduler->lock);
+        int have_job = queue_pop(scheduler, &scheduler->parse_queue, &job);
+        pthread_mutex_unlock(&scheduler->lock);
+        if (!have_job) break;
+        job.task(scheduler, job.arg, scheduler->db_handle, scheduler->config);
+    }
+
+    if (attached) db_thread_detach(scheduler->db_handle);
+    scanner_thread_exit();
+    return NULL;
+}
+
+// Поток чтения обращается к базе дважды на архив (archive_needs_rescan и update_archive_info)
+// и делает это через основное соединение: пул целиком достается потокам разбора
+static void* reader_thread(void *arg) {
+    ScanDevice *device = arg;
+    ScanScheduler *scheduler = device->scheduler;
+
+    ScanJob job;
+    for (;;) {
+        pthread_mutex_lock(&scheduler->lock);
+        int have_job = queue_pop(scheduler, &device->queue, &job);
+        pthread_mutex_unlock(&scheduler->lock);
+        if (!have_job) break;
+        job.task(scheduler, job.arg, scheduler->db_handle, scheduler->config);
+    }
+
+    scanner_thread_exit();
+    return NULL;
+}
+
+// Вызывается под scheduler->lock. Потоки чтения устройства запускаются при первом его файле
+static ScanDevice* scheduler_device(ScanScheduler *scheduler, dev_t device_id) {
+    for (int i = 0; i < scheduler->device_count; i++) {
+        if (scheduler->devices[i]->device == device_id) return scheduler->devices[i];
+    }
+
+    if (scheduler->device_count == scheduler->device_capacity) {
+        int capacity = scheduler->device_capacity ? scheduler->device_capacity * 2 : 4;
+        ScanDevice **devices = realloc(scheduler->devices, capacity * sizeof(ScanDevice*));
+        if (!devices) return NULL;
+        scheduler->devices = devices;
+        scheduler->device_capacity = capacity;
+    }
+
+    ScanDevice *device = calloc(1, sizeof(ScanDevice));
+    if (!device) return NULL;
+    device->scheduler = scheduler;
+    device->device = device_id;
+    device->threads = calloc(scheduler->readers_per_device, sizeof(pthread_t));
+    if (!device->threads ||
+        !queue_init(&device->queue, scheduler->queue_depth, 0, METRIC_GAUGE_SCAN_READ_QUEUE)) {
+        free(device->threads);
+        free(device);
+        return NULL;
+    }
+
+    for (int i = 0; i < scheduler->readers_per_device; i++) {
+        if (pthread_create(&device->threads[i], NULL, reader_thread, device) != 0) break;
+        device->thread_count++;
+    }
+    if (device->thread_count == 0) {
+        queue_destroy(&device->queue);
+        free(device->threads);
+        free(device);
+        return NULL;
+    }
+
+    scheduler->devices[scheduler->device_count++] = device;
+    log_message(scheduler->config, "INFO", "Scheduler: %d reader thread(s) for device %lu",
+                device->thread_count, (unsigned long)device_id);
+    return device;
+}
+
+ScanScheduler* scan_scheduler_create(DatabaseHandle *db_handle, Config *config) {
+    int readers = config->scanner.io_threads_per_device;
+    if (readers <= 0) return NULL;
+
+    int parsers = config->scanner.parser_threads;
+    if (parsers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        parsers = cpus > 0 ? (int)cpus : SCAN_DEFAULT_PARSERS;
+    }
+
+    // MySQL: поток разбора держит соединение пула, лишние потоки ждали бы его до конца сканирования
+    if (db_handle->db_type == DB_MYSQL && config->database.pool_size > 0 &&
+        parsers > config->database.pool_size) {
+        parsers = config->database.pool_size;
+    }
+
+    int depth = config->scanner.queue_depth > 0 ? config->scanner.queue_depth : 1;
+
+    ScanScheduler *scheduler = calloc(1, sizeof(ScanScheduler));
+    if (!scheduler) return NULL;
+    scheduler->db_handle = db_handle;
+    scheduler->config = config;
+    scheduler->readers_per_device = readers;
+    scheduler->queue_depth = depth;
+    scheduler->parsers = calloc(parsers, sizeof(pthread_t));
+    if (!scheduler->parsers ||
+        !queue_init(&scheduler->parse_queue, depth, SCAN_PARSE_QUEUE_BYTES, METRIC_GAUGE_SCAN_PARSE_QUEUE)) {
+        free(scheduler->parsers);
+        free(scheduler);
+        return NULL;
+    }
+    pthread_mutex_init(&scheduler->lock, NULL);
+
+    for (int i = 0; i < parsers; i++) {
+        if (pthread_create(&scheduler->parsers[i], NULL, parser_thread, scheduler) != 0) break;
+        scheduler->parser_count++;
+    }
+    if (scheduler->parser_count == 0) {
+        log_message(config, "ERROR", "Scheduler: cannot start parser threads, scanning in one thread");
+        queue_destroy(&scheduler->parse_queue);
+        pthread_mutex_destroy(&scheduler->lock);
+        free(scheduler->parsers);
+        free(scheduler);
+        return NULL;
+    }
+
+    log_message(config, "INFO", "Scheduler: %d parser thread(s), %d reader thread(s) per device, queue depth %d",
+                scheduler->parser_count, readers, depth);
+    return scheduler;
+}
+
+void scan_scheduler_read(ScanScheduler *scheduler, dev_t device, ScanTask task, void *arg) {
+    pthread_mutex_lock(&scheduler->lock);
+    ScanDevice *reader = scheduler_device(scheduler, device);
+    if (reader) {
+        queue_push(scheduler, &reader->queue, (ScanJob){task, arg, 0});
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    // Потоки устройства не запустились - файл читается в потоке обхода
+    if (!reader) {
+        log_message(scheduler->config, "WARNING", "Scheduler: no reader for device %lu, reading in place",
+                    (unsigned long)device);
+        task(scheduler, arg, scheduler->db_handle, scheduler->config);
+    }
+}
+
+void scan_scheduler_parse(ScanScheduler *scheduler, ScanTask task, void *arg, size_t bytes) {
+    pthread_mutex_lock(&scheduler->lock);
+    queue_push(scheduler, &scheduler->parse_queue, (ScanJob){task, arg, bytes});
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void scan_scheduler_finish(ScanScheduler *scheduler) {
+    if (!scheduler) return;
+
+    // Сначала дочитываются все устройства: читатели еще кладут задания в очередь разбора
+    for (int i = 0; i < scheduler->device_count; i++) {
+        ScanDevice *device = scheduler->devices[i];
+        queue_close(scheduler, &device->queue);
+        for (int t = 0; t < device->thread_count; t++) {
+            pthread_join(device->threads[t], NULL);
+        }
+        queue_destroy(&device->queue);
+        free(device->threads);
+        free(device);
+    }
+    free(scheduler->devices);
+
+    queue_close(scheduler, &scheduler->parse_queue);
+    for (int i = 0; i < scheduler->parser_count; i++) {
+        pthread_join(scheduler->parsers[i], NULL);
+    }
+    queue_destroy(&scheduler->parse_queue);
+    free(scheduler->parsers);
+
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler);
+}
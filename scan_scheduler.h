@@ -0,0 +1,32 @@
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "config.h"
+#include "database.h"
+
+// Предел памяти буферов в очереди разбора; одна запись больше предела проходит, когда очередь пуста
+#define SCAN_PARSE_QUEUE_BYTES (256L * 1024 * 1024)
+
+// Планировщик сканирования: на каждое устройство (st_dev) - io_threads_per_device потоков чтения,
+// которые читают файлы и архивы целиком и по порядку, и общий пул потоков разбора.
+// Обе очереди ограничены ([scanner] queue_depth): обход ждет читателей, читатели - разбор,
+// поэтому диск читается последовательно, а не вразброс, и память не растет
+typedef struct ScanScheduler ScanScheduler;
+
+// Задание выполняется в потоке планировщика. Поток разбора работает со своим соединением пула
+// MySQL (db_thread_attach), поток чтения - с основным
+typedef void (*ScanTask)(ScanScheduler *scheduler, void *arg, DatabaseHandle *db_handle, Config *config);
+
+// NULL - планировщик выключен (io_threads_per_device = 0) или не запустились потоки разбора;
+// тогда сканирование идет в одном потоке, как раньше
+ScanScheduler* scan_scheduler_create(DatabaseHandle *db_handle, Config *config);
+// Задание чтения для устройства device. Ждет, пока в очереди устройства освободится место
+void scan_scheduler_read(ScanScheduler *scheduler, dev_t device, ScanTask task, void *arg);
+// Задание разбора с буфером bytes байт. Ждет, пока в очереди разбора освободится место
+void scan_scheduler_parse(ScanScheduler *scheduler, ScanTask task, void *arg, size_t bytes);
+// Дожидается всех заданий, останавливает потоки и освобождает планировщик
+void scan_scheduler_finish(ScanScheduler *scheduler);
+
+#endif
@@ -3,22 +3,83 @@
 #include "scanner.h"
 #include "metadata.h"
 #include "utils.h"
+#include "zip_index.h"
+#include "format.h"
+#include "metrics.h"
+#include "trace.h"
+#include "scan_scheduler.h"
 #include <dirent.h>
 #include <sys/stat.h>
 #include <archive.h>
 #include <archive_entry.h>
 #include <string.h>
+#include <zlib.h>
+
+// Запись архива больше этого не распаковывается в память
+#define MAX_ARCHIVE_ENTRY_SIZE 10485760
+
+// Арена текущей книги: содержимое записи, строки метаданных, хеш и ключ обложки.
+// Сбрасывается после каждой книги, блок переиспользуется до конца сканирования
+static __thread Arena book_arena;
+
+// Архив в обработке. Без планировщика живет до конца process_archive. С планировщиком на него
+// ссылаются поток чтения и каждая его запись в очереди разбора; сведения об архиве записывает
+// тот, кто отпустит последнюю ссылку, - архив не отмечается прочитанным раньше своих книг
+typedef struct {
+    char *path;
+    char *hash;
+    ScanScheduler *scheduler;   // NULL - записи разбираются сразу в потоке чтения
+    DatabaseHandle *db_handle;
+    Config *config;
+    int file_count;
+    long total_size;
+    int scanned;
+    int refs;
+    double started;
+} ArchiveScan;
+
+// Книга, переданная потокам разбора: запись архива в памяти или отдельный файл
+typedef struct {
+    ArchiveScan *archive;       // NULL - отдельный файл
+    char *name;                 // имя записи в архиве или путь файла
+    char *content;              // запись архива (malloc), для файла NULL
+    size_t content_size;
+    char *hash;
+    FileView view;              // файл, отображенный и хешированный потоком чтения
+    const FormatHandler *handler;   // формат файла
+    long file_size;
+} ParseJob;
+
+static void scan_file(const char *filepath, ScanScheduler *scheduler, DatabaseHandle *db_handle, Config *config);
+static void scan_archive(const char *archive_path, BookFormat format, ScanScheduler *scheduler,
+                         DatabaseHandle *db_handle, Config *config);
+static void parse_task(ScanScheduler *scheduler, void *arg, DatabaseHandle *db_handle, Config *config);
+
+static void read_task(ScanScheduler *scheduler, void *arg, DatabaseHandle *db_handle, Config *config) {
+    char *filepath = arg;
+    scan_file(filepath, scheduler, db_handle, config);
+    free(filepath);
+}
 
-const char *supported_formats[SUPPORTED_FORMATS] = {
-    ".epub", ".fb2", ".pdf", ".mobi", ".txt", ".zip", ".rar", ".7z"
-};
+// Отдельный файл - книга по расширению, а при неизвестном расширении (или без него) - по сигнатуре
+// в первых FORMAT_SNIFF_SIZE байтах. Архивы по одной сигнатуре не берутся: ZIP - это и .docx, и .inpx
+static int is_book_file(const char *filepath, const char *filename) {
+    if (is_supported_format(filename)) return 1;
 
-void scan_directory(const char *path, DatabaseHandle *db_handle, Config *config) {
+    BookFormat format = detect_format(filepath);
+    return format != BOOK_FORMAT_UNKNOWN && !format_handler(format)->is_archive;
+}
+
+static void walk_directory(const char *path, ScanScheduler *scheduler, DatabaseHandle *db_handle, Config *config) {
     DIR *dir = opendir(path);
     if (!dir) {
         log_message(config, "ERROR", "Cannot open directory: %s", path);
+        metrics_inc(METRIC_ERRORS_DIRECTORY);
         return;
     }
+    metrics_inc(METRIC_DIRECTORIES_SCANNED);
+    metrics_gauge_add(METRIC_GAUGE_SCAN_DEPTH, 1);
+    trace_begin("scan", "directory", path);
 
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
@@ -31,29 +92,113 @@ void scan_directory(const char *path, DatabaseHandle *db_handle, Config *config)
         struct stat statbuf;
         if (stat(full_path, &statbuf) == -1) {
             log_message(config, "WARNING", "Cannot stat file: %s", full_path);
+            metrics_inc(METRIC_FILES_SKIPPED_STAT_FAILED);
             continue;
         }
 
         if (S_ISDIR(statbuf.st_mode)) {
             log_message(config, "DEBUG", "Entering directory: %s", full_path);
-            scan_directory(full_path, db_handle, config);
+            walk_directory(full_path, scheduler, db_handle, config);
         } else if (S_ISREG(statbuf.st_mode)) {
-            if (is_supported_format(entry->d_name)) {
+            metrics_inc(METRIC_FILES_SEEN);
+            if (is_book_file(full_path, entry->d_name)) {
                 log_message(config, "INFO", "Processing file: %s", full_path);
-                process_file(full_path, db_handle, config);
+                metrics_inc(METRIC_FILES_PROCESSED);
+                char *queued_path = scheduler ? strdup(full_path) : NULL;
+                if (queued_path) {
+                    // Файлы одного устройства читаются его потоками по порядку обхода
+                    scan_scheduler_read(scheduler, statbuf.st_dev, read_task, queued_path);
+                } else {
+                    process_file(full_path, db_handle, config);
+                }
             } else {
                 log_message(config, "DEBUG", "Skipping unsupported format: %s", full_path);
+                metrics_inc(METRIC_FILES_SKIPPED_UNSUPPORTED);
             }
+            metrics_maybe_flush();
         }
     }
 
     closedir(dir);
+    trace_end();
+    metrics_gauge_add(METRIC_GAUGE_SCAN_DEPTH, -1);
+}
+
+void scan_directory(const char *path, DatabaseHandle *db_handle, Config *config) {
+    ScanScheduler *scheduler = scan_scheduler_create(db_handle, config);
+    walk_directory(path, scheduler, db_handle, config);
+    scan_scheduler_finish(scheduler);
+}
+
+void scanner_thread_exit(void) {
+    arena_destroy(&book_arena);
+}
+
+// Отображает весь файл и хеширует его из отображения: разбор и обложка потом идут по тому же
+// view, так что с диска файл читается один раз
+static int open_book_view(const char *filepath, FileView *view, char **file_hash, Config *config) {
+    trace_begin("io", "hash", config->scanner.hash_algorithm);
+    int opened = file_view_open(filepath, NULL, view);
+    *file_hash = opened ? calculate_buffer_hash(view->data, view->size, config->scanner.hash_algorithm,
+                                                filepath) : NULL;
+    trace_end();
+    if (!opened) LOG_WARNING(config, "Cannot read file: %s", filepath);
+    return opened;
+}
+
+// Разбор и вставка отдельной книги. view и file_hash (забираются) подготовлены потоком чтения
+// через open_book_view или NULL - тогда файл отображается здесь
+static void process_book_file(const char *filepath, const FormatHandler *handler, long file_size,
+                              FileView *view, char *file_hash, DatabaseHandle *db_handle, Config *config) {
+    FileView local_view;
+    if (!view) {
+        if (!open_book_view(filepath, &local_view, &file_hash, config)) {
+            metrics_inc(METRIC_ERRORS_PARSE);
+            return;
+        }
+        view = &local_view;
+    }
+
+    DBG("[PROCESS_FILE] Parsing metadata for: %s\n", filepath);
+    trace_begin("scan", "file", filepath);
+    trace_begin("parse", "parse_metadata", handler->name);
+    BookMeta *meta = parse_metadata_view(filepath, handler->name, view, &book_arena);
+    trace_end();
+    metrics_add(METRIC_BYTES_READ, (uint64_t)file_size);
+    if (meta) {
+        meta->file_size = file_size;
+        meta->file_hash = arena_adopt(meta->arena, file_hash);
+
+        // cover_memory может портить буфер - view после этого больше не разбирается
+        if (config->scanner.extract_covers && handler->cover_memory) {
+            trace_begin("parse", "cover", NULL);
+            meta->cover_key = arena_adopt(meta->arena, handler->cover_memory(view->data, view->size, config));
+            trace_end();
+        }
+        DBG("[FILE] File size set to: %ld for %s\n", meta->file_size, filepath);
+
+        DBG("[PROCESS_FILE] Inserting book to database: %s\n", filepath);
+        insert_book_to_db(db_handle, filepath, meta, NULL, NULL, config);
+        DBG("[PROCESS_FILE] Freeing book metadata for: %s\n", filepath);
+        free_book_meta(meta);
+        DBG("[PROCESS_FILE] Successfully processed: %s\n", filepath);
+    } else {
+        LOG_WARNING(config, "Failed to parse metadata for: %s", filepath);
+        metrics_inc(METRIC_ERRORS_PARSE);
+        free(file_hash);
+        arena_reset(&book_arena);
+    }
+    file_view_close(view);
+    trace_end();
 }
 
 void process_file(const char *filepath, DatabaseHandle *db_handle, Config *config) {
-    const char *ext = strrchr(filepath, '.');
-    if (!ext) return;
+    scan_file(filepath, NULL, db_handle, config);
+}
 
+// С планировщиком вызывается в потоке чтения: архив распаковывается целиком, отдельный файл
+// отображается и хешируется - поток разбора получает тот же view и с диска его не читает
+static void scan_file(const char *filepath, ScanScheduler *scheduler, DatabaseHandle *db_handle, Config *config) {
     struct stat file_stat;
     if (stat(filepath, &file_stat) == -1) {
         LOG_WARNING(config, "Cannot stat file: %s", filepath);
@@ -64,48 +209,175 @@ void process_file(const char *filepath, DatabaseHandle *db_handle, Config *confi
 
     LOG_INFO(config, "Processing file: %s", filepath);
 
-    if (is_archive_format(filepath)) {
+    // Формат по сигнатуре: .fb2, который на самом деле ZIP, или .zip, который на самом деле RAR,
+    // уходят к своему обработчику, а не к тому, что подсказывает расширение
+    BookFormat format = detect_format(filepath);
+    if (format == BOOK_FORMAT_UNKNOWN) {
+        LOG_DEBUG(config, "Skipping unsupported format: %s", filepath);
+        return;
+    }
+    const FormatHandler *handler = format_handler(format);
+    if (format != format_from_extension(filepath)) {
+        LOG_INFO(config, "Format detected by signature as %s: %s", handler->name, filepath);
+        metrics_inc(METRIC_FILES_FORMAT_MISMATCH);
+    }
+
+    if (handler->is_archive) {
         LOG_INFO(config, "Processing archive: %s", filepath);
-        process_archive(filepath, db_handle, config);
+        trace_begin("scan", "archive", filepath);
+        scan_archive(filepath, format, scheduler, db_handle, config);
+        trace_end();
+    } else if (scheduler) {
+        ParseJob *job = calloc(1, sizeof(ParseJob));
+        char *name = strdup(filepath);
+        if (!job || !name) {
+            LOG_ERROR(config, "Out of memory queueing: %s", filepath);
+            free(job);
+            free(name);
+            return;
+        }
+        if (!open_book_view(filepath, &job->view, &job->hash, config)) {
+            metrics_inc(METRIC_ERRORS_PARSE);
+            free(job);
+            free(name);
+            return;
+        }
+        job->name = name;
+        job->handler = handler;
+        job->file_size = file_stat.st_size;
+        // Отображение занимает кэш страниц, а не кучу; в предел очереди идет только копия без mmap
+        scan_scheduler_parse(scheduler, parse_task, job, job->view.map_len ? 0 : job->view.size);
     } else {
-        DBG("[PROCESS_FILE] Parsing metadata for: %s\n", filepath);
-        BookMeta *meta = parse_metadata(filepath, ext + 1);
-        if (meta) {
-            meta->file_size = file_stat.st_size;
-            DBG("[FILE] File size set to: %ld for %s\n", meta->file_size, filepath);
-
-            DBG("[PROCESS_FILE] Inserting book to database: %s\n", filepath);
-            insert_book_to_db(db_handle, filepath, meta, NULL, NULL, config);
-            DBG("[PROCESS_FILE] Freeing book metadata for: %s\n", filepath);
-            free_book_meta(meta);
-            DBG("[PROCESS_FILE] Successfully processed: %s\n", filepath);
+        process_book_file(filepath, handler, file_stat.st_size, NULL, NULL, db_handle, config);
+    }
+}
+
+// Разбор и вставка одной книги из архива. content завершен нулем и может быть испорчен
+// (обложка FB2 декодируется на месте); entry_hash забирается в арену книги
+static void process_archive_entry(const char *archive_path, const char *filename, char *content,
+                                  size_t content_size, char *entry_hash, DatabaseHandle *db_handle,
+                                  Config *config) {
+    BookFormat format = detect_format_memory(content, content_size, filename);
+    const FormatHandler *handler = format_handler(format);
+
+    BookMeta *meta = NULL;
+    if (handler->parse_memory) {
+        meta = handler->parse_memory(content, content_size, &book_arena);
+        if (meta && config->scanner.extract_covers && handler->cover_memory) {
+            trace_begin("parse", "cover", NULL);
+            meta->cover_key = arena_adopt(meta->arena, handler->cover_memory(content, content_size, config));
+            trace_end();
+        }
+    }
+
+    // Неразобранный FB2 - ошибка; остальные форматы (и книги без названия) получают его из имени файла
+    if (!meta && format != BOOK_FORMAT_FB2) meta = book_meta_new(&book_arena);
+    if (meta && !meta->title) {
+        const char *base_name = strrchr(filename, '/');
+        base_name = base_name ? base_name + 1 : filename;
+        const char *dot = strrchr(base_name, '.');
+        if (dot) {
+            meta->title = arena_strndup(&book_arena, base_name, dot - base_name);
         } else {
-            LOG_WARNING(config, "Failed to parse metadata for: %s", filepath);
+            meta->title = arena_strdup(&book_arena, base_name);
         }
     }
+
+    if (meta) {
+        meta->file_size = (long)content_size;
+        meta->file_hash = arena_adopt(meta->arena, entry_hash);
+        printf("DEBUG: [ARCHIVE] File size set to: %ld for %s\n", meta->file_size, filename);
+
+        insert_book_to_db(db_handle, archive_path, meta, archive_path, filename, config);
+        free_book_meta(meta);
+    } else {
+        log_message(config, "WARNING", "Failed to parse metadata for archive file: %s/%s",
+                   archive_path, filename);
+        metrics_inc(METRIC_ERRORS_PARSE);
+        free(entry_hash);
+        arena_reset(&book_arena);
+    }
 }
 
-void process_archive(const char *archive_path, DatabaseHandle *db_handle, Config *config) {
-    printf("DEBUG: [PROCESS_ARCHIVE] Starting: %s\n", archive_path);
+// Запись архива разбирается сразу или, с планировщиком, уходит в очередь потокам разбора
+// (ждет там места). С планировщиком content (malloc) забирается заданием, без него остается
+// у вызывающего; entry_hash забирается всегда
+static void emit_archive_entry(ArchiveScan *archive, const char *filename, char *content,
+                               size_t content_size, char *entry_hash) {
+    if (!archive->scheduler) {
+        process_archive_entry(archive->path, filename, content, content_size, entry_hash,
+                              archive->db_handle, archive->config);
+        return;
+    }
 
-    // Используем алгоритм из конфигурации
-    char *archive_hash = calculate_file_hash(archive_path, config->scanner.hash_algorithm);
-    if (!archive_hash) {
-        log_message(config, "ERROR", "Cannot calculate hash for archive: %s", archive_path);
+    ParseJob *job = calloc(1, sizeof(ParseJob));
+    char *name = strdup(filename);
+    if (!job || !name) {
+        log_message(archive->config, "ERROR", "Out of memory queueing: %s/%s", archive->path, filename);
+        free(job);
+        free(name);
+        free(content);
+        free(entry_hash);
         return;
     }
+    job->archive = archive;
+    job->name = name;
+    job->content = content;
+    job->content_size = content_size;
+    job->hash = entry_hash;
+    __atomic_add_fetch(&archive->refs, 1, __ATOMIC_RELAXED);
+
+    trace_begin("io", "parse_queue_wait", NULL);
+    scan_scheduler_parse(archive->scheduler, parse_task, job, content_size);
+    trace_end();
+}
 
-    printf("DEBUG: [PROCESS_ARCHIVE] Using %s hash: %s\n", config->scanner.hash_algorithm, archive_hash);
+// Быстрый путь для ZIP из одной книги (типичный .fb2.zip): запись распаковывается напрямую
+// по уже прочитанному центральному каталогу, без libarchive. 0 - запись не подходит
+// (каталог, вложенный архив, неподдерживаемый метод сжатия) и архив читается обычным путем
+static int process_single_entry_zip(ArchiveScan *archive, const ZipIndex *zip_index) {
+    const char *archive_path = archive->path;
+    const ZipEntryInfo *zip_entry = &zip_index->entries[0];
+    const char *filename = zip_entry->name;
+    BookFormat format = format_from_extension(filename);
+    if (format == BOOK_FORMAT_UNKNOWN || format_handler(format)->is_archive ||
+        zip_entry->uncompressed_size > MAX_ARCHIVE_ENTRY_SIZE) {
+        return 0;
+    }
 
-    if (!archive_needs_rescan(db_handle, archive_path, archive_hash, config)) {
-        printf("DEBUG: [PROCESS_ARCHIVE] Archive doesn't need rescan: %s\n", archive_path);
-        free(archive_hash);
-        return;
+    int fd = open(archive_path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    trace_begin("scan", "entry", filename);
+    trace_begin("io", "decompress", NULL);
+    size_t content_size = 0;
+    char *content = zip_entry_read(fd, zip_entry, MAX_ARCHIVE_ENTRY_SIZE, &content_size);
+    trace_end();
+    close(fd);
+    if (!content) {
+        trace_end();
+        return 0;
     }
 
-    printf("DEBUG: [PROCESS_ARCHIVE] Processing archive: %s\n", archive_path);
-;
+    metrics_inc(METRIC_ARCHIVES_PROCESSED);
+    metrics_inc(METRIC_ARCHIVES_SINGLE_ENTRY);
+    metrics_inc(METRIC_ARCHIVE_ENTRIES);
+    metrics_add(METRIC_BYTES_READ, content_size);
+    log_message(archive->config, "INFO", "Found book in archive: %s/%s (size: %zu)", archive_path, filename, content_size);
+
+    archive->file_count = 1;
+    archive->total_size = (long)content_size;
+    emit_archive_entry(archive, filename, content, content_size,
+                       format_crc32_hash(zip_entry->crc32, zip_entry->uncompressed_size));
+    if (!archive->scheduler) free(content);
+    trace_end();
+    return 1;
+}
 
+// Обход записей через libarchive. 0 - архив не открылся
+static int scan_archive_entries(ArchiveScan *archive, const ZipIndex *zip_index) {
+    const char *archive_path = archive->path;
+    Config *config = archive->config;
     struct archive *a;
     struct archive_entry *entry;
     int r;
@@ -117,110 +389,194 @@ void process_archive(const char *archive_path, DatabaseHandle *db_handle, Config
     r = archive_read_open_filename(a, archive_path, 10240);
     if (r != ARCHIVE_OK) {
         log_message(config, "ERROR", "Failed to open archive: %s", archive_path);
+        metrics_inc(METRIC_ERRORS_ARCHIVE);
         archive_read_free(a);
-        free(archive_hash);
-        return;
+        return 0;
     }
 
-    int file_count = 0;
-    long total_size = 0;
+    metrics_inc(METRIC_ARCHIVES_PROCESSED);
+    // Архивы разных устройств читаются одновременно - счетчик общий, только прибавляем и вычитаем
+    int64_t pending = zip_index ? (int64_t)zip_index->count : 0;
+    metrics_gauge_add(METRIC_GAUGE_ARCHIVE_ENTRIES_PENDING, pending);
 
     while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
         const char *filename = archive_entry_pathname(entry);
         la_int64_t size = archive_entry_size(entry);
+        metrics_inc(METRIC_ARCHIVE_ENTRIES);
+        if (pending > 0) {
+            metrics_gauge_add(METRIC_GAUGE_ARCHIVE_ENTRIES_PENDING, -1);
+            pending--;
+        }
 
-        if (archive_entry_filetype(entry) != AE_IFREG || size > 10485760) {
+        if (archive_entry_filetype(entry) != AE_IFREG || size > MAX_ARCHIVE_ENTRY_SIZE) {
+            if (size > MAX_ARCHIVE_ENTRY_SIZE) metrics_inc(METRIC_ARCHIVE_ENTRIES_SKIPPED_TOO_LARGE);
             archive_read_data_skip(a);
             continue;
         }
 
-        const char *ext = strrchr(filename, '.');
-        if (!ext || !is_supported_format(filename)) {
+        if (!is_supported_format(filename)) {
+            metrics_inc(METRIC_ARCHIVE_ENTRIES_SKIPPED_UNSUPPORTED);
             archive_read_data_skip(a);
             continue;
         }
 
         log_message(config, "INFO", "Found book in archive: %s/%s (size: %lld)", archive_path, filename, size);
 
-        file_count++;
-        total_size += size;
+        archive->file_count++;
+        archive->total_size += size;
 
+        // Запись, уходящая в очередь разбора, переживает арену этого потока
         size_t content_size = (size_t)size;
-        char *content = malloc(content_size + 1);
+        char *content = archive->scheduler ? malloc(content_size + 1) : arena_alloc(&book_arena, content_size + 1);
         if (!content) {
             log_message(config, "WARNING", "Failed to allocate memory for: %s", filename);
             archive_read_data_skip(a);
             continue;
         }
 
+        trace_begin("scan", "entry", filename);
+        trace_begin("io", "decompress", NULL);
         la_ssize_t bytes_read = archive_read_data(a, content, content_size);
+        trace_end();
         if (bytes_read != size) {
             log_message(config, "WARNING", "Failed to read file from archive: %s (read %zd of %lld bytes)",
                        filename, bytes_read, size);
-            free(content);
+            metrics_inc(METRIC_ERRORS_READ);
+            if (archive->scheduler) {
+                free(content);
+            } else {
+                arena_reset(&book_arena);
+            }
             archive_read_data_skip(a);
+            trace_end();
             continue;
         }
 
         content[content_size] = '\0';
+        metrics_add(METRIC_BYTES_READ, content_size);
 
-        BookMeta *meta = NULL;
-        if (strcasecmp(ext + 1, "fb2") == 0) {
-            meta = parse_fb2_from_memory(content, content_size);
+        // Для RAR/7Z контрольную сумму считаем по уже распакованному содержимому
+        char *entry_hash = NULL;
+        const ZipEntryInfo *zip_entry = zip_index_find(zip_index, filename);
+        if (zip_entry) {
+            entry_hash = format_crc32_hash(zip_entry->crc32, zip_entry->uncompressed_size);
         } else {
-            meta = calloc(1, sizeof(BookMeta));
-            if (meta) {
-                const char *base_name = strrchr(filename, '/');
-                base_name = base_name ? base_name + 1 : filename;
-                const char *dot = strrchr(base_name, '.');
-                if (dot) {
-                    meta->title = strndup(base_name, dot - base_name);
-                } else {
-                    meta->title = strdup(base_name);
-                }
-            }
+            uLong crc = crc32(0L, Z_NULL, 0);
+            crc = crc32(crc, (const Bytef*)content, (uInt)content_size);
+            entry_hash = format_crc32_hash((uint32_t)crc, content_size);
         }
 
-        free(content);
-
-        if (meta) {
-            meta->file_size = size;
-            printf("DEBUG: [ARCHIVE] File size set to: %ld for %s\n", meta->file_size, filename);
-
-            insert_book_to_db(db_handle, archive_path, meta, archive_path, filename, config);
-            free_book_meta(meta);
-        } else {
-            log_message(config, "WARNING", "Failed to parse metadata for archive file: %s/%s",
-                       archive_path, filename);
-        }
+        emit_archive_entry(archive, filename, content, content_size, entry_hash);
+        trace_end();
     }
 
+    metrics_gauge_add(METRIC_GAUGE_ARCHIVE_ENTRIES_PENDING, -pending);
     archive_read_close(a);
     archive_read_free(a);
-
-    update_archive_info(db_handle, archive_path, archive_hash, file_count, total_size, config);
-    free(archive_hash);
+    return 1;
 }
 
-int is_archive_format(const char *filename) {
-    const char *ext = strrchr(filename, '.');
-    if (!ext) return 0;
+// Последняя ссылка на архив: все записи разобраны, сведения об архиве можно записать
+static void archive_scan_release(ArchiveScan *archive) {
+    if (__atomic_sub_fetch(&archive->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
 
-    return (strcasecmp(ext, ".zip") == 0 ||
-            strcasecmp(ext, ".rar") == 0 ||
-            strcasecmp(ext, ".7z") == 0);
+    if (archive->scanned) {
+        update_archive_info(archive->db_handle, archive->path, archive->hash, archive->file_count,
+                            archive->total_size, archive->config);
+        metrics_observe(METRIC_HIST_ARCHIVE, metrics_now() - archive->started);
+    }
+    free(archive->path);
+    free(archive->hash);
+    free(archive);
 }
 
-int is_supported_format(const char *filename) {
-    if (!filename) return 0;
+static void parse_task(ScanScheduler *scheduler, void *arg, DatabaseHandle *db_handle, Config *config) {
+    (void)scheduler;
+    ParseJob *job = arg;
+
+    if (job->archive) {
+        trace_begin("scan", "entry", job->name);
+        process_archive_entry(job->archive->path, job->name, job->content, job->content_size, job->hash,
+                              db_handle, config);
+        trace_end();
+        free(job->content);
+        archive_scan_release(job->archive);
+    } else {
+        process_book_file(job->name, job->handler, job->file_size, &job->view, job->hash, db_handle, config);
+    }
+    free(job->name);
+    free(job);
+}
+
+static void scan_archive(const char *archive_path, BookFormat format, ScanScheduler *scheduler,
+                         DatabaseHandle *db_handle, Config *config) {
+    printf("DEBUG: [PROCESS_ARCHIVE] Starting: %s\n", archive_path);
+    double started = metrics_now();
+
+    // Используем алгоритм из конфигурации
+    trace_begin("io", "hash", config->scanner.hash_algorithm);
+    char *archive_hash = calculate_file_hash(archive_path, config->scanner.hash_algorithm);
+    trace_end();
+    if (!archive_hash) {
+        log_message(config, "ERROR", "Cannot calculate hash for archive: %s", archive_path);
+        metrics_inc(METRIC_ERRORS_READ);
+        return;
+    }
 
-    const char *ext = strrchr(filename, '.');
-    if (!ext) return 0;
+    printf("DEBUG: [PROCESS_ARCHIVE] Using %s hash: %s\n", config->scanner.hash_algorithm, archive_hash);
+
+    if (!archive_needs_rescan(db_handle, archive_path, archive_hash, config)) {
+        printf("DEBUG: [PROCESS_ARCHIVE] Archive doesn't need rescan: %s\n", archive_path);
+        metrics_inc(METRIC_ARCHIVES_SKIPPED_UNCHANGED);
+        free(archive_hash);
+        return;
+    }
 
-    for (int i = 0; i < SUPPORTED_FORMATS; i++) {
-        if (strcasecmp(ext, supported_formats[i]) == 0) {
-            return 1;
+    ArchiveScan *archive = calloc(1, sizeof(ArchiveScan));
+    char *path = strdup(archive_path);
+    if (!archive || !path) {
+        log_message(config, "ERROR", "Out of memory scanning archive: %s", archive_path);
+        free(archive);
+        free(path);
+        free(archive_hash);
+        return;
+    }
+    archive->path = path;
+    archive->hash = archive_hash;
+    archive->scheduler = scheduler;
+    archive->db_handle = db_handle;
+    archive->config = config;
+    archive->refs = 1;
+    archive->started = started;
+
+    printf("DEBUG: [PROCESS_ARCHIVE] Processing archive: %s\n", archive_path);
+
+    // CRC32 и размер записей ZIP берем из центрального каталога - без чтения данных
+    ZipIndex *zip_index = NULL;
+    if (format == BOOK_FORMAT_ZIP) {
+        trace_begin("io", "zip_central_directory", NULL);
+        zip_index = zip_index_load(archive_path);
+        trace_end();
+        if (!zip_index) {
+            log_message(config, "WARNING", "Cannot read ZIP central directory: %s", archive_path);
         }
     }
-    return 0;
+
+    archive->scanned = (zip_index && zip_index->count == 1 && process_single_entry_zip(archive, zip_index)) ||
+                       scan_archive_entries(archive, zip_index);
+    zip_index_free(zip_index);
+
+    archive_scan_release(archive);
+}
+
+void process_archive(const char *archive_path, BookFormat format, DatabaseHandle *db_handle, Config *config) {
+    scan_archive(archive_path, format, NULL, db_handle, config);
+}
+
+int is_archive_format(const char *filename) {
+    return format_handler(format_from_extension(filename))->is_archive;
+}
+
+int is_supported_format(const char *filename) {
+    return filename && format_from_extension(filename) != BOOK_FORMAT_UNKNOWN;
 }
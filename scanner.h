@@ -3,16 +3,17 @@
 
 #include "config.h"
 #include "database.h"
+#include "format.h"
 
-
-#define SUPPORTED_FORMATS 8
-
-extern const char *supported_formats[SUPPORTED_FORMATS];
-
+// Обход каталога. С планировщиком ([scanner] io_threads_per_device > 0) файлы читаются потоками
+// своего устройства, книги разбираются пулом потоков; функция возвращается, когда все разобрано
 void scan_directory(const char *path, DatabaseHandle *db_handle, Config *config);
 void process_file(const char *filepath, DatabaseHandle *db_handle, Config *config);
-void process_archive(const char *archive_path, DatabaseHandle *db_handle, Config *config);
+// format - ZIP, RAR или 7Z по сигнатуре (detect_format); для ZIP читается центральный каталог
+void process_archive(const char *archive_path, BookFormat format, DatabaseHandle *db_handle, Config *config);
 int is_supported_format(const char *filename);
 int is_archive_format(const char *filename);
+// Освобождает арену книг потока; зовется потоками планировщика перед выходом
+void scanner_thread_exit(void);
 
 #endif
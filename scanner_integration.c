@@ -1,6 +1,7 @@
 // scanner_integration.c
 #include "scanner_integration.h"
 #include "inpx_parser.h"
+#include "intern.h"
 #include "utils.h"
 #include <stdlib.h>
 #include <string.h>
@@ -72,7 +73,8 @@ int clear_database(DatabaseHandle *db_handle, Config *config) {
         return 0;
     }
 
-    const char *tables[] = {"books", "archives", NULL};
+    // Связи раньше словарей: в MySQL book_authors ссылается на authors
+    const char *tables[] = {"book_authors", "authors", "series", "genres", "books", "archives", NULL};
 
     for (int i = 0; tables[i]; i++) {
         char sql[256];
@@ -106,6 +108,9 @@ int clear_database(DatabaseHandle *db_handle, Config *config) {
         }
     }
 
+    // Словари пусты - запомненные id больше не существуют
+    intern_forget_db_ids();
+
     log_message(config, "INFO", "Database cleared successfully");
     return 1;
 }
@@ -0,0 +1,848 @@
+// test_formats.c - проверки определения формата по сигнатуре (format_sniff, detect_format_memory),
+// разбора заголовка MOBI с записями EXTH (parse_mobi_from_memory) и метаданных PDF
+// (parse_pdf_from_memory: таблица xref, поток xref с PNG-предиктором, ObjStm, XMP),
+// декодера base64 (векторное ядро против простого декодера), поиска обложки FB2
+// и parse_epub_from_memory (container.xml, OPF, серия calibre)
+//
+// Использование: test_formats
+// Код возврата: 0 - все проверки прошли, 1 - есть ошибки.
+#include "common.h"
+#include "arena.h"
+#include "base64.h"
+#include "epub.h"
+#include "fb2_cover.h"
+#include "format.h"
+#include "mobi.h"
+#include "pdf_meta.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <zlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static int same_string(const char *value, const char *expected) {
+    if (!value || !expected) return value == expected;
+    return strcmp(value, expected) == 0;
+}
+
+#define CHECK_STRING(value, expected) \
+    CHECK(same_string(value, expected), "%s = \"%s\", expected \"%s\"", #value, \
+          (value) ? (value) : "(null)", (expected) ? (expected) : "(null)")
+
+// Буфер для сборки тестовых файлов
+typedef struct {
+    unsigned char data[4096];
+    size_t len;
+} TestBuffer;
+
+static void put_bytes(TestBuffer *buf, const void *data, size_t len) {
+    if (buf->len + len > sizeof(buf->data)) {
+        CHECK(0, "test buffer overflow");
+        return;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void put_be16(TestBuffer *buf, uint16_t v) {
+    unsigned char b[2] = {(unsigned char)(v >> 8), (unsigned char)v};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void put_be32(TestBuffer *buf, uint32_t v) {
+    unsigned char b[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void set_be32(TestBuffer *buf, size_t offset, uint32_t v) {
+    buf->data[offset] = (unsigned char)(v >> 24);
+    buf->data[offset + 1] = (unsigned char)(v >> 16);
+    buf->data[offset + 2] = (unsigned char)(v >> 8);
+    buf->data[offset + 3] = (unsigned char)v;
+}
+
+static void put_le16(TestBuffer *buf, uint16_t v) {
+    unsigned char b[2] = {(unsigned char)v, (unsigned char)(v >> 8)};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void put_le32(TestBuffer *buf, uint32_t v) {
+    unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void put_zeros(TestBuffer *buf, size_t len) {
+    static const unsigned char zeros[256];
+    while (len > 0) {
+        size_t chunk = len > sizeof(zeros) ? sizeof(zeros) : len;
+        put_bytes(buf, zeros, chunk);
+        len -= chunk;
+    }
+}
+
+static void check_sniff(const void *head, size_t len, BookFormat expected, const char *what) {
+    BookFormat got = format_sniff(head, len);
+    CHECK(got == expected, "format_sniff(%s) = %s, expected %s", what,
+          format_handler(got)->name, format_handler(expected)->name);
+}
+
+static void test_format_sniff(void) {
+    printf("=== TEST FORMAT_SNIFF ===\n");
+
+    // Локальный заголовок ZIP с несжатой записью mimetype - EPUB по OCF
+    TestBuffer epub = {0};
+    put_bytes(&epub, "PK\x03\x04", 4);
+    put_zeros(&epub, 22);
+    put_bytes(&epub, "\x08\x00\x00\x00", 4);       // длина имени 8, extra 0
+    put_bytes(&epub, "mimetype", 8);
+    put_bytes(&epub, "application/epub+zip", 20);
+    check_sniff(epub.data, epub.len, BOOK_FORMAT_EPUB, "epub");
+    check_sniff(epub.data, epub.len - 4, BOOK_FORMAT_ZIP, "epub cut inside mimetype");
+
+    TestBuffer zip = {0};
+    put_bytes(&zip, "PK\x03\x04", 4);
+    put_zeros(&zip, 22);
+    put_bytes(&zip, "\x05\x00\x00\x00", 4);
+    put_bytes(&zip, "a.fb2", 5);
+    check_sniff(zip.data, zip.len, BOOK_FORMAT_ZIP, "zip");
+    check_sniff("PK\x05\x06\0\0\0\0", 8, BOOK_FORMAT_ZIP, "empty zip");
+
+    check_sniff("Rar!\x1a\x07\x01\x00", 8, BOOK_FORMAT_RAR, "rar5");
+    check_sniff("7z\xbc\xaf\x27\x1c\x00\x04", 8, BOOK_FORMAT_7Z, "7z");
+    check_sniff("%PDF-1.7\n", 9, BOOK_FORMAT_PDF, "pdf");
+
+    TestBuffer mobi = {0};
+    put_zeros(&mobi, 60);
+    put_bytes(&mobi, "BOOKMOBI", 8);
+    put_zeros(&mobi, 10);
+    check_sniff(mobi.data, mobi.len, BOOK_FORMAT_MOBI, "mobi");
+    check_sniff(mobi.data, 64, BOOK_FORMAT_UNKNOWN, "mobi cut before type");
+
+    const char *fb2 = "\xef\xbb\xbf\r\n  <?xml version=\"1.0\" encoding=\"windows-1251\"?>\n<FictionBook xmlns=\"\">";
+    check_sniff(fb2, strlen(fb2), BOOK_FORMAT_FB2, "fb2 with BOM");
+    check_sniff("<html><body>", 12, BOOK_FORMAT_UNKNOWN, "html");
+    check_sniff("Plain text <FictionBook", 23, BOOK_FORMAT_UNKNOWN, "text mentioning FictionBook");
+    check_sniff("PK", 2, BOOK_FORMAT_UNKNOWN, "2 bytes");
+    check_sniff(NULL, 0, BOOK_FORMAT_UNKNOWN, "NULL");
+
+    // Сигнатура важнее расширения, кроме ZIP без mimetype с расширением .epub
+    CHECK(detect_format_memory((const char*)zip.data, zip.len, "book.epub") == BOOK_FORMAT_EPUB,
+          "zip named .epub must be EPUB");
+    CHECK(detect_format_memory(fb2, strlen(fb2), "book.zip") == BOOK_FORMAT_FB2,
+          "FB2 signature must win over .zip");
+    CHECK(detect_format_memory((const char*)mobi.data, mobi.len, "book.pdf") == BOOK_FORMAT_MOBI,
+          "MOBI signature must win over .pdf");
+    CHECK(detect_format_memory("just text", 9, "notes.TXT") == BOOK_FORMAT_TXT,
+          "unknown signature falls back to the extension");
+    CHECK(detect_format_memory("just text", 9, "kindle.azw3") == BOOK_FORMAT_MOBI,
+          "azw3 extension must be MOBI");
+    CHECK(detect_format_memory("just text", 9, "archive.tar") == BOOK_FORMAT_UNKNOWN,
+          "tar is not supported");
+    CHECK(format_from_extension("noext") == BOOK_FORMAT_UNKNOWN, "no extension must be unknown");
+}
+
+typedef struct {
+    uint32_t type;
+    const char *value;
+    uint32_t length;        // 0 - по строке; иначе длина записи как есть (для битых EXTH)
+} ExthRecord;
+
+// PalmDB из двух записей: запись 0 - PalmDOC + заголовок MOBI длиной 232 байта + EXTH + полное название
+static void build_mobi(TestBuffer *buf, uint32_t encoding, uint32_t locale, const char *full_name,
+                       const ExthRecord *exth, int exth_count) {
+    memset(buf, 0, sizeof(*buf));
+    const uint32_t header_length = 232;
+    const size_t record0 = 78 + 2 * 8 + 2;
+
+    put_bytes(buf, "test-book", 9);
+    put_zeros(buf, 60 - 9);
+    put_bytes(buf, "BOOKMOBI", 8);
+    put_zeros(buf, 76 - 68);
+    put_be16(buf, 2);
+    put_be32(buf, (uint32_t)record0);
+    put_be32(buf, 0);
+    put_be32(buf, 0);               // смещение записи 1 - заполняется в конце
+    put_be32(buf, 1);
+    put_zeros(buf, 2);
+
+    // PalmDOC: без сжатия, одна запись текста
+    put_be16(buf, 1);
+    put_zeros(buf, 14);
+
+    put_bytes(buf, "MOBI", 4);
+    put_be32(buf, header_length);
+    put_zeros(buf, header_length - 8);
+    set_be32(buf, record0 + 28, encoding);
+    set_be32(buf, record0 + 92, locale);
+    set_be32(buf, record0 + 108, 0xFFFFFFFF);
+    if (exth_count > 0) set_be32(buf, record0 + 128, 0x40);
+
+    if (exth_count > 0) {
+        size_t exth_start = buf->len;
+        put_bytes(buf, "EXTH", 4);
+        put_be32(buf, 0);
+        put_be32(buf, (uint32_t)exth_count);
+        for (int i = 0; i < exth_count; i++) {
+            uint32_t len = (uint32_t)strlen(exth[i].value);
+            put_be32(buf, exth[i].type);
+            put_be32(buf, exth[i].length ? exth[i].length : len + 8);
+            put_bytes(buf, exth[i].value, len);
+        }
+        set_be32(buf, exth_start + 4, (uint32_t)(buf->len - exth_start));
+    }
+
+    size_t name = buf->len;
+    put_bytes(buf, full_name, strlen(full_name));
+    put_zeros(buf, 2);
+    set_be32(buf, record0 + 84, (uint32_t)(name - record0));
+    set_be32(buf, record0 + 88, (uint32_t)strlen(full_name));
+
+    // Запись 1 - "текст"
+    set_be32(buf, 78 + 8, (uint32_t)buf->len);
+    put_bytes(buf, "text", 4);
+}
+
+static void test_mobi_exth(void) {
+    printf("=== TEST MOBI EXTH ===\n");
+    Arena arena = {0};
+
+    const ExthRecord full[] = {
+        {100, "Лев Толстой", 0},
+        {101, "Русский вестник", 0},
+        {103, "<p>Роман &amp; эпопея</p>", 0},
+        {105, "prose_classic", 0},
+        {106, "1869-01-01T00:00:00+00:00", 0},
+        {100, "Софья Толстая", 0},
+        {503, "Война и мир", 0},
+        {524, "ru", 0}
+    };
+    TestBuffer buf;
+    build_mobi(&buf, 65001, 0x0409, "War and Peace", full, sizeof(full) / sizeof(full[0]));
+    CHECK(format_sniff((const char*)buf.data, buf.len) == BOOK_FORMAT_MOBI, "built MOBI must be sniffed as MOBI");
+
+    BookMeta *meta = parse_mobi_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(meta != NULL, "UTF-8 MOBI with EXTH must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "Война и мир");
+        CHECK_STRING(meta->author, "Лев Толстой, Софья Толстая");
+        CHECK_STRING(meta->publisher, "Русский вестник");
+        CHECK_STRING(meta->description, "Роман & эпопея");
+        CHECK_STRING(meta->genre, "prose_classic");
+        CHECK_STRING(meta->language, "ru");
+        CHECK(meta->year == 1869, "year = %d, expected 1869", meta->year);
+    }
+    arena_reset(&arena);
+
+    // Без EXTH: название из заголовка MOBI в CP1252, язык из локали
+    build_mobi(&buf, 1252, 0x040C, "Caf\xe9 de Flore", NULL, 0);
+    meta = parse_mobi_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(meta != NULL, "CP1252 MOBI without EXTH must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "Café de Flore");
+        CHECK_STRING(meta->language, "fr");
+        CHECK_STRING(meta->author, NULL);
+        CHECK(meta->year == 0, "year = %d, expected 0", meta->year);
+    }
+    arena_reset(&arena);
+
+    // Запись EXTH с длиной за концом блока: разбор останавливается, прочитанное остается
+    const ExthRecord broken[] = {
+        {100, "Иван Бунин", 0},
+        {503, "Не будет прочитано", 0xFFFF},
+        {524, "de", 0}
+    };
+    build_mobi(&buf, 65001, 0x0419, "Темные аллеи", broken, sizeof(broken) / sizeof(broken[0]));
+    meta = parse_mobi_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(meta != NULL, "MOBI with a broken EXTH record must still parse");
+    if (meta) {
+        CHECK_STRING(meta->author, "Иван Бунин");
+        CHECK_STRING(meta->title, "Темные аллеи");
+        CHECK_STRING(meta->language, "ru");
+    }
+    arena_reset(&arena);
+
+    // Обрезанный файл и PalmDOC без заголовка MOBI - не MOBI
+    CHECK(parse_mobi_from_memory((const char*)buf.data, 70, &arena) == NULL, "truncated PalmDB must fail");
+    memcpy(buf.data + 78 + 16 + 2 + 16, "TEXt", 4);
+    CHECK(parse_mobi_from_memory((const char*)buf.data, buf.len, &arena) == NULL,
+          "record 0 without MOBI header must fail");
+
+    arena_destroy(&arena);
+}
+
+// PDF, собираемый в тестах; offsets - смещения объектов для таблицы и потока xref
+typedef struct {
+    char data[65536];
+    size_t len;
+    size_t offsets[8];
+} TestPdf;
+
+static void pdf_put_raw(TestPdf *pdf, const void *data, size_t len) {
+    if (pdf->len + len > sizeof(pdf->data)) {
+        CHECK(0, "test PDF overflow");
+        return;
+    }
+    memcpy(pdf->data + pdf->len, data, len);
+    pdf->len += len;
+}
+
+static void pdf_put(TestPdf *pdf, const char *format, ...) {
+    char text[2048];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= sizeof(text)) {
+        CHECK(0, "test PDF line too long");
+        return;
+    }
+    pdf_put_raw(pdf, text, (size_t)len);
+}
+
+static void pdf_object(TestPdf *pdf, int num, const char *body) {
+    pdf->offsets[num] = pdf->len;
+    pdf_put(pdf, "%d 0 obj\n", num);
+    pdf_put_raw(pdf, body, strlen(body));
+    pdf_put(pdf, "\nendobj\n");
+}
+
+// Объект-поток без фильтра
+static void pdf_stream_object(TestPdf *pdf, int num, const char *dict, const void *data, size_t len) {
+    pdf->offsets[num] = pdf->len;
+    pdf_put(pdf, "%d 0 obj\n<< %s /Length %zu >>\nstream\n", num, dict, len);
+    pdf_put_raw(pdf, data, len);
+    pdf_put(pdf, "\nendstream\nendobj\n");
+}
+
+// Классическая таблица xref на объекты 1..count и трейлер
+static void pdf_finish_table(TestPdf *pdf, int count, const char *trailer) {
+    size_t xref = pdf->len;
+    pdf_put(pdf, "xref\n0 %d\n0000000000 65535 f \n", count + 1);
+    for (int i = 1; i <= count; i++) pdf_put(pdf, "%010zu 00000 n \n", pdf->offsets[i]);
+    pdf_put(pdf, "trailer\n");
+    pdf_put_raw(pdf, trailer, strlen(trailer));
+    pdf_put(pdf, "\nstartxref\n%zu\n%%%%EOF\n", xref);
+}
+
+// Каталог, /Info и поток XMP; xmp NULL - без /Metadata
+static void build_classic_pdf(TestPdf *pdf, const char *info, const char *xmp) {
+    memset(pdf, 0, sizeof(*pdf));
+    pdf_put(pdf, "%%PDF-1.4\n%%\xe2\xe3\xcf\xd3\n");
+    pdf_object(pdf, 1, xmp ? "<< /Type /Catalog /Lang (ru-RU) /Metadata 3 0 R >>"
+                           : "<< /Type /Catalog /Lang (ru-RU) >>");
+    pdf_object(pdf, 2, info);
+    if (xmp) pdf_stream_object(pdf, 3, "/Type /Metadata /Subtype /XML", xmp, strlen(xmp));
+    pdf_object(pdf, xmp ? 4 : 3, "(\\376\\377\\004\\040\\004\\076\\004\\074\\004\\060\\004\\075)");
+    pdf_finish_table(pdf, 4 - !xmp, xmp ? "<< /Size 5 /Root 1 0 R /Info 2 0 R >>"
+                                        : "<< /Size 4 /Root 1 0 R /Info 2 0 R >>");
+}
+
+// Объекты 1 (каталог) и 2 (/Info) лежат в потоке объектов 3, xref - поток 4 со столбцами
+// /W [1 2 1], сжатый FlateDecode с PNG-предиктором Up (/Predictor 12)
+static void build_xref_stream_pdf(TestPdf *pdf, const char *objstm_header, const char *first) {
+    memset(pdf, 0, sizeof(*pdf));
+    pdf_put(pdf, "%%PDF-1.5\n");
+
+    const char *catalog = "<< /Type /Catalog /Lang (de) >>";
+    const char *info = "<< /Title (Der Zauberberg) /Author (Thomas Mann) /CreationDate (D:19241120) >>";
+    char header[64];
+    snprintf(header, sizeof(header), objstm_header, strlen(catalog) + 1);
+    char objects[512];
+    int objects_len = snprintf(objects, sizeof(objects), "%s%s\n%s\n", header, catalog, info);
+    char dict[128];
+    if (first) {
+        snprintf(dict, sizeof(dict), "/Type /ObjStm /N 2 /First %s", first);
+    } else {
+        snprintf(dict, sizeof(dict), "/Type /ObjStm /N 2 /First %zu", strlen(header));
+    }
+    pdf_stream_object(pdf, 3, dict, objects, (size_t)objects_len);
+
+    // Строки xref: тип, поле 2 (смещение или номер потока), поле 3 (индекс в потоке)
+    size_t xref = pdf->len;
+    unsigned char rows[5][4] = {
+        {0, 0, 0, 0},
+        {2, 0, 3, 0},
+        {2, 0, 3, 1},
+        {1, (unsigned char)(pdf->offsets[3] >> 8), (unsigned char)pdf->offsets[3], 0},
+        {1, (unsigned char)(xref >> 8), (unsigned char)xref, 0}
+    };
+    unsigned char predicted[5 * 5];
+    for (int r = 0; r < 5; r++) {
+        predicted[r * 5] = 2;
+        for (int i = 0; i < 4; i++) predicted[r * 5 + 1 + i] = (unsigned char)(rows[r][i] - (r ? rows[r - 1][i] : 0));
+    }
+    unsigned char packed[256];
+    uLongf packed_len = sizeof(packed);
+    if (compress2(packed, &packed_len, predicted, sizeof(predicted), 9) != Z_OK) {
+        CHECK(0, "compress2 failed");
+        return;
+    }
+
+    pdf->offsets[4] = xref;
+    pdf_put(pdf, "4 0 obj\n<< /Type /XRef /Size 5 /W [1 2 1] /Root 1 0 R /Info 2 0 R /Filter /FlateDecode "
+                 "/DecodeParms << /Predictor 12 /Columns 4 >> /Length %lu >>\nstream\n", (unsigned long)packed_len);
+    pdf_put_raw(pdf, packed, packed_len);
+    pdf_put(pdf, "\nendstream\nendobj\nstartxref\n%zu\n%%%%EOF\n", xref);
+}
+
+static void test_pdf_meta(void) {
+    printf("=== TEST PDF META ===\n");
+    Arena arena = {0};
+    static TestPdf pdf;
+
+    // Классическая таблица: /Info со строками в PDFDocEncoding, UTF-16BE и косвенной строкой
+    build_classic_pdf(&pdf, "<< /Title (Anna Karenina \\(1878\\)) "
+                            "/Author <FEFF041B0435043200200422043E043B04410442043E0439> "
+                            "/Subject 3 0 R /CreationDate (D:18780101000000Z) >>", NULL);
+    BookMeta *meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(meta != NULL, "PDF with an xref table must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "Anna Karenina (1878)");
+        CHECK_STRING(meta->author, "Лев Толстой");
+        CHECK_STRING(meta->description, "Роман");
+        CHECK_STRING(meta->language, "ru-RU");
+        CHECK(meta->year == 1878, "year = %d, expected 1878", meta->year);
+    }
+    arena_reset(&arena);
+
+    // XMP главнее /Info; чего в XMP нет (описание), берется из /Info
+    const char *xmp =
+        "<?xpacket begin=\"\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+        "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\"><rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+        "<rdf:Description xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:calibre=\"http://calibre-ebook.com/xmp-namespace\""
+        " xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\" xmp:CreateDate=\"1925-04-10\">\n"
+        "<dc:title><rdf:Alt><rdf:li xml:lang=\"x-default\">The Great Gatsby</rdf:li></rdf:Alt></dc:title>\n"
+        "<dc:creator><rdf:Seq><rdf:li>F. Scott Fitzgerald</rdf:li><rdf:li>Max Perkins</rdf:li></rdf:Seq></dc:creator>\n"
+        "<dc:language><rdf:Bag><rdf:li>en</rdf:li></rdf:Bag></dc:language>\n"
+        "<calibre:series rdf:parseType=\"Resource\"><rdf:value>Jazz Age</rdf:value>"
+        "<calibre:series_index>2</calibre:series_index></calibre:series>\n"
+        "</rdf:Description></rdf:RDF></x:xmpmeta>\n<?xpacket end=\"w\"?>";
+    build_classic_pdf(&pdf, "<< /Title (Old title) /Author (Old author) /Subject (From Info) >>", xmp);
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(meta != NULL, "PDF with XMP must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "The Great Gatsby");
+        CHECK_STRING(meta->author, "F. Scott Fitzgerald, Max Perkins");
+        CHECK_STRING(meta->language, "en");
+        CHECK_STRING(meta->series, "Jazz Age");
+        CHECK(meta->series_number == 2, "series number = %d, expected 2", meta->series_number);
+        CHECK_STRING(meta->description, "From Info");
+        CHECK(meta->year == 1925, "year = %d, expected 1925", meta->year);
+    }
+    arena_reset(&arena);
+
+    // Поток xref с PNG-предиктором, каталог и /Info - в потоке объектов
+    build_xref_stream_pdf(&pdf, "1 0 2 %zu ", NULL);
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(meta != NULL, "PDF with an xref stream must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "Der Zauberberg");
+        CHECK_STRING(meta->author, "Thomas Mann");
+        CHECK_STRING(meta->language, "de");
+        CHECK(meta->year == 1924, "year = %d, expected 1924", meta->year);
+    }
+    arena_reset(&arena);
+
+    // Отрицательные смещения в потоке объектов: объекты не находятся, за буфер разбор не выходит
+    build_xref_stream_pdf(&pdf, "1 -5 2 -%zu ", NULL);
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(!meta || (!meta->title && !meta->author && !meta->language), "negative ObjStm offsets must be rejected");
+    arena_reset(&arena);
+    build_xref_stream_pdf(&pdf, "1 0 2 %zu ", "-1000");
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(!meta || (!meta->title && !meta->author && !meta->language), "negative /First must be rejected");
+    arena_reset(&arena);
+    build_xref_stream_pdf(&pdf, "1 0 2 %zu ", "9223372036854775000");
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(!meta || (!meta->title && !meta->author && !meta->language), "overflowing /First must be rejected");
+    arena_reset(&arena);
+
+    // Обрезанный файл (нет startxref) и не PDF
+    build_classic_pdf(&pdf, "<< /Title (Cut) >>", NULL);
+    CHECK(parse_pdf_from_memory(pdf.data, pdf.len / 2, &arena) == NULL, "truncated PDF must fail");
+    CHECK(parse_pdf_from_memory("%PDF-", 5, &arena) == NULL, "PDF header only must fail");
+    CHECK(parse_pdf_from_memory("not a pdf", 9, &arena) == NULL, "non-PDF must fail");
+    arena_reset(&arena);
+
+    // Глубокая вложенность массивов: в /Info значение обрывается, трейлер без /Root - ошибка разбора
+    static char nested[3 * 20000 + 128];
+    size_t n = (size_t)snprintf(nested, sizeof(nested), "<< /Junk ");
+    memset(nested + n, '[', 20000);
+    memset(nested + n + 20000, ']', 20000);
+    snprintf(nested + n + 40000, sizeof(nested) - n - 40000, " /Title (Deep) >>");
+    build_classic_pdf(&pdf, nested, NULL);
+    meta = parse_pdf_from_memory(pdf.data, pdf.len, &arena);
+    CHECK(meta && !meta->title, "a value nested deeper than the limit must not be skipped over");
+    arena_reset(&arena);
+
+    memset(&pdf, 0, sizeof(pdf));
+    pdf_put(&pdf, "%%PDF-1.4\n");
+    pdf_object(&pdf, 1, "<< /Type /Catalog >>");
+    n = (size_t)snprintf(nested, sizeof(nested), "<< /Size 2 /Junk ");
+    memset(nested + n, '[', 3000);
+    memset(nested + n + 3000, ']', 3000);
+    snprintf(nested + n + 6000, sizeof(nested) - n - 6000, " /Root 1 0 R >>");
+    pdf_finish_table(&pdf, 1, nested);
+    CHECK(parse_pdf_from_memory(pdf.data, pdf.len, &arena) == NULL, "a trailer nested too deep must fail");
+
+    arena_destroy(&arena);
+}
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint64_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+// Кодирование с '=' в конце; line - перевод строки через каждые line символов (0 - без переводов)
+static size_t encode_base64(const unsigned char *data, size_t len, char *out, size_t line, const char *newline) {
+    size_t o = 0, chars = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        char quad[4] = {base64_alphabet[(v >> 18) & 63], base64_alphabet[(v >> 12) & 63],
+                        i + 1 < len ? base64_alphabet[(v >> 6) & 63] : '=', i + 2 < len ? base64_alphabet[v & 63] : '='};
+        for (int k = 0; k < 4; k++) {
+            if (line && chars && chars % line == 0) {
+                memcpy(out + o, newline, strlen(newline));
+                o += strlen(newline);
+            }
+            out[o++] = quad[k];
+            chars++;
+        }
+    }
+    out[o] = '\0';
+    return o;
+}
+
+// Простой декодер по описанию в base64.h: символы вне алфавита пропускаются, '=' и '<' - конец
+static size_t reference_decode(const char *src, size_t len, unsigned char *dst) {
+    uint32_t accum = 0;
+    int quad = 0;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == '=' || src[i] == '<') break;
+        const char *pos = src[i] ? strchr(base64_alphabet, src[i]) : NULL;
+        if (!pos) continue;
+        accum = (accum << 6) | (uint32_t)(pos - base64_alphabet);
+        if (++quad == 4) {
+            dst[o++] = (unsigned char)(accum >> 16);
+            dst[o++] = (unsigned char)(accum >> 8);
+            dst[o++] = (unsigned char)accum;
+            accum = 0;
+            quad = 0;
+        }
+    }
+    if (quad == 2) dst[o++] = (unsigned char)(accum >> 4);
+    if (quad == 3) {
+        dst[o++] = (unsigned char)(accum >> 10);
+        dst[o++] = (unsigned char)(accum >> 2);
+    }
+    return o;
+}
+
+// base64_decode (векторное ядро на длинных чистых участках) против reference_decode и, если
+// задано, против исходных данных; заодно декодирование на месте
+static void check_base64(const char *src, size_t len, const unsigned char *expected, size_t expected_len,
+                         const char *what) {
+    unsigned char *got = malloc(BASE64_DECODED_MAX(len) + 1);
+    unsigned char *ref = malloc(BASE64_DECODED_MAX(len) + 1);
+    char *inplace = malloc(len + 1);
+    if (!got || !ref || !inplace) {
+        CHECK(0, "out of memory");
+        free(got);
+        free(ref);
+        free(inplace);
+        return;
+    }
+
+    size_t got_len = base64_decode(src, len, got);
+    size_t ref_len = reference_decode(src, len, ref);
+    CHECK(got_len == ref_len && memcmp(got, ref, got_len) == 0, "%s: decoder differs from the reference "
+          "(%zu vs %zu bytes)", what, got_len, ref_len);
+    if (expected) {
+        CHECK(got_len == expected_len && memcmp(got, expected, got_len) == 0, "%s: decoded %zu bytes, expected %zu",
+              what, got_len, expected_len);
+    }
+
+    memcpy(inplace, src, len);
+    size_t inplace_len = base64_decode(inplace, len, (unsigned char*)inplace);
+    CHECK(inplace_len == got_len && memcmp(inplace, got, got_len) == 0, "%s: in-place decoding differs", what);
+
+    free(got);
+    free(ref);
+    free(inplace);
+}
+
+static void test_base64(void) {
+    printf("=== TEST BASE64 ===\n");
+
+    unsigned char data[3 * 65536];
+    static char text[4 * 65536 + 4 * 65536 / 8 + 16];
+    uint64_t state = 7;
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (unsigned char)next_random(&state);
+
+    // Все длины 0..64: короткие идут только скалярным хвостом, длинные - блоками по 16 и хвостом
+    char what[64];
+    for (size_t len = 0; len <= 64; len++) {
+        size_t text_len = encode_base64(data, len, text, 0, "");
+        snprintf(what, sizeof(what), "%zu bytes", len);
+        check_base64(text, text_len, data, len, what);
+    }
+
+    size_t text_len = encode_base64(data, sizeof(data), text, 0, "");
+    check_base64(text, text_len, data, sizeof(data), "large input");
+
+    // Переводы строк и пробелы: блок с ними векторное ядро отдает скалярному пути
+    text_len = encode_base64(data, 4096, text, 76, "\r\n");
+    check_base64(text, text_len, data, 4096, "CRLF every 76 chars");
+    text_len = encode_base64(data, 4099, text, 13, " \n\t");
+    check_base64(text, text_len, data, 4099, "spaces every 13 chars");
+
+    // Дополнение '=' и '==' и остановка на '<'
+    check_base64("QQ==", 4, (const unsigned char*)"A", 1, "'==' padding");
+    check_base64("QUI=", 4, (const unsigned char*)"AB", 2, "'=' padding");
+    check_base64("QUJD", 4, (const unsigned char*)"ABC", 3, "no padding");
+    check_base64("QUJD</binary>QUJD", 17, (const unsigned char*)"ABC", 3, "stop at '<'");
+    text_len = encode_base64(data, 100, text, 0, "");
+    memcpy(text + text_len, "QUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJD", 32);
+    check_base64(text, text_len + 32, data, 100, "data after padding");
+
+    // Символы вне алфавита не декодируются как данные (пропускаются, как переводы строк),
+    // в том числе посреди 16-символьных блоков векторного ядра
+    static const char invalid[] = "!-_.:*\"#$%&'()\\^`{|}~\x01\x7f\x80\xc3\xff";
+    for (size_t k = 0; k < sizeof(invalid) - 1; k++) {
+        text_len = encode_base64(data, 600, text, 0, "");
+        size_t at = 17 + (k * 37) % (text_len - 40);
+        memmove(text + at + 1, text + at, text_len - at + 1);
+        text[at] = invalid[k];
+        snprintf(what, sizeof(what), "invalid char 0x%02x at %zu", (unsigned char)invalid[k], at);
+        check_base64(text, text_len + 1, data, 600, what);
+    }
+    // Нулевой байт внутри данных - тоже не символ алфавита
+    text_len = encode_base64(data, 300, text, 0, "");
+    memmove(text + 101, text + 100, text_len - 100);
+    text[100] = '\0';
+    check_base64(text, text_len + 1, data, 300, "NUL inside data");
+}
+
+static void test_fb2_cover(void) {
+    printf("=== TEST FB2 COVER ===\n");
+
+    unsigned char image[2000];
+    uint64_t state = 11;
+    for (size_t i = 0; i < sizeof(image); i++) image[i] = (unsigned char)next_random(&state);
+    image[0] = 0xFF;
+    image[1] = 0xD8;
+
+    static char encoded[4 * sizeof(image)];
+    encode_base64(image, sizeof(image), encoded, 76, "\n");
+    static char fb2[16384];
+    int fb2_len = snprintf(fb2, sizeof(fb2),
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<FictionBook xmlns=\"http://www.gribuser.ru/xml/fictionbook/2.0\" xmlns:l=\"http://www.w3.org/1999/xlink\">\n"
+        "<description><title-info><book-title>Обложка</book-title>\n"
+        "<coverpage><image l:href=\"#cover.jpg\"/></coverpage></title-info></description>\n"
+        "<body><p><image l:href=\"#pic1.png\"/>Текст</p></body>\n"
+        "<binary id=\"pic1.png\" content-type=\"image/png\">iVBORw0KGgo=</binary>\n"
+        "<binary content-type=\"image/jpeg\" id=\"cover.jpg\">\n%s\n</binary>\n"
+        "</FictionBook>\n", encoded);
+
+    Fb2Cover cover;
+    CHECK(fb2_find_cover(fb2, (size_t)fb2_len, &cover), "cover must be found");
+    CHECK(cover.size == sizeof(image) && memcmp(cover.data, image, sizeof(image)) == 0,
+          "cover decoded to %zu bytes, expected %zu", cover.size, sizeof(image));
+    CHECK_STRING(cover.content_type, "image/jpeg");
+    fb2_cover_free(&cover);
+
+    // На месте: данные обложки указывают внутрь документа
+    CHECK(fb2_find_cover_inplace(fb2, (size_t)fb2_len, &cover), "cover must be found in place");
+    CHECK(cover.size == sizeof(image) && memcmp(cover.data, image, sizeof(image)) == 0, "in-place cover differs");
+    CHECK((char*)cover.data > fb2 && (char*)cover.data < fb2 + fb2_len, "in-place cover must point into the document");
+    CHECK(!cover.owned, "in-place cover must not be owned");
+    fb2_cover_free(&cover);
+
+    // Ссылка на несуществующий <binary> и документ без <coverpage>
+    const char *missing = "<FictionBook><description><coverpage><image xlink:href=\"#nope.jpg\"/></coverpage>"
+                          "</description><binary id=\"cover.jpg\" content-type=\"image/jpeg\">QUJD</binary></FictionBook>";
+    CHECK(!fb2_find_cover(missing, strlen(missing), &cover), "a missing binary must not give a cover");
+    const char *no_cover = "<FictionBook><binary id=\"cover.jpg\" content-type=\"image/jpeg\">QUJD</binary></FictionBook>";
+    CHECK(!fb2_find_cover(no_cover, strlen(no_cover), &cover), "no coverpage must not give a cover");
+
+    Fb2CoverSpan span;
+    const char *xlink = "<coverpage><image xlink:href='#c'/></coverpage><binary id='c' content-type='image/png'>QUJD</binary>";
+    CHECK(fb2_locate_cover(xlink, strlen(xlink), &span) && span.base64_len == 4 &&
+          strcmp(span.content_type, "image/png") == 0, "xlink:href with single quotes must be found");
+}
+
+// Запись EPUB-архива: имя и содержимое (строка)
+typedef struct {
+    const char *name;
+    const char *content;
+} EpubEntry;
+
+// ZIP без сжатия из entries, как его пишут упаковщики EPUB (mimetype первым, stored)
+static void build_epub(TestBuffer *buf, const EpubEntry *entries, int count) {
+    size_t offsets[8];
+    memset(buf, 0, sizeof(*buf));
+
+    for (int i = 0; i < count; i++) {
+        size_t name_len = strlen(entries[i].name);
+        size_t size = strlen(entries[i].content);
+        offsets[i] = buf->len;
+        put_le32(buf, 0x04034b50);
+        put_le16(buf, 20);
+        put_le16(buf, 0);
+        put_le16(buf, 0);                          // stored
+        put_le32(buf, 0);
+        put_le32(buf, (uint32_t)crc32(0, (const Bytef*)entries[i].content, (uInt)size));
+        put_le32(buf, (uint32_t)size);
+        put_le32(buf, (uint32_t)size);
+        put_le16(buf, (uint16_t)name_len);
+        put_le16(buf, 0);
+        put_bytes(buf, entries[i].name, name_len);
+        put_bytes(buf, entries[i].content, size);
+    }
+
+    size_t cd_offset = buf->len;
+    for (int i = 0; i < count; i++) {
+        size_t name_len = strlen(entries[i].name);
+        size_t size = strlen(entries[i].content);
+        put_le32(buf, 0x02014b50);
+        put_le16(buf, 20);
+        put_le16(buf, 20);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le32(buf, 0);
+        put_le32(buf, (uint32_t)crc32(0, (const Bytef*)entries[i].content, (uInt)size));
+        put_le32(buf, (uint32_t)size);
+        put_le32(buf, (uint32_t)size);
+        put_le16(buf, (uint16_t)name_len);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le32(buf, 0);
+        put_le32(buf, (uint32_t)offsets[i]);
+        put_bytes(buf, entries[i].name, name_len);
+    }
+    size_t cd_size = buf->len - cd_offset;
+
+    put_le32(buf, 0x06054b50);
+    put_le16(buf, 0);
+    put_le16(buf, 0);
+    put_le16(buf, (uint16_t)count);
+    put_le16(buf, (uint16_t)count);
+    put_le32(buf, (uint32_t)cd_size);
+    put_le32(buf, (uint32_t)cd_offset);
+    put_le16(buf, 0);
+}
+
+static void test_epub(void) {
+    printf("=== TEST EPUB ===\n");
+    Arena arena = {0};
+    TestBuffer buf;
+
+    static const char container[] =
+        "<?xml version=\"1.0\"?>\n"
+        "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+        "<rootfiles><rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/>"
+        "</rootfiles></container>\n";
+    static const char opf[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"2.0\">\n"
+        "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:opf=\"http://www.idpf.org/2007/opf\">\n"
+        "<dc:title>Мастер и Маргарита</dc:title>\n"
+        "<dc:creator opf:role=\"aut\">Михаил Булгаков</dc:creator>\n"
+        "<dc:creator opf:role=\"edt\">Редактор</dc:creator>\n"
+        "<dc:language>ru</dc:language>\n"
+        "<dc:date opf:event=\"modification\">2020-01-01</dc:date>\n"
+        "<dc:date>1967</dc:date>\n"
+        "<meta name=\"calibre:series\" content=\"Романы &amp; повести\"/>\n"
+        "<meta name=\"calibre:series_index\" content=\"3.0\"/>\n"
+        "</metadata>\n"
+        "<manifest><item id=\"t\" href=\"text.xhtml\" media-type=\"application/xhtml+xml\"/></manifest>\n"
+        "</package>\n";
+    // Лишний OPF раньше настоящего: путь должен браться из container.xml, а не из первой записи *.opf
+    static const char decoy_opf[] =
+        "<package><metadata><dc:title>Не та книга</dc:title></metadata></package>";
+
+    const EpubEntry full[] = {
+        {"mimetype", "application/epub+zip"},
+        {"META-INF/container.xml", container},
+        {"decoy.opf", decoy_opf},
+        {"OEBPS/content.opf", opf},
+        {"OEBPS/text.xhtml", "<html><body><p>Текст</p></body></html>"}
+    };
+    build_epub(&buf, full, 5);
+    BookMeta *meta = parse_epub_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(meta != NULL, "epub must parse");
+    if (meta) {
+        CHECK_STRING(meta->title, "Мастер и Маргарита");
+        CHECK_STRING(meta->author, "Михаил Булгаков");
+        CHECK_STRING(meta->language, "ru");
+        CHECK_STRING(meta->series, "Романы & повести");
+        CHECK(meta->series_number == 3, "series_number = %d, expected 3", meta->series_number);
+        CHECK(meta->year == 1967, "year = %d, expected 1967", meta->year);
+    }
+    arena_reset(&arena);
+
+    // Без container.xml - первая запись *.opf
+    const EpubEntry no_container[] = {
+        {"mimetype", "application/epub+zip"},
+        {"OEBPS/content.opf", opf}
+    };
+    build_epub(&buf, no_container, 2);
+    meta = parse_epub_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(meta && same_string(meta->title, "Мастер и Маргарита"), "OPF must be found without container.xml");
+    arena_reset(&arena);
+
+    // container.xml указывает на отсутствующий OPF, OPF нет совсем
+    const EpubEntry missing_opf[] = {
+        {"mimetype", "application/epub+zip"},
+        {"META-INF/container.xml", container}
+    };
+    build_epub(&buf, missing_opf, 2);
+    CHECK(parse_epub_from_memory((const char*)buf.data, buf.len, &arena) == NULL, "missing OPF must fail");
+
+    // Битый OPF: незакрытые элементы не дают полей и не выводят за конец записи
+    const EpubEntry broken_opf[] = {
+        {"mimetype", "application/epub+zip"},
+        {"META-INF/container.xml", container},
+        {"OEBPS/content.opf", "<package><metadata><dc:title>Оборвано<dc:creator opf:role=\"aut"}
+    };
+    build_epub(&buf, broken_opf, 3);
+    meta = parse_epub_from_memory((const char*)buf.data, buf.len, &arena);
+    CHECK(!meta || (!meta->title && !meta->author && !meta->series), "malformed OPF must not give fields");
+    arena_reset(&arena);
+
+    // Обрезанный архив (без центрального каталога) и не ZIP
+    build_epub(&buf, full, 5);
+    CHECK(parse_epub_from_memory((const char*)buf.data, buf.len - 30, &arena) == NULL, "truncated epub must fail");
+    CHECK(parse_epub_from_memory("<?xml version=\"1.0\"?><package/>", 31, &arena) == NULL, "non-zip must fail");
+
+    arena_destroy(&arena);
+}
+
+int main(void) {
+    test_format_sniff();
+    test_mobi_exth();
+    test_pdf_meta();
+    test_base64();
+    test_fb2_cover();
+    test_epub();
+
+    printf("\nRESULT: %s (%d failure(s))\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
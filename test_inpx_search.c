@@ -98,10 +98,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Код возврата 1 - .inpx не найден (make test запускает программу на библиотеке gen_corpus)
     char *found = find_inpx_file_test(argv[1]);
-    if (found) {
-        free(found);
-    }
+    if (!found) return 1;
 
+    free(found);
     return 0;
 }
@@ -0,0 +1,356 @@
+// test_scan.c - сканирование синтетической библиотеки gen_corpus в SQLite: число книг и архивов,
+// метаданные FB2 (UTF-8 и windows-1251) против записей INPX, словари, книги без расширения
+// (формат по сигнатуре) и повторный проход
+//
+// Использование: test_scan [путь к gen_corpus, по умолчанию ./gen_corpus]
+// Код возврата: 0 - все проверки прошли, 1 - есть ошибки.
+#include "common.h"
+#include "config.h"
+#include "database.h"
+#include "scanner.h"
+#include <dirent.h>
+#include <errno.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <sqlite3.h>
+
+#define TEST_BOOKS 300
+#define TEST_PER_ZIP 100
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// Что сгенерировал gen_corpus (его итоговая строка JSON)
+typedef struct {
+    long books;
+    long zipped;
+    long archives;
+    long loose;
+    long epub;
+} CorpusStats;
+
+static int generate_corpus(const char *gen_corpus, const char *out_dir, CorpusStats *stats) {
+    char command[2 * MAX_PATH + 128];
+    snprintf(command, sizeof(command), "'%s' --out '%s' --books %d --per-zip %d --body-kb 2",
+             gen_corpus, out_dir, TEST_BOOKS, TEST_PER_ZIP);
+    FILE *p = popen(command, "r");
+    if (!p) return 0;
+
+    char line[1024] = {0};
+    int got = fgets(line, sizeof(line), p) != NULL;
+    int status = pclose(p);
+    if (!got || status != 0) return 0;
+
+    return sscanf(line, "{\"books\": %ld, \"zipped\": %ld, \"archives\": %ld, \"loose\": %ld, \"epub\": %ld",
+                  &stats->books, &stats->zipped, &stats->archives, &stats->loose, &stats->epub) == 5;
+}
+
+// Функции сканера печатают отладку в stdout - на время сканирования она уходит в /dev/null
+static int scan_library(Config *config) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null_fd < 0) return 0;
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    int ok = 0;
+    DatabaseHandle *db_handle = db_connect(config);
+    if (db_handle && create_database_tables(db_handle, config)) {
+        int bulk_load = db_begin_bulk_load(db_handle, config);
+        scan_directory(config->scanner.books_dir, db_handle, config);
+        ok = db_end_bulk_load(db_handle, bulk_load, config);
+    }
+    if (db_handle) db_close(db_handle);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return ok;
+}
+
+static long query_long(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    long value = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        value = (long)sqlite3_column_int64(stmt, 0);
+    } else {
+        printf("SQL error: %s\n  in: %s\n", sqlite3_errmsg(db), sql);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+#define CHECK_QUERY(db, expected, sql) do { \
+    long value_ = query_long(db, sql); \
+    CHECK(value_ == (long)(expected), "%s = %ld, expected %ld", sql, value_, (long)(expected)); \
+} while (0)
+
+// Поля записи INP, разделенные 0x04
+enum {
+    INP_AUTHORS, INP_GENRE, INP_TITLE, INP_SERIES, INP_SERNO, INP_FILE, INP_SIZE, INP_LIBID,
+    INP_DEL, INP_EXT, INP_DATE, INP_LANG, INP_FIELDS
+};
+
+static int split_inp_line(char *line, char **fields) {
+    int count = 0;
+    fields[count++] = line;
+    for (char *p = line; *p; p++) {
+        if (*p != '\x04') continue;
+        *p = '\0';
+        if (count < INP_FIELDS) fields[count] = p + 1;
+        count++;
+    }
+    return count >= INP_FIELDS;
+}
+
+static int same_text(const unsigned char *value, const char *expected) {
+    if (!value) return expected[0] == '\0';
+    return strcmp((const char*)value, expected) == 0;
+}
+
+// Сверяет книгу из архива zip_path с записью INP; возвращает 1, если книга найдена
+static int check_inp_record(sqlite3 *db, const char *zip_path, char **f) {
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = "SELECT title, author, genre, series, series_number, language FROM books "
+                      "WHERE archive_path = ? AND archive_internal_path = ?";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        CHECK(0, "prepare failed: %s", sqlite3_errmsg(db));
+        return 0;
+    }
+
+    char internal[64];
+    snprintf(internal, sizeof(internal), "%s.%s", f[INP_FILE], f[INP_EXT]);
+    sqlite3_bind_text(stmt, 1, zip_path, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, internal, -1, SQLITE_TRANSIENT);
+
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    CHECK(found, "%s/%s is not in the database", zip_path, internal);
+    if (found) {
+        const unsigned char *title = sqlite3_column_text(stmt, 0);
+        const unsigned char *author = sqlite3_column_text(stmt, 1);
+        const unsigned char *genre = sqlite3_column_text(stmt, 2);
+        const unsigned char *series = sqlite3_column_text(stmt, 3);
+        int series_number = sqlite3_column_int(stmt, 4);
+        const unsigned char *language = sqlite3_column_text(stmt, 5);
+
+        CHECK(same_text(title, f[INP_TITLE]), "%s: title \"%s\", expected \"%s\"", internal,
+              title ? (const char*)title : "(null)", f[INP_TITLE]);
+        CHECK(same_text(series, f[INP_SERIES]), "%s: series \"%s\", expected \"%s\"", internal,
+              series ? (const char*)series : "(null)", f[INP_SERIES]);
+        CHECK(f[INP_SERIES][0] == '\0' || series_number == atoi(f[INP_SERNO]),
+              "%s: series number %d, expected %s", internal, series_number, f[INP_SERNO]);
+        CHECK(same_text(language, f[INP_LANG]), "%s: language \"%s\", expected \"%s\"", internal,
+              language ? (const char*)language : "(null)", f[INP_LANG]);
+
+        // Жанр в INP - "код:"
+        char genre_code[64];
+        snprintf(genre_code, sizeof(genre_code), "%s", f[INP_GENRE]);
+        genre_code[strcspn(genre_code, ":")] = '\0';
+        CHECK(same_text(genre, genre_code), "%s: genre \"%s\", expected \"%s\"", internal,
+              genre ? (const char*)genre : "(null)", genre_code);
+
+        // Авторы в INP - "Фамилия,Имя,Отчество:", в базе - "Имя Фамилия" через запятую
+        char *authors = f[INP_AUTHORS];
+        char *saveptr = NULL;
+        for (char *one = strtok_r(authors, ":", &saveptr); one; one = strtok_r(NULL, ":", &saveptr)) {
+            char *first = strchr(one, ',');
+            if (!first) continue;
+            *first++ = '\0';
+            char *middle = strchr(first, ',');
+            if (middle) *middle = '\0';
+
+            char name[256];
+            snprintf(name, sizeof(name), "%s %s", first, one);
+            CHECK(author && strstr((const char*)author, name), "%s: author \"%s\" has no \"%s\"", internal,
+                  author ? (const char*)author : "(null)", name);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// Метаданные книг из ZIP сверяются с INPX, который gen_corpus пишет по тем же данным
+static long check_against_inpx(sqlite3 *db, const char *corpus_dir) {
+    char inpx_path[MAX_PATH];
+    snprintf(inpx_path, sizeof(inpx_path), "%s/synthetic.inpx", corpus_dir);
+
+    struct archive *a = archive_read_new();
+    archive_read_support_format_zip(a);
+    if (archive_read_open_filename(a, inpx_path, 10240) != ARCHIVE_OK) {
+        CHECK(0, "cannot open %s: %s", inpx_path, archive_error_string(a));
+        archive_read_free(a);
+        return 0;
+    }
+
+    long checked = 0;
+    struct archive_entry *entry;
+    while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
+        const char *name = archive_entry_pathname(entry);
+        size_t name_len = strlen(name);
+        if (name_len < 5 || strcmp(name + name_len - 4, ".inp") != 0) continue;
+
+        char zip_path[MAX_PATH];
+        snprintf(zip_path, sizeof(zip_path), "%s/%.*s.zip", corpus_dir, (int)(name_len - 4), name);
+
+        size_t size = (size_t)archive_entry_size(entry);
+        char *inp = malloc(size + 1);
+        if (!inp || archive_read_data(a, inp, size) != (la_ssize_t)size) {
+            CHECK(0, "cannot read %s", name);
+            free(inp);
+            break;
+        }
+        inp[size] = '\0';
+
+        char *saveptr = NULL;
+        for (char *line = strtok_r(inp, "\r\n", &saveptr); line; line = strtok_r(NULL, "\r\n", &saveptr)) {
+            char *fields[INP_FIELDS];
+            if (!split_inp_line(line, fields)) {
+                CHECK(0, "bad INP line in %s", name);
+                continue;
+            }
+            checked += check_inp_record(db, zip_path, fields);
+        }
+        free(inp);
+    }
+
+    archive_read_close(a);
+    archive_read_free(a);
+    return checked;
+}
+
+static void check_database(const char *db_path, const char *corpus_dir, const CorpusStats *stats, int unnamed) {
+    sqlite3 *db = NULL;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        CHECK(0, "cannot open %s", db_path);
+        sqlite3_close(db);
+        return;
+    }
+
+    CHECK_QUERY(db, stats->books, "SELECT COUNT(*) FROM books");
+    CHECK_QUERY(db, stats->zipped, "SELECT COUNT(*) FROM books WHERE archive_path IS NOT NULL");
+    CHECK_QUERY(db, stats->epub, "SELECT COUNT(*) FROM books WHERE file_type = 'epub'");
+    CHECK_QUERY(db, stats->loose - unnamed, "SELECT COUNT(*) FROM books WHERE archive_path IS NULL AND file_type = 'fb2'");
+    CHECK_QUERY(db, unnamed, "SELECT COUNT(*) FROM books WHERE archive_path IS NULL AND (file_name NOT LIKE '%.%' "
+                             "OR file_name LIKE '%.bak')");
+    CHECK_QUERY(db, stats->archives, "SELECT COUNT(*) FROM archives");
+    CHECK_QUERY(db, stats->zipped, "SELECT SUM(file_count) FROM archives");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE title IS NULL OR title = ''");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE author IS NULL OR author = ''");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE file_hash IS NULL OR file_size <= 0");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE archive_path IS NOT NULL AND file_hash NOT LIKE 'crc32:%'");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE NOT EXISTS "
+                       "(SELECT 1 FROM book_authors ba WHERE ba.book_id = books.id)");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM books WHERE genre IS NOT NULL AND genre_id IS NULL");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM authors WHERE id NOT IN (SELECT author_id FROM book_authors)");
+    CHECK_QUERY(db, 0, "SELECT COUNT(*) FROM genres WHERE name LIKE '%:%'");
+
+    long checked = check_against_inpx(db, corpus_dir);
+    CHECK(checked == stats->zipped, "%ld books checked against INPX, expected %ld", checked, stats->zipped);
+
+    sqlite3_close(db);
+}
+
+static int write_file(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return 0;
+    int ok = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+// Две отдельные FB2 теряют расширение (одна - совсем, другая получает .bak): сканер должен найти
+// их по сигнатуре. Рядом кладутся файлы, которые книгами не являются, в том числе ZIP с чужим
+// расширением - он не должен обходиться как архив. Возвращает число переименованных книг
+static int add_unnamed_files(const char *corpus_dir) {
+    char dir_path[MAX_PATH];
+    snprintf(dir_path, sizeof(dir_path), "%s/loose/000", corpus_dir);
+    DIR *dir = opendir(dir_path);
+    if (!dir) return 0;
+
+    int renamed = 0;
+    struct dirent *entry;
+    while (renamed < 2 && (entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 4 || strcmp(entry->d_name + len - 4, ".fb2") != 0) continue;
+
+        char from[2 * MAX_PATH], to[2 * MAX_PATH];
+        snprintf(from, sizeof(from), "%s/%s", dir_path, entry->d_name);
+        snprintf(to, sizeof(to), "%s/%.*s%s", dir_path, (int)(len - 4), entry->d_name, renamed ? ".bak" : "");
+        if (rename(from, to) == 0) renamed++;
+    }
+    closedir(dir);
+
+    char path[MAX_PATH + 16];
+    snprintf(path, sizeof(path), "%s/README", dir_path);
+    CHECK(write_file(path, "Not a book\n", 11), "cannot write %s", path);
+    snprintf(path, sizeof(path), "%s/cover.jpg", dir_path);
+    CHECK(write_file(path, "\xff\xd8\xff\xe0\0\x10JFIF\0", 12), "cannot write %s", path);
+    static const char empty_zip[22] = "PK\x05\x06";
+    snprintf(path, sizeof(path), "%s/notes.docx", dir_path);
+    CHECK(write_file(path, empty_zip, sizeof(empty_zip)), "cannot write %s", path);
+    return renamed;
+}
+
+static void remove_tree(const char *path) {
+    char command[MAX_PATH + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", path);
+    if (system(command) != 0) printf("WARNING: cannot remove %s\n", path);
+}
+
+int main(int argc, char *argv[]) {
+    const char *gen_corpus = argc > 1 ? argv[1] : "./gen_corpus";
+
+    printf("=== TEST SCAN GEN_CORPUS ===\n");
+    char dir[] = "/tmp/test_scan.XXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("ERROR: mkdtemp failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    char corpus_dir[MAX_PATH], db_path[MAX_PATH];
+    snprintf(corpus_dir, sizeof(corpus_dir), "%s/corpus", dir);
+    snprintf(db_path, sizeof(db_path), "%s/books.db", dir);
+
+    CorpusStats stats = {0};
+    if (!generate_corpus(gen_corpus, corpus_dir, &stats)) {
+        printf("ERROR: %s failed\n", gen_corpus);
+        remove_tree(dir);
+        return 1;
+    }
+    printf("Corpus: %ld books, %ld in %ld archives, %ld loose, %ld epub\n",
+           stats.books, stats.zipped, stats.archives, stats.loose, stats.epub);
+
+    Config *config = create_default_config();
+    if (!config) {
+        remove_tree(dir);
+        return 1;
+    }
+    config->log_stream = NULL;
+    config->database.path = strdup(db_path);
+    config->scanner.books_dir = strdup(corpus_dir);
+
+    int unnamed = add_unnamed_files(corpus_dir);
+    CHECK(unnamed == 2, "%d loose books renamed, expected 2", unnamed);
+
+    CHECK(scan_library(config), "first scan failed");
+    check_database(db_path, corpus_dir, &stats, unnamed);
+
+    // Повторный проход по неизмененной библиотеке ничего не добавляет
+    printf("=== TEST RESCAN UNCHANGED ===\n");
+    CHECK(scan_library(config), "second scan failed");
+    check_database(db_path, corpus_dir, &stats, unnamed);
+
+    free_config(config);
+    remove_tree(dir);
+
+    printf("\nRESULT: %s (%d failure(s))\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
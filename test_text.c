@@ -0,0 +1,224 @@
+// test_text.c - проверки свертки текста (fold_text), отпечатков (text_fingerprint)
+// и группировки почти-дубликатов (dedupe_cluster)
+//
+// Использование: test_text
+// Код возврата: 0 - все проверки прошли, 1 - есть ошибки.
+#include "common.h"
+#include "dedupe.h"
+#include "text_fold.h"
+#include <stdint.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static const char *vocabulary[] = {
+    "снег", "дорога", "вечер", "окно", "станция", "человек", "поезд", "дождь", "рука", "глаза",
+    "солнце", "улица", "книга", "поле", "море", "город", "ветер", "река", "небо", "ночь",
+    "сказал", "подумал", "посмотрел", "увидел", "долго", "тихо", "вдруг", "снова", "уже", "только"
+};
+#define VOCABULARY_SIZE (sizeof(vocabulary) / sizeof(vocabulary[0]))
+
+static uint64_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+// Текст из words слов словаря; decorate - теги, заглавные буквы и знаки препинания
+static char* make_text(uint64_t seed, int words, int decorate) {
+    size_t cap = (size_t)words * 48 + 64;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+
+    size_t len = 0;
+    uint64_t state = seed;
+    if (decorate) len += snprintf(text + len, cap - len, "<section><p>");
+    for (int i = 0; i < words; i++) {
+        const char *word = vocabulary[next_random(&state) % VOCABULARY_SIZE];
+        if (!decorate) {
+            len += snprintf(text + len, cap - len, "%s%s", i ? " " : "", word);
+        } else if (i % 10 == 0) {
+            // Заглавная первая буква: а-п (D0 B0-BF) -> А-П (D0 90-9F), р-я (D1 80-8F) -> Р-Я (D0 A0-AF)
+            unsigned char first = (unsigned char)word[1];
+            unsigned char upper = first >= 0xB0 && first <= 0xBF ? first - 0x20 : first + 0x20;
+            len += snprintf(text + len, cap - len, "%s%c%c%s", i ? "</p>\n<p>" : "",
+                            word[0] == '\xd1' ? '\xd0' : word[0], upper, word + 2);
+        } else {
+            len += snprintf(text + len, cap - len, i % 7 == 0 ? ", %s" : " &nbsp;%s", word);
+        }
+    }
+    if (decorate) len += snprintf(text + len, cap - len, ".</p></section>");
+    return text;
+}
+
+static int distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+static void check_fold(const char *text, const char *expected) {
+    char *folded = fold_text(text);
+    CHECK(folded && strcmp(folded, expected) == 0, "fold_text(\"%s\") = \"%s\", expected \"%s\"",
+          text, folded ? folded : "(null)", expected);
+    free(folded);
+}
+
+static void test_fold_text(void) {
+    printf("=== TEST FOLD_TEXT ===\n");
+
+    check_fold("Hello,   World!", "hello world");
+    check_fold("  «Ёлка» — ЗЕЛЁНАЯ...  ", "елка зеленая");
+    check_fold("ΣΟΦΙΑ и Sofia", "σοφια и sofia");
+    check_fold("Über Straße", "über straße");
+    check_fold("Глава 12: «Начало»", "глава 12 начало");
+    check_fold("?!...", "");
+    CHECK(fold_text(NULL) == NULL, "fold_text(NULL) must be NULL");
+
+    // Ключ поиска обрезается, текст книги - нет
+    char long_text[1024];
+    memset(long_text, 'a', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    char *folded = fold_text(long_text);
+    char *key = fold_search_key(long_text);
+    CHECK(folded && strlen(folded) == sizeof(long_text) - 1, "fold_text must keep the whole text");
+    CHECK(key && strlen(key) == FOLD_KEY_MAX_CHARS, "fold_search_key must stop at %d chars", FOLD_KEY_MAX_CHARS);
+    free(folded);
+    free(key);
+}
+
+static void test_text_fingerprint(void) {
+    printf("=== TEST TEXT_FINGERPRINT ===\n");
+
+    CHECK(text_fingerprint(NULL, 0) == 0, "NULL text must have no fingerprint");
+    const char *short_text = "Слишком мало слов для надежного отпечатка текста";
+    CHECK(text_fingerprint(short_text, strlen(short_text)) == 0, "short text must have no fingerprint");
+
+    char *plain = make_text(1, 800, 0);
+    char *decorated = make_text(1, 800, 1);
+    char *other = make_text(2, 800, 0);
+    if (!plain || !decorated || !other) {
+        CHECK(0, "out of memory");
+        free(plain);
+        free(decorated);
+        free(other);
+        return;
+    }
+
+    uint64_t fp_plain = text_fingerprint(plain, strlen(plain));
+    uint64_t fp_decorated = text_fingerprint(decorated, strlen(decorated));
+    uint64_t fp_other = text_fingerprint(other, strlen(other));
+    CHECK(fp_plain != 0, "800 words must have a fingerprint");
+    CHECK(fp_plain == fp_decorated, "markup, case and punctuation must not change the fingerprint "
+          "(%016llx vs %016llx)", (unsigned long long)fp_plain, (unsigned long long)fp_decorated);
+    CHECK(distance(fp_plain, fp_other) > DEDUPE_MAX_DISTANCE,
+          "different texts are %d bits apart", distance(fp_plain, fp_other));
+
+    // Правка одного слова - тот же текст
+    char *space = strchr(plain + strlen(plain) / 2, ' ');
+    if (space) {
+        memcpy(space + 1, "xx", 2);
+        uint64_t fp_edited = text_fingerprint(plain, strlen(plain));
+        CHECK(distance(fp_plain, fp_edited) <= DEDUPE_MAX_DISTANCE,
+              "one edited word moved the fingerprint by %d bits", distance(fp_plain, fp_edited));
+    }
+
+    // Берутся только первые DEDUPE_TEXT_BYTES байт свернутого текста
+    size_t plain_len = strlen(other);
+    char *tail = malloc(2 * DEDUPE_TEXT_BYTES + plain_len + 1);
+    if (tail) {
+        size_t len = 0;
+        while (len < DEDUPE_TEXT_BYTES + 1) {
+            memcpy(tail + len, other, plain_len);
+            len += plain_len;
+            tail[len++] = ' ';
+        }
+        tail[len] = '\0';
+        uint64_t fp_before = text_fingerprint(tail, len);
+        memcpy(tail + len, plain, strlen(plain) + 1);
+        uint64_t fp_after = text_fingerprint(tail, strlen(tail));
+        CHECK(fp_before == fp_after, "text after DEDUPE_TEXT_BYTES must not change the fingerprint");
+        free(tail);
+    }
+
+    free(plain);
+    free(decorated);
+    free(other);
+}
+
+static void test_dedupe_cluster(void) {
+    printf("=== TEST DEDUPE_CLUSTER ===\n");
+
+    const uint64_t base = 0x5DEECE66D1234567ULL;
+    const uint64_t far = 0xA3C59AC2F0F0F0F0ULL;
+    DedupeBook books[] = {
+        // Одна группа: каноническое издание - больше полей, при равенстве - меньший id
+        {10, base, 100, 3, -1},
+        {11, base ^ 0x7, 50, 5, -1},                 // 3 бита
+        {12, base ^ 0x8000000000000001ULL, 50, 5, -1},
+        // Другой текст
+        {20, ~base, 500, 9, -1},
+        // Ровно на DEDUPE_MAX_DISTANCE + 1 бит дальше - не дубликат
+        {30, far, 10, 1, -1},
+        {31, far ^ 0x1F00000000ULL, 10, 1, -1}
+    };
+    long count = sizeof(books) / sizeof(books[0]);
+
+    long duplicates = dedupe_cluster(books, count);
+    CHECK(duplicates == 2, "expected 2 duplicates, got %ld", duplicates);
+    CHECK(books[0].duplicate_of == 11, "book 10 -> %lld, expected 11", books[0].duplicate_of);
+    CHECK(books[1].duplicate_of == 0, "book 11 is canonical, got %lld", books[1].duplicate_of);
+    CHECK(books[2].duplicate_of == 11, "book 12 -> %lld, expected 11", books[2].duplicate_of);
+    CHECK(books[3].duplicate_of == 0, "book 20 -> %lld, expected 0", books[3].duplicate_of);
+    CHECK(books[4].duplicate_of == 0 && books[5].duplicate_of == 0,
+          "books 5 bits apart must not be joined (%lld, %lld)", books[4].duplicate_of, books[5].duplicate_of);
+
+    // Большой набор: у каждого случайного отпечатка копия на расстоянии 1..DEDUPE_MAX_DISTANCE.
+    // LSH обязан найти все пары, случайные отпечатки между собой не склеиваются
+    const long originals = 5000;
+    DedupeBook *many = calloc(2 * originals, sizeof(DedupeBook));
+    if (!many) {
+        CHECK(0, "out of memory");
+        return;
+    }
+    uint64_t state = 42;
+    for (long i = 0; i < originals; i++) {
+        uint64_t fp = (next_random(&state) << 32) ^ next_random(&state) ^ (next_random(&state) << 17);
+        uint64_t copy = fp;
+        int flips = 1 + (int)(i % DEDUPE_MAX_DISTANCE);
+        for (int f = 0; f < flips; f++) {
+            uint64_t bit;
+            do {
+                bit = 1ULL << (next_random(&state) % 64);
+            } while ((copy ^ fp) & bit);
+            copy ^= bit;
+        }
+        many[i] = (DedupeBook){i + 1, fp, 1000, 5, -1};
+        many[originals + i] = (DedupeBook){originals + i + 1, copy, 1000, 4, -1};
+    }
+
+    duplicates = dedupe_cluster(many, 2 * originals);
+    CHECK(duplicates == originals, "expected %ld duplicates, got %ld", originals, duplicates);
+    long wrong = 0;
+    for (long i = 0; i < originals; i++) {
+        if (many[i].duplicate_of != 0 || many[originals + i].duplicate_of != i + 1) wrong++;
+    }
+    CHECK(wrong == 0, "%ld of %ld pairs are grouped wrong", wrong, originals);
+    free(many);
+
+    CHECK(dedupe_cluster(NULL, 0) == 0, "empty input must give 0 duplicates");
+}
+
+int main(void) {
+    test_fold_text();
+    test_text_fingerprint();
+    test_dedupe_cluster();
+
+    printf("\nRESULT: %s (%d failure(s))\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
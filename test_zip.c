@@ -0,0 +1,499 @@
+// test_zip.c - проверки индекса ZIP (zip_index: ZIP64, обрезанный и битый центральный каталог)
+// и выдачи диапазонов распакованной книги через book_extract (copy_deflated, copy_stored)
+//
+// Использование: test_zip [путь к book_extract, по умолчанию ./book_extract]
+// Код возврата: 0 - все проверки прошли, 1 - есть ошибки.
+#include "common.h"
+#include "zip_index.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// Буфер для сборки архивов в памяти
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} TestBuffer;
+
+static void put_bytes(TestBuffer *buf, const void *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->len + len) cap *= 2;
+        unsigned char *grown = realloc(buf->data, cap);
+        if (!grown) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void put_le16(TestBuffer *buf, uint16_t v) {
+    unsigned char b[2] = {(unsigned char)v, (unsigned char)(v >> 8)};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void put_le32(TestBuffer *buf, uint32_t v) {
+    unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+    put_bytes(buf, b, sizeof(b));
+}
+
+static void put_le64(TestBuffer *buf, uint64_t v) {
+    put_le32(buf, (uint32_t)v);
+    put_le32(buf, (uint32_t)(v >> 32));
+}
+
+static void set_le16(TestBuffer *buf, size_t offset, uint16_t v) {
+    buf->data[offset] = (unsigned char)v;
+    buf->data[offset + 1] = (unsigned char)(v >> 8);
+}
+
+static void set_le32(TestBuffer *buf, size_t offset, uint32_t v) {
+    set_le16(buf, offset, (uint16_t)v);
+    set_le16(buf, offset + 2, (uint16_t)(v >> 16));
+}
+
+typedef struct {
+    const char *name;
+    const unsigned char *content;
+    size_t size;
+    int deflate;
+    uint64_t claimed_size;      // 0 - настоящий размер; иначе записывается в каталог вместо него
+} TestEntry;
+
+// Смещения в собранном архиве, нужные тестам обрезки
+typedef struct {
+    size_t cd_offset;
+    size_t cd_size;
+    size_t eocd_offset;
+    size_t record_offsets[8];
+} TestZipLayout;
+
+static unsigned char* deflate_raw(const unsigned char *data, size_t size, size_t *out_size) {
+    uLong bound = compressBound((uLong)size) + 64;
+    unsigned char *out = malloc(bound);
+    if (!out) return NULL;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = (uInt)size;
+    zs.next_out = out;
+    zs.avail_out = (uInt)bound;
+    int status = deflate(&zs, Z_FINISH);
+    *out_size = zs.total_out;
+    deflateEnd(&zs);
+    if (status != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// ZIP с записями entries; zip64 - размеры и смещения только в extra-полях 0x0001 и EOCD64
+static void build_zip(TestBuffer *buf, const TestEntry *entries, int count, int zip64, TestZipLayout *layout) {
+    memset(buf, 0, sizeof(*buf));
+    memset(layout, 0, sizeof(*layout));
+
+    size_t offsets[8];
+    size_t csizes[8];
+    uint32_t crcs[8];
+    for (int i = 0; i < count; i++) {
+        const TestEntry *e = &entries[i];
+        unsigned char *packed = NULL;
+        size_t csize = e->size;
+        if (e->deflate) {
+            packed = deflate_raw(e->content, e->size, &csize);
+            if (!packed) {
+                fprintf(stderr, "deflate failed\n");
+                exit(1);
+            }
+        }
+        offsets[i] = buf->len;
+        csizes[i] = csize;
+        crcs[i] = (uint32_t)crc32(0, e->content, (uInt)e->size);
+        uint64_t usize = e->claimed_size ? e->claimed_size : e->size;
+
+        put_le32(buf, 0x04034b50);
+        put_le16(buf, zip64 ? 45 : 20);
+        put_le16(buf, 0);
+        put_le16(buf, e->deflate ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED);
+        put_le32(buf, 0);
+        put_le32(buf, crcs[i]);
+        put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)csize);
+        put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)usize);
+        put_le16(buf, (uint16_t)strlen(e->name));
+        put_le16(buf, zip64 ? 20 : 0);
+        put_bytes(buf, e->name, strlen(e->name));
+        if (zip64) {
+            put_le16(buf, 0x0001);
+            put_le16(buf, 16);
+            put_le64(buf, usize);
+            put_le64(buf, csize);
+        }
+        put_bytes(buf, packed ? packed : e->content, csize);
+        free(packed);
+    }
+
+    layout->cd_offset = buf->len;
+    for (int i = 0; i < count; i++) {
+        const TestEntry *e = &entries[i];
+        uint64_t usize = e->claimed_size ? e->claimed_size : e->size;
+        layout->record_offsets[i] = buf->len;
+
+        put_le32(buf, 0x02014b50);
+        put_le16(buf, zip64 ? 45 : 20);
+        put_le16(buf, zip64 ? 45 : 20);
+        put_le16(buf, 0);
+        put_le16(buf, e->deflate ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED);
+        put_le32(buf, 0);
+        put_le32(buf, crcs[i]);
+        put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)csizes[i]);
+        put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)usize);
+        put_le16(buf, (uint16_t)strlen(e->name));
+        put_le16(buf, zip64 ? 28 : 0);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le16(buf, 0);
+        put_le32(buf, 0);
+        put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)offsets[i]);
+        put_bytes(buf, e->name, strlen(e->name));
+        if (zip64) {
+            // Порядок полей 0x0001: размер, сжатый размер, смещение
+            put_le16(buf, 0x0001);
+            put_le16(buf, 24);
+            put_le64(buf, usize);
+            put_le64(buf, csizes[i]);
+            put_le64(buf, offsets[i]);
+        }
+    }
+    layout->cd_size = buf->len - layout->cd_offset;
+
+    if (zip64) {
+        size_t eocd64 = buf->len;
+        put_le32(buf, 0x06064b50);
+        put_le64(buf, 44);
+        put_le16(buf, 45);
+        put_le16(buf, 45);
+        put_le32(buf, 0);
+        put_le32(buf, 0);
+        put_le64(buf, (uint64_t)count);
+        put_le64(buf, (uint64_t)count);
+        put_le64(buf, layout->cd_size);
+        put_le64(buf, layout->cd_offset);
+
+        put_le32(buf, 0x07064b50);
+        put_le32(buf, 0);
+        put_le64(buf, eocd64);
+        put_le32(buf, 1);
+    }
+
+    layout->eocd_offset = buf->len;
+    put_le32(buf, 0x06054b50);
+    put_le16(buf, 0);
+    put_le16(buf, 0);
+    put_le16(buf, zip64 ? 0xFFFF : (uint16_t)count);
+    put_le16(buf, zip64 ? 0xFFFF : (uint16_t)count);
+    put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)layout->cd_size);
+    put_le32(buf, zip64 ? 0xFFFFFFFF : (uint32_t)layout->cd_offset);
+    put_le16(buf, 0);
+}
+
+// Псевдослучайный текст: сжимается, но не в разы (длинные диапазоны проходят несколько блоков inflate)
+static unsigned char* make_content(size_t size, uint64_t seed) {
+    static const char *words[] = {"книга ", "глава ", "book ", "chapter ", "ночь ", "river ", "12 ", "\n"};
+    unsigned char *data = malloc(size);
+    if (!data) return NULL;
+    uint64_t state = seed;
+    size_t len = 0;
+    while (len < size) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const char *w = words[(state >> 33) % 8];
+        size_t wl = strlen(w);
+        if (wl > size - len) wl = size - len;
+        memcpy(data + len, w, wl);
+        len += wl;
+        if ((state >> 40) % 5 == 0 && len < size) data[len++] = (unsigned char)('a' + (state >> 50) % 26);
+    }
+    return data;
+}
+
+static void check_entry_content(const TestBuffer *zip, const ZipIndex *index, const char *name,
+                                const unsigned char *expected, size_t expected_size) {
+    const ZipEntryInfo *entry = zip_index_find(index, name);
+    CHECK(entry != NULL, "entry %s not found", name);
+    if (!entry) return;
+    CHECK(entry->uncompressed_size == expected_size, "%s: uncompressed_size %llu, expected %zu",
+          name, (unsigned long long)entry->uncompressed_size, expected_size);
+
+    size_t size = 0;
+    char *data = zip_entry_read_memory(zip->data, zip->len, entry, expected_size + 1, &size);
+    CHECK(data && size == expected_size && memcmp(data, expected, size) == 0, "%s: content differs", name);
+    free(data);
+}
+
+static void test_zip64(void) {
+    printf("=== TEST ZIP_INDEX ZIP64 ===\n");
+
+    unsigned char *big = make_content(200000, 1);
+    const unsigned char small[] = "stored entry";
+    TestEntry entries[] = {
+        {"b/deflated.fb2", big, 200000, 1, 0},
+        {"a/stored.txt", small, sizeof(small) - 1, 0, 0},
+        {"c.fb2", small, 6, 1, 0}
+    };
+    TestBuffer zip;
+    TestZipLayout layout;
+    build_zip(&zip, entries, 3, 1, &layout);
+
+    ZipIndex *index = zip_index_load_memory(zip.data, zip.len);
+    CHECK(index != NULL, "ZIP64 archive must load");
+    if (index) {
+        CHECK(index->count == 3, "ZIP64: %zu entries, expected 3", index->count);
+        // Записи отсортированы по имени
+        CHECK(index->count == 3 && strcmp(index->entries[0].name, "a/stored.txt") == 0 &&
+              strcmp(index->entries[2].name, "c.fb2") == 0, "ZIP64 entries are not sorted by name");
+        const ZipEntryInfo *entry = zip_index_find(index, "b/deflated.fb2");
+        CHECK(entry && entry->method == ZIP_METHOD_DEFLATED && entry->local_header_offset == 0 &&
+              entry->compressed_size < 200000, "ZIP64 extra field is not applied to b/deflated.fb2");
+        entry = zip_index_find(index, "a/stored.txt");
+        CHECK(entry && entry->method == ZIP_METHOD_STORED && entry->compressed_size == sizeof(small) - 1 &&
+              entry->local_header_offset > 0, "ZIP64 extra field is not applied to a/stored.txt");
+        check_entry_content(&zip, index, "b/deflated.fb2", big, 200000);
+        check_entry_content(&zip, index, "a/stored.txt", small, sizeof(small) - 1);
+        check_entry_content(&zip, index, "c.fb2", small, 6);
+        CHECK(zip_index_find(index, "missing.fb2") == NULL, "missing entry must not be found");
+        CHECK(zip_entry_read_memory(zip.data, zip.len, zip_index_find(index, "b/deflated.fb2"), 1000, NULL) == NULL,
+              "entry larger than max_size must not be read");
+    }
+    zip_index_free(index);
+
+    // Битая CRC: запись не читается
+    size_t crc_offset = layout.record_offsets[0] + 16;
+    zip.data[crc_offset] ^= 0xFF;
+    index = zip_index_load_memory(zip.data, zip.len);
+    const ZipEntryInfo *entry = zip_index_find(index, "b/deflated.fb2");
+    CHECK(entry && zip_entry_read_memory(zip.data, zip.len, entry, 300000, NULL) == NULL,
+          "entry with a wrong CRC32 must not be read");
+    zip_index_free(index);
+
+    free(zip.data);
+    free(big);
+}
+
+static void test_truncated_directory(void) {
+    printf("=== TEST ZIP_INDEX TRUNCATED DIRECTORY ===\n");
+
+    const unsigned char text[] = "<FictionBook>test</FictionBook>";
+    TestEntry entries[] = {
+        {"1.fb2", text, sizeof(text) - 1, 0, 0},
+        {"2.fb2", text, sizeof(text) - 1, 1, 0},
+        {"3.fb2", text, sizeof(text) - 1, 0, 0}
+    };
+    TestBuffer zip;
+    TestZipLayout layout;
+    build_zip(&zip, entries, 3, 0, &layout);
+
+    ZipIndex *index = zip_index_load_memory(zip.data, zip.len);
+    CHECK(index && index->count == 3, "intact archive must have 3 entries");
+    zip_index_free(index);
+
+    // EOCD обещает больше записей, чем помещается в каталог: число записей ограничивается
+    TestBuffer copy = {0};
+    put_bytes(&copy, zip.data, zip.len);
+    set_le16(&copy, layout.eocd_offset + 8, 60000);
+    set_le16(&copy, layout.eocd_offset + 10, 60000);
+    index = zip_index_load_memory(copy.data, copy.len);
+    CHECK(index && index->count == 3, "inflated entry count: %zu entries, expected 3", index ? index->count : 0);
+    zip_index_free(index);
+
+    // Испорченная подпись второй записи: остается то, что прочитано до нее
+    memcpy(copy.data, zip.data, zip.len);
+    set_le32(&copy, layout.record_offsets[1], 0xDEADBEEF);
+    index = zip_index_load_memory(copy.data, copy.len);
+    CHECK(index && index->count == 1 && zip_index_find(index, "1.fb2"),
+          "bad second record: %zu entries, expected 1", index ? index->count : 0);
+    zip_index_free(index);
+
+    // Имя последней записи выходит за конец каталога
+    memcpy(copy.data, zip.data, zip.len);
+    set_le16(&copy, layout.record_offsets[2] + 28, 5000);
+    index = zip_index_load_memory(copy.data, copy.len);
+    CHECK(index && index->count == 2 && !zip_index_find(index, "3.fb2"),
+          "overflowing name: %zu entries, expected 2", index ? index->count : 0);
+    zip_index_free(index);
+
+    // Каталог по EOCD заходит за конец файла
+    memcpy(copy.data, zip.data, zip.len);
+    set_le32(&copy, layout.eocd_offset + 12, (uint32_t)(layout.cd_size + 1000));
+    CHECK(zip_index_load_memory(copy.data, copy.len) == NULL, "directory past the end of file must fail");
+
+    // Файл оборван посреди каталога - EOCD нет
+    CHECK(zip_index_load_memory(zip.data, layout.cd_offset + layout.cd_size / 2) == NULL,
+          "archive cut inside the directory must fail");
+    CHECK(zip_index_load_memory(zip.data, 10) == NULL, "10-byte file must fail");
+
+    // EOCD64 с неверной подписью: используется обычный EOCD
+    TestBuffer zip64;
+    TestZipLayout layout64;
+    build_zip(&zip64, entries, 3, 1, &layout64);
+    set_le32(&zip64, layout64.cd_offset + layout64.cd_size, 0);
+    CHECK(zip_index_load_memory(zip64.data, zip64.len) == NULL,
+          "ZIP64 archive with a broken EOCD64 must fail, not read 0xFFFFFFFF offsets");
+
+    free(zip64.data);
+    free(copy.data);
+    free(zip.data);
+}
+
+static int write_file(const char *path, const void *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return 0;
+    int ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+// Запускает book_extract, вывод - в out (malloc). Возвращает код возврата или -1
+static int run_extract(const char *extract, const char *range, const char *archive, const char *name,
+                       const char *out_path, unsigned char **out, size_t *out_size) {
+    char command[4096];
+    snprintf(command, sizeof(command), "'%s' %s%s '%s' '%s' > '%s' 2>/dev/null", extract,
+             range ? "--range=" : "", range ? range : "", archive, name, out_path);
+    int status = system(command);
+    if (status == -1 || !WIFEXITED(status)) return -1;
+
+    *out = NULL;
+    *out_size = 0;
+    FILE *f = fopen(out_path, "rb");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        *out = malloc(size > 0 ? (size_t)size : 1);
+        if (*out && size > 0) *out_size = fread(*out, 1, (size_t)size, f);
+        fclose(f);
+    }
+    return WEXITSTATUS(status);
+}
+
+static void check_range(const char *extract, const char *archive, const char *out_path, const char *name,
+                        const unsigned char *content, const char *range, size_t start, size_t length) {
+    unsigned char *out = NULL;
+    size_t out_size = 0;
+    int rc = run_extract(extract, range, archive, name, out_path, &out, &out_size);
+    CHECK(rc == 0, "%s %s: exit code %d", name, range ? range : "(whole)", rc);
+    CHECK(out && out_size == length && (length == 0 || memcmp(out, content + start, length) == 0),
+          "%s %s: got %zu bytes, expected %zu from offset %zu", name, range ? range : "(whole)",
+          out_size, length, start);
+    free(out);
+}
+
+static void test_extract_ranges(const char *extract) {
+    printf("=== TEST BOOK_EXTRACT RANGES ===\n");
+
+    if (access(extract, X_OK) != 0) {
+        CHECK(0, "%s is not built", extract);
+        return;
+    }
+
+    char dir[] = "/tmp/test_zip.XXXXXX";
+    if (!mkdtemp(dir)) {
+        CHECK(0, "mkdtemp failed: %s", strerror(errno));
+        return;
+    }
+    char archive[256], out_path[256];
+    snprintf(archive, sizeof(archive), "%s/books.zip", dir);
+    snprintf(out_path, sizeof(out_path), "%s/out", dir);
+
+    // Больше нескольких буферов book_extract (64 КБ), чтобы диапазоны пересекали их границы
+    const size_t size = 300007;
+    unsigned char *content = make_content(size, 7);
+    TestEntry entries[] = {
+        {"deflated.fb2", content, size, 1, 0},
+        {"stored.fb2", content, size, 0, 0},
+        // Каталог обещает на 1000 байт больше, чем есть в потоке deflate
+        {"short.fb2", content, 5000, 1, 6000}
+    };
+    TestBuffer zip;
+    TestZipLayout layout;
+    build_zip(&zip, entries, 3, 0, &layout);
+    if (!content || !write_file(archive, zip.data, zip.len)) {
+        CHECK(0, "cannot write %s", archive);
+        free(content);
+        free(zip.data);
+        return;
+    }
+
+    const char *names[] = {"deflated.fb2", "stored.fb2"};
+    for (int i = 0; i < 2; i++) {
+        const char *name = names[i];
+        check_range(extract, archive, out_path, name, content, NULL, 0, size);
+        check_range(extract, archive, out_path, name, content, "bytes=0-0", 0, 1);
+        check_range(extract, archive, out_path, name, content, "bytes=65530-65545", 65530, 16);
+        check_range(extract, archive, out_path, name, content, "bytes=100000-231071", 100000, 131072);
+        check_range(extract, archive, out_path, name, content, "bytes=300000-", 300000, 7);
+        check_range(extract, archive, out_path, name, content, "bytes=299000-999999", 299000, 1007);
+        check_range(extract, archive, out_path, name, content, "bytes=-70000", size - 70000, 70000);
+        check_range(extract, archive, out_path, name, content, "bytes=-999999", 0, size);
+
+        unsigned char *out = NULL;
+        size_t out_size = 0;
+        int rc = run_extract(extract, "bytes=300007-", archive, name, out_path, &out, &out_size);
+        CHECK(rc == 3 && out_size == 0, "%s: range past the end: exit code %d, %zu bytes", name, rc, out_size);
+        free(out);
+        rc = run_extract(extract, "bytes=10-5", archive, name, out_path, &out, &out_size);
+        CHECK(rc == 3, "%s: reversed range: exit code %d", name, rc);
+        free(out);
+    }
+
+    // Поток deflate кончается раньше заявленного размера: ошибка, а не молча обрезанный ответ
+    unsigned char *out = NULL;
+    size_t out_size = 0;
+    int rc = run_extract(extract, "bytes=4000-5999", archive, "short.fb2", out_path, &out, &out_size);
+    CHECK(rc == 4, "short deflate stream: exit code %d, expected 4", rc);
+    free(out);
+    rc = run_extract(extract, "bytes=0-4999", archive, "short.fb2", out_path, &out, &out_size);
+    CHECK(rc == 0 && out_size == 5000 && memcmp(out, content, 5000) == 0,
+          "range inside a short deflate stream: exit code %d, %zu bytes", rc, out_size);
+    free(out);
+    rc = run_extract(extract, NULL, archive, "missing.fb2", out_path, &out, &out_size);
+    CHECK(rc == 2, "missing entry: exit code %d, expected 2", rc);
+    free(out);
+
+    unlink(out_path);
+    unlink(archive);
+    rmdir(dir);
+    free(content);
+    free(zip.data);
+}
+
+int main(int argc, char *argv[]) {
+    const char *extract = argc > 1 ? argv[1] : "./book_extract";
+
+    test_zip64();
+    test_truncated_directory();
+    test_extract_ranges(extract);
+
+    printf("\nRESULT: %s (%d failure(s))\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
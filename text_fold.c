@@ -0,0 +1,189 @@
+// text_fold.c - табличное приведение UTF-8 строк к ключам поиска и сортировки
+#include "text_fold.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FOLD_SEPARATOR 0x0000   // знак препинания или пробел - заменяется одним пробелом
+#define FOLD_DROP      0xFFFF   // комбинируемые знаки и служебные символы - удаляются
+
+// Таблица для всех кодовых точек, представимых 1-2 байтами UTF-8 (U+0000..U+07FF)
+static uint16_t fold_table[0x800];
+static pthread_once_t fold_table_once = PTHREAD_ONCE_INIT;
+
+// Пары "заглавная, строчная" идут подряд: заглавная на четной (или нечетной) позиции
+static void fold_pairs(uint32_t first, uint32_t last, int upper_is_even) {
+    for (uint32_t cp = first; cp <= last; cp++) {
+        if ((cp % 2 == 0) == (upper_is_even != 0)) {
+            fold_table[cp] = (uint16_t)(cp + 1);
+        }
+    }
+}
+
+static void build_fold_table(void) {
+    for (uint32_t cp = 0; cp < 0x800; cp++) {
+        fold_table[cp] = (uint16_t)cp;
+    }
+
+    // ASCII: остаются только буквы и цифры
+    for (uint32_t cp = 0; cp < 0x80; cp++) {
+        if (cp >= 'A' && cp <= 'Z') fold_table[cp] = (uint16_t)(cp + 0x20);
+        else if (!((cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9'))) fold_table[cp] = FOLD_SEPARATOR;
+    }
+
+    // Latin-1: управляющие символы, NBSP, кавычки-елочки, знаки
+    for (uint32_t cp = 0x80; cp < 0xC0; cp++) fold_table[cp] = FOLD_SEPARATOR;
+    for (uint32_t cp = 0xC0; cp <= 0xDE; cp++) fold_table[cp] = (uint16_t)(cp + 0x20);
+    fold_table[0xD7] = FOLD_SEPARATOR;   // ×
+    fold_table[0xF7] = FOLD_SEPARATOR;   // ÷
+
+    // Latin Extended-A
+    fold_pairs(0x100, 0x137, 1);
+    fold_pairs(0x139, 0x148, 0);
+    fold_pairs(0x14A, 0x177, 1);
+    fold_table[0x178] = 0xFF;            // Ÿ
+    fold_pairs(0x179, 0x17E, 0);
+
+    // Модификаторы и комбинируемые диакритические знаки
+    for (uint32_t cp = 0x2B0; cp < 0x370; cp++) fold_table[cp] = FOLD_DROP;
+
+    // Греческий
+    fold_table[0x386] = 0x3AC;
+    for (uint32_t cp = 0x388; cp <= 0x38A; cp++) fold_table[cp] = (uint16_t)(cp + 0x25);
+    fold_table[0x38C] = 0x3CC;
+    fold_table[0x38E] = 0x3CD;
+    fold_table[0x38F] = 0x3CE;
+    for (uint32_t cp = 0x391; cp <= 0x3AB; cp++) {
+        if (cp != 0x3A2) fold_table[cp] = (uint16_t)(cp + 0x20);
+    }
+
+    // Кириллица: Ѐ..Џ, А..Я и исторические буквы парами
+    for (uint32_t cp = 0x400; cp <= 0x40F; cp++) fold_table[cp] = (uint16_t)(cp + 0x50);
+    for (uint32_t cp = 0x410; cp <= 0x42F; cp++) fold_table[cp] = (uint16_t)(cp + 0x20);
+    fold_pairs(0x460, 0x481, 1);
+    for (uint32_t cp = 0x482; cp <= 0x489; cp++) fold_table[cp] = FOLD_DROP;
+    fold_pairs(0x48A, 0x4BF, 1);
+    fold_table[0x4C0] = 0x4CF;
+    fold_pairs(0x4C1, 0x4CE, 0);
+    fold_pairs(0x4D0, 0x52F, 1);
+
+    // Ё и ё сводятся к е
+    fold_table[0x401] = 0x435;
+    fold_table[0x451] = 0x435;
+
+    // Армянский
+    for (uint32_t cp = 0x531; cp <= 0x556; cp++) fold_table[cp] = (uint16_t)(cp + 0x30);
+}
+
+// Класс кодовой точки вне таблицы (3-4 байта UTF-8)
+static uint32_t fold_wide(uint32_t cp) {
+    if ((cp >= 0x200B && cp <= 0x200F) || cp == 0x2060 || cp == 0xFEFF) return FOLD_DROP;
+    if (cp >= 0xFE00 && cp <= 0xFE0F) return FOLD_DROP;                // селекторы вариантов
+    if (cp >= 0x2000 && cp <= 0x2BFF) return FOLD_SEPARATOR;           // пунктуация, символы, стрелки
+    if (cp >= 0x3000 && cp <= 0x303F) return FOLD_SEPARATOR;           // пунктуация CJK
+    if (cp >= 0x1F000 && cp <= 0x1FAFF) return FOLD_SEPARATOR;         // эмодзи
+    return cp;
+}
+
+// Декодирует один символ UTF-8; при ошибке возвращает FOLD_DROP и пропускает байт
+static uint32_t decode_utf8(const unsigned char **p) {
+    const unsigned char *s = *p;
+    uint32_t cp;
+    int extra;
+
+    if (s[0] < 0x80) {
+        *p = s + 1;
+        return s[0];
+    } else if ((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F;
+        extra = 1;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F;
+        extra = 2;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07;
+        extra = 3;
+    } else {
+        *p = s + 1;
+        return FOLD_DROP;
+    }
+
+    for (int i = 1; i <= extra; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *p = s + 1;
+            return FOLD_DROP;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    *p = s + extra + 1;
+    return cp;
+}
+
+static char* encode_utf8(char *out, uint32_t cp) {
+    if (cp < 0x80) {
+        *out++ = (char)cp;
+    } else if (cp < 0x800) {
+        *out++ = (char)(0xC0 | (cp >> 6));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+// Свертка не длиннее max_chars символов (0 - без ограничения)
+static char* fold_utf8(const char *text, size_t max_chars) {
+    if (!text) return NULL;
+    pthread_once(&fold_table_once, build_fold_table);
+
+    // Свертка никогда не удлиняет строку в байтах: все замены той же или меньшей длины
+    size_t len = strlen(text);
+    char *key = malloc(len + 1);
+    if (!key) return NULL;
+    if (max_chars == 0) max_chars = len;
+
+    const unsigned char *p = (const unsigned char*)text;
+    char *out = key;
+    int pending_space = 0;
+    size_t chars = 0;
+
+    while (*p && chars < max_chars) {
+        uint32_t cp = decode_utf8(&p);
+        uint32_t folded = cp < 0x800 ? fold_table[cp] : fold_wide(cp);
+
+        if (folded == FOLD_DROP) continue;
+        if (folded == FOLD_SEPARATOR) {
+            pending_space = (out != key);
+            continue;
+        }
+
+        if (pending_space) {
+            *out++ = ' ';
+            chars++;
+            pending_space = 0;
+            if (chars >= max_chars) break;
+        }
+        out = encode_utf8(out, folded);
+        chars++;
+    }
+
+    *out = '\0';
+    return key;
+}
+
+char* fold_search_key(const char *text) {
+    return fold_utf8(text, FOLD_KEY_MAX_CHARS);
+}
+
+char* fold_text(const char *text) {
+    return fold_utf8(text, 0);
+}
@@ -0,0 +1,25 @@
+#ifndef TEXT_FOLD_H
+#define TEXT_FOLD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Максимальная длина ключа в символах (колонки *_key в MySQL - VARCHAR(255))
+#define FOLD_KEY_MAX_CHARS 255
+
+// Верхняя граница диапазона для поиска по префиксу: key >= prefix AND key < prefix || FOLD_KEY_RANGE_END
+#define FOLD_KEY_RANGE_END "\xF4\x8F\xBF\xBF"
+
+// Ключ для поиска и сортировки: нижний регистр (латиница, кириллица, греческий),
+// ё -> е, знаки препинания и пробелы схлопываются в один пробел, края обрезаются.
+// Возвращает новую строку (освобождать через free) или NULL, если text == NULL.
+char* fold_search_key(const char *text);
+// То же без ограничения длины - для текста книги (отпечатки содержимого)
+char* fold_text(const char *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+// trace.c - интервалы сканирования в формате Chrome trace events
+#include "common.h"
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define TRACE_BUFFER_EVENTS 4096
+#define TRACE_POOL_SIZE (64 * 1024)
+#define TRACE_DETAIL_MAX 512
+#define TRACE_NO_DETAIL UINT32_MAX
+
+typedef struct {
+    uint64_t ts_ns;
+    const char *category;
+    const char *name;
+    uint32_t detail;        // смещение в pool или TRACE_NO_DETAIL
+    char phase;             // 'B' или 'E'
+} TraceEvent;
+
+// Буфер потока: события копятся без блокировок и сбрасываются в файл целиком
+typedef struct TraceBuffer {
+    int tid;
+    int count;
+    size_t pool_used;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    char pool[TRACE_POOL_SIZE];
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file = NULL;
+static char trace_path[MAX_PATH];
+static int trace_active = 0;
+static int trace_generation = 0;
+static int trace_first_event = 1;
+static int trace_next_tid = 1;
+static uint64_t trace_started_ns = 0;
+static TraceBuffer *trace_buffers = NULL;
+
+static __thread TraceBuffer *thread_buffer = NULL;
+static __thread int thread_generation = 0;   // буфер потока принадлежит этой трассе
+
+static uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Строка JSON: кавычки, обратная косая и управляющие символы экранируются,
+// байты вне корректного UTF-8 (имена в cp1251 внутри архивов) выводятся как \u00XX
+static void write_json_string(FILE *out, const char *s) {
+    const unsigned char *p = (const unsigned char*)s;
+    fputc('"', out);
+    while (*p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p++, out);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p++);
+        } else if (*p < 0x80) {
+            fputc(*p++, out);
+        } else {
+            int len = (*p & 0xE0) == 0xC0 ? 2 : (*p & 0xF0) == 0xE0 ? 3 : (*p & 0xF8) == 0xF0 ? 4 : 0;
+            int valid = len > 0;
+            for (int i = 1; valid && i < len; i++) {
+                if ((p[i] & 0xC0) != 0x80) valid = 0;
+            }
+            if (valid) {
+                fwrite(p, 1, len, out);
+                p += len;
+            } else {
+                fprintf(out, "\\u%04x", *p++);
+            }
+        }
+    }
+    fputc('"', out);
+}
+
+// Вызывается под trace_mutex
+static void write_separator(void) {
+    if (!trace_first_event) fputs(",\n", trace_file);
+    trace_first_event = 0;
+}
+
+static void write_thread_name(int tid) {
+    char name[32];
+    if (tid == 1) {
+        snprintf(name, sizeof(name), "main");
+    } else {
+        snprintf(name, sizeof(name), "worker-%d", tid - 1);
+    }
+    write_separator();
+    fprintf(trace_file, "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+            (int)getpid(), tid, name);
+}
+
+// Вызывается под trace_mutex
+static void flush_buffer(TraceBuffer *buffer) {
+    if (trace_file) {
+        int pid = (int)getpid();
+        for (int i = 0; i < buffer->count; i++) {
+            TraceEvent *event = &buffer->events[i];
+            double ts_us = (double)(event->ts_ns - trace_started_ns) / 1000.0;
+
+            write_separator();
+            if (event->phase == 'B') {
+                fprintf(trace_file, "{\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"cat\":\"%s\",\"name\":\"%s\"",
+                        pid, buffer->tid, ts_us, event->category, event->name);
+                if (event->detail != TRACE_NO_DETAIL) {
+                    fputs(",\"args\":{\"detail\":", trace_file);
+                    write_json_string(trace_file, buffer->pool + event->detail);
+                    fputc('}', trace_file);
+                }
+                fputc('}', trace_file);
+            } else {
+                fprintf(trace_file, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}", pid, buffer->tid, ts_us);
+            }
+        }
+    }
+    buffer->count = 0;
+    buffer->pool_used = 0;
+}
+
+static TraceBuffer* get_thread_buffer(void) {
+    int generation = __atomic_load_n(&trace_generation, __ATOMIC_ACQUIRE);
+    if (thread_buffer && thread_generation == generation) {
+        return thread_buffer;
+    }
+
+    // Первое событие потока (или потока, пережившего предыдущий trace_close)
+    TraceBuffer *buffer = malloc(sizeof(TraceBuffer));
+    if (!buffer) return NULL;
+    buffer->count = 0;
+    buffer->pool_used = 0;
+
+    pthread_mutex_lock(&trace_mutex);
+    if (!trace_file) {
+        pthread_mutex_unlock(&trace_mutex);
+        free(buffer);
+        return NULL;
+    }
+    buffer->tid = trace_next_tid++;
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+    write_thread_name(buffer->tid);
+    pthread_mutex_unlock(&trace_mutex);
+
+    thread_buffer = buffer;
+    thread_generation = generation;
+    return buffer;
+}
+
+static void trace_record(char phase, const char *category, const char *name, const char *detail) {
+    TraceBuffer *buffer = get_thread_buffer();
+    if (!buffer) return;
+
+    size_t detail_len = detail ? strnlen(detail, TRACE_DETAIL_MAX) : 0;
+    if (buffer->count == TRACE_BUFFER_EVENTS ||
+        (detail && buffer->pool_used + detail_len + 1 > TRACE_POOL_SIZE)) {
+        pthread_mutex_lock(&trace_mutex);
+        flush_buffer(buffer);
+        pthread_mutex_unlock(&trace_mutex);
+    }
+
+    TraceEvent *event = &buffer->events[buffer->count++];
+    event->ts_ns = trace_now_ns();
+    event->category = category;
+    event->name = name;
+    event->phase = phase;
+    event->detail = TRACE_NO_DETAIL;
+    if (detail) {
+        memcpy(buffer->pool + buffer->pool_used, detail, detail_len);
+        buffer->pool[buffer->pool_used + detail_len] = '\0';
+        event->detail = (uint32_t)buffer->pool_used;
+        buffer->pool_used += detail_len + 1;
+    }
+}
+
+int trace_open(const char *path) {
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_file) {
+        pthread_mutex_unlock(&trace_mutex);
+        return 0;
+    }
+
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        pthread_mutex_unlock(&trace_mutex);
+        fprintf(stderr, "Cannot open trace file %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+
+    trace_started_ns = trace_now_ns();
+    trace_first_event = 1;
+    trace_next_tid = 1;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", trace_file);
+    write_separator();
+    fprintf(trace_file, "{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"book_scanner\"}}",
+            (int)getpid());
+
+    __atomic_add_fetch(&trace_generation, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_mutex);
+    return 1;
+}
+
+int trace_close(void) {
+    pthread_mutex_lock(&trace_mutex);
+    if (!trace_file) {
+        pthread_mutex_unlock(&trace_mutex);
+        return 0;
+    }
+    __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+
+    // Незакрытые интервалы (выход по ошибке) viewer дорисует до конца трассы
+    TraceBuffer *buffer = trace_buffers;
+    while (buffer) {
+        TraceBuffer *next = buffer->next;
+        flush_buffer(buffer);
+        free(buffer);
+        buffer = next;
+    }
+    trace_buffers = NULL;
+    thread_buffer = NULL;
+
+    fputs("\n]}\n", trace_file);
+    int ok = fclose(trace_file) == 0;
+    trace_file = NULL;
+    if (!ok) {
+        fprintf(stderr, "Cannot write trace file %s: %s\n", trace_path, strerror(errno));
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    return ok;
+}
+
+void trace_begin(const char *category, const char *name, const char *detail) {
+    if (!__atomic_load_n(&trace_active, __ATOMIC_RELAXED)) return;
+    trace_record('B', category, name, detail);
+}
+
+void trace_end(void) {
+    if (!__atomic_load_n(&trace_active, __ATOMIC_RELAXED)) return;
+    trace_record('E', NULL, NULL, NULL);
+}
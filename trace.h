@@ -0,0 +1,18 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Трассировка сканирования в формате Chrome trace events (chrome://tracing, Perfetto).
+// Пока trace_open не вызван, trace_begin/trace_end сводятся к проверке одного флага
+
+// Открывает файл трассировки; 1 - успех, 0 - ошибка
+int trace_open(const char *path);
+// Дописывает буферы всех потоков и закрывает JSON
+int trace_close(void);
+
+// Начало и конец вложенного интервала в текущем потоке.
+// category и name должны быть строковыми литералами - сохраняется только указатель,
+// detail (путь, имя записи, SQL) копируется и может быть NULL
+void trace_begin(const char *category, const char *name, const char *detail);
+void trace_end(void);
+
+#endif
@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <openssl/sha.h>
@@ -13,6 +14,29 @@
 #include <stdio.h>
 
 char* read_file_content(const char *filepath) {
+    char *content = malloc(FILE_HEAD_SIZE + 1);
+    if (!content) return NULL;
+
+    if (read_file_head(filepath, content, FILE_HEAD_SIZE) < 0) {
+        free(content);
+        return NULL;
+    }
+    return content;
+}
+
+long read_file_head(const char *filepath, char *buffer, size_t capacity) {
+    FILE *file = fopen(filepath, "rb");
+    if (!file) return -1;
+
+    size_t bytes_read = fread(buffer, 1, capacity, file);
+    buffer[bytes_read] = '\0';
+    fclose(file);
+
+    return (long)bytes_read;
+}
+
+// Читает файл целиком (для стадий, которым нужен весь FB2, например обложки в конце файла)
+char* read_file_full(const char *filepath, size_t *size_out) {
     FILE *file = fopen(filepath, "rb");
     if (!file) return NULL;
 
@@ -20,20 +44,102 @@ char* read_file_content(const char *filepath) {
     long file_size = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    long read_size = file_size > 65536 ? 65536 : file_size;
-    char *content = malloc(read_size + 1);
+    if (file_size < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    char *content = malloc((size_t)file_size + 1);
     if (!content) {
         fclose(file);
         return NULL;
     }
 
-    size_t bytes_read = fread(content, 1, read_size, file);
+    size_t bytes_read = fread(content, 1, (size_t)file_size, file);
     content[bytes_read] = '\0';
     fclose(file);
 
+    if (size_out) *size_out = bytes_read;
     return content;
 }
 
+// Резервирует анонимную память на len + 1 байт и накладывает на ее начало len байт файла.
+// Хвост резерва остается анонимной нулевой страницей - это и есть завершающий ноль
+static char* map_file_window(int fd, size_t len, size_t *map_len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t reserve = (len + 1 + page - 1) / page * page;
+
+    char *base = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+
+    if (len > 0 &&
+        mmap(base, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, reserve);
+        return NULL;
+    }
+    if (len > 0) madvise(base, len, MADV_SEQUENTIAL);
+
+    *map_len = reserve;
+    return base;
+}
+
+int file_view_open(const char *filepath, const char *end_marker, FileView *view) {
+    memset(view, 0, sizeof(FileView));
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 0) {
+        close(fd);
+        return 0;
+    }
+    view->file_size = (size_t)st.st_size;
+
+    size_t marker_len = end_marker ? strlen(end_marker) : 0;
+    size_t window = end_marker && view->file_size > FILE_HEAD_SIZE ? FILE_HEAD_SIZE : view->file_size;
+    size_t searched = 0;
+
+    while (1) {
+        char *data = map_file_window(fd, window, &view->map_len);
+        if (!data) break;
+
+        const char *found = NULL;
+        if (end_marker && window > searched) {
+            found = memmem(data + searched, window - searched, end_marker, marker_len);
+        }
+        if (found || !end_marker || window == view->file_size) {
+            view->data = data;
+            view->size = found ? (size_t)(found - data) + marker_len : window;
+            // Ноль после маркера копирует одну страницу, остальное остается отображением файла
+            if (view->size < window) view->data[view->size] = '\0';
+            close(fd);
+            return 1;
+        }
+
+        // Маркер мог начаться в конце окна - следующий поиск начинаем с перекрытием
+        munmap(data, view->map_len);
+        searched = window >= marker_len ? window - marker_len + 1 : 0;
+        window = window * 2 < view->file_size ? window * 2 : view->file_size;
+    }
+    close(fd);
+
+    // mmap не поддерживается (например, некоторыми FUSE) - читаем файл обычным способом
+    view->map_len = 0;
+    view->data = read_file_full(filepath, &view->size);
+    return view->data != NULL;
+}
+
+void file_view_close(FileView *view) {
+    if (!view->data) return;
+    if (view->map_len) {
+        munmap(view->data, view->map_len);
+    } else {
+        free(view->data);
+    }
+    view->data = NULL;
+}
+
 void trim_string(char *str) {
     if (!str) return;
 
@@ -131,32 +237,37 @@ int detect_encoding(const char *text) {
     return 2;
 }
 
-char* clean_html_tags(const char *html) {
-    if (!html) return NULL;
-
-    size_t len = strlen(html);
-    char *result = malloc(len + 1);
-    if (!result) return NULL;
+void strip_html_tags(char *str) {
+    if (!str) return;
 
-    char *dest = result;
+    char *dest = str;
     int in_tag = 0;
 
-    for (size_t i = 0; i < len; i++) {
-        if (html[i] == '<') {
+    for (const char *src = str; *src; src++) {
+        if (*src == '<') {
             in_tag = 1;
             continue;
         }
-        if (html[i] == '>') {
+        if (*src == '>') {
             in_tag = 0;
             continue;
         }
         if (!in_tag) {
-            *dest++ = html[i];
+            *dest++ = *src;
         }
     }
     *dest = '\0';
 
-    trim_string(result);
+    trim_string(str);
+}
+
+char* clean_html_tags(const char *html) {
+    if (!html) return NULL;
+
+    char *result = strdup(html);
+    if (!result) return NULL;
+
+    strip_html_tags(result);
 
     if (strlen(result) == 0) {
         free(result);
@@ -186,6 +297,44 @@ int is_already_running(const char *lockfile_path) {
     return 0;
 }
 
+// Выбор алгоритма хеширования по имени; неизвестное имя - SHA256
+static const EVP_MD* hash_algorithm_md(const char *algorithm, const char *what) {
+    (void)what;     // только для DBG
+    if (strcasecmp(algorithm, "md5") == 0) {
+        DBG("[CALCULATE_HASH] Using MD5 for: %s\n", what);
+        return EVP_md5();
+    } else if (strcasecmp(algorithm, "sha1") == 0) {
+        DBG("[CALCULATE_HASH] Using SHA1 for: %s\n", what);
+        return EVP_sha1();
+    } else if (strcasecmp(algorithm, "sha256") == 0) {
+        DBG("[CALCULATE_HASH] Using SHA256 for: %s\n", what);
+        return EVP_sha256();
+    } else if (strcasecmp(algorithm, "sha512") == 0) {
+        DBG("[CALCULATE_HASH] Using SHA512 for: %s\n", what);
+        return EVP_sha512();
+    }
+    printf("ERROR: [CALCULATE_HASH] Unknown algorithm: %s, using SHA256\n", algorithm);
+    return EVP_sha256();
+}
+
+// Завершает хеш и освобождает mdctx. Возвращает шестнадцатеричную строку (malloc) или NULL
+static char* hash_finish(EVP_MD_CTX *mdctx) {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_len;
+
+    int ok = EVP_DigestFinal_ex(mdctx, hash, &hash_len) == 1;
+    EVP_MD_CTX_free(mdctx);
+    if (!ok) return NULL;
+
+    char *hash_str = malloc(hash_len * 2 + 1);
+    if (!hash_str) return NULL;
+    for (unsigned int i = 0; i < hash_len; i++) {
+        sprintf(hash_str + (i * 2), "%02x", hash[i]);
+    }
+    hash_str[hash_len * 2] = '\0';
+    return hash_str;
+}
+
 char* calculate_file_hash(const char *filepath, const char *algorithm) {
     FILE *file = fopen(filepath, "rb");
     if (!file) {
@@ -193,25 +342,7 @@ char* calculate_file_hash(const char *filepath, const char *algorithm) {
         return NULL;
     }
 
-    const EVP_MD *md_algorithm = NULL;
-
-    // Выбор алгоритма хеширования
-    if (strcasecmp(algorithm, "md5") == 0) {
-        md_algorithm = EVP_md5();
-        printf("DEBUG: [CALCULATE_HASH] Using MD5 for: %s\n", filepath);
-    } else if (strcasecmp(algorithm, "sha1") == 0) {
-        md_algorithm = EVP_sha1();
-        printf("DEBUG: [CALCULATE_HASH] Using SHA1 for: %s\n", filepath);
-    } else if (strcasecmp(algorithm, "sha256") == 0) {
-        md_algorithm = EVP_sha256();
-        printf("DEBUG: [CALCULATE_HASH] Using SHA256 for: %s\n", filepath);
-    } else if (strcasecmp(algorithm, "sha512") == 0) {
-        md_algorithm = EVP_sha512();
-        printf("DEBUG: [CALCULATE_HASH] Using SHA512 for: %s\n", filepath);
-    } else {
-        printf("ERROR: [CALCULATE_HASH] Unknown algorithm: %s, using SHA256\n", algorithm);
-        md_algorithm = EVP_sha256();
-    }
+    const EVP_MD *md_algorithm = hash_algorithm_md(algorithm, filepath);
 
     EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
     if (!mdctx) {
@@ -235,26 +366,140 @@ char* calculate_file_hash(const char *filepath, const char *algorithm) {
             return NULL;
         }
     }
+    fclose(file);
 
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hash_len;
+    char *hash_str = hash_finish(mdctx);
+    if (hash_str) printf("DEBUG: [CALCULATE_HASH] %s hash for %s: %s\n", algorithm, filepath, hash_str);
+    return hash_str;
+}
+
+char* calculate_buffer_hash(const void *data, size_t size, const char *algorithm, const char *name) {
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    if (!mdctx) return NULL;
 
-    if (EVP_DigestFinal_ex(mdctx, hash, &hash_len) != 1) {
+    if (EVP_DigestInit_ex(mdctx, hash_algorithm_md(algorithm, name), NULL) != 1 ||
+        EVP_DigestUpdate(mdctx, data, size) != 1) {
         EVP_MD_CTX_free(mdctx);
-        fclose(file);
         return NULL;
     }
 
-    EVP_MD_CTX_free(mdctx);
-    fclose(file);
+    char *hash_str = hash_finish(mdctx);
+    DBG("[CALCULATE_HASH] %s hash for %s: %s\n", algorithm, name, hash_str ? hash_str : "(failed)");
+    return hash_str;
+}
 
-    char *hash_str = malloc(hash_len * 2 + 1);
-    for (unsigned int i = 0; i < hash_len; i++) {
-        sprintf(hash_str + (i * 2), "%02x", hash[i]);
+
+void utf8_truncate(char *str, size_t max_chars) {
+    if (!str) return;
+
+    size_t chars = 0;
+    unsigned char *p = (unsigned char*)str;
+    while (*p) {
+        // Начало нового символа - любой байт, кроме продолжения 10xxxxxx
+        if ((*p & 0xC0) != 0x80) {
+            if (chars == max_chars) {
+                *p = '\0';
+                return;
+            }
+            chars++;
+        }
+        p++;
     }
-    hash_str[hash_len * 2] = '\0';
+}
 
-    printf("DEBUG: [CALCULATE_HASH] %s hash for %s: %s\n", algorithm, filepath, hash_str);
-    return hash_str;
+size_t utf8_encode(unsigned long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+char** split_name_list(const char *list, const char *separators, int *count) {
+    *count = 0;
+    if (!list) return NULL;
+
+    // Имен не больше, чем разделителей + 1
+    int capacity = 1;
+    for (const char *p = list; *p; p++) {
+        if (strchr(separators, *p)) capacity++;
+    }
+
+    char **names = malloc(sizeof(char*) * capacity);
+    if (!names) return NULL;
+
+    const char *start = list;
+    for (;;) {
+        const char *end = start;
+        while (*end && !strchr(separators, *end)) end++;
+
+        const char *name_start = start;
+        const char *name_end = end;
+        while (name_start < name_end && isspace((unsigned char)*name_start)) name_start++;
+        while (name_end > name_start && isspace((unsigned char)name_end[-1])) name_end--;
+
+        if (name_end > name_start) {
+            char *name = strndup(name_start, name_end - name_start);
+            if (name) {
+                utf8_truncate(name, DICT_NAME_MAX_CHARS);
+
+                int duplicate = 0;
+                for (int i = 0; i < *count && !duplicate; i++) {
+                    duplicate = (strcmp(names[i], name) == 0);
+                }
+                if (duplicate) {
+                    free(name);
+                } else {
+                    names[(*count)++] = name;
+                }
+            }
+        }
+
+        if (!*end) break;
+        start = end + 1;
+    }
+
+    if (*count == 0) {
+        free(names);
+        return NULL;
+    }
+    return names;
+}
+
+char** split_author_list(const char *authors, int *count) {
+    return split_name_list(authors, AUTHOR_LIST_SEPARATORS, count);
+}
+
+char* primary_genre(const char *genres) {
+    int count = 0;
+    char **names = split_name_list(genres, GENRE_LIST_SEPARATORS, &count);
+    if (!names) return NULL;
+
+    char *genre = names[0];
+    names[0] = NULL;
+    free_string_list(names, count);
+    return genre;
 }
 
+void free_string_list(char **list, int count) {
+    if (!list) return;
+    for (int i = 0; i < count; i++) {
+        free(list[i]);
+    }
+    free(list);
+}
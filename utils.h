@@ -2,16 +2,63 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+
+// Метаданные FB2 лежат в начале файла - для разбора читаем только первые FILE_HEAD_SIZE байт
+#define FILE_HEAD_SIZE 65536
+
 char* read_file_content(const char *filepath);
+// Читает до capacity байт в buffer (размером capacity + 1) и завершает нулем; -1 - ошибка открытия
+long read_file_head(const char *filepath, char *buffer, size_t capacity);
+char* read_file_full(const char *filepath, size_t *size_out);
+
+// Файл (или его начало), отображенный в память без копирования.
+// Отображение MAP_PRIVATE: запись в data меняет только копию страницы в процессе.
+// За data[size] всегда стоит ноль, поэтому data можно разбирать как строку C
+typedef struct {
+    char *data;
+    size_t size;            // длина данных без завершающего нуля
+    size_t file_size;
+    size_t map_len;         // длина отображения для munmap, 0 - data из read_file_full
+} FileView;
+
+// Отображает начало файла до первого end_marker включительно (NULL - весь файл).
+// Окно начинается с FILE_HEAD_SIZE и удваивается, пока маркер не найден, так что
+// дальше маркера читается не больше одного окна. Возвращает 1 при успехе, 0 при ошибке
+int file_view_open(const char *filepath, const char *end_marker, FileView *view);
+void file_view_close(FileView *view);
 void trim_string(char *str);
 char* convert_encoding(const char *text, const char *from_encoding, const char *to_encoding);
 char* clean_html_tags(const char *html);
+// Удаляет HTML-теги на месте и сжимает пробелы (результат не длиннее исходной строки)
+void strip_html_tags(char *str);
 int detect_encoding(const char *text);
 int is_already_running(const char *lockfile_path);
 char* calculate_file_hash(const char *filepath, const char *algorithm);  // Добавить второй параметр
+// Хеш данных, уже лежащих в памяти (например, FileView всего файла); name - только для логов
+char* calculate_buffer_hash(const void *data, size_t size, const char *algorithm, const char *name);
 
 // Добавить новые функции
 int is_valid_hash_algorithm(const char *algorithm);
 void print_hash_algorithms();
 
+// Максимальная длина имени в словарях authors/series/genres (VARCHAR(255) в MySQL)
+#define DICT_NAME_MAX_CHARS 255
+
+// Обрезает строку UTF-8 до max_chars символов, не разрывая многобайтовые последовательности
+void utf8_truncate(char *str, size_t max_chars);
+// Записывает кодовую точку в out (до 4 байт) и возвращает число записанных байт
+size_t utf8_encode(unsigned long cp, char *out);
+// Разделители списков имен: авторы через ',' или ';', жанры INPX - через ':' ("sf_fantasy:adv_history:")
+#define AUTHOR_LIST_SEPARATORS ",;"
+#define GENRE_LIST_SEPARATORS ":,;"
+// Разбивает список по любому из separators на имена без пробелов по краям и без повторов.
+// Возвращает массив из *count строк (освобождать через free_string_list) или NULL, если имен нет.
+char** split_name_list(const char *list, const char *separators, int *count);
+// split_name_list для авторов
+char** split_author_list(const char *authors, int *count);
+// Первый жанр списка - на него ссылается books.genre_id; NULL, если жанров нет. Освобождать через free
+char* primary_genre(const char *genres);
+void free_string_list(char **list, int count);
+
 #endif
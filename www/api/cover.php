@@ -17,6 +17,11 @@ class CoverExtractor {
             return;
         }
 
+        // Обложка, заранее извлеченная сканером (extract_covers = yes)
+        if ($this->servePregeneratedCover($book, $isThumb)) {
+            return;
+        }
+
         $coverPath = Config::COVER_CACHE_DIR . '/' . $bookId . ($isThumb ? '_thumb.jpg' : '.jpg');
 
         // Если обложка уже есть в кэше - отдаем ее
@@ -33,6 +38,37 @@ class CoverExtractor {
         }
     }
     
+    /**
+     * Отдать обложку из кэша сканера по ключу cover_key (<sha1>.<ext>)
+     */
+    private function servePregeneratedCover($book, $isThumb) {
+        $coverKey = $book['cover_key'] ?? '';
+        if (!preg_match('/^[0-9a-f]{40}\.(jpg|png|gif)$/', $coverKey)) {
+            return false;
+        }
+        
+        $shardDir = Config::COVER_CACHE_DIR . '/' . substr($coverKey, 0, 2);
+        $fullPath = $shardDir . '/' . $coverKey;
+        if (!file_exists($fullPath)) {
+            return false;
+        }
+        
+        if (!$isThumb) {
+            $mimeTypes = ['jpg' => 'image/jpeg', 'png' => 'image/png', 'gif' => 'image/gif'];
+            $this->serveCachedCover($fullPath, $mimeTypes[pathinfo($coverKey, PATHINFO_EXTENSION)]);
+            return true;
+        }
+        
+        // Миниатюра создается один раз на обложку и используется всеми дубликатами
+        $thumbPath = $shardDir . '/' . substr($coverKey, 0, 40) . '_thumb.jpg';
+        if (!file_exists($thumbPath) && !$this->createThumbnail($fullPath, $thumbPath, 200, 300)) {
+            return false;
+        }
+        
+        $this->serveCachedCover($thumbPath);
+        return true;
+    }
+    
     private function extractCover($book, $bookId, $isThumb) {
         $filePath = $book['file_path'];
         $internalPath = $book['archive_internal_path'];
@@ -333,8 +369,8 @@ class CoverExtractor {
         return false;
     }
     
-    private function serveCachedCover($coverPath) {
-        header('Content-Type: image/jpeg');
+    private function serveCachedCover($coverPath, $mimeType = 'image/jpeg') {
+        header('Content-Type: ' . $mimeType);
         header('Cache-Control: public, max-age=86400');
         header('Expires: ' . gmdate('D, d M Y H:i:s', time() + 86400) . ' GMT');
         readfile($coverPath);
@@ -19,6 +19,35 @@ if (!$book) {
     exit;
 }
 
+// Обложка, заранее извлеченная сканером (extract_covers = yes)
+$coverKey = $book['cover_key'] ?? '';
+if (preg_match('/^[0-9a-f]{40}\.(jpg|png|gif)$/', $coverKey, $keyMatch)) {
+    $keyPath = Config::COVER_CACHE_DIR . '/' . substr($coverKey, 0, 2) . '/' . $coverKey;
+    if (file_exists($keyPath)) {
+        if ($thumb) {
+            $thumbPath = dirname($keyPath) . '/' . substr($coverKey, 0, 40) . '_thumb.jpg';
+            if (!file_exists($thumbPath)) {
+                $thumbData = createThumbnailFromData(file_get_contents($keyPath), 200, 300);
+                if ($thumbData) {
+                    file_put_contents($thumbPath, $thumbData);
+                }
+            }
+            if (file_exists($thumbPath)) {
+                header('Content-Type: image/jpeg');
+                header('Cache-Control: public, max-age=86400');
+                readfile($thumbPath);
+                exit;
+            }
+        } else {
+            $mimeTypes = ['jpg' => 'image/jpeg', 'png' => 'image/png', 'gif' => 'image/gif'];
+            header('Content-Type: ' . $mimeTypes[$keyMatch[1]]);
+            header('Cache-Control: public, max-age=86400');
+            readfile($keyPath);
+            exit;
+        }
+    }
+}
+
 // ПРОСТОЙ ВАРИАНТ БЕЗ КЭШИРОВАНИЯ В ПАМЯТИ
 $coverPath = Config::COVER_CACHE_DIR . '/' . $id . ($thumb ? '_thumb.jpg' : '.jpg');
 
@@ -38,6 +38,10 @@ function downloadRegularFile($book) {
     $filename = basename($filePath);
     $mimeType = getMimeType($book['file_type']);
     
+    if (extractHelperAvailable()) {
+        sendWithHelper([$filePath], $filename, $mimeType);
+    }
+    
     header('Content-Type: ' . $mimeType);
     header('Content-Disposition: attachment; filename="' . $filename . '"');
     header('Content-Length: ' . filesize($filePath));
@@ -59,6 +63,11 @@ function downloadFromArchive($book) {
     $filename = ($book['title'] ?: 'book') . '.' . $extension;
     $mimeType = getMimeType($extension);
     
+    // Нативный помощник: без запуска unzip и с поддержкой докачки (Range)
+    if (extractHelperAvailable()) {
+        sendWithHelper([$archivePath, $internalPath], $filename, $mimeType);
+    }
+    
     // Используем системные команды для извлечения из архива
     $archiveType = pathinfo($archivePath, PATHINFO_EXTENSION);
     
@@ -84,6 +93,59 @@ function downloadFromArchive($book) {
     exit;
 }
 
+function extractHelperAvailable() {
+    return defined('Config::EXTRACT_HELPER') && is_executable(Config::EXTRACT_HELPER);
+}
+
+/**
+ * Отдает файл через book_extract с поддержкой HTTP Range
+ */
+function sendWithHelper($args, $filename, $mimeType) {
+    $escapedArgs = implode(' ', array_map('escapeshellarg', $args));
+    $helper = escapeshellarg(Config::EXTRACT_HELPER);
+    
+    $output = [];
+    $status = 0;
+    exec($helper . ' --stat ' . $escapedArgs, $output, $status);
+    if ($status !== 0 || !isset($output[0]) || !is_numeric($output[0])) {
+        http_response_code($status === 2 ? 404 : 500);
+        die('Cannot read book from archive');
+    }
+    $size = (int)$output[0];
+    
+    header('Content-Type: ' . $mimeType);
+    header('Content-Disposition: attachment; filename="' . $filename . '"');
+    header('Accept-Ranges: bytes');
+    
+    $rangeArg = '';
+    if (isset($_SERVER['HTTP_RANGE']) && preg_match('/^bytes=(\d*)-(\d*)$/', $_SERVER['HTTP_RANGE'], $m)
+        && ($m[1] !== '' || $m[2] !== '')) {
+        if ($m[1] === '') {
+            $start = max(0, $size - (int)$m[2]);
+            $end = $size - 1;
+        } else {
+            $start = (int)$m[1];
+            $end = ($m[2] === '') ? $size - 1 : min((int)$m[2], $size - 1);
+        }
+        
+        if ($start >= $size || $start > $end) {
+            http_response_code(416);
+            header('Content-Range: bytes */' . $size);
+            exit;
+        }
+        
+        http_response_code(206);
+        header('Content-Range: bytes ' . $start . '-' . $end . '/' . $size);
+        header('Content-Length: ' . ($end - $start + 1));
+        $rangeArg = ' ' . escapeshellarg('--range=bytes=' . $start . '-' . $end);
+    } else {
+        header('Content-Length: ' . $size);
+    }
+    
+    passthru($helper . $rangeArg . ' ' . $escapedArgs);
+    exit;
+}
+
 function getMimeType($fileType) {
     $mimeTypes = [
         'epub' => 'application/epub+zip',
@@ -13,6 +13,8 @@ class Config {
     const BOOKS_DIR = '/path/to.collection/books/';
     const SCANNER_PATH = __DIR__ . '/scanner/path/';
     const SCANNER_CONFIG = __DIR__ . '/config.ini';
+    // Помощник выдачи книг из архивов (собирается вместе со сканером: make)
+    const EXTRACT_HELPER = '/usr/local/bin/book_extract';
     
     // Настройки веб-интерфейса
     const SITE_TITLE = 'Моя домашняя библиотека';
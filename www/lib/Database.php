@@ -8,6 +8,10 @@ class Database {
     private $queryCount = 0;
     private $cacheHits = 0;
     private $cacheMisses = 0;
+    private $fullTextAvailable = null;
+    private $trigramAvailable = null;
+    private $searchKeysAvailable = null;
+    private $dictionariesAvailable = null;
     
     private function __construct() {
         try {
@@ -159,7 +163,219 @@ class Database {
     // === ОСНОВНЫЕ МЕТОДЫ ДОСТУПА К ДАННЫМ ===
     
     /**
-     * Поиск книг - оптимизированная версия
+     * Есть ли полнотекстовый индекс, который строит сканер (books_fts / ft_books_search)
+     */
+    private function hasFullTextIndex() {
+        if ($this->fullTextAvailable !== null) {
+            return $this->fullTextAvailable;
+        }
+        
+        try {
+            switch (Config::DB_TYPE) {
+                case 'sqlite':
+                    $stmt = $this->executeQuery("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'books_fts'");
+                    $this->fullTextAvailable = (bool)$stmt->fetchColumn();
+                    break;
+                case 'mysql':
+                    $stmt = $this->executeQuery(
+                        "SELECT COUNT(*) FROM information_schema.statistics " .
+                        "WHERE table_schema = DATABASE() AND table_name = 'books' AND index_name = 'ft_books_search'"
+                    );
+                    $this->fullTextAvailable = $stmt->fetchColumn() > 0;
+                    break;
+                default:
+                    $this->fullTextAvailable = false;
+            }
+        } catch (PDOException $e) {
+            $this->fullTextAvailable = false;
+        }
+        
+        return $this->fullTextAvailable;
+    }
+    
+    /**
+     * Запрос FTS5: каждое слово - префикс в кавычках ("толст"* "война"*)
+     */
+    private function buildFts5Query($query) {
+        $terms = preg_split('/\s+/u', trim($query), -1, PREG_SPLIT_NO_EMPTY);
+        $parts = [];
+        foreach ($terms as $term) {
+            $parts[] = '"' . str_replace('"', '""', $term) . '"*';
+        }
+        return implode(' ', $parts);
+    }
+    
+    /**
+     * Запрос MySQL BOOLEAN MODE: каждое слово обязательно и ищется как префикс (+толст* +война*)
+     */
+    private function buildBooleanQuery($query) {
+        $clean = preg_replace('/[+\-<>()~*"@]+/u', ' ', $query);
+        $terms = preg_split('/\s+/u', trim($clean), -1, PREG_SPLIT_NO_EMPTY);
+        $parts = [];
+        foreach ($terms as $term) {
+            $parts[] = '+' . $term . '*';
+        }
+        return implode(' ', $parts);
+    }
+    
+    /**
+     * Есть ли триграммный индекс подстрок books_trigram (только SQLite)
+     */
+    private function hasTrigramIndex() {
+        if ($this->trigramAvailable !== null) {
+            return $this->trigramAvailable;
+        }
+        
+        $this->trigramAvailable = false;
+        if (Config::DB_TYPE === 'sqlite') {
+            try {
+                $stmt = $this->executeQuery("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'books_trigram'");
+                $this->trigramAvailable = (bool)$stmt->fetchColumn();
+            } catch (PDOException $e) {
+                $this->trigramAvailable = false;
+            }
+        }
+        
+        return $this->trigramAvailable;
+    }
+    
+    /**
+     * Есть ли нормализованные колонки title_key/author_key/series_key (их добавляет сканер)
+     */
+    private function hasSearchKeys() {
+        if ($this->searchKeysAvailable !== null) {
+            return $this->searchKeysAvailable;
+        }
+        
+        try {
+            $stmt = $this->executeQuery("SELECT title_key, author_key, series_key FROM books LIMIT 1");
+            $stmt->fetchAll();
+            $this->searchKeysAvailable = true;
+        } catch (PDOException $e) {
+            $this->searchKeysAvailable = false;
+        }
+        
+        return $this->searchKeysAvailable;
+    }
+    
+    /**
+     * Есть ли словари authors/series/genres и связи book_authors (их заполняет сканер)
+     */
+    private function hasDictionaries() {
+        if ($this->dictionariesAvailable !== null) {
+            return $this->dictionariesAvailable;
+        }
+        
+        try {
+            // Пустая выборка только проверяет, что все четыре таблицы существуют
+            $stmt = $this->executeQuery("SELECT 1 FROM authors, series, genres, book_authors WHERE 1 = 0");
+            $stmt->fetchAll();
+            $this->dictionariesAvailable = true;
+        } catch (PDOException $e) {
+            $this->dictionariesAvailable = false;
+        }
+        
+        return $this->dictionariesAvailable;
+    }
+    
+    /**
+     * Ключ поиска - то же приведение, что fold_search_key() в сканере:
+     * нижний регистр, ё -> е, знаки препинания схлопываются в пробел
+     */
+    private function foldKey($text) {
+        $key = mb_strtolower($text, 'UTF-8');
+        $key = str_replace('ё', 'е', $key);
+        $key = preg_replace('/[^\p{L}\p{N}]+/u', ' ', $key);
+        return mb_substr(trim($key), 0, 255, 'UTF-8');
+    }
+    
+    /**
+     * Условие поиска для searchBooks() и getSearchCount().
+     * Возвращает [join, where, orderBy]; параметры добавляются в $params.
+     */
+    private function buildSearchCondition($query, $field, &$params) {
+        $fields = ['author', 'title', 'genre', 'series'];
+        
+        // Фрагмент из 3+ символов ищем как подстроку по триграммам - как LIKE, но по индексу
+        if (!empty($query) && $field !== 'genre' && mb_strlen(trim($query), 'UTF-8') >= 3 && $this->hasTrigramIndex()) {
+            $phrase = '"' . str_replace('"', '""', trim($query)) . '"';
+            if (in_array($field, $fields, true)) {
+                $phrase = '{' . $field . '} : ' . $phrase;
+            }
+            $params[] = $phrase;
+            return [
+                " JOIN books_trigram ON books_trigram.rowid = books.id",
+                " AND books_trigram MATCH ?",
+                " ORDER BY author, title"
+            ];
+        }
+        
+        $useFullText = !empty($query) && $this->hasFullTextIndex();
+        
+        if ($useFullText && Config::DB_TYPE === 'sqlite') {
+            $ftsQuery = $this->buildFts5Query($query);
+            if ($ftsQuery !== '') {
+                if (in_array($field, $fields, true)) {
+                    $ftsQuery = '{' . $field . '} : (' . $ftsQuery . ')';
+                }
+                $params[] = $ftsQuery;
+                return [
+                    " JOIN books_fts ON books_fts.rowid = books.id",
+                    " AND books_fts MATCH ?",
+                    " ORDER BY bm25(books_fts, 10.0, 5.0, 2.0, 1.0)"
+                ];
+            }
+        }
+        
+        // FULLTEXT-индекс MySQL покрывает только все четыре колонки вместе
+        if ($useFullText && Config::DB_TYPE === 'mysql' && !in_array($field, $fields, true)) {
+            $booleanQuery = $this->buildBooleanQuery($query);
+            if ($booleanQuery !== '') {
+                $params[] = $booleanQuery;
+                return [
+                    "",
+                    " AND MATCH(title, author, series, genre) AGAINST (? IN BOOLEAN MODE)",
+                    " ORDER BY MATCH(title, author, series, genre) AGAINST (? IN BOOLEAN MODE) DESC"
+                ];
+            }
+        }
+        
+        // Ключи *_key уже приведены к нижнему регистру, поэтому LIKE не зависит от регистра и ё/е
+        $keyQuery = !empty($query) && $field !== 'genre' && $this->hasSearchKeys() ? $this->foldKey($query) : '';
+        if ($keyQuery !== '') {
+            $pattern = "%$keyQuery%";
+            if (in_array($field, $fields, true)) {
+                $where = " AND {$field}_key LIKE ?";
+                $params[] = $pattern;
+            } else {
+                $where = " AND (title_key LIKE ? OR author_key LIKE ? OR series_key LIKE ? OR genre LIKE ?)";
+                $params[] = $pattern;
+                $params[] = $pattern;
+                $params[] = $pattern;
+                $params[] = "%$query%";
+            }
+            return ["", $where, " ORDER BY author_key, title_key"];
+        }
+        
+        $where = "";
+        if (!empty($query)) {
+            if (in_array($field, $fields, true)) {
+                $where = " AND $field LIKE ?";
+                $params[] = "%$query%";
+            } else {
+                $where = " AND (title LIKE ? OR author LIKE ? OR genre LIKE ? OR series LIKE ?)";
+                $params[] = "%$query%";
+                $params[] = "%$query%";
+                $params[] = "%$query%";
+                $params[] = "%$query%";
+            }
+        }
+        
+        return ["", $where, " ORDER BY author, title"];
+    }
+    
+    /**
+     * Поиск книг - через полнотекстовый индекс, если он есть, иначе через LIKE
      */
     public function searchBooks($query, $field = 'all', $page = 1, $perPage = null) {
         if ($perPage === null) {
@@ -170,38 +386,14 @@ class Database {
         $perPage = min((int)$perPage, 100);
         $params = [];
         
-        $sql = "SELECT * FROM books WHERE 1=1";
+        list($join, $where, $orderBy) = $this->buildSearchCondition($query, $field, $params);
         
-        if (!empty($query)) {
-            switch ($field) {
-                case 'author':
-                    $sql .= " AND author LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'title':
-                    $sql .= " AND title LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'genre':
-                    $sql .= " AND genre LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'series':
-                    $sql .= " AND series LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'all':
-                default:
-                    $sql .= " AND (title LIKE ? OR author LIKE ? OR genre LIKE ? OR series LIKE ?)";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    break;
-            }
+        // Для MySQL релевантность в ORDER BY использует тот же запрос, что и WHERE
+        if (strpos($orderBy, '?') !== false) {
+            $params[] = end($params);
         }
         
-        $sql .= " ORDER BY author, title LIMIT ? OFFSET ?";
+        $sql = "SELECT books.* FROM books" . $join . " WHERE 1=1" . $where . $orderBy . " LIMIT ? OFFSET ?";
         $params[] = $perPage;
         $params[] = $offset;
         
@@ -234,36 +426,8 @@ class Database {
      */
     public function getSearchCount($query, $field = 'all') {
         $params = [];
-        $sql = "SELECT COUNT(*) as count FROM books WHERE 1=1";
-        
-        if (!empty($query)) {
-            switch ($field) {
-                case 'author':
-                    $sql .= " AND author LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'title':
-                    $sql .= " AND title LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'genre':
-                    $sql .= " AND genre LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'series':
-                    $sql .= " AND series LIKE ?";
-                    $params[] = "%$query%";
-                    break;
-                case 'all':
-                default:
-                    $sql .= " AND (title LIKE ? OR author LIKE ? OR genre LIKE ? OR series LIKE ?)";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    $params[] = "%$query%";
-                    break;
-            }
-        }
+        list($join, $where) = $this->buildSearchCondition($query, $field, $params);
+        $sql = "SELECT COUNT(*) as count FROM books" . $join . " WHERE 1=1" . $where;
         
         $stmt = $this->executeQuery($sql, $params);
         $result = $stmt->fetch();
@@ -281,6 +445,11 @@ class Database {
      * Получить все авторы
      */
     public function getAuthors() {
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("SELECT name AS author FROM authors ORDER BY name_key, name LIMIT 5000");
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery(
             "SELECT DISTINCT author FROM books WHERE author IS NOT NULL AND author != '' ORDER BY author LIMIT 5000"
         );
@@ -291,6 +460,11 @@ class Database {
      * Получить все жанры
      */
     public function getGenres() {
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("SELECT name AS genre FROM genres ORDER BY name LIMIT 1000");
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery(
             "SELECT DISTINCT genre FROM books WHERE genre IS NOT NULL AND genre != '' ORDER BY genre LIMIT 1000"
         );
@@ -301,6 +475,11 @@ class Database {
      * Получить все серии
      */
     public function getSeries() {
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("SELECT name AS series FROM series ORDER BY name_key, name LIMIT 5000");
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery(
             "SELECT DISTINCT series FROM books WHERE series IS NOT NULL AND series != '' ORDER BY series LIMIT 5000"
         );
@@ -386,14 +565,25 @@ class Database {
      * Получить все жанры с их частотой и читаемыми названиями
      */
     public function getGenresWithCount() {
-        $stmt = $this->executeQuery("
-            SELECT genre, COUNT(*) as count 
-            FROM books 
-            WHERE genre IS NOT NULL AND genre != '' 
-            GROUP BY genre 
-            ORDER BY count DESC, genre
-            LIMIT 100
-        ");
+        if ($this->hasDictionaries()) {
+            // Группировка по целочисленному genre_id через индекс idx_books_genre_id
+            $stmt = $this->executeQuery("
+                SELECT g.name AS genre, c.count
+                FROM (SELECT genre_id, COUNT(*) AS count FROM books WHERE genre_id IS NOT NULL GROUP BY genre_id) c
+                JOIN genres g ON g.id = c.genre_id
+                ORDER BY c.count DESC, g.name
+                LIMIT 100
+            ");
+        } else {
+            $stmt = $this->executeQuery("
+                SELECT genre, COUNT(*) as count 
+                FROM books 
+                WHERE genre IS NOT NULL AND genre != '' 
+                GROUP BY genre 
+                ORDER BY count DESC, genre
+                LIMIT 100
+            ");
+        }
         $genres = $stmt->fetchAll();
         
         foreach ($genres as &$genre) {
@@ -409,6 +599,17 @@ class Database {
     public function getTopAuthors($limit = 20) {
         $limit = min((int)$limit, 100);
         
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("
+                SELECT a.name AS author, c.count
+                FROM (SELECT author_id, COUNT(*) AS count FROM book_authors GROUP BY author_id) c
+                JOIN authors a ON a.id = c.author_id
+                ORDER BY c.count DESC, a.name
+                LIMIT ?
+            ", [$limit]);
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery("
             SELECT author, COUNT(*) as count 
             FROM books 
@@ -426,6 +627,17 @@ class Database {
     public function getTopSeries($limit = 20) {
         $limit = min((int)$limit, 100);
         
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("
+                SELECT s.name AS series, c.count
+                FROM (SELECT series_id, COUNT(*) AS count FROM books WHERE series_id IS NOT NULL GROUP BY series_id) c
+                JOIN series s ON s.id = c.series_id
+                ORDER BY c.count DESC, s.name
+                LIMIT ?
+            ", [$limit]);
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery("
             SELECT series, COUNT(*) as count 
             FROM books 
@@ -444,6 +656,19 @@ class Database {
         $offset = (int)(($page - 1) * $perPage);
         $perPage = min((int)$perPage, 100);
         
+        // Через book_authors находятся и книги в соавторстве ("А, Б")
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery("
+                SELECT b.* FROM authors a
+                JOIN book_authors ba ON ba.author_id = a.id
+                JOIN books b ON b.id = ba.book_id
+                WHERE a.name = ?
+                ORDER BY b.series, b.series_number, b.title
+                LIMIT ? OFFSET ?
+            ", [$author, $perPage, $offset]);
+            return $stmt->fetchAll();
+        }
+        
         $stmt = $this->executeQuery("
             SELECT * FROM books 
             WHERE author = ? 
@@ -457,6 +682,15 @@ class Database {
      * Получить количество книг по автору
      */
     public function getBooksCountByAuthor($author) {
+        if ($this->hasDictionaries()) {
+            $stmt = $this->executeQuery(
+                "SELECT COUNT(*) as count FROM authors a JOIN book_authors ba ON ba.author_id = a.id WHERE a.name = ?",
+                [$author]
+            );
+            $result = $stmt->fetch();
+            return $result['count'];
+        }
+        
         $stmt = $this->executeQuery("SELECT COUNT(*) as count FROM books WHERE author = ?", [$author]);
         $result = $stmt->fetch();
         return $result['count'];
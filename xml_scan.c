@@ -0,0 +1,178 @@
+// xml_scan.c - поиск элементов и атрибутов в небольших XML без построения дерева
+#include "common.h"
+#include "xml_scan.h"
+#include "utils.h"
+
+static int is_xml_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Сравнивает локальное имя (часть после префикса пространства имен) с name
+static int local_name_is(const char *qname, const char *qname_end, const char *name) {
+    const char *local = qname;
+    for (const char *c = qname; c < qname_end; c++) {
+        if (*c == ':') local = c + 1;
+    }
+    size_t name_len = strlen(name);
+    return (size_t)(qname_end - local) == name_len && memcmp(local, name, name_len) == 0;
+}
+
+int xml_next_element(const char **cursor, const char *end, const char *name, XmlElement *el) {
+    const char *p = *cursor;
+
+    while (p < end) {
+        const char *lt = memchr(p, '<', end - p);
+        if (!lt || lt + 1 >= end) break;
+
+        const char *q = lt + 1;
+        if (end - q >= 3 && memcmp(q, "!--", 3) == 0) {
+            const char *comment_end = memmem(q, end - q, "-->", 3);
+            if (!comment_end) break;
+            p = comment_end + 3;
+            continue;
+        }
+        if (*q == '/' || *q == '!' || *q == '?') {
+            p = q;
+            continue;
+        }
+
+        const char *qname = q;
+        while (q < end && !is_xml_space(*q) && *q != '>' && *q != '/') q++;
+        const char *qname_end = q;
+
+        const char *gt = memchr(q, '>', end - q);
+        if (!gt) break;
+        p = gt + 1;
+        if (!local_name_is(qname, qname_end, name)) continue;
+
+        el->attrs = qname_end;
+        el->attrs_end = gt;
+        el->text = el->text_end = gt + 1;
+        if (gt[-1] == '/') {
+            el->attrs_end = gt - 1;
+        } else {
+            // Закрывающий тег с тем же полным именем, например </dc:title>
+            size_t qname_len = qname_end - qname;
+            const char *close = gt + 1;
+            while ((close = memmem(close, end - close, "</", 2)) != NULL) {
+                const char *after = close + 2 + qname_len;
+                if (after < end && memcmp(close + 2, qname, qname_len) == 0 &&
+                    (*after == '>' || is_xml_space(*after))) {
+                    break;
+                }
+                close += 2;
+            }
+            if (!close) break;
+            el->text_end = close;
+        }
+        *cursor = p;
+        return 1;
+    }
+
+    *cursor = end;
+    return 0;
+}
+
+const char* xml_element_attr(const XmlElement *el, const char *name, size_t *value_len) {
+    const char *p = el->attrs;
+    const char *end = el->attrs_end;
+
+    while (p < end) {
+        while (p < end && is_xml_space(*p)) p++;
+        const char *attr = p;
+        while (p < end && *p != '=' && !is_xml_space(*p)) p++;
+        const char *attr_end = p;
+
+        while (p < end && is_xml_space(*p)) p++;
+        if (p >= end || *p != '=') return NULL;
+        p++;
+        while (p < end && is_xml_space(*p)) p++;
+        if (p >= end || (*p != '"' && *p != '\'')) return NULL;
+
+        char quote = *p++;
+        const char *value = p;
+        const char *value_end = memchr(value, quote, end - value);
+        if (!value_end) return NULL;
+        p = value_end + 1;
+
+        if (attr_end > attr && local_name_is(attr, attr_end, name)) {
+            *value_len = value_end - value;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+int xml_attr_equals(const XmlElement *el, const char *name, const char *expected) {
+    size_t len = 0;
+    const char *value = xml_element_attr(el, name, &len);
+    return value && len == strlen(expected) && strncasecmp(value, expected, len) == 0;
+}
+
+// Копия [src, src + len) в арену с раскрытыми сущностями XML и обрезанными пробелами.
+// Результат не длиннее исходника: самая короткая числовая ссылка (&#9;) длиннее своих байтов UTF-8.
+// NULL для пустой строки
+char* xml_string(const char *src, size_t len, Arena *arena) {
+    while (len > 0 && is_xml_space(*src)) {
+        src++;
+        len--;
+    }
+
+    char *out = arena_alloc(arena, len + 1);
+    if (!out) return NULL;
+
+    static const struct { const char *name; char value; } entities[] = {
+        {"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}
+    };
+
+    size_t o = 0;
+    for (size_t i = 0; i < len; ) {
+        if (src[i] != '&') {
+            out[o++] = src[i++];
+            continue;
+        }
+
+        const char *semi = memchr(src + i, ';', len - i);
+        size_t ref_len = semi ? (size_t)(semi - (src + i)) + 1 : 0;
+        int decoded = 0;
+
+        if (ref_len > 3 && src[i + 1] == '#') {
+            int hex = src[i + 2] == 'x' || src[i + 2] == 'X';
+            char *num_end = NULL;
+            unsigned long cp = strtoul(src + i + (hex ? 3 : 2), &num_end, hex ? 16 : 10);
+            if (num_end == semi && cp > 0 && cp <= 0x10FFFF && !(cp >= 0xD800 && cp <= 0xDFFF)) {
+                o += utf8_encode(cp, out + o);
+                decoded = 1;
+            }
+        } else if (ref_len > 0) {
+            for (size_t e = 0; e < sizeof(entities) / sizeof(entities[0]); e++) {
+                size_t name_len = strlen(entities[e].name);
+                if (ref_len == name_len + 1 && memcmp(src + i + 1, entities[e].name, name_len) == 0) {
+                    out[o++] = entities[e].value;
+                    decoded = 1;
+                    break;
+                }
+            }
+        }
+
+        if (decoded) {
+            i += ref_len;
+        } else {
+            out[o++] = src[i++];
+        }
+    }
+    out[o] = '\0';
+
+    trim_string(out);
+    return out[0] ? out : NULL;
+}
+
+char* xml_element_text(const XmlElement *el, Arena *arena) {
+    return xml_string(el->text, el->text_end - el->text, arena);
+}
+
+char* xml_element_attr_string(const XmlElement *el, const char *name, Arena *arena) {
+    size_t len = 0;
+    const char *value = xml_element_attr(el, name, &len);
+    return value ? xml_string(value, len, arena) : NULL;
+}
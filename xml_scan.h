@@ -0,0 +1,31 @@
+#ifndef XML_SCAN_H
+#define XML_SCAN_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Поиск элементов в небольших XML (OPF из EPUB, XMP из PDF) без построения дерева.
+// Элементы сравниваются по локальному имени: dc:title, opf:meta и meta подходят одинаково
+
+// Элемент: атрибуты [attrs, attrs_end) и текст [text, text_end) (пустой у <x/>)
+typedef struct {
+    const char *attrs;
+    const char *attrs_end;
+    const char *text;
+    const char *text_end;
+} XmlElement;
+
+// Ищет в [*cursor, end) следующий элемент name и сдвигает *cursor за его открывающий тег,
+// так что вложенные элементы находятся следующими вызовами. 0 - элементов больше нет
+int xml_next_element(const char **cursor, const char *end, const char *name, XmlElement *el);
+// Значение атрибута по локальному имени (opf:role и role равнозначны); NULL - атрибута нет
+const char* xml_element_attr(const XmlElement *el, const char *name, size_t *value_len);
+// Атрибут есть и равен expected без учета регистра
+int xml_attr_equals(const XmlElement *el, const char *name, const char *expected);
+
+// Копия [src, src + len) в арену с раскрытыми сущностями XML и обрезанными пробелами; NULL для пустой
+char* xml_string(const char *src, size_t len, Arena *arena);
+char* xml_element_text(const XmlElement *el, Arena *arena);
+char* xml_element_attr_string(const XmlElement *el, const char *name, Arena *arena);
+
+#endif
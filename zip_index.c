@@ -0,0 +1,333 @@
+// zip_index.c - чтение центрального каталога ZIP без распаковки содержимого
+#include "common.h"
+#include "zip_index.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP_EOCD_SIZE 22
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIG 0x06064b50
+#define ZIP64_EOCD_SIZE 56
+#define ZIP_CDIR_SIG 0x02014b50
+#define ZIP_CDIR_SIZE 46
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_MAX_COMMENT 65535
+
+static uint16_t read_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const unsigned char *p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+// Источник байтов архива: файл (fd) или ZIP целиком в памяти (EPUB внутри архива коллекции)
+typedef struct {
+    int fd;
+    const unsigned char *data;
+    uint64_t size;
+} ZipSource;
+
+static int read_exact(const ZipSource *src, void *buf, size_t len, uint64_t offset) {
+    if (src->data) {
+        if (offset > src->size || len > src->size - offset) return 0;
+        memcpy(buf, src->data + offset, len);
+        return 1;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(src->fd, (char*)buf + done, len - done, (off_t)(offset + done));
+        if (r <= 0) return 0;
+        done += (size_t)r;
+    }
+    return 1;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const ZipEntryInfo *ea = (const ZipEntryInfo*)a;
+    const ZipEntryInfo *eb = (const ZipEntryInfo*)b;
+    return strcmp(ea->name, eb->name);
+}
+
+// Ищет конец центрального каталога и возвращает его смещение, размер и число записей
+static int locate_central_directory(const ZipSource *src, uint64_t *cd_offset,
+                                    uint64_t *cd_size, uint64_t *entry_count) {
+    uint64_t file_size = src->size;
+    size_t tail_size = (size_t)(file_size < ZIP_EOCD_SIZE + ZIP_MAX_COMMENT ?
+                                file_size : ZIP_EOCD_SIZE + ZIP_MAX_COMMENT);
+    if (tail_size < ZIP_EOCD_SIZE) return 0;
+
+    unsigned char *tail = malloc(tail_size);
+    if (!tail) return 0;
+
+    if (!read_exact(src, tail, tail_size, file_size - tail_size)) {
+        free(tail);
+        return 0;
+    }
+
+    // EOCD ищем с конца: комментарий архива может быть произвольным
+    long eocd_pos = -1;
+    for (long i = (long)tail_size - ZIP_EOCD_SIZE; i >= 0; i--) {
+        if (read_le32(tail + i) == ZIP_EOCD_SIG) {
+            eocd_pos = i;
+            break;
+        }
+    }
+
+    if (eocd_pos < 0) {
+        free(tail);
+        return 0;
+    }
+
+    const unsigned char *eocd = tail + eocd_pos;
+    *entry_count = read_le16(eocd + 10);
+    *cd_size = read_le32(eocd + 12);
+    *cd_offset = read_le32(eocd + 16);
+
+    // ZIP64: большие архивы коллекций часто больше 4 ГБ или содержат >65535 файлов
+    if (eocd_pos >= ZIP64_LOCATOR_SIZE &&
+        read_le32(eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIG) {
+        uint64_t zip64_eocd_offset = read_le64(eocd - ZIP64_LOCATOR_SIZE + 8);
+        unsigned char zip64_eocd[ZIP64_EOCD_SIZE];
+
+        if (read_exact(src, zip64_eocd, sizeof(zip64_eocd), zip64_eocd_offset) &&
+            read_le32(zip64_eocd) == ZIP64_EOCD_SIG) {
+            *entry_count = read_le64(zip64_eocd + 32);
+            *cd_size = read_le64(zip64_eocd + 40);
+            *cd_offset = read_le64(zip64_eocd + 48);
+        }
+    }
+
+    free(tail);
+    return (*cd_offset + *cd_size <= file_size);
+}
+
+// Применяет extra-поле ZIP64 (0x0001) к полям, помеченным как 0xFFFFFFFF
+static void apply_zip64_extra(ZipEntryInfo *info, const unsigned char *extra, size_t extra_len,
+                              int need_usize, int need_csize, int need_offset) {
+    size_t pos = 0;
+    while (pos + 4 <= extra_len) {
+        uint16_t id = read_le16(extra + pos);
+        uint16_t len = read_le16(extra + pos + 2);
+        const unsigned char *data = extra + pos + 4;
+        if (pos + 4 + len > extra_len) break;
+
+        if (id == 0x0001) {
+            size_t off = 0;
+            if (need_usize && off + 8 <= len) { info->uncompressed_size = read_le64(data + off); off += 8; }
+            if (need_csize && off + 8 <= len) { info->compressed_size = read_le64(data + off); off += 8; }
+            if (need_offset && off + 8 <= len) { info->local_header_offset = read_le64(data + off); }
+            return;
+        }
+        pos += 4 + len;
+    }
+}
+
+static ZipIndex* load_index(const ZipSource *src) {
+    uint64_t cd_offset = 0, cd_size = 0, entry_count = 0;
+    if (!locate_central_directory(src, &cd_offset, &cd_size, &entry_count)) {
+        return NULL;
+    }
+
+    unsigned char *cd = malloc(cd_size ? cd_size : 1);
+    ZipIndex *index = calloc(1, sizeof(ZipIndex));
+    if (!cd || !index || !read_exact(src, cd, cd_size, cd_offset)) {
+        free(cd);
+        free(index);
+        return NULL;
+    }
+
+    // Число записей из EOCD не доверяем вслепую: каждой нужно не меньше ZIP_CDIR_SIZE байт каталога
+    if (entry_count > cd_size / ZIP_CDIR_SIZE) entry_count = cd_size / ZIP_CDIR_SIZE;
+
+    index->entries = calloc(entry_count ? entry_count : 1, sizeof(ZipEntryInfo));
+    if (!index->entries) {
+        free(cd);
+        free(index);
+        return NULL;
+    }
+
+    size_t pos = 0;
+    while (index->count < entry_count && pos + ZIP_CDIR_SIZE <= cd_size) {
+        const unsigned char *h = cd + pos;
+        if (read_le32(h) != ZIP_CDIR_SIG) break;
+
+        uint16_t name_len = read_le16(h + 28);
+        uint16_t extra_len = read_le16(h + 30);
+        uint16_t comment_len = read_le16(h + 32);
+        if (pos + ZIP_CDIR_SIZE + name_len + extra_len + comment_len > cd_size) break;
+
+        ZipEntryInfo *info = &index->entries[index->count];
+        info->flags = read_le16(h + 8);
+        info->method = read_le16(h + 10);
+        info->crc32 = read_le32(h + 16);
+        info->compressed_size = read_le32(h + 20);
+        info->uncompressed_size = read_le32(h + 24);
+        info->local_header_offset = read_le32(h + 42);
+        info->name = strndup((const char*)h + ZIP_CDIR_SIZE, name_len);
+        if (!info->name) break;
+
+        apply_zip64_extra(info, h + ZIP_CDIR_SIZE + name_len, extra_len,
+                          info->uncompressed_size == 0xFFFFFFFF,
+                          info->compressed_size == 0xFFFFFFFF,
+                          info->local_header_offset == 0xFFFFFFFF);
+
+        index->count++;
+        pos += ZIP_CDIR_SIZE + name_len + extra_len + comment_len;
+    }
+
+    free(cd);
+
+    qsort(index->entries, index->count, sizeof(ZipEntryInfo), compare_entries);
+    return index;
+}
+
+ZipIndex* zip_index_load(const char *archive_path) {
+    int fd = open(archive_path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    ZipSource src = {fd, NULL, (uint64_t)st.st_size};
+    ZipIndex *index = load_index(&src);
+    close(fd);
+    return index;
+}
+
+ZipIndex* zip_index_load_memory(const void *data, size_t size) {
+    if (!data) return NULL;
+    ZipSource src = {-1, data, size};
+    return load_index(&src);
+}
+
+const ZipEntryInfo* zip_index_find(const ZipIndex *index, const char *name) {
+    if (!index || !name || index->count == 0) return NULL;
+
+    ZipEntryInfo key;
+    key.name = (char*)name;
+    return bsearch(&key, index->entries, index->count, sizeof(ZipEntryInfo), compare_entries);
+}
+
+void zip_index_free(ZipIndex *index) {
+    if (!index) return;
+
+    for (size_t i = 0; i < index->count; i++) {
+        free(index->entries[i].name);
+    }
+    free(index->entries);
+    free(index);
+}
+
+static int64_t entry_data_offset(const ZipSource *src, const ZipEntryInfo *entry) {
+    // Длина extra-поля в локальном заголовке может отличаться от центрального каталога
+    unsigned char header[ZIP_LOCAL_SIZE];
+    if (!read_exact(src, header, sizeof(header), entry->local_header_offset) ||
+        read_le32(header) != ZIP_LOCAL_SIG) {
+        return -1;
+    }
+
+    uint16_t name_len = read_le16(header + 26);
+    uint16_t extra_len = read_le16(header + 28);
+    return (int64_t)(entry->local_header_offset + ZIP_LOCAL_SIZE + name_len + extra_len);
+}
+
+int64_t zip_entry_data_offset(int fd, const ZipEntryInfo *entry) {
+    if (fd < 0 || !entry) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) return -1;
+    ZipSource src = {fd, NULL, (uint64_t)st.st_size};
+    return entry_data_offset(&src, entry);
+}
+
+// Сжатые данные читаются целиком: для этого предназначены только небольшие служебные записи
+static char* read_entry(const ZipSource *src, const ZipEntryInfo *entry, size_t max_size, size_t *size_out) {
+    if (!entry || entry->uncompressed_size > max_size || entry->compressed_size > src->size) return NULL;
+    if (entry->flags & 0x0001) return NULL;    // зашифрованная запись
+    if (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATED) return NULL;
+
+    int64_t data_offset = entry_data_offset(src, entry);
+    if (data_offset < 0) return NULL;
+
+    size_t compressed_size = (size_t)entry->compressed_size;
+    size_t size = (size_t)entry->uncompressed_size;
+    unsigned char *packed = malloc(compressed_size ? compressed_size : 1);
+    char *content = malloc(size + 1);
+    if (!packed || !content || !read_exact(src, packed, compressed_size, (uint64_t)data_offset)) {
+        free(packed);
+        free(content);
+        return NULL;
+    }
+
+    int ok = 0;
+    if (entry->method == ZIP_METHOD_STORED) {
+        ok = compressed_size == size;
+        if (ok) memcpy(content, packed, size);
+    } else {
+        // Сырой deflate без заголовка zlib
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, -MAX_WBITS) == Z_OK) {
+            stream.next_in = packed;
+            stream.avail_in = (uInt)compressed_size;
+            stream.next_out = (Bytef*)content;
+            stream.avail_out = (uInt)size;
+            ok = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == size;
+            inflateEnd(&stream);
+        }
+    }
+    free(packed);
+
+    if (ok && (uint32_t)crc32(crc32(0L, Z_NULL, 0), (const Bytef*)content, (uInt)size) != entry->crc32) {
+        ok = 0;
+    }
+    if (!ok) {
+        free(content);
+        return NULL;
+    }
+
+    content[size] = '\0';
+    if (size_out) *size_out = size;
+    return content;
+}
+
+char* zip_entry_read(int fd, const ZipEntryInfo *entry, size_t max_size, size_t *size_out) {
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) return NULL;
+    ZipSource src = {fd, NULL, (uint64_t)st.st_size};
+    return read_entry(&src, entry, max_size, size_out);
+}
+
+char* zip_entry_read_memory(const void *data, size_t size, const ZipEntryInfo *entry,
+                            size_t max_size, size_t *size_out) {
+    if (!data) return NULL;
+    ZipSource src = {-1, data, size};
+    return read_entry(&src, entry, max_size, size_out);
+}
+
+char* format_crc32_hash(uint32_t crc32, uint64_t size) {
+    char *hash = malloc(64);
+    if (!hash) return NULL;
+
+    snprintf(hash, 64, "crc32:%08x:%llu", crc32, (unsigned long long)size);
+    return hash;
+}
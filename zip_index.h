@@ -0,0 +1,47 @@
+#ifndef ZIP_INDEX_H
+#define ZIP_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Методы сжатия ZIP, которые нас интересуют
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+// Запись центрального каталога ZIP
+typedef struct {
+    char *name;
+    uint32_t crc32;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint16_t method;
+    uint16_t flags;
+    uint64_t local_header_offset;
+} ZipEntryInfo;
+
+// Индекс архива: записи отсортированы по имени для бинарного поиска
+typedef struct {
+    ZipEntryInfo *entries;
+    size_t count;
+} ZipIndex;
+
+// Читает только центральный каталог (хвост файла), содержимое не распаковывается
+ZipIndex* zip_index_load(const char *archive_path);
+// То же для ZIP, целиком лежащего в памяти (например, EPUB, извлеченный из архива)
+ZipIndex* zip_index_load_memory(const void *data, size_t size);
+const ZipEntryInfo* zip_index_find(const ZipIndex *index, const char *name);
+void zip_index_free(ZipIndex *index);
+
+// Смещение начала сжатых данных записи (после локального заголовка), -1 при ошибке
+int64_t zip_entry_data_offset(int fd, const ZipEntryInfo *entry);
+
+// Распаковывает одну запись (stored или deflate) с проверкой CRC32 в malloc-буфер,
+// завершенный нулем. NULL при ошибке или если запись больше max_size
+char* zip_entry_read(int fd, const ZipEntryInfo *entry, size_t max_size, size_t *size_out);
+char* zip_entry_read_memory(const void *data, size_t size, const ZipEntryInfo *entry,
+                            size_t max_size, size_t *size_out);
+
+// Строка для books.file_hash вида "crc32:<hex>:<size>"
+char* format_crc32_hash(uint32_t crc32, uint64_t size);
+
+#endif